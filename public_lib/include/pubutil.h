@@ -78,6 +78,7 @@ int statistic_head_finalize(statistic_head_t *pstat);
 int statistic_addobj(void *pobj, void *pstat);
 int statistic_spliceobj(void *pstatsrc, void *pdst);
 int statistic_getobj(void **ppobj, void *pstat);
+int statistic_getobj_tail(void **ppobj, void *pstat);
 int statistic_freeobj(void *pobj, void *pstat);
 int statistic_freeobj_custom(void *pobj, void *pstat, free_func ffree);
 int statistic_delobj(void *pobj, void *pstat);
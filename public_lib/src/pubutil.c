@@ -300,6 +300,50 @@ int statistic_getobj(void **ppobj, void *pstat)
     return found;
 }
 
+/* get and remove an object from the tail of stat_head, which is the end
+ * opposite to statistic_getobj, so that other threads can steal work from
+ * a queue while its owner keeps consuming from the head */
+int statistic_getobj_tail(void **ppobj, void *pstat)
+{
+    int rc = 0;
+    int found = -1;
+    struct list_head *plist = NULL;
+    statistic_head_t *pstatistic = (statistic_head_t *)pstat;
+
+    if (pstatistic->stat_need_mutex)
+    {
+        rc = pthread_mutex_lock(&pstatistic->stat_mutex);
+        if (rc)
+        {
+            fprintf(stderr, "statistic_getobj_tail lock %p failed\n", &pstatistic->stat_mutex);
+            return -1;
+        }       
+    }
+
+    if (pstatistic->stat_count)
+    {
+        rc = list_pop_tail(&plist, &pstatistic->stat_head);
+        if (rc >= 0)
+        {
+            found = 0;
+            *ppobj = (void *)plist;
+            pstatistic->stat_count--;
+        }       
+    }
+
+    if (pstatistic->stat_need_mutex)
+    {
+        rc = pthread_mutex_unlock(&pstatistic->stat_mutex);
+        if (rc)
+        {
+            fprintf(stderr, "statistic_getobj_tail unlock %p failed\n", &pstatistic->stat_mutex);
+            //return -1;
+        }       
+    }
+
+    return found;
+}
+
 int statistic_delobj(void *pobj, void *pstat)
 {
     int rc = 0;
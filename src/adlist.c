@@ -157,6 +157,17 @@ list *listInsertNode(list *list, listNode *old_node, void *value, int after) {
  *
  * This function can't fail. */
 void listDelNode(list *list, listNode *node)
+{
+    listUnlinkNode(list, node);
+    if (list->free) list->free(node->value);
+    zfree(node);
+}
+
+/* Remove the specified node from the list without freeing it nor its
+ * private value, that's up to the caller.
+ *
+ * This function can't fail. */
+void listUnlinkNode(list *list, listNode *node)
 {
     if (node->prev)
         node->prev->next = node->next;
@@ -166,8 +177,8 @@ void listDelNode(list *list, listNode *node)
         node->next->prev = node->prev;
     else
         list->tail = node->prev;
-    if (list->free) list->free(node->value);
-    zfree(node);
+    node->prev = NULL;
+    node->next = NULL;
     list->len--;
 }
 
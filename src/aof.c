@@ -1165,7 +1165,6 @@ int rewriteSortedSetObjectToSds(sds *savebuf, robj *key, robj *o) {
     dictIterator *di = NULL;
     dictEntry *de = NULL;
     robj *eleobj = NULL;
-    double *pscore = NULL;
 
     if (o->encoding == OBJ_ENCODING_ZIPLIST) {
         zl = o->ptr;
@@ -1227,7 +1226,7 @@ int rewriteSortedSetObjectToSds(sds *savebuf, robj *key, robj *o) {
 
         while((de = dictNext(di)) != NULL) {
             eleobj = dictGetKey(de);
-            pscore = dictGetVal(de);
+            score = dictGetDoubleVal(de);
 
             if (count == 0) {
                 cmd_items = (items > AOF_REWRITE_ITEMS_PER_CMD) ?
@@ -1249,7 +1248,7 @@ int rewriteSortedSetObjectToSds(sds *savebuf, robj *key, robj *o) {
                 }       
             }
 
-            wrsize = rioWriteBulkDoubleToSds(savebuf, *pscore);
+            wrsize = rioWriteBulkDoubleToSds(savebuf, score);
             if (wrsize == 0) {
                 return 0;
             } 
@@ -1319,7 +1318,7 @@ int rewriteSortedSetObject(rio *r, robj *key, robj *o) {
 
         while((de = dictNext(di)) != NULL) {
             robj *eleobj = dictGetKey(de);
-            double *score = dictGetVal(de);
+            double score = dictGetDoubleVal(de);
 
             if (count == 0) {
                 int cmd_items = (items > AOF_REWRITE_ITEMS_PER_CMD) ?
@@ -1329,7 +1328,7 @@ int rewriteSortedSetObject(rio *r, robj *key, robj *o) {
                 if (rioWriteBulkString(r,"ZADD",4) == 0) return 0;
                 if (rioWriteBulkObject(r,key) == 0) return 0;
             }
-            if (rioWriteBulkDouble(r,*score) == 0) return 0;
+            if (rioWriteBulkDouble(r,score) == 0) return 0;
             if (rioWriteBulkObject(r,eleobj) == 0) return 0;
             if (++count == AOF_REWRITE_ITEMS_PER_CMD) count = 0;
             items--;
@@ -1680,6 +1679,7 @@ int aofSaveThdProc(void *priv)
     dump_denode_t *pdenode = NULL;
     dump_taskpool_priv_t *tpoolpriv = NULL;
     dump_task_priv_t *tpriv = NULL;
+    int canstop = 0;
 
     if (!ptask) {
         return C_OK;
@@ -1701,9 +1701,14 @@ int aofSaveThdProc(void *priv)
     
     while (1) {
         pdenode = NULL;
-        statistic_getobj((void **)&pdenode, &tpriv->thd_stat);
+        canstop = tpoolpriv->task_can_stop;
+        __sync_synchronize();
+
+        dumpSaveThdGetDentry(tpoolpriv, ptask->task_id, &pdenode);
         if (!pdenode) {
-            if (tpoolpriv->task_can_stop && tpriv->thd_stat.stat_count == 0) {
+            /* task_can_stop was read before every queue was found empty,
+             * so no entry can be queued after this point */
+            if (canstop) {
                 break;
             }
             
@@ -1737,9 +1742,9 @@ int aofSaveThdProc(void *priv)
         return C_ERR;
     }
 
-    serverLog(LL_WARNING, "Thread %d save %d keys to aof, "
-              "which started at %ld and duration %ld ms",
-              ptask->task_id, tpriv->thd_opnr, 
+    serverLog(LL_WARNING, "Thread %d save %lld keys (%lld stolen) to aof, "
+              "which started at %lld and duration %lld ms",
+              ptask->task_id, tpriv->thd_opnr, tpriv->thd_stealnr,
               tpriv->thd_opstart, mstime() - tpriv->thd_opstart);
 
     return C_OK;
@@ -1866,7 +1871,7 @@ int aofSaveSingleDbCont(redisDb *db, rio *aof, long long now)
 
     if (server.dump_concurrency == DUMP_CONCURRENCY) {
         rc = dumpSaveTaskpoolInitAndStart(&taskpool, db, aof, 
-                                now, "DUMPAOF", aofSaveThdProc);
+                                now, 0, "DUMPAOF", aofSaveThdProc);
         if (rc != C_OK) {
             serverLog(LL_WARNING, 
                       "dumpSaveTaskpoolInitAndStart to dump aof failed");
@@ -154,6 +154,9 @@ void *bioProcessBackgroundJobs(void *arg) {
     pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
     pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
 
+    /* decrRefCount() behaves differently in the lazy free thread. */
+    if (type == BIO_LAZY_FREE) lazyfree_bio_thread = 1;
+
     pthread_mutex_lock(&bio_mutex[type]);
     /* Block SIGALRM so we are sure that only the main thread will
      * receive the watchdog signal. */
@@ -183,6 +186,14 @@ void *bioProcessBackgroundJobs(void *arg) {
             close((long)job->arg1);
         } else if (type == BIO_AOF_FSYNC) {
             aof_fsync((long)job->arg1);
+        } else if (type == BIO_LAZY_FREE) {
+            /* What we free changes depending on what arguments are set:
+             * arg1 -> free the object at pointer.
+             * arg2 & arg3 -> free two dictionaries (a Redis DB). */
+            if (job->arg1)
+                lazyfreeFreeObjectFromBioThread(job->arg1);
+            else
+                lazyfreeFreeDatabaseFromBioThread(job->arg2,job->arg3);
         } else {
             serverPanic("Wrong job type in bioProcessBackgroundJobs().");
         }
@@ -34,59 +34,87 @@
  * Helpers and low level bit functions.
  * -------------------------------------------------------------------------- */
 
+/* Count the bits set in a 64 bit word. When the compiler targets a CPU with
+ * a population count instruction we use it, otherwise we fall back to the
+ * classic SWAR algorithm. */
+#if defined(__POPCNT__) || defined(__aarch64__)
+#define popcount64(x) ((uint64_t)__builtin_popcountll(x))
+#else
+static inline uint64_t popcount64(uint64_t x) {
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+}
+#endif
+
+/* Carry save adder: sums the three words 'a', 'b' and 'c' bit by bit,
+ * storing the carries into 'h' and the sums into 'l'. */
+#define BITOPS_CSA(h,l,a,b,c) do { \
+    uint64_t _u = (a) ^ (b); \
+    (h) = ((a) & (b)) | (_u & (c)); \
+    (l) = _u ^ (c); \
+} while(0)
+
 /* Count number of bits set in the binary array pointed by 's' and long
  * 'count' bytes. The implementation of this function is required to
- * work with a input string length up to 512 MB. */
+ * work with a input string length up to 512 MB.
+ *
+ * Whole 64 bit words are counted 16 at a time with the Harley-Seal
+ * algorithm: a tree of carry save adders reduces the 16 words to a few
+ * accumulators of ones, twos, fours, eights and sixteens, so only one
+ * population count is needed per 128 bytes instead of one per word. */
 size_t redisPopcount(void *s, long count) {
     size_t bits = 0;
     unsigned char *p = s;
-    uint32_t *p4;
+    uint64_t *p8;
     static const unsigned char bitsinbyte[256] = {0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,4,5,5,6,5,6,6,7,5,6,6,7,6,7,7,8};
 
-    /* Count initial bytes not aligned to 32 bit. */
-    while((unsigned long)p & 3 && count) {
+    /* Count initial bytes not aligned to 64 bit. */
+    while((unsigned long)p & 7 && count) {
         bits += bitsinbyte[*p++];
         count--;
     }
 
-    /* Count bits 28 bytes at a time */
-    p4 = (uint32_t*)p;
-    while(count>=28) {
-        uint32_t aux1, aux2, aux3, aux4, aux5, aux6, aux7;
-
-        aux1 = *p4++;
-        aux2 = *p4++;
-        aux3 = *p4++;
-        aux4 = *p4++;
-        aux5 = *p4++;
-        aux6 = *p4++;
-        aux7 = *p4++;
-        count -= 28;
-
-        aux1 = aux1 - ((aux1 >> 1) & 0x55555555);
-        aux1 = (aux1 & 0x33333333) + ((aux1 >> 2) & 0x33333333);
-        aux2 = aux2 - ((aux2 >> 1) & 0x55555555);
-        aux2 = (aux2 & 0x33333333) + ((aux2 >> 2) & 0x33333333);
-        aux3 = aux3 - ((aux3 >> 1) & 0x55555555);
-        aux3 = (aux3 & 0x33333333) + ((aux3 >> 2) & 0x33333333);
-        aux4 = aux4 - ((aux4 >> 1) & 0x55555555);
-        aux4 = (aux4 & 0x33333333) + ((aux4 >> 2) & 0x33333333);
-        aux5 = aux5 - ((aux5 >> 1) & 0x55555555);
-        aux5 = (aux5 & 0x33333333) + ((aux5 >> 2) & 0x33333333);
-        aux6 = aux6 - ((aux6 >> 1) & 0x55555555);
-        aux6 = (aux6 & 0x33333333) + ((aux6 >> 2) & 0x33333333);
-        aux7 = aux7 - ((aux7 >> 1) & 0x55555555);
-        aux7 = (aux7 & 0x33333333) + ((aux7 >> 2) & 0x33333333);
-        bits += ((((aux1 + (aux1 >> 4)) & 0x0F0F0F0F) +
-                    ((aux2 + (aux2 >> 4)) & 0x0F0F0F0F) +
-                    ((aux3 + (aux3 >> 4)) & 0x0F0F0F0F) +
-                    ((aux4 + (aux4 >> 4)) & 0x0F0F0F0F) +
-                    ((aux5 + (aux5 >> 4)) & 0x0F0F0F0F) +
-                    ((aux6 + (aux6 >> 4)) & 0x0F0F0F0F) +
-                    ((aux7 + (aux7 >> 4)) & 0x0F0F0F0F))* 0x01010101) >> 24;
+    /* Count bits 128 bytes at a time. */
+    p8 = (uint64_t*)p;
+    if (count >= 128) {
+        uint64_t ones = 0, twos = 0, fours = 0, eights = 0, sixteens;
+        uint64_t twosA, twosB, foursA, foursB, eightsA, eightsB;
+        uint64_t total = 0;
+
+        while(count >= 128) {
+            BITOPS_CSA(twosA,ones,ones,p8[0],p8[1]);
+            BITOPS_CSA(twosB,ones,ones,p8[2],p8[3]);
+            BITOPS_CSA(foursA,twos,twos,twosA,twosB);
+            BITOPS_CSA(twosA,ones,ones,p8[4],p8[5]);
+            BITOPS_CSA(twosB,ones,ones,p8[6],p8[7]);
+            BITOPS_CSA(foursB,twos,twos,twosA,twosB);
+            BITOPS_CSA(eightsA,fours,fours,foursA,foursB);
+            BITOPS_CSA(twosA,ones,ones,p8[8],p8[9]);
+            BITOPS_CSA(twosB,ones,ones,p8[10],p8[11]);
+            BITOPS_CSA(foursA,twos,twos,twosA,twosB);
+            BITOPS_CSA(twosA,ones,ones,p8[12],p8[13]);
+            BITOPS_CSA(twosB,ones,ones,p8[14],p8[15]);
+            BITOPS_CSA(foursB,twos,twos,twosA,twosB);
+            BITOPS_CSA(eightsB,fours,fours,foursA,foursB);
+            BITOPS_CSA(sixteens,eights,eights,eightsA,eightsB);
+            total += popcount64(sixteens);
+            p8 += 16;
+            count -= 128;
+        }
+        bits += 16*total + 8*popcount64(eights) + 4*popcount64(fours) +
+                2*popcount64(twos) + popcount64(ones);
     }
+
+    /* Count the remaining whole words. */
+    while(count >= 8) {
+        bits += popcount64(*p8++);
+        count -= 8;
+    }
+
     /* Count the remaining bytes. */
-    p = (unsigned char*)p4;
+    p = (unsigned char*)p8;
     while(count--) bits += bitsinbyte[*p++];
     return bits;
 }
@@ -124,9 +152,20 @@ long redisBitpos(void *s, unsigned long count, int bit) {
         pos += 8;
     }
 
-    /* Skip bits with full word step. */
+    /* Skip bits four words at a time while all of them can be skipped,
+     * then with full word step. */
     skipval = bit ? 0 : ULONG_MAX;
     l = (unsigned long*) c;
+    while (count >= sizeof(*l)*4) {
+        if (bit) {
+            if ((l[0] | l[1] | l[2] | l[3]) != 0) break;
+        } else {
+            if ((l[0] & l[1] & l[2] & l[3]) != ULONG_MAX) break;
+        }
+        l += 4;
+        count -= sizeof(*l)*4;
+        pos += sizeof(*l)*8*4;
+    }
     while (count >= sizeof(*l)) {
         if (*l != skipval) break;
         l++;
@@ -592,6 +631,75 @@ void getbitCommand(client *c) {
     addReply(c, bitval ? shared.cone : shared.czero);
 }
 
+/* Size of the blocks the BITOP result is computed in, see bitopCommand(). */
+#define BITOP_BLOCK_BYTES 8192
+
+/* Combine 'len' bytes of 'src' into 'dst' with the operation 'op', that is
+ * one of BITOP_AND, BITOP_OR or BITOP_XOR. Whole words are processed four
+ * at a time, different loops per operation for speed.
+ *
+ * Note: sds pointers are always aligned to 8 byte boundary. */
+static void bitopCombine(unsigned char *dst, unsigned char *src,
+                         unsigned long len, int op)
+{
+    unsigned long *ld = (unsigned long*) dst, *ls = (unsigned long*) src;
+    unsigned long j, words = len / (sizeof(unsigned long)*4);
+
+    if (op == BITOP_AND) {
+        while(words--) {
+            ld[0] &= ls[0];
+            ld[1] &= ls[1];
+            ld[2] &= ls[2];
+            ld[3] &= ls[3];
+            ld+=4;
+            ls+=4;
+        }
+    } else if (op == BITOP_OR) {
+        while(words--) {
+            ld[0] |= ls[0];
+            ld[1] |= ls[1];
+            ld[2] |= ls[2];
+            ld[3] |= ls[3];
+            ld+=4;
+            ls+=4;
+        }
+    } else if (op == BITOP_XOR) {
+        while(words--) {
+            ld[0] ^= ls[0];
+            ld[1] ^= ls[1];
+            ld[2] ^= ls[2];
+            ld[3] ^= ls[3];
+            ld+=4;
+            ls+=4;
+        }
+    }
+
+    /* Remaining bytes. */
+    j = (unsigned char*)ld - dst;
+    for (; j < len; j++) {
+        switch(op) {
+        case BITOP_AND: dst[j] &= src[j]; break;
+        case BITOP_OR:  dst[j] |= src[j]; break;
+        case BITOP_XOR: dst[j] ^= src[j]; break;
+        }
+    }
+}
+
+/* Invert the 'len' bytes at 'p'. */
+static void bitopNot(unsigned char *p, unsigned long len) {
+    unsigned long *lp = (unsigned long*) p;
+    unsigned long j, words = len / (sizeof(unsigned long)*4);
+
+    while(words--) {
+        lp[0] = ~lp[0];
+        lp[1] = ~lp[1];
+        lp[2] = ~lp[2];
+        lp[3] = ~lp[3];
+        lp+=4;
+    }
+    for (j = (unsigned char*)lp - p; j < len; j++) p[j] = ~p[j];
+}
+
 /* BITOP op_name target_key src_key1 src_key2 src_key3 ... src_keyN */
 void bitopCommand(client *c) {
     unsigned long i = 0;
@@ -669,90 +777,32 @@ void bitopCommand(client *c) {
         if (j == 0 || len[j] < minlen) minlen = len[j];
     }
 
-    /* Compute the bit operation, if at least one string is not empty. */
+    /* Compute the bit operation, if at least one string is not empty.
+     *
+     * The result is computed one block at a time: every source is folded
+     * into the block while it is still in the CPU cache, so with many
+     * sources the result is not streamed from memory once per key. The
+     * result string is created zeroed, so for AND we can stop at the
+     * shortest source, since what follows is zero padding anyway. */
     if (maxlen) {
-        res = (unsigned char*) sdsnewlen(NULL,maxlen);
-        unsigned char output, byte;
-        unsigned long i;
-
-        /* Fast path: as far as we have data for all the input bitmaps we
-         * can take a fast path that performs much better than the
-         * vanilla algorithm. */
-        j = 0;
-        if (minlen >= sizeof(unsigned long)*4 && numkeys <= 16) {
-            unsigned long *lp[16];
-            unsigned long *lres = (unsigned long*) res;
-
-            /* Note: sds pointer is always aligned to 8 byte boundary. */
-            memcpy(lp,src,sizeof(unsigned long*)*numkeys);
-            memcpy(res,src[0],minlen);
-
-            /* Different branches per different operations for speed (sorry). */
-            if (op == BITOP_AND) {
-                while(minlen >= sizeof(unsigned long)*4) {
-                    for (i = 1; i < numkeys; i++) {
-                        lres[0] &= lp[i][0];
-                        lres[1] &= lp[i][1];
-                        lres[2] &= lp[i][2];
-                        lres[3] &= lp[i][3];
-                        lp[i]+=4;
-                    }
-                    lres+=4;
-                    j += sizeof(unsigned long)*4;
-                    minlen -= sizeof(unsigned long)*4;
-                }
-            } else if (op == BITOP_OR) {
-                while(minlen >= sizeof(unsigned long)*4) {
-                    for (i = 1; i < numkeys; i++) {
-                        lres[0] |= lp[i][0];
-                        lres[1] |= lp[i][1];
-                        lres[2] |= lp[i][2];
-                        lres[3] |= lp[i][3];
-                        lp[i]+=4;
-                    }
-                    lres+=4;
-                    j += sizeof(unsigned long)*4;
-                    minlen -= sizeof(unsigned long)*4;
-                }
-            } else if (op == BITOP_XOR) {
-                while(minlen >= sizeof(unsigned long)*4) {
-                    for (i = 1; i < numkeys; i++) {
-                        lres[0] ^= lp[i][0];
-                        lres[1] ^= lp[i][1];
-                        lres[2] ^= lp[i][2];
-                        lres[3] ^= lp[i][3];
-                        lp[i]+=4;
-                    }
-                    lres+=4;
-                    j += sizeof(unsigned long)*4;
-                    minlen -= sizeof(unsigned long)*4;
-                }
-            } else if (op == BITOP_NOT) {
-                while(minlen >= sizeof(unsigned long)*4) {
-                    lres[0] = ~lres[0];
-                    lres[1] = ~lres[1];
-                    lres[2] = ~lres[2];
-                    lres[3] = ~lres[3];
-                    lres+=4;
-                    j += sizeof(unsigned long)*4;
-                    minlen -= sizeof(unsigned long)*4;
-                }
-            }
-        }
+        unsigned long off, end = (op == BITOP_AND) ? minlen : maxlen;
 
-        /* j is set to the next byte to process by the previous loop. */
-        for (; j < maxlen; j++) {
-            output = (len[0] <= j) ? 0 : src[0][j];
-            if (op == BITOP_NOT) output = ~output;
-            for (i = 1; i < numkeys; i++) {
-                byte = (len[i] <= j) ? 0 : src[i][j];
-                switch(op) {
-                case BITOP_AND: output &= byte; break;
-                case BITOP_OR:  output |= byte; break;
-                case BITOP_XOR: output ^= byte; break;
+        res = (unsigned char*) sdsnewlen(NULL,maxlen);
+        for (off = 0; off < end; off += BITOP_BLOCK_BYTES) {
+            unsigned long blen = end-off, avail;
+            unsigned char *out = res+off;
+
+            if (blen > BITOP_BLOCK_BYTES) blen = BITOP_BLOCK_BYTES;
+            for (j = 0; j < numkeys; j++) {
+                avail = (len[j] > off) ? len[j]-off : 0;
+                if (avail > blen) avail = blen;
+                if (j == 0) {
+                    if (avail) memcpy(out,src[0]+off,avail);
+                    if (op == BITOP_NOT) bitopNot(out,blen);
+                } else if (avail) {
+                    bitopCombine(out,src[j]+off,avail,op);
                 }
             }
-            res[j] = output;
         }
     }
     for (j = 0; j < numkeys; j++) {
@@ -122,7 +122,10 @@ void processUnblockedClients(void) {
          * client is not blocked before to proceed, but things may change and
          * the code is conceptually more correct this way. */
         if (!(c->flags & CLIENT_BLOCKED)) {
-            if (c->querybuf && sdslen(c->querybuf) > 0) {
+            /* A command parsed by an I/O thread while clients were paused
+             * is pending with an empty query buffer. */
+            if ((c->querybuf && sdslen(c->querybuf) > 0) ||
+                c->flags & CLIENT_PENDING_COMMAND) {
                 processInputBuffer(c);
             }
         }
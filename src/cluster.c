@@ -31,6 +31,7 @@
 #include "server.h"
 #include "cluster.h"
 #include "endianconv.h"
+#include "rocks.h"
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -76,6 +77,8 @@ void clusterDelNode(clusterNode *delnode);
 sds representClusterNodeFlags(sds ci, uint16_t flags);
 uint64_t clusterGetMaxEpoch(void);
 int clusterBumpConfigEpochWithoutConsensus(void);
+void clusterSlotMigrationCron(void);
+void clusterMigrateSlotCommand(client *c);
 
 /* -----------------------------------------------------------------------------
  * Initialization
@@ -415,6 +418,10 @@ void clusterInit(void) {
     server.cluster->lastVoteEpoch = 0;
     server.cluster->stats_bus_messages_sent = 0;
     server.cluster->stats_bus_messages_received = 0;
+    server.cluster->slot_migrations = listCreate();
+    memset(server.cluster->slot_migrating_job,0,
+        sizeof(server.cluster->slot_migrating_job));
+    server.cluster->slot_migrations_running = 0;
     memset(server.cluster->slots,0, sizeof(server.cluster->slots));
     clusterCloseAllSlots();
 
@@ -466,8 +473,9 @@ void clusterInit(void) {
         }
     }
 
-    /* The slots -> keys map is a sorted set. Init it. */
-    server.cluster->slots_to_keys = zslCreate();
+    /* The slots -> keys map has a dict of keys per slot, created on demand. */
+    memset(server.cluster->slots_to_keys,0,
+           sizeof(server.cluster->slots_to_keys));
 
     /* Set myself->port to my listening port, we'll just need to discover
      * the IP address via MEET messages. */
@@ -3295,6 +3303,9 @@ void clusterCron(void) {
             clusterHandleSlaveMigration(max_slaves);
     }
 
+    /* Drive the CLUSTER MIGRATESLOT jobs. */
+    clusterSlotMigrationCron();
+
     if (update_state || server.cluster->state == CLUSTER_FAIL)
         clusterUpdateState();
 }
@@ -4070,6 +4081,9 @@ void clusterCommand(client *c) {
         }
         clusterDoBeforeSleep(CLUSTER_TODO_SAVE_CONFIG|CLUSTER_TODO_UPDATE_STATE);
         addReply(c,shared.ok);
+    } else if (!strcasecmp(c->argv[1]->ptr,"migrateslot") && c->argc >= 3) {
+        /* CLUSTER MIGRATESLOT <slot> <node ID> | CANCEL <slot> | STATUS */
+        clusterMigrateSlotCommand(c);
     } else if (!strcasecmp(c->argv[1]->ptr,"bumpepoch") && c->argc == 2) {
         /* CLUSTER BUMPEPOCH */
         int retval = clusterBumpConfigEpochWithoutConsensus();
@@ -4157,7 +4171,7 @@ void clusterCommand(client *c) {
         /* CLUSTER GETKEYSINSLOT <slot> <count> */
         long long maxkeys, slot;
         unsigned int numkeys, j;
-        robj **keys;
+        sds *keys;
 
         if (getLongLongFromObjectOrReply(c,c->argv[2],&slot,NULL) != C_OK)
             return;
@@ -4169,10 +4183,11 @@ void clusterCommand(client *c) {
             return;
         }
 
-        keys = zmalloc(sizeof(robj*)*maxkeys);
+        keys = zmalloc(sizeof(sds)*maxkeys);
         numkeys = getKeysInSlot(slot, keys, maxkeys);
         addReplyMultiBulkLen(c,numkeys);
-        for (j = 0; j < numkeys; j++) addReplyBulk(c,keys[j]);
+        for (j = 0; j < numkeys; j++) 
+            addReplyBulkCBuffer(c,keys[j],sdslen(keys[j]));
         zfree(keys);
     } else if (!strcasecmp(c->argv[1]->ptr,"forget") && c->argc == 3) {
         /* CLUSTER FORGET <NODE ID> */
@@ -4391,6 +4406,28 @@ void clusterCommand(client *c) {
  * DUMP, RESTORE and MIGRATE commands
  * -------------------------------------------------------------------------- */
 
+/* Write the footer of a DUMP payload, this is how it looks like:
+ * ----------------+---------------------+---------------+
+ * ... RDB payload | 2 bytes RDB version | 8 bytes CRC64 |
+ * ----------------+---------------------+---------------+
+ * RDB version and CRC are both in little endian.
+ */
+static void dumpPayloadAddFooter(rio *payload) {
+    unsigned char buf[2];
+    uint64_t crc;
+
+    /* RDB version */
+    buf[0] = RDB_VERSION & 0xff;
+    buf[1] = (RDB_VERSION >> 8) & 0xff;
+    payload->io.buffer.ptr = sdscatlen(payload->io.buffer.ptr,buf,2);
+
+    /* CRC64 */
+    crc = crc64(0,(unsigned char*)payload->io.buffer.ptr,
+                sdslen(payload->io.buffer.ptr));
+    memrev64ifbe(&crc);
+    payload->io.buffer.ptr = sdscatlen(payload->io.buffer.ptr,&crc,8);
+}
+
 /* Generates a DUMP-format representation of the object 'o', adding it to the
  * io stream pointed by 'rio'.  
  * Returns 0 on success, -1 on error */
@@ -4399,9 +4436,6 @@ int createDumpPayload(redisDb *db,
                       robj *ko, 
                       rio *payload, 
                       robj *o) {
-    unsigned char buf[2];
-    uint64_t crc;
-
     /* Serialize the object in a RDB-like format. It consist of an object type
      * byte followed by the serialized object. This is understood by RESTORE. */
     rioInitWithBuffer(payload, sdsempty());
@@ -4413,25 +4447,62 @@ int createDumpPayload(redisDb *db,
         return -1;
     }
 
-    /* Write the footer, this is how it looks like:
-     * ----------------+---------------------+---------------+
-     * ... RDB payload | 2 bytes RDB version | 8 bytes CRC64 |
-     * ----------------+---------------------+---------------+
-     * RDB version and CRC are both in little endian.
-     */
+    dumpPayloadAddFooter(payload);
+    return 0;
+}
 
-    /* RDB version */
-    buf[0] = RDB_VERSION & 0xff;
-    buf[1] = (RDB_VERSION >> 8) & 0xff;
-    payload->io.buffer.ptr = sdscatlen(payload->io.buffer.ptr,buf,2);
+/* Generates a DUMP-format representation of an on disk value from its
+ * rocksdb encoded bytes 'rawval', without decoding it. Like in RDB files
+ * the value is prefixed by RDB_OPCODE_DISKVAL and its object type, so only
+ * RESTORE of instances sharing our disk store format understand it. */
+static void createDiskValDumpPayload(rio *payload, 
+                              unsigned type, 
+                              char *rawval, 
+                              size_t rawlen) {
+    rioInitWithBuffer(payload, sdsempty());
+    rdbSaveType(payload, RDB_OPCODE_DISKVAL);
+    rdbSaveType(payload, type);
+    rdbSaveRawString(payload, (unsigned char *)rawval, rawlen);
+    dumpPayloadAddFooter(payload);
+}
 
-    /* CRC64 */
-    crc = crc64(0,(unsigned char*)payload->io.buffer.ptr,
-                sdslen(payload->io.buffer.ptr));
-    memrev64ifbe(&crc);
-    payload->io.buffer.ptr = sdscatlen(payload->io.buffer.ptr,&crc,8);
+/* Generates the DUMP payload of 'key', whose entry in 'db' is 'de', without
+ * loading into the keyspace a value stored on disk. The rocksdb encoded
+ * bytes of such a value, read by the caller into 'rawval', are shipped as
+ * they are with dump-dstore-raw, otherwise they are decoded just for the
+ * time of the serialization.
+ * Returns 0 on success, -1 on error (nothing is left in 'payload'). */
+static int createEntryDumpPayload(redisDb *db, 
+                                  robj *key, 
+                                  dictEntry *de,
+                                  char *rawval, 
+                                  size_t rawlen, 
+                                  rio *payload) {
+    int rc = 0;
+    robj *o = NULL;
 
-    return 0;
+    if (!dictIsEntryValOnDisk(de)) {
+        o = dictGetVal(de);
+    } else if (rawval == NULL) {
+        return -1;
+    } else if (server.dump_dstore_raw) {
+        createDiskValDumpPayload(payload, de->v_type, rawval, rawlen);
+        return 0;
+    } else {
+        o = rocksLoadRawValObject(db, key->ptr, rawval, rawlen);
+        if (o == NULL) {
+            return -1;
+        }
+    }
+
+    rc = createDumpPayload(db, de->v_sno, key, payload, o);
+    if (dictIsEntryValOnDisk(de)) {
+        decrRefCount(o);
+    }
+    if (rc == -1) {
+        sdsfree(payload->io.buffer.ptr);
+    }
+    return rc;
 }
 
 /* Verify that the RDB version of the dump payload matches the one of this Redis
@@ -4461,31 +4532,35 @@ int verifyDumpPayload(unsigned char *p, size_t len) {
  * DUMP is actually not used by Redis Cluster but it is the obvious
  * complement of RESTORE and can be useful for different applications. */
 void dumpCommand(client *c) {
-    robj *o = NULL;
+    int rc = 0;
     robj *dumpobj = NULL;
     rio payload;
     dictEntry *de = NULL;
+    char *rawval = NULL;
+    size_t rawlen = 0;
 
-    /* Check if the key is here. */
-    o = lookupKeyRead(c->db, c->argv[1]);
-    if (o == NULL) {
+    /* Check if the key is here, values on disk are not loaded in memory. */
+    if (getKeyType(c->db, c->argv[1]) == OBJ_RESERVED ||
+        (de = dictFind(c->db->dict, c->argv[1]->ptr)) == NULL) 
+    {
         addReply(c, shared.nullbulk);
         return;
     }
 
-    if (o == shared.dstoreerr) {        
+    if (dictIsEntryValOnDisk(de) && 
+        loadRawValFromDiskWithSds(c->db, de->v_sno, c->argv[1]->ptr, 
+                                  de->v_type, getClearedSharedKeySds(),
+                                  &rawval, &rawlen) != C_OK) 
+    {
         addReply(c, shared.dstoreerr);
         return;
     }
 
-    de = dictFind(c->db->dict, c->argv[1]->ptr);
-    if (!de) {
-        addReply(c, shared.nullbulk);
-        return;
-    }
-
     /* Create the DUMP encoded representation. */
-    if (createDumpPayload(c->db, de->v_sno, c->argv[1], &payload, o) == -1) {
+    rc = createEntryDumpPayload(c->db, c->argv[1], de, rawval, rawlen, 
+                                &payload);
+    rocksFree(rawval);
+    if (rc == -1) {
         addReply(c, shared.nullbulk);
         return;
     }
@@ -4497,12 +4572,17 @@ void dumpCommand(client *c) {
     return;
 }
 
-/* RESTORE key ttl serialized-value [REPLACE] */
+/* RESTORE key ttl serialized-value [REPLACE] 
+ *
+ * A payload of an on disk value generated with dump-dstore-raw is written
+ * as is into the disk store when we are over membuf-size, so that keys
+ * migrated in bulk don't need to be swapped out again. */
 void restoreCommand(client *c) {
     long long ttl;
     rio payload;
-    int j, type, replace = 0;
-    robj *obj;
+    int j, type, disktype = -1, replace = 0;
+    robj *obj = NULL, *rawval = NULL;
+    dictEntry *de = NULL;
 
     /* Parse additional options */
     for (j = 4; j < c->argc; j++) {
@@ -4515,13 +4595,7 @@ void restoreCommand(client *c) {
     }
 
     /* Make sure this key does not already exist here... */
-    obj = lookupKeyWrite(c->db, c->argv[1]);
-    if (obj == shared.dstoreerr) {
-        addReply(c, shared.dstoreerr);
-        return;
-    }
-    
-    if ((!replace) &&  obj != NULL) {
+    if ((!replace) && getKeyType(c->db, c->argv[1]) != OBJ_RESERVED) {
         addReply(c,shared.busykeyerr);
         return;
     }
@@ -4542,9 +4616,28 @@ void restoreCommand(client *c) {
     }
 
     rioInitWithBuffer(&payload,c->argv[3]->ptr);
-    if (((type = rdbLoadObjectType(&payload)) == -1) ||
-        ((obj = rdbLoadObject(c->db, c->argv[1]->ptr, type,&payload)) == NULL))
-    {
+    type = rdbLoadType(&payload);
+    if (type == RDB_OPCODE_DISKVAL) {
+        if ((disktype = rdbLoadType(&payload)) == -1 || 
+            disktype > OBJ_HASH ||
+            (rawval = rdbLoadStringObject(&payload)) == NULL) 
+        {
+            addReplyError(c,"Bad data format");
+            return;
+        }
+        /* Lists are never stored on disk as a whole. */
+        if (!useDiskStore() || !needSaveObjectOnDisk(0) || 
+            disktype == OBJ_LIST) 
+        {
+            obj = rocksLoadRawValObject(c->db, c->argv[1]->ptr, rawval->ptr,
+                                        sdslen(rawval->ptr));
+            decrRefCount(rawval);
+            rawval = NULL;
+        }
+    } else if (rdbIsObjectType(type)) {
+        obj = rdbLoadObject(c->db, c->argv[1]->ptr, type, &payload);
+    }
+    if (obj == NULL && rawval == NULL) {
         addReplyError(c,"Bad data format");
         return;
     }
@@ -4554,6 +4647,19 @@ void restoreCommand(client *c) {
 
     /* Create the key and set the TTL if any */
     dbAdd(c->db,c->argv[1],obj);
+    if (rawval) {
+        de = dictFind(c->db->dict, c->argv[1]->ptr);
+        setEntryValOnDisk(c->db->dict, de, disktype);
+        if (saveRawValOnDisk(c->db, de->v_sno, c->argv[1]->ptr, disktype, 
+                             rawval->ptr, sdslen(rawval->ptr)) != C_OK) 
+        {
+            decrRefCount(rawval);
+            dbDelete(c->db,c->argv[1]);
+            addReply(c, shared.dstoreerr);
+            return;
+        }
+        decrRefCount(rawval);
+    }
     if (ttl) setExpire(c->db,c->argv[1],mstime()+ttl);
     signalModifiedKey(c->db,c->argv[1]);
     addReply(c,shared.ok);
@@ -4677,6 +4783,114 @@ void migrateCloseTimedoutSockets(void) {
     dictReleaseIterator(di);
 }
 
+/* Number of keys MIGRATE serializes, and then writes to the target, at a
+ * time. The values of a batch stored on disk are read with one MultiGet. */
+#define MIGRATE_BATCH_KEYS 64
+
+/* Append to 'cmd' the RESTORE commands migrating the 'num' keys 'kv'.
+ * Values stored on disk are not loaded into the keyspace, see
+ * createEntryDumpPayload(). Returns C_ERR if a payload can't be created. */
+static int migrateAppendRestoreCommands(redisDb *db, 
+                                        rio *cmd, 
+                                        robj **kv, 
+                                        int num, 
+                                        int replace) {
+    int j, k = 0, numondisk = 0, rc = C_OK;
+    rio payload;
+    dictEntry **des = zmalloc(sizeof(dictEntry*)*num);
+    dictEntry **ondisk = zmalloc(sizeof(dictEntry*)*num);
+    char **rawvals = zmalloc(sizeof(char*)*num);
+    size_t *rawlens = zmalloc(sizeof(size_t)*num);
+
+    for (j = 0; j < num; j++) {
+        des[j] = dictFind(db->dict, kv[j]->ptr);
+        if (des[j] == NULL) {
+            rc = C_ERR;
+            goto cleanup;
+        }
+        if (dictIsEntryValOnDisk(des[j])) {
+            ondisk[numondisk++] = des[j];
+        }
+    }
+    if (numondisk) {
+        loadRawValsFromDisk(db, ondisk, numondisk, rawvals, rawlens);
+    }
+
+    for (j = 0; j < num; j++) {
+        long long ttl = 0;
+        long long expireat = getExpire(db,kv[j]);
+        char *rawval = NULL;
+        size_t rawlen = 0;
+
+        if (expireat != -1) {
+            ttl = expireat-mstime();
+            if (ttl < 1) ttl = 1;
+        }
+        if (dictIsEntryValOnDisk(des[j])) {
+            rawval = rawvals[k];
+            rawlen = rawlens[k];
+            k++;
+        }
+
+        /* Emit the payload argument, that is the serialized object using
+         * the DUMP format. */
+        if (createEntryDumpPayload(db, kv[j], des[j], rawval, rawlen, 
+                                   &payload) == -1) 
+        {
+            rc = C_ERR;
+            goto cleanup;
+        }
+
+        serverAssert(rioWriteBulkCount(cmd,'*',replace ? 5 : 4));
+        if (server.cluster_enabled)
+            serverAssert(rioWriteBulkString(cmd,"RESTORE-ASKING",14));
+        else
+            serverAssert(rioWriteBulkString(cmd,"RESTORE",7));
+        serverAssert(sdsEncodedObject(kv[j]));
+        serverAssert(rioWriteBulkString(cmd,kv[j]->ptr,sdslen(kv[j]->ptr)));
+        serverAssert(rioWriteBulkLongLong(cmd,ttl));
+        serverAssert(rioWriteBulkString(cmd,payload.io.buffer.ptr,
+                                        sdslen(payload.io.buffer.ptr)));
+        sdsfree(payload.io.buffer.ptr);
+
+        /* Add the REPLACE option to the RESTORE command if it was specified
+         * as a MIGRATE option. */
+        if (replace) {
+            serverAssert(rioWriteBulkString(cmd, "REPLACE", 7));
+        }
+    }
+
+cleanup:
+    for (j = 0; j < numondisk; j++) {
+        rocksFree(rawvals[j]);
+    }
+    zfree(des);
+    zfree(ondisk);
+    zfree(rawvals);
+    zfree(rawlens);
+    return rc;
+}
+
+/* Write the whole query buffered in 'cmd' to 'fd' in 64K chunks and empty
+ * the buffer. Returns C_ERR on write errors or timeout. */
+static int migrateWriteQuery(int fd, rio *cmd, long timeout) {
+    sds buf = cmd->io.buffer.ptr;
+    size_t pos = 0, towrite;
+    int nwritten = 0;
+
+    while ((towrite = sdslen(buf)-pos) > 0) {
+        towrite = (towrite > (64*1024) ? (64*1024) : towrite);
+        nwritten = syncWrite(fd,buf+pos,towrite,timeout);
+        if (nwritten != (signed)towrite) {
+            return C_ERR;
+        }
+        pos += nwritten;
+    }
+    sdsclear(buf);
+    cmd->io.buffer.pos = 0;
+    return C_OK;
+}
+
 /* MIGRATE host port key dbid timeout [COPY | REPLACE]
  *
  * On in the multiple keys form:
@@ -4687,10 +4901,9 @@ void migrateCommand(client *c) {
     int copy, replace, j;
     long timeout;
     long dbid;
-    robj **ov = NULL; /* Objects to migrate. */
     robj **kv = NULL; /* Key names. */
     robj **newargv = NULL; /* Used to rewrite the command as DEL ... keys ... */
-    rio cmd, payload;
+    rio cmd;
     int may_retry = 1;
     int write_error = 0;
     int argv_rewritten = 0;
@@ -4738,14 +4951,13 @@ void migrateCommand(client *c) {
      * the caller there was nothing to migrate. We don't return an error in
      * this case, since often this is due to a normal condition like the key
      * expiring in the meantime. */
-    ov = zrealloc(ov,sizeof(robj*)*num_keys);
     kv = zrealloc(kv,sizeof(robj*)*num_keys);
     int oi = 0;
 
     for (j = 0; j < num_keys; j++) {
-        ov[oi] = lookupKeyRead(c->db, c->argv[first_key + j]);
-        
-        if (ov[oi] != NULL && ov[oi] != shared.dstoreerr) {
+        /* Values stored on disk are left there, they are read in batches
+         * while serializing the RESTORE commands. */
+        if (getKeyType(c->db, c->argv[first_key+j]) != OBJ_RESERVED) {
             kv[oi] = c->argv[first_key+j];
             oi++;
         }
@@ -4753,7 +4965,6 @@ void migrateCommand(client *c) {
     
     num_keys = oi;
     if (num_keys == 0) {
-        zfree(ov); 
         zfree(kv);
         addReplySds(c,sdsnew("+NOKEY\r\n"));
         return;
@@ -4765,7 +4976,7 @@ try_again:
     /* Connect */
     cs = migrateGetSocket(c,c->argv[1],c->argv[2],timeout);
     if (cs == NULL) {
-        zfree(ov); zfree(kv);
+        zfree(kv);
         return; /* error sent to the client by migrateGetSocket() */
     }
 
@@ -4779,67 +4990,21 @@ try_again:
         serverAssertWithInfo(c,NULL,rioWriteBulkLongLong(&cmd,dbid));
     }
 
-    /* Create RESTORE payload and generate the protocol to call the command. */
-    for (j = 0; j < num_keys; j++) {
-        long long ttl = 0;
-        long long expireat = getExpire(c->db,kv[j]);
-
-        if (expireat != -1) {
-            ttl = expireat-mstime();
-            if (ttl < 1) ttl = 1;
-        }
-        serverAssertWithInfo(c,NULL,rioWriteBulkCount(&cmd,'*',replace ? 5 : 4));
-        if (server.cluster_enabled)
-            serverAssertWithInfo(c,NULL,
-                rioWriteBulkString(&cmd,"RESTORE-ASKING",14));
-        else
-            serverAssertWithInfo(c,NULL,rioWriteBulkString(&cmd,"RESTORE",7));
-        serverAssertWithInfo(c,NULL,sdsEncodedObject(kv[j]));
-        serverAssertWithInfo(c,NULL,rioWriteBulkString(&cmd,kv[j]->ptr,
-                sdslen(kv[j]->ptr)));
-        serverAssertWithInfo(c,NULL,rioWriteBulkLongLong(&cmd,ttl));
+    /* Create the RESTORE payloads and generate the protocol to call the
+     * command, pipelining the batches to the other node so that only one
+     * batch of serialized values is in memory at a time. */
+    errno = 0;
+    for (j = 0; j < num_keys; j += MIGRATE_BATCH_KEYS) {
+        int batch = num_keys-j;
 
-        /* Emit the payload argument, that is the serialized object using
-         * the DUMP format. */
-        dictEntry *de = dictFind(c->db->dict, kv[j]->ptr);
-        if (!de) {
-            sdsfree(payload.io.buffer.ptr);
+        if (batch > MIGRATE_BATCH_KEYS) batch = MIGRATE_BATCH_KEYS;
+        if (migrateAppendRestoreCommands(c->db,&cmd,kv+j,batch,replace) == C_ERR) 
             goto socket_err;
-        }
-        
-        if (createDumpPayload(c->db, de->v_sno, kv[j], &payload, ov[j]) == -1) {
-            sdsfree(payload.io.buffer.ptr);
-            goto socket_err;
-        }
-        
-        serverAssertWithInfo(c,NULL,
-            rioWriteBulkString(&cmd,payload.io.buffer.ptr,
-                               sdslen(payload.io.buffer.ptr)));
-        sdsfree(payload.io.buffer.ptr);
-
-        /* Add the REPLACE option to the RESTORE command if it was specified
-         * as a MIGRATE option. */
-        if (replace) {
-            serverAssertWithInfo(c, NULL, 
-                                 rioWriteBulkString(&cmd, "REPLACE", 7));
-        }
-    }
 
-    /* Transfer the query to the other node in 64K chunks. */
-    errno = 0;
-    {
-        sds buf = cmd.io.buffer.ptr;
-        size_t pos = 0, towrite;
-        int nwritten = 0;
-
-        while ((towrite = sdslen(buf)-pos) > 0) {
-            towrite = (towrite > (64*1024) ? (64*1024) : towrite);
-            nwritten = syncWrite(cs->fd,buf+pos,towrite,timeout);
-            if (nwritten != (signed)towrite) {
-                write_error = 1;
-                goto socket_err;
-            }
-            pos += nwritten;
+        /* Transfer the query to the other node in 64K chunks. */
+        if (migrateWriteQuery(cs->fd,&cmd,timeout) == C_ERR) {
+            write_error = 1;
+            goto socket_err;
         }
     }
 
@@ -4937,7 +5102,7 @@ try_again:
     }
 
     sdsfree(cmd.io.buffer.ptr);
-    zfree(ov); zfree(kv); zfree(newargv);
+    zfree(kv); zfree(newargv);
     return;
 
 /* On socket errors we try to close the cached socket and try again.
@@ -4964,7 +5129,7 @@ socket_err:
     }
 
     /* Cleanup we want to do if no retry is attempted. */
-    zfree(ov); zfree(kv);
+    zfree(kv);
     addReplySds(c,
         sdscatprintf(sdsempty(),
             "-IOERR error or timeout %s to target instance\r\n",
@@ -4972,6 +5137,625 @@ socket_err:
     return;
 }
 
+/* -----------------------------------------------------------------------------
+ * CLUSTER MIGRATESLOT
+ *
+ * Moves all the keys of a slot to another master and then hands the slot
+ * off to it, without the round trips of MIGRATE driven by redis-trib.
+ *
+ * The job has a dedicated non blocking connection with the target where
+ * commands are pipelined: first CLUSTER SETSLOT IMPORTING, then a
+ * RESTORE-ASKING ... REPLACE for every key of the slot, found scanning the
+ * keys of the slot incrementally, and finally CLUSTER SETSLOT NODE. Every
+ * key is deleted locally as soon as the target acknowledges it, and the
+ * keys modified while in flight are sent again (or deleted on the target if
+ * they no longer exist here), so that the target always ends up with the
+ * last version. Keys created here while the target takes the slot are sent
+ * as well before handing it off again. Flow control bounds both the commands
+ * waiting for a reply and the bytes not yet written, and every step
+ * serializes for at most about a millisecond so that clients are still
+ * served.
+ *
+ * Like with MIGRATE the keys are serialized by the main thread, since they
+ * can be modified by clients meanwhile, but values stored on disk are read
+ * in batches and never loaded into the keyspace.
+ * -------------------------------------------------------------------------- */
+
+#define CLUSTER_MIGRATION_MAX_PENDING 4096 /* Commands waiting for a reply. */
+#define CLUSTER_MIGRATION_MAX_OUTBUF (1024*1024*4) /* Bytes not yet written. */
+#define CLUSTER_MIGRATION_STEP_US 1000 /* Max time to fill the buffer. */
+#define CLUSTER_MIGRATION_MAX_FINISHED 16 /* Finished jobs kept for STATUS. */
+#define CLUSTER_MIGRATION_MAX_HANDOFF_RETRIES 3
+
+/* Commands of the pipeline waiting for a reply. */
+#define CLUSTER_MIGRATION_CMD_IMPORTING 0
+#define CLUSTER_MIGRATION_CMD_ASKING 1
+#define CLUSTER_MIGRATION_CMD_KEY 2     /* RESTORE-ASKING or DEL of a key. */
+#define CLUSTER_MIGRATION_CMD_NODE 3
+
+typedef struct slotMigrationCmd {
+    int type;
+    sds key;
+} slotMigrationCmd;
+
+static void slotMigrationReadHandler(aeEventLoop *el, int fd, 
+                                     void *privdata, int mask);
+static void slotMigrationWriteHandler(aeEventLoop *el, int fd, 
+                                      void *privdata, int mask);
+
+static void slotMigrationFreeCmd(void *ptr) {
+    slotMigrationCmd *cmd = ptr;
+
+    sdsfree(cmd->key);
+    zfree(cmd);
+}
+
+/* Release the connection and the transfer state of a job, leaving only its
+ * status. */
+static void slotMigrationCloseConnection(clusterSlotMigration *job) {
+    int j;
+
+    if (job->fd != -1) {
+        aeDeleteFileEvent(server.el,job->fd,AE_READABLE|AE_WRITABLE);
+        close(job->fd);
+        job->fd = -1;
+    }
+    job->writing = 0;
+    sdsfree(job->outbuf);
+    sdsfree(job->inbuf);
+    job->outbuf = job->inbuf = NULL;
+    if (job->pending) listRelease(job->pending);
+    if (job->inflight) dictRelease(job->inflight);
+    if (job->requeue) dictRelease(job->requeue);
+    job->pending = NULL;
+    job->inflight = job->requeue = NULL;
+    for (j = 0; j < job->batchlen; j++) decrRefCount(job->batch[j]);
+    zfree(job->batch);
+    job->batch = NULL;
+    job->batchlen = job->batchsize = 0;
+    job->end_time = mstime();
+    if (server.cluster->slot_migrating_job[job->slot] == job) {
+        server.cluster->slot_migrating_job[job->slot] = NULL;
+        server.cluster->slot_migrations_running--;
+    }
+}
+
+static void slotMigrationRelease(clusterSlotMigration *job) {
+    slotMigrationCloseConnection(job);
+    sdsfree(job->err);
+    zfree(job);
+}
+
+/* Stop the job. The keys already moved stay on the target, the slot is
+ * left in migrating state so that clients are redirected to them, and the
+ * job can be started again. */
+static void slotMigrationAbort(clusterSlotMigration *job, const char *err) {
+    serverLog(LL_WARNING,"Migration of slot %d to %.40s failed: %s",
+        job->slot, job->target, err);
+    job->state = CLUSTER_MIGRATION_FAILED;
+    sdsfree(job->err);
+    job->err = sdsnew(err);
+    slotMigrationCloseConnection(job);
+}
+
+/* Release the finished jobs of 'slot' if any, and the oldest finished
+ * jobs exceeding CLUSTER_MIGRATION_MAX_FINISHED. Must not be called by the
+ * handlers of a job, that may be the one released. */
+static void slotMigrationPruneFinished(int slot) {
+    list *jobs = server.cluster->slot_migrations;
+    unsigned long finished;
+    listIter li;
+    listNode *ln;
+
+    finished = listLength(jobs)-server.cluster->slot_migrations_running;
+    listRewind(jobs,&li);
+    while ((ln = listNext(&li)) != NULL) {
+        clusterSlotMigration *job = ln->value;
+
+        if (job->fd != -1) continue;
+        if (job->slot == slot || finished > CLUSTER_MIGRATION_MAX_FINISHED) {
+            listDelNode(jobs,ln);
+            slotMigrationRelease(job);
+            finished--;
+        }
+    }
+}
+
+static void slotMigrationAddCmd(clusterSlotMigration *job, int type, sds key) {
+    slotMigrationCmd *cmd = zmalloc(sizeof(*cmd));
+
+    cmd->type = type;
+    cmd->key = key ? sdsdup(key) : NULL;
+    listAddNodeTail(job->pending,cmd);
+    if (key) {
+        dictEntry *de = dictFind(job->inflight,key);
+
+        if (de == NULL) de = dictAddRaw(job->inflight,sdsdup(key));
+        dictSetUnsignedIntegerVal(de,dictGetUnsignedIntegerVal(de)+1);
+    }
+}
+
+/* Append to the output buffer the CLUSTER SETSLOT command 'action' about
+ * the migrated slot. */
+static void slotMigrationAddSetSlot(clusterSlotMigration *job, int type, 
+                                    const char *action, const char *node) {
+    rio cmd;
+
+    rioInitWithBuffer(&cmd,job->outbuf);
+    serverAssert(rioWriteBulkCount(&cmd,'*',5));
+    serverAssert(rioWriteBulkString(&cmd,"CLUSTER",7));
+    serverAssert(rioWriteBulkString(&cmd,"SETSLOT",7));
+    serverAssert(rioWriteBulkLongLong(&cmd,job->slot));
+    serverAssert(rioWriteBulkString(&cmd,action,strlen(action)));
+    serverAssert(rioWriteBulkString(&cmd,node,CLUSTER_NAMELEN));
+    job->outbuf = cmd.io.buffer.ptr;
+    slotMigrationAddCmd(job,type,NULL);
+}
+
+static void slotMigrationBatchAdd(clusterSlotMigration *job, sds key) {
+    if (job->batchlen == job->batchsize) {
+        job->batchsize = job->batchsize ? job->batchsize*2 : MIGRATE_BATCH_KEYS;
+        job->batch = zrealloc(job->batch,sizeof(robj*)*job->batchsize);
+    }
+    job->batch[job->batchlen++] = createStringObject(key,sdslen(key));
+}
+
+static void slotMigrationScanCallback(void *privdata, const dictEntry *de) {
+    clusterSlotMigration *job = privdata;
+    sds key = dictGetKey(de);
+
+    /* Keys in flight are sent again only if modified, see requeue. */
+    if (dictFind(job->inflight,key) == NULL) slotMigrationBatchAdd(job,key);
+}
+
+/* Collect in job->batch the next keys to send: the ones modified while in
+ * flight first, then the ones found going on with the scan of the slot. */
+static void slotMigrationCollectBatch(clusterSlotMigration *job) {
+    dictIterator *di;
+    dictEntry *de;
+    dict *d;
+
+    di = dictGetSafeIterator(job->requeue);
+    while (job->batchlen < MIGRATE_BATCH_KEYS && 
+           (de = dictNext(di)) != NULL) 
+    {
+        slotMigrationBatchAdd(job,dictGetKey(de));
+        dictDelete(job->requeue,dictGetKey(de));
+    }
+    dictReleaseIterator(di);
+
+    while (job->batchlen < MIGRATE_BATCH_KEYS && !job->scan_done) {
+        d = server.cluster->slots_to_keys[job->slot];
+        if (d == NULL) {
+            job->scan_done = 1;
+            break;
+        }
+        job->cursor = dictScan(d,job->cursor,slotMigrationScanCallback,job);
+        if (job->cursor == 0) job->scan_done = 1;
+    }
+}
+
+/* Serialize job->batch into the output buffer: a RESTORE-ASKING for the
+ * keys we still have, a DEL for the ones deleted meanwhile. */
+static int slotMigrationSendBatch(clusterSlotMigration *job) {
+    redisDb *db = &server.db[0];
+    robj **kv = zmalloc(sizeof(robj*)*job->batchlen);
+    int j, numkeys = 0, rc = C_OK;
+    rio cmd;
+
+    rioInitWithBuffer(&cmd,job->outbuf);
+    for (j = 0; j < job->batchlen; j++) {
+        robj *key = job->batch[j];
+
+        if (dictFind(db->dict,key->ptr)) {
+            kv[numkeys++] = key;
+            continue;
+        }
+        serverAssert(rioWriteBulkCount(&cmd,'*',1));
+        serverAssert(rioWriteBulkString(&cmd,"ASKING",6));
+        serverAssert(rioWriteBulkCount(&cmd,'*',2));
+        serverAssert(rioWriteBulkString(&cmd,"DEL",3));
+        serverAssert(rioWriteBulkString(&cmd,key->ptr,sdslen(key->ptr)));
+        slotMigrationAddCmd(job,CLUSTER_MIGRATION_CMD_ASKING,NULL);
+        slotMigrationAddCmd(job,CLUSTER_MIGRATION_CMD_KEY,key->ptr);
+    }
+    if (numkeys) {
+        if (migrateAppendRestoreCommands(db,&cmd,kv,numkeys,1) == C_ERR) {
+            rc = C_ERR;
+        } else {
+            for (j = 0; j < numkeys; j++) {
+                slotMigrationAddCmd(job,CLUSTER_MIGRATION_CMD_KEY,kv[j]->ptr);
+            }
+        }
+    }
+    job->outbuf = cmd.io.buffer.ptr;
+
+    for (j = 0; j < job->batchlen; j++) decrRefCount(job->batch[j]);
+    job->batchlen = 0;
+    zfree(kv);
+    return rc;
+}
+
+/* Fill the output buffer with the next commands of the job, as long as
+ * the flow control limits allow it. */
+static void slotMigrationFill(clusterSlotMigration *job) {
+    long long start = ustime();
+
+    job->more = 0;
+    while (job->state == CLUSTER_MIGRATION_SENDING &&
+           listLength(job->pending) < CLUSTER_MIGRATION_MAX_PENDING &&
+           sdslen(job->outbuf)-job->outpos < CLUSTER_MIGRATION_MAX_OUTBUF)
+    {
+        if (ustime()-start > CLUSTER_MIGRATION_STEP_US) {
+            job->more = 1;
+            break;
+        }
+
+        slotMigrationCollectBatch(job);
+        if (job->batchlen) {
+            if (slotMigrationSendBatch(job) == C_ERR) {
+                slotMigrationAbort(job,"can't serialize the keys");
+                return;
+            }
+            continue;
+        }
+
+        /* Nothing left to send, wait for all the replies. */
+        if (listLength(job->pending)) break;
+        if (countKeysInSlot(job->slot) != 0) {
+            /* Keys we skipped while they were in flight: scan again. */
+            job->scan_done = 0;
+            job->cursor = 0;
+            continue;
+        }
+        slotMigrationAddSetSlot(job,CLUSTER_MIGRATION_CMD_NODE,"NODE",
+                                job->target);
+        job->state = CLUSTER_MIGRATION_HANDOFF;
+    }
+}
+
+/* Install the write handler if there is something to write, or if we
+ * have more to serialize, remove it otherwise. */
+static void slotMigrationUpdateWriteHandler(clusterSlotMigration *job) {
+    int needed;
+
+    if (job->fd == -1) return;
+    needed = sdslen(job->outbuf) > job->outpos || job->more;
+    if (needed && !job->writing) {
+        if (aeCreateFileEvent(server.el,job->fd,AE_WRITABLE,
+                slotMigrationWriteHandler,job) == AE_ERR) 
+        {
+            slotMigrationAbort(job,"can't create the writable event");
+            return;
+        }
+        job->writing = 1;
+    } else if (!needed && job->writing) {
+        aeDeleteFileEvent(server.el,job->fd,AE_WRITABLE);
+        job->writing = 0;
+    }
+}
+
+/* Delete locally a key the target acknowledged, unless it was modified
+ * meanwhile and has to be sent again. */
+static void slotMigrationKeyAcked(clusterSlotMigration *job, sds key) {
+    dictEntry *de = dictFind(job->inflight,key);
+    uint64_t count;
+    robj *keyobj;
+
+    serverAssert(de != NULL);
+    count = dictGetUnsignedIntegerVal(de);
+    if (--count) {
+        dictSetUnsignedIntegerVal(de,count);
+        return;
+    }
+    dictDelete(job->inflight,key);
+    if (dictFind(job->requeue,key)) return;
+
+    keyobj = createStringObject(key,sdslen(key));
+    if (dbDelete(&server.db[0],keyobj)) {
+        propagateExpire(&server.db[0],keyobj);
+        signalModifiedKey(&server.db[0],keyobj);
+        server.dirty++;
+        job->keys_moved++;
+    }
+    decrRefCount(keyobj);
+}
+
+/* The target owns the slot now, so do we think. */
+static void slotMigrationHandOff(clusterSlotMigration *job) {
+    clusterNode *n = clusterLookupNode(job->target);
+
+    if (n == NULL) {
+        slotMigrationAbort(job,"the target node was removed");
+        return;
+    }
+    if (countKeysInSlot(job->slot) != 0) {
+        /* Keys were created here while the target took the slot: send them
+         * too and hand the slot off again, since dropping the ownership now
+         * would lose them. */
+        if (++job->handoff_retries > CLUSTER_MIGRATION_MAX_HANDOFF_RETRIES) {
+            slotMigrationAbort(job,"keys of the slot are still created "
+                                   "while handing it off");
+            return;
+        }
+        serverLog(LL_NOTICE,"Keys of slot %d were created while handing it "
+            "off to %.40s, sending them too", job->slot, job->target);
+        job->state = CLUSTER_MIGRATION_SENDING;
+        job->scan_done = 0;
+        job->cursor = 0;
+        return;
+    }
+    server.cluster->migrating_slots_to[job->slot] = NULL;
+    clusterDelSlot(job->slot);
+    clusterAddSlot(n,job->slot);
+    clusterDoBeforeSleep(CLUSTER_TODO_SAVE_CONFIG|CLUSTER_TODO_UPDATE_STATE);
+    job->state = CLUSTER_MIGRATION_DONE;
+    slotMigrationCloseConnection(job);
+    serverLog(LL_NOTICE,"Slot %d migrated to %.40s: %lld keys in %lld ms",
+        job->slot, job->target, job->keys_moved, 
+        (long long)(job->end_time-job->start_time));
+}
+
+static void slotMigrationProcessReply(clusterSlotMigration *job, char *reply) {
+    listNode *ln = listFirst(job->pending);
+    slotMigrationCmd *cmd;
+
+    if (ln == NULL) {
+        slotMigrationAbort(job,"unexpected reply from the target");
+        return;
+    }
+    cmd = ln->value;
+    if (reply[0] == '-') {
+        sds err = sdscatprintf(sdsempty(),"target replied: %s",reply+1);
+        slotMigrationAbort(job,err);
+        sdsfree(err);
+        return;
+    }
+
+    switch(cmd->type) {
+    case CLUSTER_MIGRATION_CMD_IMPORTING:
+        /* The target accepts the keys, redirect here the clients looking
+         * for the keys already moved. */
+        server.cluster->migrating_slots_to[job->slot] = 
+            clusterLookupNode(job->target);
+        break;
+    case CLUSTER_MIGRATION_CMD_KEY:
+        slotMigrationKeyAcked(job,cmd->key);
+        break;
+    case CLUSTER_MIGRATION_CMD_NODE:
+        listDelNode(job->pending,ln);
+        slotMigrationHandOff(job);
+        return;
+    }
+    listDelNode(job->pending,ln);
+}
+
+static void slotMigrationReadHandler(aeEventLoop *el, int fd, 
+                                     void *privdata, int mask) {
+    clusterSlotMigration *job = privdata;
+    char buf[PROTO_IOBUF_LEN];
+    size_t start = 0;
+    ssize_t nread;
+    char *eol;
+    UNUSED(el);
+    UNUSED(mask);
+
+    nread = read(fd,buf,sizeof(buf));
+    if (nread == -1 && errno == EAGAIN) return;
+    if (nread <= 0) {
+        slotMigrationAbort(job, nread ? strerror(errno) : 
+                                        "connection closed by the target");
+        return;
+    }
+    job->last_io_time = mstime();
+    job->inbuf = sdscatlen(job->inbuf,buf,nread);
+
+    /* All the replies we expect are single line ones. */
+    while ((eol = strstr(job->inbuf+start,"\r\n")) != NULL) {
+        *eol = '\0';
+        slotMigrationProcessReply(job,job->inbuf+start);
+        if (job->fd == -1) return; /* Job finished or failed. */
+        start = (eol+2)-job->inbuf;
+    }
+    sdsrange(job->inbuf,start,-1);
+
+    slotMigrationFill(job);
+    slotMigrationUpdateWriteHandler(job);
+}
+
+static void slotMigrationWriteHandler(aeEventLoop *el, int fd, 
+                                      void *privdata, int mask) {
+    clusterSlotMigration *job = privdata;
+    size_t towrite = sdslen(job->outbuf)-job->outpos;
+    ssize_t nwritten;
+    UNUSED(el);
+    UNUSED(mask);
+
+    if (towrite) {
+        nwritten = write(fd,job->outbuf+job->outpos,towrite);
+        if (nwritten == -1) {
+            if (errno == EAGAIN) return;
+            slotMigrationAbort(job,strerror(errno));
+            return;
+        }
+        job->outpos += nwritten;
+        job->bytes_sent += nwritten;
+        job->last_io_time = mstime();
+        if (job->outpos == sdslen(job->outbuf)) {
+            sdsclear(job->outbuf);
+            job->outpos = 0;
+        } else if (job->outpos > CLUSTER_MIGRATION_MAX_OUTBUF) {
+            sdsrange(job->outbuf,job->outpos,-1);
+            job->outpos = 0;
+        }
+    }
+
+    slotMigrationFill(job);
+    slotMigrationUpdateWriteHandler(job);
+}
+
+static void slotMigrationStart(client *c, int slot, clusterNode *n) {
+    clusterSlotMigration *job;
+    int fd;
+
+    fd = anetTcpNonBlockConnect(server.neterr,n->ip,n->port);
+    if (fd == -1) {
+        addReplyErrorFormat(c,"Can't connect to target node: %s",
+            server.neterr);
+        return;
+    }
+    anetEnableTcpNoDelay(server.neterr,fd);
+
+    job = zcalloc(sizeof(*job));
+    job->slot = slot;
+    memcpy(job->target,n->name,CLUSTER_NAMELEN);
+    job->state = CLUSTER_MIGRATION_SENDING;
+    job->fd = fd;
+    job->outbuf = sdsempty();
+    job->inbuf = sdsempty();
+    job->pending = listCreate();
+    listSetFreeMethod(job->pending,slotMigrationFreeCmd);
+    job->inflight = dictCreate(&slotMigrationDictType,NULL);
+    job->requeue = dictCreate(&slotMigrationDictType,NULL);
+    job->start_time = job->last_io_time = mstime();
+    listAddNodeTail(server.cluster->slot_migrations,job);
+    server.cluster->slot_migrating_job[slot] = job;
+    server.cluster->slot_migrations_running++;
+
+    if (aeCreateFileEvent(server.el,fd,AE_READABLE,
+            slotMigrationReadHandler,job) == AE_ERR) 
+    {
+        slotMigrationAbort(job,"can't create the readable event");
+        addReplyError(c,job->err);
+        return;
+    }
+    slotMigrationAddSetSlot(job,CLUSTER_MIGRATION_CMD_IMPORTING,"IMPORTING",
+                            myself->name);
+    slotMigrationFill(job);
+    slotMigrationUpdateWriteHandler(job);
+    serverLog(LL_NOTICE,"Migrating slot %d to %.40s", slot, n->name);
+    addReply(c,shared.ok);
+}
+
+/* Called when a key is modified: if it is in flight it must be sent again
+ * once its current transfer is acknowledged. */
+void clusterSlotMigrationKeyModified(robj *key) {
+    clusterSlotMigration *job;
+    int slot;
+
+    if (server.cluster->slot_migrations_running == 0) return;
+    slot = keyHashSlot(key->ptr,sdslen(key->ptr));
+    job = server.cluster->slot_migrating_job[slot];
+    if (job == NULL) return;
+    if (dictFind(job->inflight,key->ptr) && !dictFind(job->requeue,key->ptr))
+        dictAdd(job->requeue,sdsdup(key->ptr),NULL);
+}
+
+/* Called by clusterCron(), stops the jobs that can't go on and resumes the
+ * ones that were stopped by the flow control. */
+void clusterSlotMigrationCron(void) {
+    listIter li;
+    listNode *ln;
+
+    slotMigrationPruneFinished(-1);
+    listRewind(server.cluster->slot_migrations,&li);
+    while ((ln = listNext(&li)) != NULL) {
+        clusterSlotMigration *job = ln->value;
+
+        if (job->fd == -1) continue;
+        if (nodeIsSlave(myself) || server.cluster->slots[job->slot] != myself) {
+            slotMigrationAbort(job,"this node is no longer the slot owner");
+        } else if (clusterLookupNode(job->target) == NULL) {
+            slotMigrationAbort(job,"the target node was removed");
+        } else if (mstime()-job->last_io_time > server.cluster_node_timeout &&
+                   (listLength(job->pending) || job->outpos < sdslen(job->outbuf)))
+        {
+            slotMigrationAbort(job,"timeout talking with the target");
+        } else {
+            slotMigrationFill(job);
+            slotMigrationUpdateWriteHandler(job);
+        }
+    }
+}
+
+static sds slotMigrationCatStatus(sds s, clusterSlotMigration *job) {
+    char *statestr[] = {"sending","handoff","done","failed"};
+    mstime_t end = job->end_time ? job->end_time : mstime();
+
+    s = sdscatprintf(s,
+        "slot:%d target:%.40s state:%s keys_moved:%lld keys_left:%u "
+        "keys_inflight:%lu bytes_sent:%lld elapsed_ms:%lld",
+        job->slot, job->target, statestr[job->state], job->keys_moved,
+        job->state <= CLUSTER_MIGRATION_HANDOFF ? countKeysInSlot(job->slot) : 0,
+        job->inflight ? dictSize(job->inflight) : 0, job->bytes_sent,
+        (long long)(end-job->start_time));
+    if (job->err) s = sdscatprintf(s," error:%s",job->err);
+    return sdscatlen(s,"\r\n",2);
+}
+
+/* CLUSTER MIGRATESLOT <slot> <node ID>
+ * CLUSTER MIGRATESLOT CANCEL <slot>
+ * CLUSTER MIGRATESLOT STATUS */
+void clusterMigrateSlotCommand(client *c) {
+    clusterSlotMigration *job;
+    clusterNode *n;
+    int slot;
+
+    if (!strcasecmp(c->argv[2]->ptr,"status") && c->argc == 3) {
+        listIter li;
+        listNode *ln;
+        sds s = sdsempty();
+
+        listRewind(server.cluster->slot_migrations,&li);
+        while ((ln = listNext(&li)) != NULL) 
+            s = slotMigrationCatStatus(s,ln->value);
+        addReplyBulkSds(c,s);
+    } else if (!strcasecmp(c->argv[2]->ptr,"cancel") && c->argc == 4) {
+        if ((slot = getSlotOrReply(c,c->argv[3])) == -1) return;
+        job = server.cluster->slot_migrating_job[slot];
+        if (job == NULL) {
+            addReplyErrorFormat(c,"No migration of slot %d in progress",slot);
+            return;
+        }
+        slotMigrationAbort(job,"cancelled");
+        addReply(c,shared.ok);
+    } else if (c->argc == 4) {
+        if ((slot = getSlotOrReply(c,c->argv[2])) == -1) return;
+        if (nodeIsSlave(myself)) {
+            addReplyError(c,"Please use MIGRATESLOT only with masters.");
+            return;
+        }
+        if (server.cluster->slots[slot] != myself) {
+            addReplyErrorFormat(c,"I'm not the owner of hash slot %u",slot);
+            return;
+        }
+        if ((n = clusterLookupNode(c->argv[3]->ptr)) == NULL) {
+            addReplyErrorFormat(c,"I don't know about node %s",
+                (char*)c->argv[3]->ptr);
+            return;
+        }
+        if (n == myself || !nodeIsMaster(n)) {
+            addReplyError(c,"The target node must be another master");
+            return;
+        }
+        if (server.cluster->migrating_slots_to[slot] &&
+            server.cluster->migrating_slots_to[slot] != n)
+        {
+            addReplyErrorFormat(c,"Slot %d is migrating to another node",
+                slot);
+            return;
+        }
+        if (server.cluster->slot_migrating_job[slot] != NULL) {
+            addReplyErrorFormat(c,"Slot %d is already migrating",slot);
+            return;
+        }
+        slotMigrationPruneFinished(slot);
+        slotMigrationStart(c,slot,n);
+    } else {
+        addReplyError(c,"Wrong CLUSTER MIGRATESLOT arguments");
+    }
+}
+
 /* -----------------------------------------------------------------------------
  * Cluster functions related to serving / redirecting clients
  * -------------------------------------------------------------------------- */
@@ -105,6 +105,42 @@ typedef struct clusterNode {
     list *fail_reports;         /* List of nodes signaling this as failing */
 } clusterNode;
 
+/* CLUSTER MIGRATESLOT job states. */
+#define CLUSTER_MIGRATION_SENDING 0 /* Moving the keys of the slot. */
+#define CLUSTER_MIGRATION_HANDOFF 1 /* Waiting the target to own the slot. */
+#define CLUSTER_MIGRATION_DONE 2
+#define CLUSTER_MIGRATION_FAILED 3
+
+/* A server side migration of all the keys of a slot, see CLUSTER
+ * MIGRATESLOT in cluster.c. The last CLUSTER_MIGRATION_MAX_FINISHED
+ * finished jobs are kept for their status. */
+typedef struct clusterSlotMigration {
+    int slot;
+    char target[CLUSTER_NAMELEN]; /* Name of the node importing the slot. */
+    int state;                  /* CLUSTER_MIGRATION_* */
+    int fd;                     /* Pipelined connection with the target. */
+    int writing;                /* True if the write handler is installed. */
+    int more;                   /* True if we stopped filling 'outbuf' only
+                                   because of the time limit. */
+    sds outbuf;                 /* Commands not yet written to 'fd'. */
+    size_t outpos;              /* Bytes of 'outbuf' already written. */
+    sds inbuf;                  /* Replies not yet processed. */
+    list *pending;              /* Commands waiting for a reply, in order. */
+    dict *inflight;             /* Key -> RESTORE/DEL sent without a reply. */
+    dict *requeue;              /* Inflight keys modified, to send again. */
+    unsigned long cursor;       /* dictScan() cursor of the slot keys. */
+    int scan_done;              /* The scan of the slot keys completed. */
+    robj **batch;               /* Keys to send next. */
+    int batchlen, batchsize;
+    long long keys_moved;       /* Keys acknowledged and deleted locally. */
+    long long bytes_sent;
+    mstime_t start_time;
+    mstime_t end_time;
+    mstime_t last_io_time;      /* Last time we read or wrote 'fd'. */
+    int handoff_retries;        /* Times keys were left at hand off time. */
+    sds err;                    /* Why the job failed, if it did. */
+} clusterSlotMigration;
+
 typedef struct clusterState {
     clusterNode *myself;  /* This node */
     uint64_t currentEpoch;
@@ -115,7 +151,7 @@ typedef struct clusterState {
     clusterNode *migrating_slots_to[CLUSTER_SLOTS];
     clusterNode *importing_slots_from[CLUSTER_SLOTS];
     clusterNode *slots[CLUSTER_SLOTS];
-    zskiplist *slots_to_keys;
+    dict *slots_to_keys[CLUSTER_SLOTS]; /* Keys of every slot, NULL if none */
     /* The following fields are used to take the slave state on elections. */
     mstime_t failover_auth_time; /* Time of previous or next election. */
     int failover_auth_count;    /* Number of votes received so far. */
@@ -139,6 +175,10 @@ typedef struct clusterState {
     int todo_before_sleep; /* Things to do in clusterBeforeSleep(). */
     long long stats_bus_messages_sent;  /* Num of msg sent via cluster bus. */
     long long stats_bus_messages_received; /* Num of msg rcvd via cluster bus.*/
+    list *slot_migrations;      /* CLUSTER MIGRATESLOT jobs. */
+    clusterSlotMigration *slot_migrating_job[CLUSTER_SLOTS]; /* Running
+                                   job of every slot, NULL if none. */
+    int slot_migrations_running; /* Non NULL entries of the above. */
 } clusterState;
 
 /* clusterState todo_before_sleep flags. */
@@ -257,5 +297,6 @@ typedef struct {
 clusterNode *getNodeByQuery(client *c, struct redisCommand *cmd, robj **argv, int argc, int *hashslot, int *ask);
 int clusterRedirectBlockedClientIfNeeded(client *c);
 void clusterRedirectClient(client *c, clusterNode *n, int hashslot, int error_code);
+void clusterSlotMigrationKeyModified(robj *key);
 
 #endif /* __CLUSTER_H */
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "codec.h"
+#include "lzf.h"
+#include <limits.h>
+
+#ifdef LZ4
+#include <lz4.h>
+#endif
+
+#ifdef ZSTD
+#include <zstd.h>
+#include <pthread.h>
+#include "zmalloc.h"
+
+/* Level 1 is about as fast as LZ4 to compress and still a lot better than
+ * LZF in ratio. Decompression speed doesn't depend on the level. */
+#define CODEC_ZSTD_LEVEL 1
+
+/* The contexts are reused across calls, one pair per thread since the dump
+ * threads compress concurrently. They are kept in thread specific data so
+ * that they are freed when the thread that created them exits. */
+typedef struct codecZstdCtx {
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+} codecZstdCtx;
+
+static pthread_key_t codec_zstd_key;
+static pthread_once_t codec_zstd_once = PTHREAD_ONCE_INIT;
+
+static void codecZstdFreeCtx(void *p) {
+    codecZstdCtx *ctx = p;
+
+    ZSTD_freeCCtx(ctx->cctx);
+    ZSTD_freeDCtx(ctx->dctx);
+    zfree(ctx);
+}
+
+static void codecZstdInitKey(void) {
+    pthread_key_create(&codec_zstd_key,codecZstdFreeCtx);
+}
+
+/* Return the contexts of the calling thread, creating them if needed. */
+static codecZstdCtx *codecZstdGetCtx(void) {
+    codecZstdCtx *ctx;
+
+    pthread_once(&codec_zstd_once,codecZstdInitKey);
+    ctx = pthread_getspecific(codec_zstd_key);
+    if (ctx == NULL) {
+        ctx = zmalloc(sizeof(*ctx));
+        ctx->cctx = ZSTD_createCCtx();
+        ctx->dctx = ZSTD_createDCtx();
+        if (ctx->cctx == NULL || ctx->dctx == NULL ||
+            pthread_setspecific(codec_zstd_key,ctx) != 0)
+        {
+            codecZstdFreeCtx(ctx);
+            return NULL;
+        }
+    }
+    return ctx;
+}
+#endif
+
+/* Return 1 if 'codec' was compiled in, 0 otherwise. */
+int codecAvailable(int codec) {
+    switch(codec) {
+    case CODEC_LZF: return 1;
+#ifdef LZ4
+    case CODEC_LZ4: return 1;
+#endif
+#ifdef ZSTD
+    case CODEC_ZSTD: return 1;
+#endif
+    default: return 0;
+    }
+}
+
+/* Return the name of 'codec', as used in the configuration. */
+const char *codecName(int codec) {
+    switch(codec) {
+    case CODEC_LZF: return "lzf";
+    case CODEC_LZ4: return "lz4";
+    case CODEC_ZSTD: return "zstd";
+    default: return "unknown";
+    }
+}
+
+/* Compress 'inlen' bytes at 'in' into the 'outlen' bytes buffer at 'out'.
+ * Returns the compressed length, or 0 if the result doesn't fit in 'out',
+ * so that passing 'outlen' < 'inlen' rejects incompressible data. */
+size_t codecCompress(int codec, const void *in, size_t inlen, void *out,
+                     size_t outlen)
+{
+    switch(codec) {
+    case CODEC_LZF:
+        return lzf_compress(in,inlen,out,outlen);
+#ifdef LZ4
+    case CODEC_LZ4: {
+        int n;
+
+        if (inlen > LZ4_MAX_INPUT_SIZE) return 0;
+        if (outlen > INT_MAX) outlen = INT_MAX;
+        n = LZ4_compress_default(in,out,(int)inlen,(int)outlen);
+        return n > 0 ? (size_t)n : 0;
+    }
+#endif
+#ifdef ZSTD
+    case CODEC_ZSTD: {
+        codecZstdCtx *ctx = codecZstdGetCtx();
+        size_t n;
+
+        if (ctx == NULL) return 0;
+        n = ZSTD_compressCCtx(ctx->cctx,out,outlen,in,inlen,
+                              CODEC_ZSTD_LEVEL);
+        return ZSTD_isError(n) ? 0 : n;
+    }
+#endif
+    default:
+        return 0;
+    }
+}
+
+/* Decompress 'inlen' bytes at 'in' into 'out', that must be exactly as long
+ * as the original data. Returns 'outlen' on success, 0 if the data is
+ * corrupted, has a different length or the codec is not compiled in. */
+size_t codecDecompress(int codec, const void *in, size_t inlen, void *out,
+                       size_t outlen)
+{
+    size_t n = 0;
+
+    switch(codec) {
+    case CODEC_LZF:
+        n = lzf_decompress(in,inlen,out,outlen);
+        break;
+#ifdef LZ4
+    case CODEC_LZ4: {
+        int len;
+
+        if (inlen > INT_MAX || outlen > INT_MAX) return 0;
+        len = LZ4_decompress_safe(in,out,(int)inlen,(int)outlen);
+        n = len > 0 ? (size_t)len : 0;
+        break;
+    }
+#endif
+#ifdef ZSTD
+    case CODEC_ZSTD: {
+        codecZstdCtx *ctx = codecZstdGetCtx();
+
+        if (ctx == NULL) return 0;
+        n = ZSTD_decompressDCtx(ctx->dctx,out,outlen,in,inlen);
+        if (ZSTD_isError(n)) n = 0;
+        break;
+    }
+#endif
+    default:
+        return 0;
+    }
+    return n == outlen ? n : 0;
+}
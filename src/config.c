@@ -95,6 +95,13 @@ configEnum aof_fsync_enum[] = {
     {NULL, 0}
 };
 
+configEnum compression_codec_enum[] = {
+    {"lzf", CODEC_LZF},
+    {"lz4", CODEC_LZ4},
+    {"zstd", CODEC_ZSTD},
+    {NULL, 0}
+};
+
 /* Output buffer limits presets. */
 clientBufferLimitsConfig clientBufferLimitsDefaults[CLIENT_TYPE_OBUF_COUNT] = {
     {0, 0, 0}, /* normal */
@@ -222,6 +229,29 @@ void loadServerConfigFromString(char *config) {
             if (server.tcp_backlog < 0) {
                 err = "Invalid backlog value"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"io-threads") && argc == 2) {
+            server.io_threads_num = atoi(argv[1]);
+            if (server.io_threads_num < 1 ||
+                server.io_threads_num > IO_THREADS_MAX_NUM)
+            {
+                err = "Invalid number of I/O threads"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"io-threads-do-reads") && argc == 2) {
+            if ((server.io_threads_do_reads = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"lazyfree-lazy-eviction") && argc == 2) {
+            if ((server.lazyfree_lazy_eviction = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"lazyfree-lazy-expire") && argc == 2) {
+            if ((server.lazyfree_lazy_expire = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"lazyfree-lazy-server-del") && argc == 2) {
+            if ((server.lazyfree_lazy_server_del = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"bind") && argc >= 2) {
             int j, addresses = argc-1;
 
@@ -329,6 +359,16 @@ void loadServerConfigFromString(char *config) {
             if (server.dump_thdbuf_size < DUMP_THDBUF_SIZE) {
                 server.dump_thdbuf_size = DUMP_THDBUF_SIZE;
             }
+        } else if (!strcasecmp(argv[0], "dump-segment") && argc == 2) {
+            if ((server.dump_segment = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; 
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0], "dump-dstore-raw") && argc == 2) {
+            if ((server.dump_dstore_raw = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; 
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0], "use-disk-store") && argc == 2) {
             if ((server.use_disk_store = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; 
@@ -379,6 +419,22 @@ void loadServerConfigFromString(char *config) {
         } else if (!strcasecmp(argv[0], "dstore-need-loadmem-hz") 
                    && argc == 2) {
             server.dstore_need_loadmem_hz = atoi(argv[1]);
+        } else if (!strcasecmp(argv[0], "dstore-bulkload") && argc == 2) {
+            if ((server.dstore_bulkload = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; 
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0], "dstore-bulkload-buf-size") 
+                   && argc == 2) {
+            server.dstore_bulkload_bufsize = memtoll(argv[1], NULL);
+        } else if (!strcasecmp(argv[0], "dstore-compression-codec") 
+                   && argc == 2) {
+            server.dstore_compression_codec =
+                configEnumGetValue(compression_codec_enum, argv[1]);
+            if (!codecAvailable(server.dstore_compression_codec)) {
+                err = "Invalid or not compiled in compression codec";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0], "disk-store-policy") && argc == 2) {
             server.dstore_policy =
                 configEnumGetValue(diskstore_policy_enum, argv[1]);
@@ -533,6 +589,13 @@ void loadServerConfigFromString(char *config) {
             if ((server.rdb_compression = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"rdbcompression-codec") && argc == 2) {
+            server.rdb_compression_codec =
+                configEnumGetValue(compression_codec_enum,argv[1]);
+            if (!codecAvailable(server.rdb_compression_codec)) {
+                err = "Invalid or not compiled in compression codec";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"rdbchecksum") && argc == 2) {
             if ((server.rdb_checksum = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
@@ -541,6 +604,10 @@ void loadServerConfigFromString(char *config) {
             if ((server.activerehashing = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"rehash-while-saving") && argc == 2) {
+            if ((server.rehash_while_saving = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"daemonize") && argc == 2) {
             if ((server.daemonize = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
@@ -625,6 +692,15 @@ void loadServerConfigFromString(char *config) {
             server.list_max_ziplist_size = atoi(argv[1]);
         } else if (!strcasecmp(argv[0],"list-compress-depth") && argc == 2) {
             server.list_compress_depth = atoi(argv[1]);
+        } else if (!strcasecmp(argv[0],"list-compress-codec") && argc == 2) {
+            server.list_compress_codec =
+                configEnumGetValue(compression_codec_enum,argv[1]);
+            if (server.list_compress_codec == CODEC_ZSTD ||
+                !codecAvailable(server.list_compress_codec))
+            {
+                err = "Invalid list compression codec, use lzf or lz4";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"set-max-intset-entries") && argc == 2) {
             server.set_max_intset_entries = memtoll(argv[1], NULL);
         } else if (!strcasecmp(argv[0],"zset-max-ziplist-entries") && argc == 2) {
@@ -1030,6 +1106,22 @@ void configSetCommand(client *c) {
             server.client_obuf_limits[class].soft_limit_seconds = soft_seconds;
         }
         sdsfreesplitres(v,vlen);
+    } config_set_special_field("rdbcompression-codec") {
+        int codec = configEnumGetValue(compression_codec_enum,o->ptr);
+
+        if (!codecAvailable(codec)) goto badfmt;
+        server.rdb_compression_codec = codec;
+    } config_set_special_field("list-compress-codec") {
+        int codec = configEnumGetValue(compression_codec_enum,o->ptr);
+
+        /* Compressed list nodes have room to tag LZF and LZ4 only. */
+        if (codec == CODEC_ZSTD || !codecAvailable(codec)) goto badfmt;
+        server.list_compress_codec = codec;
+    } config_set_special_field("dstore-compression-codec") {
+        int codec = configEnumGetValue(compression_codec_enum,o->ptr);
+
+        if (!codecAvailable(codec)) goto badfmt;
+        server.dstore_compression_codec = codec;
     } config_set_special_field("notify-keyspace-events") {
         int flags = keyspaceEventsStringToFlags(o->ptr);
 
@@ -1059,12 +1151,23 @@ void configSetCommand(client *c) {
       "slave-read-only",server.repl_slave_ro) {
     } config_set_bool_field(
       "activerehashing",server.activerehashing) {
+    } config_set_bool_field(
+      "rehash-while-saving",server.rehash_while_saving) {
+        updateDictResizePolicy();
     } config_set_bool_field(
       "protected-mode",server.protected_mode) {
     } config_set_bool_field(
       "stop-writes-on-bgsave-error",server.stop_writes_on_bgsave_err) {
     } config_set_bool_field(
       "no-appendfsync-on-rewrite",server.aof_no_fsync_on_rewrite) {
+    } config_set_bool_field(
+      "io-threads-do-reads",server.io_threads_do_reads) {
+    } config_set_bool_field(
+      "lazyfree-lazy-eviction",server.lazyfree_lazy_eviction) {
+    } config_set_bool_field(
+      "lazyfree-lazy-expire",server.lazyfree_lazy_expire) {
+    } config_set_bool_field(
+      "lazyfree-lazy-server-del",server.lazyfree_lazy_server_del) {
 
     /* Numerical fields.
      * config_set_numerical_field(name,var,min,max) */
@@ -1146,6 +1249,10 @@ void configSetCommand(client *c) {
       "dump-thdnr", server.dump_thdnr, 1, LLONG_MAX) {
     } config_set_numerical_field(
       "dump-thdbuf-size", server.dump_thdbuf_size, 1, LLONG_MAX) {
+    } config_set_bool_field(
+      "dump-segment", server.dump_segment) { 
+    } config_set_bool_field(
+      "dump-dstore-raw", server.dump_dstore_raw) { 
     } config_set_numerical_field(
       "realtime-expire-once-maxnr",
       server.realtime_expire_once_maxnr, 0, LLONG_MAX) {
@@ -1185,6 +1292,10 @@ void configSetCommand(client *c) {
       server.dstore_hash_loop_field_nr, 0, LLONG_MAX) {
     } config_set_numerical_field(
       "dstore-need-loadmem-hz", server.dstore_need_loadmem_hz, 0, LLONG_MAX) {
+    } config_set_memory_field(
+      "dstore-bulkload-buf-size", server.dstore_bulkload_bufsize) {
+    } config_set_bool_field(
+      "dstore-bulkload", server.dstore_bulkload) {
     } config_set_bool_field(
       "use-disk-store", server.use_disk_store) {
     } config_set_bool_field(
@@ -1361,6 +1472,7 @@ void configGetCommand(client *c) {
             server.slowlog_max_len);
     config_get_numerical_field("port",server.port);
     config_get_numerical_field("tcp-backlog",server.tcp_backlog);
+    config_get_numerical_field("io-threads",server.io_threads_num);
     config_get_numerical_field("databases",server.dbnum);
     config_get_numerical_field("repl-ping-slave-period",server.repl_ping_slave_period);
     config_get_numerical_field("repl-timeout",server.repl_timeout);
@@ -1388,6 +1500,8 @@ void configGetCommand(client *c) {
     config_get_bool_field("dump-conccurrency", server.dump_concurrency);
     config_get_numerical_field("dump-thdnr", server.dump_thdnr);
     config_get_numerical_field("dump-thdbuf-size", server.dump_thdbuf_size);
+    config_get_bool_field("dump-segment", server.dump_segment);
+    config_get_bool_field("dump-dstore-raw", server.dump_dstore_raw);
     
     /* disk storage */
     config_get_bool_field("use-disk-store", server.use_disk_store);
@@ -1417,6 +1531,9 @@ void configGetCommand(client *c) {
       
     config_get_numerical_field("dstore-need-loadmem-hz", 
                                server.dstore_need_loadmem_hz); 
+    config_get_bool_field("dstore-bulkload", server.dstore_bulkload);
+    config_get_numerical_field("dstore-bulkload-buf-size", 
+                               server.dstore_bulkload_bufsize);
     config_get_enum_field("disk-store-policy",
             server.dstore_policy, diskstore_policy_enum);     
     config_get_numerical_field("rocksdb-num-levels", server.rocksdboptions.db_num_levels);
@@ -1464,6 +1581,14 @@ void configGetCommand(client *c) {
             server.cluster_require_full_coverage);
     config_get_bool_field("no-appendfsync-on-rewrite",
             server.aof_no_fsync_on_rewrite);
+    config_get_bool_field("io-threads-do-reads",
+            server.io_threads_do_reads);
+    config_get_bool_field("lazyfree-lazy-eviction",
+            server.lazyfree_lazy_eviction);
+    config_get_bool_field("lazyfree-lazy-expire",
+            server.lazyfree_lazy_expire);
+    config_get_bool_field("lazyfree-lazy-server-del",
+            server.lazyfree_lazy_server_del);
     config_get_bool_field("slave-serve-stale-data",
             server.repl_serve_stale_data);
     config_get_bool_field("slave-read-only",
@@ -1474,6 +1599,7 @@ void configGetCommand(client *c) {
     config_get_bool_field("rdbcompression", server.rdb_compression);
     config_get_bool_field("rdbchecksum", server.rdb_checksum);
     config_get_bool_field("activerehashing", server.activerehashing);
+    config_get_bool_field("rehash-while-saving", server.rehash_while_saving);
     config_get_bool_field("protected-mode", server.protected_mode);
     config_get_bool_field("repl-disable-tcp-nodelay",
             server.repl_disable_tcp_nodelay);
@@ -1495,6 +1621,12 @@ void configGetCommand(client *c) {
             server.aof_fsync,aof_fsync_enum);
     config_get_enum_field("syslog-facility",
             server.syslog_facility,syslog_facility_enum);
+    config_get_enum_field("rdbcompression-codec",
+            server.rdb_compression_codec,compression_codec_enum);
+    config_get_enum_field("list-compress-codec",
+            server.list_compress_codec,compression_codec_enum);
+    config_get_enum_field("dstore-compression-codec",
+            server.dstore_compression_codec,compression_codec_enum);
 
     /* Everything we can't handle with macros follows. */
 
@@ -2125,6 +2257,7 @@ int rewriteConfig(char *path) {
     rewriteConfigStringOption(state,"pidfile",server.pidfile,CONFIG_DEFAULT_PID_FILE);
     rewriteConfigNumericalOption(state,"port",server.port,CONFIG_DEFAULT_SERVER_PORT);
     rewriteConfigNumericalOption(state,"tcp-backlog",server.tcp_backlog,CONFIG_DEFAULT_TCP_BACKLOG);
+    rewriteConfigNumericalOption(state,"io-threads",server.io_threads_num,CONFIG_DEFAULT_IO_THREADS_NUM);
     rewriteConfigBindOption(state);
     rewriteConfigStringOption(state,"unixsocket",server.unixsocket,NULL);
     rewriteConfigOctalOption(state,"unixsocketperm",server.unixsocketperm,CONFIG_DEFAULT_UNIX_SOCKET_PERM);
@@ -2140,6 +2273,7 @@ int rewriteConfig(char *path) {
     rewriteConfigNumericalOption(state,"databases",server.dbnum,CONFIG_DEFAULT_DBNUM);
     rewriteConfigYesNoOption(state,"stop-writes-on-bgsave-error",server.stop_writes_on_bgsave_err,CONFIG_DEFAULT_STOP_WRITES_ON_BGSAVE_ERROR);
     rewriteConfigYesNoOption(state,"rdbcompression",server.rdb_compression,CONFIG_DEFAULT_RDB_COMPRESSION);
+    rewriteConfigEnumOption(state,"rdbcompression-codec",server.rdb_compression_codec,compression_codec_enum,CONFIG_DEFAULT_RDB_COMPRESSION_CODEC);
     rewriteConfigYesNoOption(state,"rdbchecksum",server.rdb_checksum,CONFIG_DEFAULT_RDB_CHECKSUM);
     rewriteConfigStringOption(state,"dbfilename",server.rdb_filename,CONFIG_DEFAULT_RDB_FILENAME);
     rewriteConfigDirOption(state);
@@ -2166,6 +2300,9 @@ int rewriteConfig(char *path) {
     rewriteConfigNumericalOption(state, "dump-thdnr", server.dump_thdnr, 1); 
     rewriteConfigNumericalOption(state, "dump-thdbuf-size", 
                                  server.dump_thdbuf_size, DUMP_THDBUF_SIZE);
+    rewriteConfigYesNoOption(state, "dump-segment", server.dump_segment, 0);
+    rewriteConfigYesNoOption(state, "dump-dstore-raw", 
+                        server.dump_dstore_raw, 0);
     
     rewriteConfigYesNoOption(state, "use-disk-store", server.use_disk_store, 0);
     rewriteConfigYesNoOption(state, "write-disk-directly",
@@ -2202,8 +2339,17 @@ int rewriteConfig(char *path) {
                         
     rewriteConfigNumericalOption(state, "dstore-need-loadmem-hz", 
                      server.dstore_need_loadmem_hz, DISK_STORE_NEED_LOADMEM_HZ);               
+    rewriteConfigYesNoOption(state, "dstore-bulkload", 
+                        server.dstore_bulkload, 0);
+    rewriteConfigBytesOption(state, "dstore-bulkload-buf-size", 
+                        server.dstore_bulkload_bufsize, 
+                        DSTORE_BULKLOAD_BUF_SIZE);
     rewriteConfigEnumOption(state, "disk-store-policy", server.dstore_policy,
                         diskstore_policy_enum, DISK_STORE_ALLKEYS_LRU);   
+    rewriteConfigEnumOption(state, "dstore-compression-codec", 
+                        server.dstore_compression_codec, 
+                        compression_codec_enum, 
+                        CONFIG_DEFAULT_DSTORE_COMPRESSION_CODEC);
     rewriteConfigNumericalOption(state, "rocksdb-num-levels", 
               server.rocksdboptions.db_num_levels, ROCKSDB_NUM_LEVELS_DEF);
     rewriteConfigBytesOption(state, "rocksdb-write-buf-size", 
@@ -2269,6 +2415,10 @@ int rewriteConfig(char *path) {
     rewriteConfigStringOption(state,"appendfilename",server.aof_filename,CONFIG_DEFAULT_AOF_FILENAME);
     rewriteConfigEnumOption(state,"appendfsync",server.aof_fsync,aof_fsync_enum,CONFIG_DEFAULT_AOF_FSYNC);
     rewriteConfigYesNoOption(state,"no-appendfsync-on-rewrite",server.aof_no_fsync_on_rewrite,CONFIG_DEFAULT_AOF_NO_FSYNC_ON_REWRITE);
+    rewriteConfigYesNoOption(state,"io-threads-do-reads",server.io_threads_do_reads,CONFIG_DEFAULT_IO_THREADS_DO_READS);
+    rewriteConfigYesNoOption(state,"lazyfree-lazy-eviction",server.lazyfree_lazy_eviction,CONFIG_DEFAULT_LAZYFREE_LAZY_EVICTION);
+    rewriteConfigYesNoOption(state,"lazyfree-lazy-expire",server.lazyfree_lazy_expire,CONFIG_DEFAULT_LAZYFREE_LAZY_EXPIRE);
+    rewriteConfigYesNoOption(state,"lazyfree-lazy-server-del",server.lazyfree_lazy_server_del,CONFIG_DEFAULT_LAZYFREE_LAZY_SERVER_DEL);
     rewriteConfigNumericalOption(state,"auto-aof-rewrite-percentage",server.aof_rewrite_perc,AOF_REWRITE_PERC);
     rewriteConfigBytesOption(state,"auto-aof-rewrite-min-size",server.aof_rewrite_min_size,AOF_REWRITE_MIN_SIZE);
     rewriteConfigNumericalOption(state,"lua-time-limit",server.lua_time_limit,LUA_SCRIPT_TIME_LIMIT);
@@ -2286,11 +2436,13 @@ int rewriteConfig(char *path) {
     rewriteConfigNumericalOption(state,"hash-max-ziplist-value",server.hash_max_ziplist_value,OBJ_HASH_MAX_ZIPLIST_VALUE);
     rewriteConfigNumericalOption(state,"list-max-ziplist-size",server.list_max_ziplist_size,OBJ_LIST_MAX_ZIPLIST_SIZE);
     rewriteConfigNumericalOption(state,"list-compress-depth",server.list_compress_depth,OBJ_LIST_COMPRESS_DEPTH);
+    rewriteConfigEnumOption(state,"list-compress-codec",server.list_compress_codec,compression_codec_enum,CONFIG_DEFAULT_LIST_COMPRESS_CODEC);
     rewriteConfigNumericalOption(state,"set-max-intset-entries",server.set_max_intset_entries,OBJ_SET_MAX_INTSET_ENTRIES);
     rewriteConfigNumericalOption(state,"zset-max-ziplist-entries",server.zset_max_ziplist_entries,OBJ_ZSET_MAX_ZIPLIST_ENTRIES);
     rewriteConfigNumericalOption(state,"zset-max-ziplist-value",server.zset_max_ziplist_value,OBJ_ZSET_MAX_ZIPLIST_VALUE);
     rewriteConfigNumericalOption(state,"hll-sparse-max-bytes",server.hll_sparse_max_bytes,CONFIG_DEFAULT_HLL_SPARSE_MAX_BYTES);
     rewriteConfigYesNoOption(state,"activerehashing",server.activerehashing,CONFIG_DEFAULT_ACTIVE_REHASHING);
+    rewriteConfigYesNoOption(state,"rehash-while-saving",server.rehash_while_saving,CONFIG_DEFAULT_REHASH_WHILE_SAVING);
     rewriteConfigYesNoOption(state,"protected-mode",server.protected_mode,CONFIG_DEFAULT_PROTECTED_MODE);
     rewriteConfigClientoutputbufferlimitOption(state);
     rewriteConfigNumericalOption(state,"hz",server.hz,CONFIG_DEFAULT_HZ);
@@ -222,6 +222,38 @@ robj *lookupKeyWriteOrReply(client *c, robj *key, robj *reply) {
     return o;
 }
 
+/* Warm up the keys a run of pipelined commands is about to access: the
+ * value objects of the keys in memory are prefetched in the CPU caches,
+ * and when 'loadcold' is true the values stored on disk are loaded with
+ * a single rocksdb MultiGet instead of a read per command.
+ *
+ * This is just a hint, lookupKey() works the same whatever happened here. */
+void dbPrefetchKeys(redisDb *db, sds *keys, int numkeys, int loadcold) {
+    dictEntry *des[PROTO_PIPELINE_PREFETCH_MAX];
+    dictEntry *ondisk[PROTO_PIPELINE_PREFETCH_MAX];
+    int j, k, numondisk = 0;
+
+    dictFindMany(db->dict,(void**)keys,des,numkeys);
+    for (j = 0; j < numkeys; j++) {
+        dictEntry *de = des[j];
+
+        if (de == NULL) continue;
+        if (!dictIsEntryValOnDisk(de)) {
+            if (dictGetVal(de)) dictPrefetch(dictGetVal(de));
+            continue;
+        }
+        if (!loadcold || numondisk == PROTO_PIPELINE_PREFETCH_MAX) continue;
+
+        /* The same key may be accessed more than once in the run. */
+        for (k = 0; k < numondisk; k++)
+            if (ondisk[k] == de) break;
+        if (k == numondisk) ondisk[numondisk++] = de;
+    }
+
+    /* A single read is left to lookupKey(). */
+    if (numondisk > 1) loadObjectsFromDisk(db,ondisk,numondisk);
+}
+
 /* Add the key to the DB. It's up to the caller to increment the reference
  * counter of the value if needed.
  *
@@ -236,7 +268,7 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
     }
     
     if (server.cluster_enabled) {
-        slotToKeyAdd(key);
+        slotToKeyAdd(copy);
     }
  }
 
@@ -247,11 +279,18 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
  * The program is aborted if the key was not already present. */
 void dbOverwrite(redisDb *db, robj *key, robj *val) {
     dictEntry *de = dictFind(db->dict,key->ptr);
+    robj *old = NULL;
 
     serverAssertWithInfo(NULL,key,de != NULL);   
+    if (server.lazyfree_lazy_server_del && !dictIsEntryValOnDisk(de)) {
+        /* Detach the old value so that dictReplace() leaves it to us. */
+        old = dictGetVal(de);
+        dictSetVal(db->dict, de, NULL);
+    }
     dictSetEntryValType(de, val->type);    
     dictReplace(db->dict, key->ptr, val);
 	dictSetEntryValNotOnDisk(de);
+    if (old) freeObjAsync(old);
 }
 
 /* High level Set operation. This function can be used in order to set
@@ -344,7 +383,7 @@ robj *dbRandomKey(redisDb *db) {
 }
 
 /* Delete a key, value, and associated expiration entry if any, from the DB */
-int dbDelete(redisDb *db, robj *key) {
+int dbSyncDelete(redisDb *db, robj *key) {
     int rc = C_OK;
     
     /* Deleting an entry from the expires dict will not free the sds of
@@ -353,18 +392,26 @@ int dbDelete(redisDb *db, robj *key) {
         dictDelete(db->expires, key->ptr);
     }
 
+    /* The slot to key map shares the sds of the key, drop it first. */
+    if (server.cluster_enabled) {
+        slotToKeyDel(key->ptr);
+    }
+
     rc = dictDeleteMemAndDisk(db, key->ptr);
     //rc = dictDelete(db->dict, key->ptr);
     if (rc != DICT_OK) {
         return 0;
     }
-    
-    if (server.cluster_enabled) {
-        slotToKeyDel(key);
-    }
     return 1;
 }
 
+/* This is a wrapper whose behavior depends on the Redis lazy free
+ * configuration. Deletes the key synchronously or asynchronously. */
+int dbDelete(redisDb *db, robj *key) {
+    return server.lazyfree_lazy_server_del ? dbAsyncDelete(db,key) :
+                                             dbSyncDelete(db,key);
+}
+
 /* Prepare the string object stored at 'key' to be modified destructively
  * to implement commands like SETBIT or APPEND.
  *
@@ -404,10 +451,20 @@ robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o) {
 }
 
 long long emptyDb(void(callback)(void*)) {
+    return emptyDbWithFlags(EMPTYDB_NO_FLAGS,callback);
+}
+
+/* Remove all keys from all the databases. With EMPTYDB_ASYNC the memory
+ * is reclaimed by the lazy free thread, see emptyDbAsync(). */
+long long emptyDbWithFlags(int flags, void(callback)(void*)) {
     int j;
     long long removed = 0;
 
     for (j = 0; j < server.dbnum; j++) {
+        if (flags & EMPTYDB_ASYNC) {
+            removed += emptyDbAsync(&server.db[j]);
+            continue;
+        }
         removed += dictSize(server.db[j].dict);
         dictEmpty(server.db[j].dict,callback);
         dictEmpty(server.db[j].expires,callback);
@@ -441,29 +498,70 @@ redisDb *getDbByIdx(int id) {
 
 void signalModifiedKey(redisDb *db, robj *key) {
     touchWatchedKey(db,key);
+    trackingInvalidateKey(key);
+    if (server.cluster_enabled) clusterSlotMigrationKeyModified(key);
 }
 
 void signalFlushedDb(int dbid) {
     touchWatchedKeysOnFlush(dbid);
+    trackingInvalidateKeysOnFlush(dbid);
 }
 
 /*-----------------------------------------------------------------------------
  * Type agnostic commands operating on the key space
  *----------------------------------------------------------------------------*/
 
+/* Return the set of flags to use for the emptyDbWithFlags() call for
+ * FLUSHALL and FLUSHDB commands.
+ *
+ * Currently the command just attempts to parse the "ASYNC" option. It
+ * also checks if the command arity is wrong.
+ *
+ * On success C_OK is returned and the flags are stored in *flags, otherwise
+ * C_ERR is returned and the function sends an error to the client. */
+int getFlushCommandFlags(client *c, int *flags) {
+    /* Parse the optional ASYNC option. */
+    if (c->argc > 1) {
+        if (c->argc > 2 || strcasecmp(c->argv[1]->ptr,"async")) {
+            addReply(c,shared.syntaxerr);
+            return C_ERR;
+        }
+        *flags = EMPTYDB_ASYNC;
+    } else {
+        *flags = EMPTYDB_NO_FLAGS;
+    }
+    return C_OK;
+}
+
+/* FLUSHDB [ASYNC]
+ *
+ * Flushes the currently SELECTed Redis DB. */
 void flushdbCommand(client *c) {
-    server.dirty += dictSize(c->db->dict);
+    int flags;
+
+    if (getFlushCommandFlags(c,&flags) == C_ERR) return;
     signalFlushedDb(c->db->id);
-    dictEmpty(c->db->dict,NULL);
-    dictEmpty(c->db->expires,NULL);
-    realtimeExpireDescEmpty(c->db);
+    if (flags & EMPTYDB_ASYNC) {
+        server.dirty += emptyDbAsync(c->db);
+    } else {
+        server.dirty += dictSize(c->db->dict);
+        dictEmpty(c->db->dict,NULL);
+        dictEmpty(c->db->expires,NULL);
+        realtimeExpireDescEmpty(c->db);
+    }
     if (server.cluster_enabled) slotToKeyFlush();
     addReply(c,shared.ok);
 }
 
+/* FLUSHALL [ASYNC]
+ *
+ * Flushes the whole server data set. */
 void flushallCommand(client *c) {
+    int flags;
+
+    if (getFlushCommandFlags(c,&flags) == C_ERR) return;
     signalFlushedDb(-1);
-    server.dirty += emptyDb(NULL);
+    server.dirty += emptyDbWithFlags(flags,NULL);
     addReply(c,shared.ok);
     if (server.rdb_child_pid != -1) {
         kill(server.rdb_child_pid,SIGUSR1);
@@ -479,8 +577,9 @@ void flushallCommand(client *c) {
     server.dirty++;
 }
 
-void delCommand(client *c) {
-    int deleted = 0;
+/* This command implements DEL and UNLINK. */
+void delGenericCommand(client *c, int lazy) {
+    int deleted = 0, numdel = 0;
     char *a = NULL;
     int j = 1;
     int delrealexp = 0;
@@ -504,15 +603,25 @@ void delCommand(client *c) {
             }
         }
         
-        if (dbDelete(c->db,c->argv[j])) {
+        deleted = lazy ? dbAsyncDelete(c->db,c->argv[j]) :
+                         dbSyncDelete(c->db,c->argv[j]);
+        if (deleted) {
             signalModifiedKey(c->db,c->argv[j]);
             notifyKeyspaceEvent(NOTIFY_GENERIC,
                 "del",c->argv[j],c->db->id);
             server.dirty++;
-            deleted++;
+            numdel++;
         }
     }
-    addReplyLongLong(c,deleted);
+    addReplyLongLong(c,numdel);
+}
+
+void delCommand(client *c) {
+    delGenericCommand(c,0);
+}
+
+void unlinkCommand(client *c) {
+    delGenericCommand(c,1);
 }
 
 /* EXISTS key1 key2 ... key_N.
@@ -607,7 +716,7 @@ void scanCallback(void *privdata, const dictEntry *de) {
     } else if (o->type == OBJ_ZSET) {
         key = dictGetKey(de);
         incrRefCount(key);
-        val = createStringObjectFromLongDouble(*(double*)dictGetVal(de),0);
+        val = createStringObjectFromLongDouble(dictGetDoubleVal(de),0);
     } else {
         serverPanic("Type not handled in SCAN callback.");
     }
@@ -1145,24 +1254,20 @@ void realtimeZslDisplay(zskiplist *zsl) {
     serverLog(LL_WARNING, "==========================================================");
 }
 
-sds createRealtimeExpireDescObj(int dbid, robj *key, long long expire_time)
+/* 'key' is the key sds of the main dict, the timer refers to it and is
+ * released together with the expire of the key. */
+sds createRealtimeExpireDescObj(int dbid, sds key, long long expire_time)
 {
     expireExtDesc expdesc;
-    zskiplistNode *znode = NULL;   
     redisDb *db = NULL;
 
     db = getDbByIdx(dbid);
-    znode = zslInsert(db->expireskiplist, (double)expire_time, key);
-    serverAssert(znode != NULL);
     serverLog(LL_DEBUG, "INSERT KEY %s WITH EXPIRE TIME %lld", 
-              (char *)key->ptr, expire_time);
-    incrRefCount(key);
-    //realtimeZslDisplay(db->expireskiplist);
+              key, expire_time);
     
     expdesc.needdel_realtime = OBJ_NEED_EXPIRE_REAL_TIME;
     expdesc.dbid = (unsigned int)dbid;
-    incrRefCount(key);
-    expdesc.obj = key;
+    expdesc.twnode = twAdd(db->expirewheel, expire_time, key);
     expdesc.expire_time = expire_time;
 
     return sdsnewlen(&expdesc, sizeof(expdesc));    
@@ -1189,7 +1294,8 @@ void setExpire(redisDb *db, robj *key, long long when) {
     serverAssertWithInfo(NULL, key, kde != NULL);
 
     if (hasRealtimedelFlag(key)) {
-        expiredescobj = createRealtimeExpireDescObj(db->id, key, when);
+        expiredescobj = createRealtimeExpireDescObj(db->id, 
+                                                    dictGetKey(kde), when);
     } else {
         expiredescobj = createExpireDescObj(when);
     }
@@ -1403,7 +1509,9 @@ int expireIfNeeded(redisDb *db, robj *key) {
     server.stat_expiredkeys++;
     propagateExpire(db,key);
     notifyKeyspaceEvent(NOTIFY_EXPIRED, "expired",key,db->id);
-    return dbDelete(db,key);
+    trackingInvalidateKey(key);
+    return server.lazyfree_lazy_expire ? dbAsyncDelete(db,key) :
+                                         dbSyncDelete(db,key);
 }
 
 /*-----------------------------------------------------------------------------
@@ -1801,88 +1909,90 @@ int *migrateGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkey
 
 /* Slot to Key API. This is used by Redis Cluster in order to obtain in
  * a fast way a key that belongs to a specified hash slot. This is useful
- * while rehashing the cluster. */
-void slotToKeyAdd(robj *key) {
-    unsigned int hashslot = keyHashSlot(key->ptr,sdslen(key->ptr));
+ * while rehashing the cluster.
+ *
+ * Every slot has its own set of keys, a dict sharing the sds keys of the
+ * db->dict entries, so keys must be removed from it before being freed. */
+void slotToKeyAdd(sds key) {
+    unsigned int hashslot = keyHashSlot(key,sdslen(key));
+    dict **d = &server.cluster->slots_to_keys[hashslot];
 
-    zslInsert(server.cluster->slots_to_keys,hashslot,key);
-    incrRefCount(key);
+    if (*d == NULL) *d = dictCreate(&slotToKeyDictType,NULL);
+    dictAdd(*d,key,NULL);
 }
 
-void slotToKeyDel(robj *key) {
-    unsigned int hashslot = keyHashSlot(key->ptr,sdslen(key->ptr));
+void slotToKeyDel(sds key) {
+    unsigned int hashslot = keyHashSlot(key,sdslen(key));
+    dict *d = server.cluster->slots_to_keys[hashslot];
 
-    zslDelete(server.cluster->slots_to_keys,hashslot,key);
+    if (d == NULL || dictDelete(d,key) != DICT_OK) return;
+    if (d->iterators) return; /* See delKeysInSlot(). */
+    if (dictSize(d) == 0) {
+        dictRelease(d);
+        server.cluster->slots_to_keys[hashslot] = NULL;
+    } else if (htNeedsResize(d)) {
+        dictResize(d);
+    }
 }
 
 void slotToKeyFlush(void) {
-    zslFree(server.cluster->slots_to_keys);
-    server.cluster->slots_to_keys = zslCreate();
+    int j;
+
+    for (j = 0; j < CLUSTER_SLOTS; j++) {
+        if (server.cluster->slots_to_keys[j]) {
+            dictRelease(server.cluster->slots_to_keys[j]);
+            server.cluster->slots_to_keys[j] = NULL;
+        }
+    }
 }
 
-unsigned int getKeysInSlot(unsigned int hashslot, robj **keys, unsigned int count) {
-    zskiplistNode *n;
-    zrangespec range;
+/* Fill 'keys' with up to 'count' keys of the slot. The returned sds strings
+ * are the ones of db->dict, they are valid until the keys are deleted. */
+unsigned int getKeysInSlot(unsigned int hashslot, sds *keys, unsigned int count) {
+    dict *d = server.cluster->slots_to_keys[hashslot];
+    dictIterator *di;
+    dictEntry *de;
     int j = 0;
 
-    range.min = range.max = hashslot;
-    range.minex = range.maxex = 0;
-
-    n = zslFirstInRange(server.cluster->slots_to_keys, &range);
-    while(n && n->score == hashslot && count--) {
-        keys[j++] = n->obj;
-        n = n->level[0].forward;
+    if (d == NULL) return 0;
+    di = dictGetIterator(d);
+    while(count-- && (de = dictNext(di)) != NULL) {
+        keys[j++] = dictGetKey(de);
     }
+    dictReleaseIterator(di);
     return j;
 }
 
 /* Remove all the keys in the specified hash slot.
  * The number of removed items is returned. */
 unsigned int delKeysInSlot(unsigned int hashslot) {
-    zskiplistNode *n;
-    zrangespec range;
+    dict *d = server.cluster->slots_to_keys[hashslot];
+    dictIterator *di;
+    dictEntry *de;
     int j = 0;
 
-    range.min = range.max = hashslot;
-    range.minex = range.maxex = 0;
+    if (d == NULL) return 0;
+    di = dictGetSafeIterator(d);
+    while((de = dictNext(di)) != NULL) {
+        sds sdskey = dictGetKey(de);
+        robj *key = createStringObject(sdskey,sdslen(sdskey));
 
-    n = zslFirstInRange(server.cluster->slots_to_keys, &range);
-    while(n && n->score == hashslot) {
-        robj *key = n->obj;
-        n = n->level[0].forward; /* Go to the next item before freeing it. */
-        incrRefCount(key); /* Protect the object while freeing it. */
         dbDelete(&server.db[0],key);
         decrRefCount(key);
         j++;
     }
+    dictReleaseIterator(di);
+
+    /* slotToKeyDel() can't release nor resize the dict we are iterating. */
+    if (dictSize(d) == 0) {
+        dictRelease(d);
+        server.cluster->slots_to_keys[hashslot] = NULL;
+    }
     return j;
 }
 
 unsigned int countKeysInSlot(unsigned int hashslot) {
-    zskiplist *zsl = server.cluster->slots_to_keys;
-    zskiplistNode *zn;
-    zrangespec range;
-    int rank, count = 0;
-
-    range.min = range.max = hashslot;
-    range.minex = range.maxex = 0;
-
-    /* Find first element in range */
-    zn = zslFirstInRange(zsl, &range);
+    dict *d = server.cluster->slots_to_keys[hashslot];
 
-    /* Use rank of first element, if any, to determine preliminary count */
-    if (zn != NULL) {
-        rank = zslGetRank(zsl, zn->score, zn->obj);
-        count = (zsl->length - (rank - 1));
-
-        /* Find last element in range */
-        zn = zslLastInRange(zsl, &range);
-
-        /* Use rank of last element, if any, to determine the actual count */
-        if (zn != NULL) {
-            rank = zslGetRank(zsl, zn->score, zn->obj);
-            count -= (zsl->length - rank);
-        }
-    }
-    return count;
+    return d ? dictSize(d) : 0;
 }
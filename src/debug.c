@@ -227,9 +227,9 @@ int computeDatasetDigest(unsigned char *final) {
 
                     while((de = dictNext(di)) != NULL) {
                         robj *eleobj = dictGetKey(de);
-                        double *score = dictGetVal(de);
+                        double score = dictGetDoubleVal(de);
 
-                        snprintf(buf,sizeof(buf),"%.17g",*score);
+                        snprintf(buf,sizeof(buf),"%.17g",score);
                         memset(eledigest,0,20);
                         mixObjectDigest(eledigest,eleobj);
                         mixDigest(eledigest,buf,strlen(buf));
@@ -661,7 +661,7 @@ void serverLogObjectDebugInfo(robj *o) {
     } else if (o->type == OBJ_ZSET) {
         serverLog(LL_WARNING,"Sorted set size: %d", (int) zsetLength(o));
         if (o->encoding == OBJ_ENCODING_SKIPLIST)
-            serverLog(LL_WARNING,"Skiplist level: %d", (int) ((zset*)o->ptr)->zsl->level);
+            serverLog(LL_WARNING,"Tree height: %d", (int) ((zset*)o->ptr)->zbt->height);
     }
 }
 
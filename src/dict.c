@@ -61,12 +61,40 @@
 static int dict_can_resize = 1;
 static unsigned int dict_force_resize_ratio = 5;
 
+/* Using dictEnableCopyRehash() / dictDisableCopyRehash() the rehashing
+ * can be switched to a copy-on-write friendly mode while a child is
+ * saving: instead of relinking the entries of the old table into the new
+ * one (which writes the 'next' pointer of every entry and so copies every
+ * page holding an entry), each entry is copied into a freshly allocated
+ * one and the old entry is only read. The old entries are retired in
+ * dict_retired and released by dictFreeRetiredMilliseconds() once the child
+ * is gone. While copy rehashing is enabled tables are allowed to grow at the
+ * usual 1:1 ratio, since neither the new table nor the copies share pages
+ * with the child.
+ *
+ * Note that the retired entries keep their memory until the child exits:
+ * every entry moved during the save exists twice, so a dict fully rehashed
+ * while a child is alive temporarily uses an extra dictEntry per element,
+ * on top of the new table.
+ *
+ * dict_retired is not protected by any lock: threads other than the main
+ * one that build private dicts have to call dictDisableCopyRehashInThread()
+ * first, so their rehashing relinks entries as usual. */
+static int dict_copy_rehash = 0;
+static __thread int dict_thread_no_copy_rehash = 0;
+static dictEntry **dict_retired = NULL;
+static unsigned long dict_retired_len = 0;
+static unsigned long dict_retired_size = 0;
+
 /* -------------------------- private prototypes ---------------------------- */
 
 static int _dictExpandIfNeeded(dict *ht);
 static unsigned long _dictNextPower(unsigned long size);
 static int _dictKeyIndex(dict *ht, const void *key);
 static int _dictInit(dict *ht, dictType *type, void *privDataPtr);
+static dictEntry *_dictCopyRetireEntry(dictEntry *de);
+
+#define _dictCopyRehashing() (dict_copy_rehash && !dict_thread_no_copy_rehash)
 
 /* -------------------------- hash functions -------------------------------- */
 
@@ -267,6 +295,7 @@ int dictRehash(dict *d, int n) {
             nextde = de->next;
             /* Get the index in the new hash table */
             h = dictHashKey(d, de->key) & d->ht[1].sizemask;
+            if (_dictCopyRehashing()) de = _dictCopyRetireEntry(de);
             de->next = d->ht[1].table[h];
             d->ht[1].table[h] = de;
             d->ht[0].used--;
@@ -309,6 +338,44 @@ int dictRehashMilliseconds(dict *d, int ms) {
     return rehashes;
 }
 
+/* Return a copy of 'de' for the copy-on-write friendly rehashing, adding
+ * the original entry to the retired ones. The original is only read. */
+static dictEntry *_dictCopyRetireEntry(dictEntry *de) {
+    dictEntry *copy = zmalloc(sizeof(*copy));
+
+    *copy = *de;
+    if (dict_retired_len == dict_retired_size) {
+        dict_retired_size = dict_retired_size ? dict_retired_size*2 : 1024;
+        dict_retired = zrealloc(dict_retired,
+            sizeof(dictEntry*)*dict_retired_size);
+    }
+    dict_retired[dict_retired_len++] = de;
+    return copy;
+}
+
+/* Free the entries retired by the copy rehashing for about 'ms'
+ * milliseconds. Must not be called while copy rehashing is enabled, as the
+ * child may still share the pages of the retired entries. Returns the
+ * number of entries still retired. */
+unsigned long dictFreeRetiredMilliseconds(int ms) {
+    long long start = timeInMilliseconds();
+
+    if (dict_copy_rehash) return dict_retired_len;
+    while(dict_retired_len) {
+        int j;
+
+        for (j = 0; j < 1000 && dict_retired_len; j++)
+            zfree(dict_retired[--dict_retired_len]);
+        if (timeInMilliseconds()-start > ms) break;
+    }
+    if (dict_retired_len == 0 && dict_retired) {
+        zfree(dict_retired);
+        dict_retired = NULL;
+        dict_retired_size = 0;
+    }
+    return dict_retired_len;
+}
+
 /* This function performs just a step of rehashing, and only if there are
  * no safe iterators bound to our hash table. When we have iterators in the
  * middle of a rehashing we can't mess with the two hash tables otherwise
@@ -572,6 +639,83 @@ dictEntry *dictFind(dict *d, const void *key)
     return NULL;
 }
 
+/* Lookup 'count' keys at once, storing in des[j] the entry of keys[j], or
+ * NULL if the key is not found.
+ *
+ * A dictFind() is a chain of dependent loads: the table slot, the entry,
+ * the key of the entry, each one usually a cache miss in a big dictionary.
+ * Here the keys are processed in batches going through the same steps in
+ * stages: all the hashes are computed and their table slots prefetched,
+ * then the entries the slots point to are prefetched, then their keys,
+ * and only at the end the chains are walked, so that the memory accesses
+ * of the different keys overlap instead of adding up. */
+void dictFindMany(dict *d, void **keys, dictEntry **des, unsigned int count)
+{
+    unsigned int h[DICT_FINDMANY_BATCH];
+    unsigned int j, base, n, table;
+    dictEntry *he;
+
+    /* Do the rehashing work dictFind() would do. */
+    for (j = 0; j < count && dictIsRehashing(d); j++) _dictRehashStep(d);
+
+    for (base = 0; base < count; base += n) {
+        n = count-base;
+        if (n > DICT_FINDMANY_BATCH) n = DICT_FINDMANY_BATCH;
+
+        if (d->ht[0].used + d->ht[1].used == 0) { /* dict is empty */
+            for (j = 0; j < n; j++) des[base+j] = NULL;
+            continue;
+        }
+
+        /* Stage 1: hash the keys and prefetch the table slots. */
+        for (j = 0; j < n; j++) {
+            h[j] = dictHashKey(d, keys[base+j]);
+            for (table = 0; table <= 1; table++) {
+                dictPrefetch(&d->ht[table].table[h[j] & d->ht[table].sizemask]);
+                if (!dictIsRehashing(d)) break;
+            }
+        }
+
+        /* Stage 2: prefetch the first entry of every chain. */
+        for (j = 0; j < n; j++) {
+            for (table = 0; table <= 1; table++) {
+                he = d->ht[table].table[h[j] & d->ht[table].sizemask];
+                if (he) dictPrefetch(he);
+                if (!dictIsRehashing(d)) break;
+            }
+        }
+
+        /* Stage 3: prefetch the keys of the entries. */
+        for (j = 0; j < n; j++) {
+            for (table = 0; table <= 1; table++) {
+                he = d->ht[table].table[h[j] & d->ht[table].sizemask];
+                if (he) dictPrefetch(he->key);
+                if (!dictIsRehashing(d)) break;
+            }
+        }
+
+        /* Stage 4: walk the chains, now mostly in the cache. */
+        for (j = 0; j < n; j++) {
+            void *key = keys[base+j];
+
+            des[base+j] = NULL;
+            for (table = 0; table <= 1; table++) {
+                he = d->ht[table].table[h[j] & d->ht[table].sizemask];
+                while(he) {
+                    if (key==he->key || dictCompareKeys(d, key, he->key))
+                        break;
+                    he = he->next;
+                }
+                if (he) {
+                    des[base+j] = he;
+                    break;
+                }
+                if (!dictIsRehashing(d)) break;
+            }
+        }
+    }
+}
+
 void *dictFetchRawValue(dict *d, const void *key)
 {
     dictEntry *he = NULL;
@@ -685,6 +829,10 @@ dictEntry *dictNext(dictIterator *iter)
                 }
             }
             iter->entry = ht->table[iter->index];
+
+            /* The chain of the next slot is the next to be visited. */
+            if (iter->index+1 < (long) ht->size && ht->table[iter->index+1])
+                dictPrefetch(ht->table[iter->index+1]);
         } else {
             iter->entry = iter->nextEntry;
         }
@@ -816,6 +964,10 @@ unsigned int dictGetSomeKeysWithDstoreCheck(dict *d,
                 }
             } else {
                 emptylen = 0;
+
+                /* The chain of the next slot is likely the next visited. */
+                if (i+1 < d->ht[j].size && d->ht[j].table[i+1])
+                    dictPrefetch(d->ht[j].table[i+1]);
                 while (he) {
                     if (dstore_check) {
                         if (dictIsEntryValOnDisk(he)) {
@@ -1050,7 +1202,7 @@ static int _dictExpandIfNeeded(dict *d)
      * elements/buckets is over the "safe" threshold, we resize doubling
      * the number of buckets. */
     if (d->ht[0].used >= d->ht[0].size &&
-        (dict_can_resize ||
+        (dict_can_resize || _dictCopyRehashing() ||
          d->ht[0].used/d->ht[0].size > dict_force_resize_ratio))
     {
         return dictExpand(d, d->ht[0].used*2);
@@ -1117,6 +1269,19 @@ void dictDisableResize(void) {
     dict_can_resize = 0;
 }
 
+void dictEnableCopyRehash(void) {
+    dict_copy_rehash = 1;
+}
+
+void dictDisableCopyRehash(void) {
+    dict_copy_rehash = 0;
+}
+
+/* Opt the calling thread out of copy rehashing. */
+void dictDisableCopyRehashInThread(void) {
+    dict_thread_no_copy_rehash = 1;
+}
+
 /* ------------------------------- Debugging ---------------------------------*/
 
 #define DICT_STATS_VECTLEN 50
@@ -107,6 +107,16 @@ typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 /* This is the initial size of every hash table */
 #define DICT_HT_INITIAL_SIZE     4
 
+/* Keys looked up together by every stage of dictFindMany() */
+#define DICT_FINDMANY_BATCH      16
+
+/* Hint the CPU to load the memory at 'addr' in the cache. */
+#if defined(__GNUC__)
+#define dictPrefetch(addr) __builtin_prefetch(addr)
+#else
+#define dictPrefetch(addr) ((void)(addr))
+#endif
+
 /* ------------------------------- Macros ------------------------------------*/
 void dictFreeVal(dict *d, dictEntry *entry);
 void dictSetVal(dict *d, dictEntry *entry, void *val);
@@ -157,6 +167,7 @@ int dictDelete(dict *d, const void *key);
 int dictDeleteNoFree(dict *d, const void *key);
 void dictRelease(dict *d);
 dictEntry * dictFind(dict *d, const void *key);
+void dictFindMany(dict *d, void **keys, dictEntry **des, unsigned int count);
 //void *dictFetchValue(redisDb *db, dict *d, const void *key);
 void *dictFetchRawValue(dict *d, const void *key);
 int dictResize(dict *d);
@@ -176,6 +187,10 @@ unsigned int dictGenCaseHashFunction(const unsigned char *buf, int len);
 void dictEmpty(dict *d, void(callback)(void*));
 void dictEnableResize(void);
 void dictDisableResize(void);
+void dictEnableCopyRehash(void);
+void dictDisableCopyRehash(void);
+void dictDisableCopyRehashInThread(void);
+unsigned long dictFreeRetiredMilliseconds(int ms);
 int dictRehash(dict *d, int n);
 int dictRehashMilliseconds(dict *d, int ms);
 void dictSetHashFunctionSeed(unsigned int initval);
@@ -31,12 +31,18 @@
 #include "geo.h"
 #include "geohash_helper.h"
 #include "debugmacro.h"
+#include "pqsort.h" /* Partial qsort for GEORADIUS+COUNT */
 
 /* Things exported from t_zset.c only for geo.c, since it is the only other
  * part of Redis that requires close zset introspection. */
 unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec *range);
 int zslValueLteMax(double value, zrangespec *spec);
 
+/* Exported by geohash_helper.c, we need the same constant to compute the
+ * same distances. */
+extern const double EARTH_RADIUS_IN_METERS;
+#define GEO_D_R (M_PI / 180.0)
+
 /* ====================================================================
  * This file implements the following commands:
  *
@@ -182,52 +188,84 @@ void addReplyDoubleDistance(client *c, double d) {
     addReplyBulkCBuffer(c, dbuf, dlen);
 }
 
+/* Initialize the search 'gs' for the points within 'radius' meters from
+ * the point 'lon', 'lat'. */
+void geoSearchInit(geoSearch *gs, double lon, double lat, double radius) {
+    gs->longitude = lon;
+    gs->latitude = lat;
+    gs->radius = radius;
+    gs->lon_rad = lon * GEO_D_R;
+    gs->lat_rad = lat * GEO_D_R;
+    gs->cos_lat = cos(gs->lat_rad);
+    /* The distance between two points is never smaller than the distance
+     * along the meridian, that is, the latitude difference multiplied by
+     * the earth radius. A small margin protects against rounding. */
+    gs->max_dlat = radius / EARTH_RADIUS_IN_METERS + 1e-9;
+}
+
+/* Return 1 and set '*distance' if the point 'lon', 'lat' is within the
+ * radius of the search 'gs', otherwise 0 is returned.
+ *
+ * The distance is computed exactly like geohashGetDistance() does, so the
+ * reported distances are the same, but the terms only depending on the
+ * center are computed once per search, and the points too far in latitude
+ * are rejected without any trigonometry. */
+int geoSearchDistanceIfInRadius(geoSearch *gs, double lon, double lat,
+                                double *distance)
+{
+    double lat2r = lat * GEO_D_R, lon2r = lon * GEO_D_R, u, v;
+
+    if (fabs(lat2r - gs->lat_rad) > gs->max_dlat) return 0;
+    u = sin((lat2r - gs->lat_rad) / 2);
+    v = sin((lon2r - gs->lon_rad) / 2);
+    *distance = 2.0 * EARTH_RADIUS_IN_METERS *
+                asin(sqrt(u * u + gs->cos_lat * cos(lat2r) * v * v));
+    if (*distance > gs->radius) return 0;
+    return 1;
+}
+
 /* Helper function for geoGetPointsInRange(): given a sorted set score
- * representing a point, and another point (the center of our search) and
- * a radius, appends this entry as a geoPoint into the specified geoArray
- * only if the point is within the search area.
+ * representing a point, and a search 'gs' with the center and the radius,
+ * appends this entry as a geoPoint into the specified geoArray only if the
+ * point is within the search area.
  *
- * returns C_OK if the point is included, or REIDS_ERR if it is outside. */
-int geoAppendIfWithinRadius(geoArray *ga, double lon, double lat, double radius, double score, sds member) {
+ * The appended point is returned with a NULL member, so that the caller
+ * only creates the member string of the points actually included.
+ * If the point is outside the search area NULL is returned. */
+geoPoint *geoAppendIfWithinRadius(geoArray *ga, geoSearch *gs, double score) {
     double distance, xy[2];
 
-    if (!decodeGeohash(score,xy)) return C_ERR; /* Can't decode. */
-    /* Note that geohashGetDistanceIfInRadiusWGS84() takes arguments in
-     * reverse order: longitude first, latitude later. */
-    if (!geohashGetDistanceIfInRadiusWGS84(lon,lat, xy[0], xy[1],
-                                           radius, &distance))
-    {
-        return C_ERR;
-    }
+    if (!decodeGeohash(score,xy)) return NULL; /* Can't decode. */
+    if (!geoSearchDistanceIfInRadius(gs,xy[0],xy[1],&distance)) return NULL;
 
     /* Append the new element. */
     geoPoint *gp = geoArrayAppend(ga);
     gp->longitude = xy[0];
     gp->latitude = xy[1];
     gp->dist = distance;
-    gp->member = member;
+    gp->member = NULL;
     gp->score = score;
-    return C_OK;
+    return gp;
 }
 
 /* Query a Redis sorted set to extract all the elements between 'min' and
  * 'max', appending them into the array of geoPoint structures 'gparray'.
  * The command returns the number of elements added to the array.
  *
- * Elements which are farest than 'radius' from the specified 'x' and 'y'
- * coordinates are not included.
+ * Elements which are farest than the radius of the search 'gs' from its
+ * center are not included.
  *
  * The ability of this function to append to an existing set of points is
  * important for good performances because querying by radius is performed
  * using multiple queries to the sorted set, that we later need to sort
  * via qsort. Similarly we need to be able to reject points outside the search
  * radius area ASAP in order to allocate and process more points than needed. */
-int geoGetPointsInRange(robj *zobj, double min, double max, double lon, double lat, double radius, geoArray *ga) {
+int geoGetPointsInRange(robj *zobj, double min, double max, geoSearch *gs, geoArray *ga) {
     /* minex 0 = include min in range; maxex 1 = exclude max in range */
     /* That's: min <= val < max */
     zrangespec range = { .min = min, .max = max, .minex = 0, .maxex = 1 };
     size_t origincount = ga->used;
-    sds member;
+    geoPoint *gp;
 
     if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
         unsigned char *zl = zobj->ptr;
@@ -250,36 +288,37 @@ int geoGetPointsInRange(robj *zobj, double min, double max, double lon, double l
             if (!zslValueLteMax(score, &range))
                 break;
 
-            /* We know the element exists. ziplistGet should always succeed */
-            ziplistGet(eptr, &vstr, &vlen, &vlong);
-            member = (vstr == NULL) ? sdsfromlonglong(vlong) :
-                                      sdsnewlen(vstr,vlen);
-            if (geoAppendIfWithinRadius(ga,lon,lat,radius,score,member)
-                == C_ERR) sdsfree(member);
+            if ((gp = geoAppendIfWithinRadius(ga,gs,score)) != NULL) {
+                /* We know the element exists. ziplistGet should always
+                 * succeed */
+                ziplistGet(eptr, &vstr, &vlen, &vlong);
+                gp->member = (vstr == NULL) ? sdsfromlonglong(vlong) :
+                                              sdsnewlen(vstr,vlen);
+            }
             zzlNext(zl, &eptr, &sptr);
         }
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
-        zskiplist *zsl = zs->zsl;
-        zskiplistNode *ln;
+        zbtCursor ln;
 
-        if ((ln = zslFirstInRange(zsl, &range)) == NULL) {
+        if (!zbtFirstInRange(zs->zbt, &range, &ln)) {
             /* Nothing exists starting at our min.  No results. */
             return 0;
         }
 
-        while (ln) {
-            robj *o = ln->obj;
+        while (ln.leaf) {
+            robj *o = zbtCursorObj(&ln);
+            double score = zbtCursorScore(&ln);
             /* Abort when the node is no longer in range. */
-            if (!zslValueLteMax(ln->score, &range))
+            if (!zslValueLteMax(score, &range))
                 break;
 
-            member = (o->encoding == OBJ_ENCODING_INT) ?
-                        sdsfromlonglong((long)o->ptr) :
-                        sdsdup(o->ptr);
-            if (geoAppendIfWithinRadius(ga,lon,lat,radius,ln->score,member)
-                == C_ERR) sdsfree(member);
-            ln = ln->level[0].forward;
+            if ((gp = geoAppendIfWithinRadius(ga,gs,score)) != NULL) {
+                gp->member = (o->encoding == OBJ_ENCODING_INT) ?
+                                sdsfromlonglong((long)o->ptr) :
+                                sdsdup(o->ptr);
+            }
+            zbtNext(&ln);
         }
     }
     return ga->used - origincount;
@@ -314,20 +353,18 @@ void scoresOfGeoHashBox(GeoHashBits hash, GeoHashFix52Bits *min, GeoHashFix52Bit
     *max = geohashAlign52Bits(hash);
 }
 
-/* Obtain all members between the min/max of this geohash bounding box.
- * Populate a geoArray of GeoPoints by calling geoGetPointsInRange().
- * Return the number of points added to the array. */
-int membersOfGeoHashBox(robj *zobj, GeoHashBits hash, geoArray *ga, double lon, double lat, double radius) {
-    GeoHashFix52Bits min, max;
-
-    scoresOfGeoHashBox(hash,&min,&max);
-    return geoGetPointsInRange(zobj, min, max, lon, lat, radius, ga);
-}
-
-/* Search all eight neighbors + self geohash box */
-int membersOfAllNeighbors(robj *zobj, GeoHashRadius n, double lon, double lat, double radius, geoArray *ga) {
+/* Search all eight neighbors + self geohash box.
+ *
+ * The score ranges of the boxes are sorted and the ones overlapping or
+ * adjacent are merged, so that every merged range is scanned once. Boxes
+ * that are next to each other in the geohash order become a single range
+ * scan, and when a huge radius (in the 5000 km range or more) is used,
+ * neighbors that are the same box, or that contain each other, can't
+ * produce duplicated elements. */
+int membersOfAllNeighbors(robj *zobj, GeoHashRadius n, geoSearch *gs, geoArray *ga) {
     GeoHashBits neighbors[9];
-    unsigned int i, count = 0, last_processed = 0;
+    GeoHashFix52Bits min[9], max[9];
+    unsigned int i, j, ranges = 0, count = 0;
     int debugmsg = 0;
 
     neighbors[0] = n.hash;
@@ -340,9 +377,12 @@ int membersOfAllNeighbors(robj *zobj, GeoHashRadius n, double lon, double lat, d
     neighbors[7] = n.neighbors.south_east;
     neighbors[8] = n.neighbors.south_west;
 
-    /* For each neighbor (*and* our own hashbox), get all the matching
-     * members and add them to the potential result list. */
+    /* For each neighbor (*and* our own hashbox), compute the range of
+     * scores of the members inside it, keeping the ranges sorted by their
+     * start with an insertion sort, there are at most nine. */
     for (i = 0; i < sizeof(neighbors) / sizeof(*neighbors); i++) {
+        GeoHashFix52Bits bmin, bmax;
+
         if (HASHISZERO(neighbors[i])) {
             if (debugmsg) D("neighbors[%d] is zero",i);
             continue;
@@ -364,20 +404,27 @@ int membersOfAllNeighbors(robj *zobj, GeoHashRadius n, double lon, double lat, d
             D("\n");
         }
 
-        /* When a huge Radius (in the 5000 km range or more) is used,
-         * adjacent neighbors can be the same, leading to duplicated
-         * elements. Skip every range which is the same as the one
-         * processed previously. */
-        if (last_processed &&
-            neighbors[i].bits == neighbors[last_processed].bits &&
-            neighbors[i].step == neighbors[last_processed].step)
-        {
-            if (debugmsg)
-                D("Skipping processing of %d, same as previous\n",i);
-            continue;
+        scoresOfGeoHashBox(neighbors[i],&bmin,&bmax);
+        for (j = ranges; j > 0 && min[j-1] > bmin; j--) {
+            min[j] = min[j-1];
+            max[j] = max[j-1];
         }
-        count += membersOfGeoHashBox(zobj, neighbors[i], ga, lon, lat, radius);
-        last_processed = i;
+        min[j] = bmin;
+        max[j] = bmax;
+        ranges++;
+    }
+
+    /* Merge the ranges and get all the matching members of each one. */
+    for (i = 0; i < ranges; i = j) {
+        GeoHashFix52Bits rmax = max[i];
+
+        for (j = i+1; j < ranges && min[j] <= rmax; j++) {
+            if (max[j] > rmax) rmax = max[j];
+        }
+        if (debugmsg && j-i > 1)
+            D("Merged %u ranges starting at %llu\n", j-i,
+              (unsigned long long) min[i]);
+        count += geoGetPointsInRange(zobj, min[i], rmax, gs, ga);
     }
     return count;
 }
@@ -561,8 +608,10 @@ void georadiusGeneric(client *c, int type) {
         geohashGetAreasByRadiusWGS84(xy[0], xy[1], radius_meters);
 
     /* Search the zset for all matching points */
+    geoSearch gs;
+    geoSearchInit(&gs, xy[0], xy[1], radius_meters);
     geoArray *ga = geoArrayCreate();
-    membersOfAllNeighbors(zobj, georadius, xy[0], xy[1], radius_meters, ga);
+    membersOfAllNeighbors(zobj, georadius, &gs, ga);
 
     /* If no matching results, the user gets an empty reply. */
     if (ga->used == 0 && storekey == NULL) {
@@ -576,11 +625,19 @@ void georadiusGeneric(client *c, int type) {
                           result_length : count;
     long option_length = 0;
 
-    /* Process [optional] requested sorting */
-    if (sort == SORT_ASC) {
-        qsort(ga->array, result_length, sizeof(geoPoint), sort_gp_asc);
-    } else if (sort == SORT_DESC) {
-        qsort(ga->array, result_length, sizeof(geoPoint), sort_gp_desc);
+    /* Process [optional] requested sorting. When only COUNT items out of
+     * many are returned we just need the first COUNT in order, so a partial
+     * sort is used. */
+    if (sort != SORT_NONE) {
+        int (*cmp)(const void *, const void *) =
+            (sort == SORT_ASC) ? sort_gp_asc : sort_gp_desc;
+
+        if (returned_items < result_length) {
+            pqsort(ga->array, result_length, sizeof(geoPoint), cmp,
+                   0, returned_items-1);
+        } else {
+            qsort(ga->array, result_length, sizeof(geoPoint), cmp);
+        }
     }
 
     if (storekey == NULL) {
@@ -643,7 +700,6 @@ void georadiusGeneric(client *c, int type) {
         }
 
         for (i = 0; i < returned_items; i++) {
-            zskiplistNode *znode;
             geoPoint *gp = ga->array+i;
             gp->dist /= conversion; /* Fix according to unit. */
             double score = storedist ? gp->dist : gp->score;
@@ -651,10 +707,7 @@ void georadiusGeneric(client *c, int type) {
             robj *ele = createObject(OBJ_STRING,gp->member);
 
             if (maxelelen < elelen) maxelelen = elelen;
-            incrRefCount(ele); /* Set refcount to 2 since we reference the
-                                  object both in the skiplist and dict. */
-            znode = zslInsert(zs->zsl,score,ele);
-            serverAssert(dictAdd(zs->dict,ele,&znode->score) == DICT_OK);
+            zsetAddElement(zs,ele,score);
             gp->member = NULL;
         }
 
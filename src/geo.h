@@ -19,4 +19,17 @@ typedef struct geoArray {
     size_t used;
 } geoArray;
 
+/* Center and radius of a GEORADIUS search, with the values derived from
+ * them that every candidate point is checked against. */
+typedef struct geoSearch {
+    double longitude;
+    double latitude;
+    double radius;      /* Radius in meters. */
+    double lon_rad;     /* Longitude of the center in radians. */
+    double lat_rad;     /* Latitude of the center in radians. */
+    double cos_lat;     /* cos(lat_rad), the same for every candidate. */
+    double max_dlat;    /* Max latitude difference in radians of a point
+                           within the radius. */
+} geoSearch;
+
 #endif
@@ -497,13 +497,14 @@ int hllDenseAdd(uint8_t *registers, unsigned char *ele, size_t elesize) {
     }
 }
 
-/* Compute SUM(2^-reg) in the dense representation.
- * PE is an array with a pre-computer table of values 2^-reg indexed by reg.
- * As a side effect the integer pointed by 'ezp' is set to the number
- * of zero registers. */
-double hllDenseSum(uint8_t *registers, double *PE, int *ezp) {
-    double E = 0;
-    int j, ez = 0;
+/* Compute the register histogram in the dense representation: reghisto[v]
+ * is incremented for every register holding the value 'v'. The estimator
+ * only needs how many registers have each value, so a single pass over the
+ * packed registers that bumps small integer counters replaces the floating
+ * point accumulation per register, and SUM(2^-reg) is later computed with
+ * just 64 multiplications by hllCount(). */
+void hllDenseRegHisto(uint8_t *registers, int *reghisto) {
+    int j;
 
     /* Redis default is to use 16384 registers 6 bits each. The code works
      * with other values by modifying the defines, but for our target value
@@ -514,29 +515,27 @@ double hllDenseSum(uint8_t *registers, double *PE, int *ezp) {
                       r10, r11, r12, r13, r14, r15;
         for (j = 0; j < 1024; j++) {
             /* Handle 16 registers per iteration. */
-            r0 = r[0] & 63; if (r0 == 0) ez++;
-            r1 = (r[0] >> 6 | r[1] << 2) & 63; if (r1 == 0) ez++;
-            r2 = (r[1] >> 4 | r[2] << 4) & 63; if (r2 == 0) ez++;
-            r3 = (r[2] >> 2) & 63; if (r3 == 0) ez++;
-            r4 = r[3] & 63; if (r4 == 0) ez++;
-            r5 = (r[3] >> 6 | r[4] << 2) & 63; if (r5 == 0) ez++;
-            r6 = (r[4] >> 4 | r[5] << 4) & 63; if (r6 == 0) ez++;
-            r7 = (r[5] >> 2) & 63; if (r7 == 0) ez++;
-            r8 = r[6] & 63; if (r8 == 0) ez++;
-            r9 = (r[6] >> 6 | r[7] << 2) & 63; if (r9 == 0) ez++;
-            r10 = (r[7] >> 4 | r[8] << 4) & 63; if (r10 == 0) ez++;
-            r11 = (r[8] >> 2) & 63; if (r11 == 0) ez++;
-            r12 = r[9] & 63; if (r12 == 0) ez++;
-            r13 = (r[9] >> 6 | r[10] << 2) & 63; if (r13 == 0) ez++;
-            r14 = (r[10] >> 4 | r[11] << 4) & 63; if (r14 == 0) ez++;
-            r15 = (r[11] >> 2) & 63; if (r15 == 0) ez++;
-
-            /* Additional parens will allow the compiler to optimize the
-             * code more with a loss of precision that is not very relevant
-             * here (floating point math is not commutative!). */
-            E += (PE[r0] + PE[r1]) + (PE[r2] + PE[r3]) + (PE[r4] + PE[r5]) +
-                 (PE[r6] + PE[r7]) + (PE[r8] + PE[r9]) + (PE[r10] + PE[r11]) +
-                 (PE[r12] + PE[r13]) + (PE[r14] + PE[r15]);
+            r0 = r[0] & 63;
+            r1 = (r[0] >> 6 | r[1] << 2) & 63;
+            r2 = (r[1] >> 4 | r[2] << 4) & 63;
+            r3 = (r[2] >> 2) & 63;
+            r4 = r[3] & 63;
+            r5 = (r[3] >> 6 | r[4] << 2) & 63;
+            r6 = (r[4] >> 4 | r[5] << 4) & 63;
+            r7 = (r[5] >> 2) & 63;
+            r8 = r[6] & 63;
+            r9 = (r[6] >> 6 | r[7] << 2) & 63;
+            r10 = (r[7] >> 4 | r[8] << 4) & 63;
+            r11 = (r[8] >> 2) & 63;
+            r12 = r[9] & 63;
+            r13 = (r[9] >> 6 | r[10] << 2) & 63;
+            r14 = (r[10] >> 4 | r[11] << 4) & 63;
+            r15 = (r[11] >> 2) & 63;
+
+            reghisto[r0]++; reghisto[r1]++; reghisto[r2]++; reghisto[r3]++;
+            reghisto[r4]++; reghisto[r5]++; reghisto[r6]++; reghisto[r7]++;
+            reghisto[r8]++; reghisto[r9]++; reghisto[r10]++; reghisto[r11]++;
+            reghisto[r12]++; reghisto[r13]++; reghisto[r14]++; reghisto[r15]++;
             r += 12;
         }
     } else {
@@ -544,17 +543,66 @@ double hllDenseSum(uint8_t *registers, double *PE, int *ezp) {
             unsigned long reg;
 
             HLL_DENSE_GET_REGISTER(reg,registers,j);
-            if (reg == 0) {
-                ez++;
-                /* Increment E at the end of the loop. */
-            } else {
-                E += PE[reg]; /* Precomputed 2^(-reg[j]). */
-            }
+            reghisto[reg]++;
+        }
+    }
+}
+
+/* Merge the dense registers 'registers' into the array of HLL_REGISTERS
+ * uint8_t registers 'max', setting max[i] to MAX(max[i],registers[i]).
+ *
+ * Multi-key PFCOUNT and PFMERGE call this once per source key, so the
+ * registers are unpacked four at a time from every group of three bytes
+ * and the max is taken without branches: the loop has no data dependent
+ * control flow and the compiler is free to vectorize it. */
+void hllDenseMerge(uint8_t *max, uint8_t *registers) {
+    int j;
+
+    if (HLL_REGISTERS == 16384 && HLL_BITS == 6) {
+        uint8_t *r = registers, *m = max;
+        uint8_t r0, r1, r2, r3;
+        for (j = 0; j < HLL_REGISTERS/4; j++) {
+            r0 = r[0] & 63;
+            r1 = (r[0] >> 6 | r[1] << 2) & 63;
+            r2 = (r[1] >> 4 | r[2] << 4) & 63;
+            r3 = (r[2] >> 2) & 63;
+            m[0] = r0 > m[0] ? r0 : m[0];
+            m[1] = r1 > m[1] ? r1 : m[1];
+            m[2] = r2 > m[2] ? r2 : m[2];
+            m[3] = r3 > m[3] ? r3 : m[3];
+            r += 3;
+            m += 4;
+        }
+    } else {
+        uint8_t val;
+
+        for (j = 0; j < HLL_REGISTERS; j++) {
+            HLL_DENSE_GET_REGISTER(val,registers,j);
+            if (val > max[j]) max[j] = val;
+        }
+    }
+}
+
+/* Pack the array of HLL_REGISTERS uint8_t registers 'raw' into the dense
+ * representation 'registers', overwriting every register. Used by PFMERGE
+ * to store the merged registers without setting them one by one. */
+void hllDenseFromRaw(uint8_t *registers, uint8_t *raw) {
+    int j;
+
+    if (HLL_REGISTERS == 16384 && HLL_BITS == 6) {
+        uint8_t *r = registers, *m = raw;
+        for (j = 0; j < HLL_REGISTERS/4; j++) {
+            r[0] = m[0] | m[1] << 6;
+            r[1] = m[1] >> 2 | m[2] << 4;
+            r[2] = m[2] >> 4 | m[3] << 2;
+            r += 3;
+            m += 4;
+        }
+    } else {
+        for (j = 0; j < HLL_REGISTERS; j++) {
+            HLL_DENSE_SET_REGISTER(registers,j,raw[j]);
         }
-        E += ez; /* Add 2^0 'ez' times. */
     }
-    *ezp = ez;
-    return E;
 }
 
 /* ================== Sparse representation implementation  ================= */
@@ -881,76 +929,65 @@ promote: /* Promote to dense representation. */
     return dense_retval;
 }
 
-/* Compute SUM(2^-reg) in the sparse representation.
- * PE is an array with a pre-computer table of values 2^-reg indexed by reg.
- * As a side effect the integer pointed by 'ezp' is set to the number
- * of zero registers. */
-double hllSparseSum(uint8_t *sparse, int sparselen, double *PE, int *ezp, int *invalid) {
-    double E = 0;
-    int ez = 0, idx = 0, runlen, regval;
+/* Compute the register histogram in the sparse representation, see
+ * hllDenseRegHisto() for more information. A run of registers with the
+ * same value updates the histogram with a single addition. */
+void hllSparseRegHisto(uint8_t *sparse, int sparselen, int *invalid, int *reghisto) {
+    int idx = 0, runlen, regval;
     uint8_t *end = sparse+sparselen, *p = sparse;
 
     while(p < end) {
         if (HLL_SPARSE_IS_ZERO(p)) {
             runlen = HLL_SPARSE_ZERO_LEN(p);
             idx += runlen;
-            ez += runlen;
-            /* Increment E at the end of the loop. */
+            reghisto[0] += runlen;
             p++;
         } else if (HLL_SPARSE_IS_XZERO(p)) {
             runlen = HLL_SPARSE_XZERO_LEN(p);
             idx += runlen;
-            ez += runlen;
-            /* Increment E at the end of the loop. */
+            reghisto[0] += runlen;
             p += 2;
         } else {
             runlen = HLL_SPARSE_VAL_LEN(p);
             regval = HLL_SPARSE_VAL_VALUE(p);
             idx += runlen;
-            E += PE[regval]*runlen;
+            reghisto[regval] += runlen;
             p++;
         }
     }
     if (idx != HLL_REGISTERS && invalid) *invalid = 1;
-    E += ez; /* Add 2^0 'ez' times. */
-    *ezp = ez;
-    return E;
 }
 
 /* ========================= HyperLogLog Count ==============================
  * This is the core of the algorithm where the approximated count is computed.
- * The function uses the lower level hllDenseSum() and hllSparseSum() functions
- * as helpers to compute the SUM(2^-reg) part of the computation, which is
- * representation-specific, while all the rest is common. */
+ * The function uses the lower level hllDenseRegHisto(), hllSparseRegHisto()
+ * and hllRawRegHisto() functions as helpers to compute the histogram of the
+ * register values, which is representation-specific, while all the rest is
+ * common. */
 
-/* Implements the SUM operation for uint8_t data type which is only used
+/* Implements the register histogram for uint8_t data type which is only used
  * internally as speedup for PFCOUNT with multiple keys. */
-double hllRawSum(uint8_t *registers, double *PE, int *ezp) {
-    double E = 0;
-    int j, ez = 0;
+void hllRawRegHisto(uint8_t *registers, int *reghisto) {
     uint64_t *word = (uint64_t*) registers;
     uint8_t *bytes;
+    int j;
 
     for (j = 0; j < HLL_REGISTERS/8; j++) {
         if (*word == 0) {
-            ez += 8;
+            reghisto[0] += 8;
         } else {
             bytes = (uint8_t*) word;
-            if (bytes[0]) E += PE[bytes[0]]; else ez++;
-            if (bytes[1]) E += PE[bytes[1]]; else ez++;
-            if (bytes[2]) E += PE[bytes[2]]; else ez++;
-            if (bytes[3]) E += PE[bytes[3]]; else ez++;
-            if (bytes[4]) E += PE[bytes[4]]; else ez++;
-            if (bytes[5]) E += PE[bytes[5]]; else ez++;
-            if (bytes[6]) E += PE[bytes[6]]; else ez++;
-            if (bytes[7]) E += PE[bytes[7]]; else ez++;
+            reghisto[bytes[0]]++;
+            reghisto[bytes[1]]++;
+            reghisto[bytes[2]]++;
+            reghisto[bytes[3]]++;
+            reghisto[bytes[4]]++;
+            reghisto[bytes[5]]++;
+            reghisto[bytes[6]]++;
+            reghisto[bytes[7]]++;
         }
         word++;
     }
-    E += ez; /* 2^(-reg[j]) is 1 when m is 0, add it 'ez' times for every
-                zero register in the HLL. */
-    *ezp = ez;
-    return E;
 }
 
 /* Return the approximated cardinality of the set based on the harmonic
@@ -968,6 +1005,7 @@ uint64_t hllCount(struct hllhdr *hdr, int *invalid) {
     double m = HLL_REGISTERS;
     double E, alpha = 0.7213/(1+1.079/m);
     int j, ez; /* Number of registers equal to 0. */
+    int reghisto[64];
 
     /* We precompute 2^(-reg[j]) in a small table in order to
      * speedup the computation of SUM(2^-register[0..i]). */
@@ -982,18 +1020,26 @@ uint64_t hllCount(struct hllhdr *hdr, int *invalid) {
         initialized = 1;
     }
 
-    /* Compute SUM(2^-register[0..i]). */
+    /* Compute the histogram of the register values. */
+    memset(reghisto,0,sizeof(reghisto));
     if (hdr->encoding == HLL_DENSE) {
-        E = hllDenseSum(hdr->registers,PE,&ez);
+        hllDenseRegHisto(hdr->registers,reghisto);
     } else if (hdr->encoding == HLL_SPARSE) {
-        E = hllSparseSum(hdr->registers,
-                         sdslen((sds)hdr)-HLL_HDR_SIZE,PE,&ez,invalid);
+        hllSparseRegHisto(hdr->registers,
+                          sdslen((sds)hdr)-HLL_HDR_SIZE,invalid,reghisto);
     } else if (hdr->encoding == HLL_RAW) {
-        E = hllRawSum(hdr->registers,PE,&ez);
+        hllRawRegHisto(hdr->registers,reghisto);
     } else {
         serverPanic("Unknown HyperLogLog encoding in hllCount()");
     }
 
+    /* Compute SUM(2^-register[0..i]) from the histogram. */
+    E = 0;
+    for (j = 0; j < 64; j++) {
+        if (reghisto[j]) E += PE[j]*reghisto[j];
+    }
+    ez = reghisto[0];
+
     /* Muliply the inverse of E for alpha_m * m^2 to have the raw estimate. */
     E = (1/E)*alpha*m*m;
 
@@ -1046,12 +1092,7 @@ int hllMerge(uint8_t *max, robj *hll) {
     int i;
 
     if (hdr->encoding == HLL_DENSE) {
-        uint8_t val;
-
-        for (i = 0; i < HLL_REGISTERS; i++) {
-            HLL_DENSE_GET_REGISTER(val,hdr->registers,i);
-            if (val > max[i]) max[i] = val;
-        }
+        hllDenseMerge(max,hdr->registers);
     } else {
         uint8_t *p = hll->ptr, *end = p + sdslen(hll->ptr);
         long runlen, regval;
@@ -1361,9 +1402,7 @@ void pfmergeCommand(client *c) {
     /* Write the resulting HLL to the destination HLL registers and
      * invalidate the cached value. */
     hdr = o->ptr;
-    for (j = 0; j < HLL_REGISTERS; j++) {
-        HLL_DENSE_SET_REGISTER(hdr->registers,j,max[j]);
-    }
+    hllDenseFromRaw(hdr->registers,max);
     HLL_INVALIDATE_CACHE(hdr);
 
     signalModifiedKey(c->db,c->argv[1]);
@@ -1385,7 +1424,7 @@ void pfselftestCommand(client *c) {
     sds bitcounters = sdsnewlen(NULL,HLL_DENSE_SIZE);
     struct hllhdr *hdr = (struct hllhdr*) bitcounters, *hdr2;
     robj *o = NULL;
-    uint8_t bytecounters[HLL_REGISTERS];
+    uint8_t bytecounters[HLL_REGISTERS], rawcounters[HLL_REGISTERS];
 
     /* Test 1: access registers.
      * The test is conceived to test that the different counters of our data
@@ -1412,6 +1451,37 @@ void pfselftestCommand(client *c) {
                 goto cleanup;
             }
         }
+
+        /* Check that merging into zeroed raw registers, packing them back
+         * and computing the histogram give the same registers. */
+        int densehisto[64], rawhisto[64];
+        memset(rawcounters,0,sizeof(rawcounters));
+        hllDenseMerge(rawcounters,hdr->registers);
+        if (memcmp(rawcounters,bytecounters,sizeof(rawcounters)) != 0) {
+            addReplyError(c, "TESTFAILED dense merge mismatch");
+            goto cleanup;
+        }
+        memset(densehisto,0,sizeof(densehisto));
+        memset(rawhisto,0,sizeof(rawhisto));
+        hllDenseRegHisto(hdr->registers,densehisto);
+        hllRawRegHisto(rawcounters,rawhisto);
+        if (memcmp(densehisto,rawhisto,sizeof(densehisto)) != 0) {
+            addReplyError(c, "TESTFAILED dense/raw histogram mismatch");
+            goto cleanup;
+        }
+        memset(hdr->registers,0,HLL_DENSE_SIZE-HLL_HDR_SIZE);
+        hllDenseFromRaw(hdr->registers,rawcounters);
+        for (i = 0; i < HLL_REGISTERS; i++) {
+            unsigned int val;
+
+            HLL_DENSE_GET_REGISTER(val,hdr->registers,i);
+            if (val != bytecounters[i]) {
+                addReplyErrorFormat(c,
+                    "TESTFAILED Packed register %d should be %d but is %d",
+                    i, (int) bytecounters[i], (int) val);
+                goto cleanup;
+            }
+        }
     }
 
     /* Test 2: approximation error.
@@ -281,6 +281,133 @@ size_t intsetBlobLen(intset *is) {
     return sizeof(intset)+intrev32ifbe(is->length)*intrev32ifbe(is->encoding);
 }
 
+/* Create an intset with room for 'len' elements of the given encoding.
+ * The length is set to zero, the caller is in charge of updating it. */
+static intset *intsetNewSized(uint8_t encoding, uint32_t len) {
+    intset *is = zmalloc(sizeof(intset)+(size_t)len*encoding);
+    is->encoding = intrev32ifbe(encoding);
+    is->length = 0;
+    return is;
+}
+
+/* Return the first position starting from 'from' holding an element which
+ * is >= 'value', or the length of the intset if there is none. The
+ * position is found galloping forward (1, 2, 4, ... elements) and then
+ * bisecting the last step, so that advancing a cursor over a big set only
+ * touches O(log(distance)) elements. */
+static uint32_t intsetGallop(intset *is, uint32_t from, int64_t value) {
+    uint32_t len = intrev32ifbe(is->length), lo, hi, step = 1;
+
+    if (from >= len || _intsetGet(is,from) >= value) return from;
+
+    /* From now on the element at 'lo' is always < value, while 'hi' is
+     * either the length or the position of an element >= value. */
+    lo = from;
+    while(1) {
+        hi = lo+step;
+        if (hi >= len) {
+            hi = len;
+            break;
+        }
+        if (_intsetGet(is,hi) >= value) break;
+        lo = hi;
+        step <<= 1;
+    }
+    while(hi-lo > 1) {
+        uint32_t mid = lo+(hi-lo)/2;
+        if (_intsetGet(is,mid) < value)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return hi;
+}
+
+/* Shrink the result of a set operation to its final length. */
+static intset *intsetTrim(intset *is, uint32_t len) {
+    is->length = intrev32ifbe(len);
+    return intsetResize(is,len);
+}
+
+/* Return a new intset with the elements that are members of all the 'num'
+ * intsets. Every set is only scanned forward, galloping over the elements
+ * that can't be part of the result, so the work is about the size of the
+ * first set times the log of the others: callers should pass the smallest
+ * set first. */
+intset *intsetIntersection(intset **sets, uint32_t num) {
+    uint32_t len = intrev32ifbe(sets[0]->length), rlen = 0, i, j;
+    uint32_t *cursor = zcalloc(sizeof(uint32_t)*num);
+    intset *res = intsetNewSized(intrev32ifbe(sets[0]->encoding),len);
+
+    for (i = 0; i < len; i++) {
+        int64_t value = _intsetGet(sets[0],i);
+
+        for (j = 1; j < num; j++) {
+            if (sets[j] == sets[0]) continue;
+            cursor[j] = intsetGallop(sets[j],cursor[j],value);
+            if (cursor[j] == intrev32ifbe(sets[j]->length)) goto done;
+            if (_intsetGet(sets[j],cursor[j]) != value) break;
+        }
+        if (j == num) _intsetSet(res,rlen++,value);
+    }
+
+done:
+    zfree(cursor);
+    return intsetTrim(res,rlen);
+}
+
+/* Return a new intset with the elements that are members of at least one
+ * of the 'num' intsets. The sets are merged pairwise. */
+intset *intsetUnion(intset **sets, uint32_t num) {
+    uint32_t j;
+    intset *res = intsetNewSized(INTSET_ENC_INT16,0);
+
+    for (j = 0; j < num; j++) {
+        intset *a = res, *b = sets[j], *merged;
+        uint32_t alen = intrev32ifbe(a->length), blen = intrev32ifbe(b->length);
+        uint32_t ai = 0, bi = 0, rlen = 0;
+        uint8_t enc = intrev32ifbe(a->encoding);
+
+        if (intrev32ifbe(b->encoding) > enc) enc = intrev32ifbe(b->encoding);
+        merged = intsetNewSized(enc,alen+blen);
+        while (ai < alen && bi < blen) {
+            int64_t av = _intsetGet(a,ai), bv = _intsetGet(b,bi);
+
+            if (av <= bv) ai++;
+            if (bv <= av) bi++;
+            _intsetSet(merged,rlen++,av < bv ? av : bv);
+        }
+        while (ai < alen) _intsetSet(merged,rlen++,_intsetGet(a,ai++));
+        while (bi < blen) _intsetSet(merged,rlen++,_intsetGet(b,bi++));
+        zfree(res);
+        res = intsetTrim(merged,rlen);
+    }
+    return res;
+}
+
+/* Return a new intset with the elements of the first intset that are not
+ * members of any of the other 'num'-1 intsets. */
+intset *intsetDifference(intset **sets, uint32_t num) {
+    uint32_t len = intrev32ifbe(sets[0]->length), rlen = 0, i, j;
+    uint32_t *cursor = zcalloc(sizeof(uint32_t)*num);
+    intset *res = intsetNewSized(intrev32ifbe(sets[0]->encoding),len);
+
+    for (i = 0; i < len; i++) {
+        int64_t value = _intsetGet(sets[0],i);
+
+        for (j = 1; j < num; j++) {
+            if (sets[j] == sets[0]) break;
+            cursor[j] = intsetGallop(sets[j],cursor[j],value);
+            if (cursor[j] < intrev32ifbe(sets[j]->length) &&
+                _intsetGet(sets[j],cursor[j]) == value) break;
+        }
+        if (j == num) _intsetSet(res,rlen++,value);
+    }
+
+    zfree(cursor);
+    return intsetTrim(res,rlen);
+}
+
 #ifdef REDIS_TEST
 #include <sys/time.h>
 #include <time.h>
@@ -471,6 +598,42 @@ int intsetTest(int argc, char **argv) {
                num,size,usec()-start);
     }
 
+    printf("Intersection, union and difference: "); {
+        intset *sets[3], *res;
+        int64_t v;
+        uint32_t j;
+
+        sets[0] = createSet(10,200);
+        sets[1] = createSet(10,400);
+        sets[2] = intsetAdd(createSet(10,300),65536,NULL);
+
+        res = intsetIntersection(sets,3);
+        checkConsistency(res);
+        for (j = 0; intsetGet(sets[0],j,&v); j++)
+            assert(intsetFind(res,v) == (intsetFind(sets[1],v) &&
+                                         intsetFind(sets[2],v)));
+        zfree(res);
+
+        res = intsetUnion(sets,3);
+        checkConsistency(res);
+        assert(intrev32ifbe(res->encoding) == INTSET_ENC_INT32);
+        for (i = 0; i < 3; i++)
+            for (j = 0; intsetGet(sets[i],j,&v); j++)
+                assert(intsetFind(res,v));
+        for (j = 0; intsetGet(res,j,&v); j++)
+            assert(intsetFind(sets[0],v) || intsetFind(sets[1],v) ||
+                   intsetFind(sets[2],v));
+        zfree(res);
+
+        res = intsetDifference(sets,3);
+        checkConsistency(res);
+        for (j = 0; intsetGet(sets[0],j,&v); j++)
+            assert(intsetFind(res,v) == !(intsetFind(sets[1],v) ||
+                                          intsetFind(sets[2],v)));
+        zfree(res);
+        ok();
+    }
+
     printf("Stress add+delete: "); {
         int i, v1, v2;
         is = intsetNew();
@@ -46,6 +46,9 @@ int64_t intsetRandom(intset *is);
 uint8_t intsetGet(intset *is, uint32_t pos, int64_t *value);
 uint32_t intsetLen(intset *is);
 size_t intsetBlobLen(intset *is);
+intset *intsetIntersection(intset **sets, uint32_t num);
+intset *intsetUnion(intset **sets, uint32_t num);
+intset *intsetDifference(intset **sets, uint32_t num);
 
 #ifdef REDIS_TEST
 int intsetTest(int argc, char *argv[]);
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "server.h"
+#include "bio.h"
+#include "rocks.h"
+
+/* Values whose free effort is above this threshold are released by the
+ * lazy free bio thread, smaller ones are not worth the job overhead. */
+#define LAZYFREE_THRESHOLD 64
+
+/* Set in the lazy free bio thread only, see decrRefCount(). */
+__thread int lazyfree_bio_thread = 0;
+
+static pthread_mutex_t lazyfree_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t lazyfree_objects = 0;    /* Objects queued to the bio thread. */
+static list *lazyfree_deferred = NULL; /* Refs the bio thread doesn't own. */
+
+/* The expires of a flushed db are released in the bio thread: their timers
+ * are already gone with realtimeExpireDescEmpty(), so just free the
+ * descriptors. The dict is only released, never looked up. */
+static void lazyfreeExpireDescDestructor(void *privdata, void *val) {
+    DICT_NOTUSED(privdata);
+
+    if (val) sdsfree((sds)val);
+}
+
+static dictType lazyfreeExpiresDictType = {
+    NULL,                         /* hash function */
+    NULL,                         /* key dup */
+    NULL,                         /* val dup */
+    NULL,                         /* key compare */
+    NULL,                         /* key destructor */
+    lazyfreeExpireDescDestructor  /* val destructor */
+};
+
+/* The elements of a sorted set are shared by the dict and the skiplist,
+ * the dict is released without touching them, see lazyfreeZsetObject(). */
+static dictType lazyfreeZsetDictType = {
+    NULL,                         /* hash function */
+    NULL,                         /* key dup */
+    NULL,                         /* val dup */
+    NULL,                         /* key compare */
+    NULL,                         /* key destructor */
+    NULL                          /* val destructor */
+};
+
+static void lazyfreeUpdatePending(long long delta) {
+    pthread_mutex_lock(&lazyfree_mutex);
+    lazyfree_objects += delta;
+    pthread_mutex_unlock(&lazyfree_mutex);
+}
+
+/* Return the number of objects waiting to be freed by the bio thread. */
+size_t lazyfreeGetPendingObjectsCount(void) {
+    size_t aux;
+
+    pthread_mutex_lock(&lazyfree_mutex);
+    aux = lazyfree_objects;
+    pthread_mutex_unlock(&lazyfree_mutex);
+    return aux;
+}
+
+/* Return the amount of work needed in order to free an object.
+ * The return value is not always the actual number of allocations the
+ * object is composed of, but a number proportional to it.
+ *
+ * For strings the function always returns 1.
+ *
+ * For aggregated objects represented by hash tables or other data
+ * structures the function just returns the number of elements the object
+ * is composed of.
+ *
+ * Objects composed of single allocations are always reported as having a
+ * single item even if they are actually logical composed of multiple
+ * elements. */
+size_t lazyfreeGetFreeEffort(robj *obj) {
+    if (obj->type == OBJ_LIST && obj->encoding == OBJ_ENCODING_QUICKLIST) {
+        quicklist *ql = obj->ptr;
+        return ql->len;
+    } else if (obj->type == OBJ_SET && obj->encoding == OBJ_ENCODING_HT) {
+        dict *ht = obj->ptr;
+        return dictSize(ht);
+    } else if (obj->type == OBJ_ZSET && obj->encoding == OBJ_ENCODING_SKIPLIST){
+        zset *zs = obj->ptr;
+        return zs->zbt->length;
+    } else if (obj->type == OBJ_HASH && obj->encoding == OBJ_ENCODING_HT) {
+        dict *ht = obj->ptr;
+        return dictSize(ht);
+    } else {
+        return 1; /* Everything else is a single allocation. */
+    }
+}
+
+/* Delete a key, value, and associated expiration entry if any, from the DB.
+ * If there are enough allocations to free the value object may be put into
+ * a lazy free list instead of being freed synchronously. The lazy free list
+ * will be reclaimed in a different bio.c thread.
+ *
+ * The parts of the value stored in rocksdb on their own (list nodes, hash
+ * fields) are deleted right away, in a single batch: their rocksdb keys
+ * derive from the key name, so a late delete from the bio thread could hit
+ * a value written meanwhile under the same name. */
+int dbAsyncDelete(redisDb *db, robj *key) {
+    dictEntry *de;
+    robj *val;
+    sds dictkey;
+    unsigned long long desno;
+
+    /* Deleting an entry from the expires dict will not free the sds of
+     * the key, because it is shared with the main dictionary. */
+    if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
+
+    de = dictFind(db->dict,key->ptr);
+    if (de == NULL) return 0;
+    if (dictIsEntryValOnDisk(de)) return dbSyncDelete(db,key);
+
+    val = dictGetVal(de);
+    if (val == NULL || val->refcount != 1 ||
+        lazyfreeGetFreeEffort(val) <= LAZYFREE_THRESHOLD)
+    {
+        return dbSyncDelete(db,key);
+    }
+
+    dictkey = dictGetKey(de);
+    desno = de->v_sno;
+    delValPartsOnDisk(db,desno,dictkey,val);
+    if (server.cluster_enabled) slotToKeyDel(dictkey);
+    dictDeleteNoFree(db->dict,key->ptr);
+    sdsfree(dictkey);
+
+    lazyfreeUpdatePending(1);
+    bioCreateBackgroundJob(BIO_LAZY_FREE,val,NULL,NULL);
+    return 1;
+}
+
+/* Free an object, if the object is huge enough, free it in async way. */
+void freeObjAsync(robj *o) {
+    if (o->refcount == 1 && lazyfreeGetFreeEffort(o) > LAZYFREE_THRESHOLD) {
+        lazyfreeUpdatePending(1);
+        bioCreateBackgroundJob(BIO_LAZY_FREE,o,NULL,NULL);
+    } else {
+        decrRefCount(o);
+    }
+}
+
+/* Empty a Redis DB asynchronously. What the function does actually is to
+ * create a new empty set of hash tables and scheduling the old ones for
+ * lazy freeing. Returns the number of keys removed. */
+long long emptyDbAsync(redisDb *db) {
+    dict *oldht1 = db->dict, *oldht2 = db->expires;
+    long long removed = dictSize(oldht1);
+
+    /* The timers point to the expires entries, drop them here. */
+    realtimeExpireDescEmpty(db);
+    oldht2->type = &lazyfreeExpiresDictType;
+
+    db->dict = dictCreate(&dbDictType,NULL);
+    db->expires = dictCreate(&keyptrDictType,NULL);
+    lazyfreeUpdatePending(removed);
+    bioCreateBackgroundJob(BIO_LAZY_FREE,NULL,oldht1,oldht2);
+    return removed;
+}
+
+/* Called by decrRefCount() in the bio thread for objects it doesn't own
+ * alone: the main thread may still use or release them, so the reference
+ * is handed back to be dropped by the main thread. */
+void lazyfreeDeferDecrRefCount(robj *o) {
+    pthread_mutex_lock(&lazyfree_mutex);
+    if (lazyfree_deferred == NULL) lazyfree_deferred = listCreate();
+    listAddNodeTail(lazyfree_deferred,o);
+    pthread_mutex_unlock(&lazyfree_mutex);
+}
+
+/* Drop the references handed back by the bio thread. Called by the main
+ * thread from beforeSleep(). */
+void lazyfreeReleaseDeferred(void) {
+    list *deferred;
+    listNode *ln;
+
+    pthread_mutex_lock(&lazyfree_mutex);
+    deferred = lazyfree_deferred;
+    if (deferred && listLength(deferred)) {
+        lazyfree_deferred = NULL;
+    } else {
+        deferred = NULL;
+    }
+    pthread_mutex_unlock(&lazyfree_mutex);
+    if (deferred == NULL) return;
+
+    while ((ln = listFirst(deferred)) != NULL) {
+        decrRefCount(listNodeValue(ln));
+        listDelNode(deferred,ln);
+    }
+    listRelease(deferred);
+}
+
+/* Release a node of the tree of a sorted set. The separators of the inner
+ * nodes hold one more reference to some of the elements, these are always
+ * handed back, so that the leaves see the same counts as with no tree. */
+static void lazyfreeZsetNode(zbtNode *n) {
+    int j;
+
+    if (n->leaf) {
+        zbtLeaf *l = (zbtLeaf*)n;
+
+        for (j = 0; j < n->count; j++) {
+            robj *ele = l->obj[j];
+
+            if (ele->refcount == 2) {
+                ele->refcount = 1;
+                decrRefCount(ele);
+            } else if (ele->refcount != OBJ_SHARED_REFCOUNT) {
+                /* Both references go back at once: the main thread may drop
+                 * its own meanwhile, and the second one would then look like
+                 * the last. */
+                lazyfreeDeferDecrRefCount(ele);
+                lazyfreeDeferDecrRefCount(ele);
+            }
+        }
+    } else {
+        zbtInner *in = (zbtInner*)n;
+
+        for (j = 0; j < n->count-1; j++) {
+            if (in->sepobj[j]->refcount != OBJ_SHARED_REFCOUNT)
+                lazyfreeDeferDecrRefCount(in->sepobj[j]);
+        }
+        for (j = 0; j < n->count; j++) lazyfreeZsetNode(in->child[j]);
+    }
+    zfree(n);
+}
+
+/* Sorted set elements are referenced twice by the value itself, so the
+ * generic path would see every element as shared. Free the elements whose
+ * only references are the ones of the set, hand back the others. */
+static void lazyfreeZsetObject(robj *o) {
+    zset *zs = o->ptr;
+
+    zs->dict->type = &lazyfreeZsetDictType;
+    dictRelease(zs->dict);
+
+    lazyfreeZsetNode(zs->zbt->root);
+    zfree(zs->zbt);
+    zfree(zs);
+    zfree(o);
+}
+
+/* Release objects from the lazyfree thread. It's just decrRefCount()
+ * updating the count of objects to release. */
+void lazyfreeFreeObjectFromBioThread(robj *o) {
+    if (o->type == OBJ_ZSET && o->encoding == OBJ_ENCODING_SKIPLIST)
+        lazyfreeZsetObject(o);
+    else
+        decrRefCount(o);
+    lazyfreeUpdatePending(-1);
+}
+
+/* Release a database from the lazyfree thread. The 'db' pointer is the
+ * database which was substituted with a fresh one in the main thread
+ * when the database was logically deleted. */
+void lazyfreeFreeDatabaseFromBioThread(dict *ht1, dict *ht2) {
+    size_t numkeys = dictSize(ht1);
+
+    dictRelease(ht1);
+    dictRelease(ht2);
+    lazyfreeUpdatePending(-(long long)numkeys);
+}
@@ -96,6 +96,7 @@ client *createClient(int fd) {
     c->multibulklen = 0;
     c->bulklen = -1;
     c->sentlen = 0;
+    c->pipeline_ahead = 0;
     c->flags = 0;
     c->ctime = c->lastinteraction = server.unixtime;
     c->authenticated = 0;
@@ -123,9 +124,13 @@ client *createClient(int fd) {
     c->pubsub_channels = dictCreate(&setDictType,NULL);
     c->pubsub_patterns = listCreate();
     c->peerid = NULL;
+    c->client_tracking_redirection = 0;
     listSetFreeMethod(c->pubsub_patterns,decrRefCountVoid);
     listSetMatchMethod(c->pubsub_patterns,listMatchObjects);
-    if (fd != -1) listAddNodeTail(server.clients,c);
+    if (fd != -1) {
+        listAddNodeTail(server.clients,c);
+        dictAdd(server.clients_index,&c->id,c);
+    }
     initClientMultiState(c);
     return c;
 }
@@ -172,7 +177,7 @@ int prepareClientToWrite(client *c) {
      * was yet not flagged), and, for slaves, if the slave can actually
      * receive writes at this stage. */
     if (!clientHasPendingReplies(c) &&
-        !(c->flags & CLIENT_PENDING_WRITE) &&
+        !(c->flags & (CLIENT_PENDING_WRITE|CLIENT_PENDING_READ)) &&
         (c->replstate == REPL_STATE_NONE ||
          (c->replstate == SLAVE_STATE_ONLINE && !c->repl_put_online_on_ack)))
     {
@@ -181,7 +186,11 @@ int prepareClientToWrite(client *c) {
          * to write to the socket. This way before re-entering the event
          * loop, we can try to directly write to the client sockets avoiding
          * a system call. We'll only really install the write handler if
-         * we'll not be able to write the whole reply at once. */
+         * we'll not be able to write the whole reply at once.
+         *
+         * Clients waiting for the I/O threads are skipped, since a thread
+         * may be queueing a protocol error right now: the main thread
+         * puts them in the list once their reads are handled. */
         c->flags |= CLIENT_PENDING_WRITE;
         listAddNodeHead(server.clients_pending_write,c);
     }
@@ -206,6 +215,17 @@ robj *dupLastObjectIfNeeded(list *reply) {
     return listNodeValue(ln);
 }
 
+/* Return true if 'len' more bytes can be appended to the tail object of a
+ * reply list. Big values are referenced by the reply list instead of being
+ * copied (see addReply()): appending to them while they are still shared
+ * would copy the whole value, so a new node is used instead. */
+static int replyTailCanAppend(robj *tail, size_t len) {
+    if (tail->ptr == NULL || tail->encoding != OBJ_ENCODING_RAW) return 0;
+    if (tail->refcount > 1 && sdslen(tail->ptr) >= PROTO_REPLY_MIN_SHARED)
+        return 0;
+    return sdslen(tail->ptr)+len <= PROTO_REPLY_CHUNK_BYTES;
+}
+
 /* -----------------------------------------------------------------------------
  * Low level functions to add more data to output buffers.
  * -------------------------------------------------------------------------- */
@@ -239,10 +259,10 @@ void _addReplyObjectToList(client *c, robj *o) {
     } else {
         tail = listNodeValue(listLast(c->reply));
 
-        /* Append to this object when possible. */
-        if (tail->ptr != NULL &&
-            tail->encoding == OBJ_ENCODING_RAW &&
-            sdslen(tail->ptr)+sdslen(o->ptr) <= PROTO_REPLY_CHUNK_BYTES)
+        /* Append to this object when possible. Big objects are always
+         * referenced, never copied. */
+        if (sdslen(o->ptr) < PROTO_REPLY_MIN_SHARED &&
+            replyTailCanAppend(tail,sdslen(o->ptr)))
         {
             c->reply_bytes -= sdsZmallocSize(tail->ptr);
             tail = dupLastObjectIfNeeded(c->reply);
@@ -274,9 +294,7 @@ void _addReplySdsToList(client *c, sds s) {
         tail = listNodeValue(listLast(c->reply));
 
         /* Append to this object when possible. */
-        if (tail->ptr != NULL && tail->encoding == OBJ_ENCODING_RAW &&
-            sdslen(tail->ptr)+sdslen(s) <= PROTO_REPLY_CHUNK_BYTES)
-        {
+        if (replyTailCanAppend(tail,sdslen(s))) {
             c->reply_bytes -= sdsZmallocSize(tail->ptr);
             tail = dupLastObjectIfNeeded(c->reply);
             tail->ptr = sdscatlen(tail->ptr,s,sdslen(s));
@@ -304,9 +322,7 @@ void _addReplyStringToList(client *c, const char *s, size_t len) {
         tail = listNodeValue(listLast(c->reply));
 
         /* Append to this object when possible. */
-        if (tail->ptr != NULL && tail->encoding == OBJ_ENCODING_RAW &&
-            sdslen(tail->ptr)+len <= PROTO_REPLY_CHUNK_BYTES)
-        {
+        if (replyTailCanAppend(tail,len)) {
             c->reply_bytes -= sdsZmallocSize(tail->ptr);
             tail = dupLastObjectIfNeeded(c->reply);
             tail->ptr = sdscatlen(tail->ptr,s,len);
@@ -335,9 +351,14 @@ void addReply(client *c, robj *obj) {
      *
      * If the encoding is RAW and there is room in the static buffer
      * we'll be able to send the object to the client without
-     * messing with its page. */
+     * messing with its page.
+     *
+     * Big objects are instead always referenced by the reply list: when
+     * many clients read the same value it is written to all the sockets
+     * straight from the object, without a copy per client. */
     if (sdsEncodedObject(obj)) {
-        if (_addReplyToBuffer(c,obj->ptr,sdslen(obj->ptr)) != C_OK)
+        if (sdslen(obj->ptr) >= PROTO_REPLY_MIN_SHARED ||
+            _addReplyToBuffer(c,obj->ptr,sdslen(obj->ptr)) != C_OK)
             _addReplyObjectToList(c,obj);
     } else if (obj->encoding == OBJ_ENCODING_INT) {
         /* Optimization: if there is room in the static buffer for 32 bytes
@@ -453,8 +474,11 @@ void setDeferredMultiBulkLength(client *c, void *node, long length) {
     if (ln->next != NULL) {
         next = listNodeValue(ln->next);
 
-        /* Only glue when the next node is non-NULL (an sds in this case) */
-        if (next->ptr != NULL) {
+        /* Only glue when the next node is non-NULL (an sds in this case)
+         * and is not a big object the reply list just references. */
+        if (next->ptr != NULL &&
+            sdslen(next->ptr) < PROTO_REPLY_MIN_SHARED)
+        {
             c->reply_bytes -= sdsZmallocSize(len->ptr);
             c->reply_bytes -= getStringObjectSdsUsedMemory(next);
             len->ptr = sdscatlen(len->ptr,next->ptr,sdslen(next->ptr));
@@ -757,6 +781,7 @@ void unlinkClient(client *c) {
         ln = listSearchKey(server.clients,c);
         serverAssert(ln != NULL);
         listDelNode(server.clients,ln);
+        dictDelete(server.clients_index,&c->id);
 
         /* Unregister async I/O handlers and close the socket. */
         aeDeleteFileEvent(server.el,c->fd,AE_READABLE);
@@ -773,6 +798,14 @@ void unlinkClient(client *c) {
         c->flags &= ~CLIENT_PENDING_WRITE;
     }
 
+    /* Remove from the list of clients waiting for the I/O threads. */
+    if (c->flags & CLIENT_PENDING_READ) {
+        ln = listSearchKey(server.clients_pending_read,c);
+        serverAssert(ln != NULL);
+        listDelNode(server.clients_pending_read,ln);
+        c->flags &= ~CLIENT_PENDING_READ;
+    }
+
     /* When client was just unblocked because of a blocking operation,
      * remove it from the list of unblocked clients. */
     if (c->flags & CLIENT_UNBLOCKED) {
@@ -783,6 +816,11 @@ void unlinkClient(client *c) {
     }
 }
 
+/* Return the connected client with the specified ID, or NULL. */
+client *lookupClientByID(uint64_t id) {
+    return dictFetchRawValue(server.clients_index,&id);
+}
+
 void freeClient(client *c) {
     listNode *ln;
 
@@ -827,6 +865,9 @@ void freeClient(client *c) {
     dictRelease(c->pubsub_channels);
     listRelease(c->pubsub_patterns);
 
+    /* Stop tracking keys for client side caching. */
+    if (c->flags & CLIENT_TRACKING) disableTracking(c);
+
     /* Free data structures. */
     listRelease(c->reply);
     freeClientArgv(c);
@@ -897,50 +938,103 @@ void freeClientsInAsyncFreeQueue(void) {
     }
 }
 
-/* Write data in output buffers to client. Return C_OK if the client
- * is still valid after the call, C_ERR if it was freed. */
-int writeToClient(int fd, client *c, int handler_installed) {
-    ssize_t nwritten = 0, totwritten = 0;
-    size_t objlen;
-    size_t objmem;
+/* Drop the head of the client reply list. When 'garbage' is not NULL the
+ * object is moved there instead of being released: reply lists may share
+ * objects with other clients, so their refcount is only touched by the
+ * main thread. */
+static void releaseReplyHead(client *c, list *garbage) {
+    listNode *ln = listFirst(c->reply);
+
+    if (garbage == NULL) {
+        listDelNode(c->reply,ln);
+        return;
+    }
+    listUnlinkNode(c->reply,ln);
+    listAddNodeTail(garbage,listNodeValue(ln));
+    zfree(ln);
+}
+
+/* Drop the first 'nwritten' bytes of the client output buffers, that were
+ * sent to the socket: the static buffer comes first, then the reply list.
+ * Empty objects at the head of the list are released as well. */
+static void consumeClientReplies(client *c, size_t nwritten, list *garbage) {
+    size_t left;
     robj *o;
 
-    while(clientHasPendingReplies(c)) {
-        if (c->bufpos > 0) {
-            nwritten = write(fd,c->buf+c->sentlen,c->bufpos-c->sentlen);
-            if (nwritten <= 0) break;
+    if (c->bufpos > 0) {
+        left = c->bufpos-c->sentlen;
+        if (nwritten < left) {
+            c->sentlen += nwritten;
+            return;
+        }
+        nwritten -= left;
+        c->bufpos = 0;
+        c->sentlen = 0;
+    }
+    while(listLength(c->reply)) {
+        o = listNodeValue(listFirst(c->reply));
+        left = sdslen(o->ptr)-c->sentlen;
+        if (nwritten < left) {
             c->sentlen += nwritten;
-            totwritten += nwritten;
+            return;
+        }
+        nwritten -= left;
+        c->reply_bytes -= getStringObjectSdsUsedMemory(o);
+        releaseReplyHead(c,garbage);
+        c->sentlen = 0;
+    }
+}
 
-            /* If the buffer was sent, set bufpos to zero to continue with
-             * the remainder of the reply. */
-            if ((int)c->sentlen == c->bufpos) {
-                c->bufpos = 0;
-                c->sentlen = 0;
-            }
-        } else {
-            o = listNodeValue(listFirst(c->reply));
-            objlen = sdslen(o->ptr);
-            objmem = getStringObjectSdsUsedMemory(o);
+/* Write as much as possible of the client output buffers to the socket.
+ * The static buffer and the objects of the reply list are gathered in a
+ * single writev() call, so that the protocol in the static buffer and the
+ * values referenced by the reply list go out together.
+ * The client is never freed here and the event loop is not touched, so
+ * that the I/O threads can use this function as well. The number of bytes
+ * sent is stored in '*written'. Returns C_ERR on write errors. */
+static int _writeToClient(int fd, client *c, list *garbage, ssize_t *written) {
+    ssize_t nwritten = 0, totwritten = 0;
+    struct iovec iov[NET_MAX_WRITEV_IOVCNT];
+    listIter li;
+    listNode *ln;
+    robj *o;
 
-            if (objlen == 0) {
-                listDelNode(c->reply,listFirst(c->reply));
-                c->reply_bytes -= objmem;
-                continue;
-            }
+    while(clientHasPendingReplies(c)) {
+        size_t offset = c->sentlen, iovlen = 0;
+        int iovcnt = 0;
 
-            nwritten = write(fd, ((char*)o->ptr)+c->sentlen,objlen-c->sentlen);
-            if (nwritten <= 0) break;
-            c->sentlen += nwritten;
-            totwritten += nwritten;
+        if (c->bufpos > 0) {
+            iov[iovcnt].iov_base = c->buf+offset;
+            iov[iovcnt].iov_len = c->bufpos-offset;
+            iovlen += iov[iovcnt].iov_len;
+            iovcnt++;
+            offset = 0;
+        }
+        listRewind(c->reply,&li);
+        while(iovcnt < NET_MAX_WRITEV_IOVCNT &&
+              iovlen < NET_MAX_WRITES_PER_EVENT &&
+              (ln = listNext(&li)) != NULL)
+        {
+            o = listNodeValue(ln);
+            if (sdslen(o->ptr) == offset) continue;
+            iov[iovcnt].iov_base = ((char*)o->ptr)+offset;
+            iov[iovcnt].iov_len = sdslen(o->ptr)-offset;
+            iovlen += iov[iovcnt].iov_len;
+            iovcnt++;
+            offset = 0;
+        }
 
-            /* If we fully sent the object on head go to the next one */
-            if (c->sentlen == objlen) {
-                listDelNode(c->reply,listFirst(c->reply));
-                c->sentlen = 0;
-                c->reply_bytes -= objmem;
-            }
+        /* Only empty objects are left. */
+        if (iovcnt == 0) {
+            consumeClientReplies(c,0,garbage);
+            continue;
         }
+
+        nwritten = writev(fd,iov,iovcnt);
+        if (nwritten <= 0) break;
+        totwritten += nwritten;
+        consumeClientReplies(c,nwritten,garbage);
+
         /* Note that we avoid to send more than NET_MAX_WRITES_PER_EVENT
          * bytes, in a single threaded server it's a good idea to serve
          * other clients as well, even if a very large request comes from
@@ -949,20 +1043,15 @@ int writeToClient(int fd, client *c, int handler_installed) {
          *
          * However if we are over the maxmemory limit we ignore that and
          * just deliver as much data as it is possible to deliver. */
-        server.stat_net_output_bytes += totwritten;
         if (totwritten > NET_MAX_WRITES_PER_EVENT &&
             (server.maxmemory == 0 ||
              zmalloc_used_memory() < server.maxmemory)) break;
     }
-    if (nwritten == -1) {
-        if (errno == EAGAIN) {
-            nwritten = 0;
-        } else {
-            serverLog(LL_VERBOSE,
-                "Error writing to client: %s", strerror(errno));
-            freeClient(c);
-            return C_ERR;
-        }
+    *written = totwritten;
+    if (nwritten == -1 && errno != EAGAIN) {
+        serverLog(LL_VERBOSE,
+            "Error writing to client: %s", strerror(errno));
+        return C_ERR;
     }
     if (totwritten > 0) {
         /* For clients representing masters we don't count sending data
@@ -971,8 +1060,23 @@ int writeToClient(int fd, client *c, int handler_installed) {
          * We just rely on data / pings received for timeout detection. */
         if (!(c->flags & CLIENT_MASTER)) c->lastinteraction = server.unixtime;
     }
+    if (!clientHasPendingReplies(c)) c->sentlen = 0;
+    return C_OK;
+}
+
+/* Write data in output buffers to client. Return C_OK if the client
+ * is still valid after the call, C_ERR if it was freed. */
+int writeToClient(int fd, client *c, int handler_installed) {
+    ssize_t totwritten;
+    int retval;
+
+    retval = _writeToClient(fd,c,NULL,&totwritten);
+    server.stat_net_output_bytes += totwritten;
+    if (retval == C_ERR) {
+        freeClient(c);
+        return C_ERR;
+    }
     if (!clientHasPendingReplies(c)) {
-        c->sentlen = 0;
         if (handler_installed) aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
 
         /* Close connection after entire reply has been sent. */
@@ -1259,8 +1363,9 @@ int processMultibulkBuffer(client *c) {
 
 void processInputBuffer(client *c) {
     server.current_client = c;
-    /* Keep processing while there is something in the input buffer */
-    while(sdslen(c->querybuf)) {
+    /* Keep processing while there is something in the input buffer, or a
+     * command already parsed by an I/O thread. */
+    while(sdslen(c->querybuf) || c->flags & CLIENT_PENDING_COMMAND) {
         /* Return if clients are paused. */
         if (!(c->flags & CLIENT_SLAVE) && clientsArePaused()) break;
 
@@ -1274,27 +1379,35 @@ void processInputBuffer(client *c) {
          * The same applies for clients we want to terminate ASAP. */
         if (c->flags & (CLIENT_CLOSE_AFTER_REPLY|CLIENT_CLOSE_ASAP)) break;
 
-        /* Determine request type when unknown. */
-        if (!c->reqtype) {
-            if (c->querybuf[0] == '*') {
-                c->reqtype = PROTO_REQ_MULTIBULK;
-            } else {
-                c->reqtype = PROTO_REQ_INLINE;
+        if (c->flags & CLIENT_PENDING_COMMAND) {
+            /* argv is already populated by an I/O thread. */
+            c->flags &= ~CLIENT_PENDING_COMMAND;
+        } else {
+            /* Determine request type when unknown. */
+            if (!c->reqtype) {
+                if (c->querybuf[0] == '*') {
+                    c->reqtype = PROTO_REQ_MULTIBULK;
+                } else {
+                    c->reqtype = PROTO_REQ_INLINE;
+                }
             }
-        }
 
-        if (c->reqtype == PROTO_REQ_INLINE) {
-            if (processInlineBuffer(c) != C_OK) break;
-        } else if (c->reqtype == PROTO_REQ_MULTIBULK) {
-            if (processMultibulkBuffer(c) != C_OK) break;
-        } else {
-            serverPanic("Unknown request type");
+            if (c->reqtype == PROTO_REQ_INLINE) {
+                if (processInlineBuffer(c) != C_OK) break;
+            } else if (c->reqtype == PROTO_REQ_MULTIBULK) {
+                if (processMultibulkBuffer(c) != C_OK) break;
+            } else {
+                serverPanic("Unknown request type");
+            }
         }
 
         /* Multibulk processing could see a <= 0 length. */
         if (c->argc == 0) {
             resetClient(c);
         } else {
+            /* This command was already seen by prefetchPipelinedKeys(). */
+            if (c->pipeline_ahead) c->pipeline_ahead--;
+
             /* Only reset the client when the command was executed. */
             if (processCommand(c) == C_OK)
                 resetClient(c);
@@ -1306,12 +1419,117 @@ void processInputBuffer(client *c) {
     server.current_client = NULL;
 }
 
-void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
-    client *c = (client*) privdata;
+/* Parse the multi bulk length or bulk length at 'p', that is the "*<num>"
+ * or "$<num>" line, without consuming the query buffer. Returns a pointer
+ * to the next line, or NULL if the line is incomplete or malformed. */
+static char *peekMultibulkLen(char *p, char *end, char type, long long *ll) {
+    char *newline;
+
+    if (p >= end || *p != type) return NULL;
+    newline = memchr(p,'\r',end-p);
+    if (newline == NULL || newline+1 >= end) return NULL;
+    if (!string2ll(p+1,newline-(p+1),ll) || *ll < 0) return NULL;
+    return newline+2;
+}
+
+/* Called by processCommand() before executing a command of the client: when
+ * the query buffer already holds the next commands of a pipeline, the run
+ * of commands having the same name as the current one is scanned, without
+ * consuming the query buffer, and the keys of the whole run are warmed up
+ * at once with dbPrefetchKeys(). Only commands with a single key as first
+ * argument are considered, the values on disk are loaded just for read
+ * only commands.
+ *
+ * The commands of the run are then parsed and executed one by one as
+ * usual, so the replies, the propagation and the replication stream are
+ * exactly the same. c->pipeline_ahead counts the commands of the run that
+ * are still to be executed, so that the buffer is not scanned again. */
+void prefetchPipelinedKeys(client *c) {
+    sds keys[PROTO_PIPELINE_PREFETCH_MAX];
+    struct redisCommand *cmd = c->cmd;
+    char *name = c->argv[0]->ptr, *p, *end;
+    size_t namelen = sdslen(name);
+    int j, numkeys = 0;
+
+    if (c->pipeline_ahead || c->multibulklen) return;
+    if (sdslen(c->querybuf) == 0 || c->querybuf[0] != '*') return;
+    if (cmd->firstkey != 1 || cmd->lastkey != 1 || cmd->getkeys_proc ||
+        c->argc < 2) return;
+    if (c->flags & (CLIENT_MULTI|CLIENT_LUA)) return;
+
+    keys[numkeys++] = sdsdup(c->argv[1]->ptr);
+    p = c->querybuf;
+    end = c->querybuf+sdslen(c->querybuf);
+    while(numkeys < PROTO_PIPELINE_PREFETCH_MAX) {
+        long long argc, len;
+        sds key = NULL;
+
+        if ((p = peekMultibulkLen(p,end,'*',&argc)) == NULL || argc < 2)
+            break;
+        for (j = 0; j < argc && p != NULL; j++) {
+            if ((p = peekMultibulkLen(p,end,'$',&len)) == NULL ||
+                end-p < len+2)
+            {
+                p = NULL;
+            } else if (j == 0 &&
+                       ((size_t)len != namelen || strncasecmp(p,name,len)))
+            {
+                p = NULL;
+            } else {
+                if (j == 1) key = sdsnewlen(p,len);
+                p += len+2;
+            }
+        }
+        if (p == NULL) {
+            sdsfree(key);
+            break;
+        }
+        keys[numkeys++] = key;
+    }
+
+    c->pipeline_ahead = numkeys-1;
+    dbPrefetchKeys(c->db,keys,numkeys,cmd->flags & CMD_READONLY);
+    for (j = 0; j < numkeys; j++) sdsfree(keys[j]);
+}
+
+/* Parse the next command of the query buffer into argv without executing
+ * it, flagging the client with CLIENT_PENDING_COMMAND once a whole command
+ * is available. Used by the I/O threads: processInputBuffer() executes the
+ * command later from the main thread. */
+static void parseClientQueryBuf(client *c) {
+    int retval;
+
+    if (c->flags & (CLIENT_BLOCKED|CLIENT_CLOSE_AFTER_REPLY|
+                    CLIENT_CLOSE_ASAP|CLIENT_PENDING_COMMAND)) return;
+    if (sdslen(c->querybuf) == 0) return;
+
+    if (!c->reqtype) {
+        if (c->querybuf[0] == '*') {
+            c->reqtype = PROTO_REQ_MULTIBULK;
+        } else {
+            c->reqtype = PROTO_REQ_INLINE;
+        }
+    }
+
+    if (c->reqtype == PROTO_REQ_INLINE)
+        retval = processInlineBuffer(c);
+    else
+        retval = processMultibulkBuffer(c);
+    if (retval != C_OK) return;
+
+    if (c->argc == 0)
+        resetClient(c);
+    else
+        c->flags |= CLIENT_PENDING_COMMAND;
+}
+
+/* Read from the client socket into the query buffer. Returns the number of
+ * bytes read, 0 if the read would block, or -1 if the connection was closed
+ * or hit an error and the client must be freed. Neither the client nor the
+ * global stats are touched besides that, so the I/O threads can call it. */
+static int readClientQueryBuf(client *c) {
     int nread, readlen;
     size_t qblen;
-    UNUSED(el);
-    UNUSED(mask);
 
     readlen = PROTO_IOBUF_LEN;
     /* If this is a multi bulk request, and we are processing a bulk reply
@@ -1331,25 +1549,25 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     qblen = sdslen(c->querybuf);
     if (c->querybuf_peak < qblen) c->querybuf_peak = qblen;
     c->querybuf = sdsMakeRoomFor(c->querybuf, readlen);
-    nread = read(fd, c->querybuf+qblen, readlen);
+    nread = read(c->fd, c->querybuf+qblen, readlen);
     if (nread == -1) {
-        if (errno == EAGAIN) {
-            return;
-        } else {
-            serverLog(LL_VERBOSE, "Reading from client: %s",strerror(errno));
-            freeClient(c);
-            return;
-        }
+        if (errno == EAGAIN) return 0;
+        serverLog(LL_VERBOSE, "Reading from client: %s",strerror(errno));
+        return -1;
     } else if (nread == 0) {
         serverLog(LL_VERBOSE, "Client closed connection");
-        freeClient(c);
-        return;
+        return -1;
     }
 
     sdsIncrLen(c->querybuf,nread);
     c->lastinteraction = server.unixtime;
     if (c->flags & CLIENT_MASTER) c->reploff += nread;
-    server.stat_net_input_bytes += nread;
+    return nread;
+}
+
+/* Free the client if its query buffer grew over the configured limit.
+ * Returns C_ERR if the client was freed. */
+static int checkClientQueryBufLimit(client *c) {
     if (sdslen(c->querybuf) > server.client_max_querybuf_len) {
         sds ci = catClientInfoString(sdsempty(),c), bytes = sdsempty();
 
@@ -1357,12 +1575,304 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
         serverLog(LL_WARNING,"Closing client that reached max query buffer length: %s (qbuf initial bytes: %s)", ci, bytes);
         sdsfree(ci);
         sdsfree(bytes);
+        freeClient(c);
+        return C_ERR;
+    }
+    return C_OK;
+}
+
+/* When the I/O threads are active, queue the client so that its socket is
+ * read and its query parsed by the threads before the next event loop
+ * iteration. Returns 1 if the read was postponed. */
+static int postponeClientRead(client *c) {
+    if (server.io_threads_active &&
+        server.io_threads_do_reads &&
+        !server.loading &&
+        server.lua_caller == NULL &&
+        !(c->flags & (CLIENT_MASTER|CLIENT_SLAVE|CLIENT_BLOCKED|
+                      CLIENT_PENDING_READ)))
+    {
+        c->flags |= CLIENT_PENDING_READ;
+        listAddNodeTail(server.clients_pending_read,c);
+        return 1;
+    }
+    return 0;
+}
+
+void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
+    client *c = (client*) privdata;
+    int nread;
+    UNUSED(el);
+    UNUSED(fd);
+    UNUSED(mask);
+
+    if (postponeClientRead(c)) return;
+
+    nread = readClientQueryBuf(c);
+    if (nread == 0) return;
+    if (nread < 0) {
         freeClient(c);
         return;
     }
+    server.stat_net_input_bytes += nread;
+    if (checkClientQueryBufLimit(c) == C_ERR) return;
     processInputBuffer(c);
 }
 
+/* -----------------------------------------------------------------------------
+ * Threaded I/O
+ *
+ * With io-threads greater than one, reading and parsing the queries and
+ * writing the replies are spread across a set of I/O threads, the main
+ * thread being the first of them. Commands are still executed by the main
+ * thread only: the I/O threads just run while it waits for them, and every
+ * client is served by a single thread in a given phase.
+ * -------------------------------------------------------------------------- */
+
+#define IO_THREADS_OP_IDLE 0
+#define IO_THREADS_OP_READ 1
+#define IO_THREADS_OP_WRITE 2
+
+typedef struct ioThread {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int op;             /* IO_THREADS_OP_* requested by the main thread. */
+    list *clients;      /* Clients to serve during the current op. */
+    list *garbage;      /* Sent reply objects, released by the main thread. */
+    long long netbytes; /* Bytes read or written during the current op. */
+} ioThread;
+
+static ioThread io_threads[IO_THREADS_MAX_NUM];
+static pthread_mutex_t io_threads_done_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t io_threads_done_cond = PTHREAD_COND_INITIALIZER;
+static int io_threads_pending;
+
+static void ioThreadServeClients(ioThread *t, int op) {
+    listIter li;
+    listNode *ln;
+    ssize_t nwritten;
+    int nread;
+
+    t->netbytes = 0;
+    listRewind(t->clients,&li);
+    while((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+
+        if (op == IO_THREADS_OP_WRITE) {
+            if (_writeToClient(c->fd,c,t->garbage,&nwritten) == C_ERR)
+                c->flags |= CLIENT_IO_ERROR;
+            t->netbytes += nwritten;
+        } else {
+            nread = readClientQueryBuf(c);
+            if (nread < 0) {
+                c->flags |= CLIENT_IO_ERROR;
+                continue;
+            }
+            t->netbytes += nread;
+            /* The main thread will close it, don't bother parsing. */
+            if (sdslen(c->querybuf) > server.client_max_querybuf_len)
+                continue;
+            parseClientQueryBuf(c);
+        }
+    }
+}
+
+static void *ioThreadMain(void *arg) {
+    ioThread *t = arg;
+    sigset_t sigset;
+    int op;
+
+    /* Block SIGALRM so we are sure that only the main thread will
+     * receive the watchdog signal. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    if (pthread_sigmask(SIG_BLOCK, &sigset, NULL))
+        serverLog(LL_WARNING,
+            "Warning: can't mask SIGALRM in I/O thread: %s", strerror(errno));
+
+    while(1) {
+        pthread_mutex_lock(&t->lock);
+        while (t->op == IO_THREADS_OP_IDLE)
+            pthread_cond_wait(&t->cond,&t->lock);
+        op = t->op;
+        pthread_mutex_unlock(&t->lock);
+
+        ioThreadServeClients(t,op);
+
+        pthread_mutex_lock(&t->lock);
+        t->op = IO_THREADS_OP_IDLE;
+        pthread_mutex_unlock(&t->lock);
+
+        pthread_mutex_lock(&io_threads_done_mutex);
+        if (--io_threads_pending == 0)
+            pthread_cond_signal(&io_threads_done_cond);
+        pthread_mutex_unlock(&io_threads_done_mutex);
+    }
+    return NULL;
+}
+
+/* Spread the clients of the list across the I/O threads, run 'op' and
+ * wait for all the threads to finish. The list itself is left untouched,
+ * every thread keeps its share in io_threads[j].clients. */
+static void ioThreadsRun(list *clients, int op) {
+    listIter li;
+    listNode *ln;
+    int j = 0;
+
+    listRewind(clients,&li);
+    while((ln = listNext(&li))) {
+        listAddNodeTail(io_threads[j % server.io_threads_num].clients,
+                        listNodeValue(ln));
+        j++;
+    }
+
+    pthread_mutex_lock(&io_threads_done_mutex);
+    io_threads_pending = server.io_threads_num-1;
+    pthread_mutex_unlock(&io_threads_done_mutex);
+    for (j = 1; j < server.io_threads_num; j++) {
+        ioThread *t = &io_threads[j];
+
+        pthread_mutex_lock(&t->lock);
+        t->op = op;
+        pthread_cond_signal(&t->cond);
+        pthread_mutex_unlock(&t->lock);
+    }
+
+    /* The main thread serves its own share meanwhile. */
+    ioThreadServeClients(&io_threads[0],op);
+
+    pthread_mutex_lock(&io_threads_done_mutex);
+    while (io_threads_pending)
+        pthread_cond_wait(&io_threads_done_cond,&io_threads_done_mutex);
+    pthread_mutex_unlock(&io_threads_done_mutex);
+}
+
+void initThreadedIO(void) {
+    int j;
+
+    server.io_threads_active = 0;
+    if (server.io_threads_num == 1) return;
+
+    for (j = 0; j < server.io_threads_num; j++) {
+        ioThread *t = &io_threads[j];
+
+        t->clients = listCreate();
+        t->garbage = listCreate();
+        listSetFreeMethod(t->garbage,decrRefCountVoid);
+        t->op = IO_THREADS_OP_IDLE;
+        t->netbytes = 0;
+        pthread_mutex_init(&t->lock,NULL);
+        pthread_cond_init(&t->cond,NULL);
+
+        /* Thread 0 is the main thread. */
+        if (j == 0) continue;
+        if (pthread_create(&t->thread,NULL,ioThreadMain,t) != 0) {
+            serverLog(LL_WARNING,"Fatal: Can't initialize I/O threads.");
+            exit(1);
+        }
+    }
+    serverLog(LL_NOTICE,"Threaded I/O enabled with %d threads.",
+        server.io_threads_num);
+}
+
+/* Read and parse the queries of the clients postponed by
+ * readQueryFromClient() using the I/O threads, then execute the parsed
+ * commands from the main thread. Returns the number of clients served. */
+int handleClientsWithPendingReadsUsingThreads(void) {
+    int processed = listLength(server.clients_pending_read);
+    int j;
+
+    if (processed == 0) return 0;
+    server.stat_io_reads_processed += processed;
+    ioThreadsRun(server.clients_pending_read,IO_THREADS_OP_READ);
+    for (j = 0; j < server.io_threads_num; j++) {
+        server.stat_net_input_bytes += io_threads[j].netbytes;
+        while (listLength(io_threads[j].clients))
+            listDelNode(io_threads[j].clients,listFirst(io_threads[j].clients));
+    }
+
+    /* Walk the global list rather than the per thread ones: executing a
+     * command may free other clients, that unlinkClient() removes from
+     * it. */
+    while (listLength(server.clients_pending_read)) {
+        listNode *ln = listFirst(server.clients_pending_read);
+        client *c = listNodeValue(ln);
+
+        c->flags &= ~CLIENT_PENDING_READ;
+        listDelNode(server.clients_pending_read,ln);
+
+        /* Replies queued while the client was waiting, by a thread or by
+         * other clients, still need to be scheduled. */
+        if (clientHasPendingReplies(c) && !(c->flags & CLIENT_PENDING_WRITE)) {
+            c->flags |= CLIENT_PENDING_WRITE;
+            listAddNodeHead(server.clients_pending_write,c);
+        }
+
+        if (c->flags & CLIENT_IO_ERROR) {
+            freeClient(c);
+            continue;
+        }
+        if (checkClientQueryBufLimit(c) == C_ERR) continue;
+        processInputBuffer(c);
+    }
+    return processed;
+}
+
+/* Like handleClientsWithPendingWrites() but writing the output buffers
+ * using the I/O threads when there are enough clients to make it worth.
+ * This is also where the I/O threads are turned on and off for reads. */
+int handleClientsWithPendingWritesUsingThreads(void) {
+    int processed = listLength(server.clients_pending_write);
+    int j;
+
+    if (processed == 0) return 0;
+    if (server.io_threads_num == 1 || processed < server.io_threads_num*2) {
+        server.io_threads_active = 0;
+        return handleClientsWithPendingWrites();
+    }
+    server.io_threads_active = 1;
+    server.stat_io_writes_processed += processed;
+
+    ioThreadsRun(server.clients_pending_write,IO_THREADS_OP_WRITE);
+    while (listLength(server.clients_pending_write)) {
+        listNode *ln = listFirst(server.clients_pending_write);
+        client *c = listNodeValue(ln);
+
+        c->flags &= ~CLIENT_PENDING_WRITE;
+        listDelNode(server.clients_pending_write,ln);
+    }
+
+    for (j = 0; j < server.io_threads_num; j++) {
+        ioThread *t = &io_threads[j];
+
+        server.stat_net_output_bytes += t->netbytes;
+        while (listLength(t->garbage))
+            listDelNode(t->garbage,listFirst(t->garbage));
+        while (listLength(t->clients)) {
+            listNode *ln = listFirst(t->clients);
+            client *c = listNodeValue(ln);
+
+            listDelNode(t->clients,ln);
+            if (c->flags & CLIENT_IO_ERROR) {
+                freeClient(c);
+                continue;
+            }
+            if (!clientHasPendingReplies(c)) {
+                /* Close connection after entire reply has been sent. */
+                if (c->flags & CLIENT_CLOSE_AFTER_REPLY) freeClient(c);
+                continue;
+            }
+            if (aeCreateFileEvent(server.el, c->fd, AE_WRITABLE,
+                    sendReplyToClient, c) == AE_ERR)
+            {
+                freeClientAsync(c);
+            }
+        }
+    }
+    return processed;
+}
+
 void getClientsMaxBuffers(unsigned long *longest_output_list,
                           unsigned long *biggest_input_buffer) {
     client *c;
@@ -1439,6 +1949,7 @@ sds catClientInfoString(sds s, client *client) {
     if (client->flags & CLIENT_CLOSE_ASAP) *p++ = 'A';
     if (client->flags & CLIENT_UNIX_SOCKET) *p++ = 'U';
     if (client->flags & CLIENT_READONLY) *p++ = 'r';
+    if (client->flags & CLIENT_TRACKING) *p++ = 't';
     if (p == flags) *p++ = 'N';
     *p++ = '\0';
 
@@ -1494,6 +2005,9 @@ void clientCommand(client *c) {
         sds o = getAllClientsInfoString();
         addReplyBulkCBuffer(c,o,sdslen(o));
         sdsfree(o);
+    } else if (!strcasecmp(c->argv[1]->ptr,"id") && c->argc == 2) {
+        /* CLIENT ID */
+        addReplyLongLong(c,c->id);
     } else if (!strcasecmp(c->argv[1]->ptr,"reply") && c->argc == 3) {
         /* CLIENT REPLY ON|OFF|SKIP */
         if (!strcasecmp(c->argv[2]->ptr,"on")) {
@@ -1634,8 +2148,31 @@ void clientCommand(client *c) {
                                         != C_OK) return;
         pauseClients(duration);
         addReply(c,shared.ok);
+    } else if (!strcasecmp(c->argv[1]->ptr,"tracking")) {
+        /* CLIENT TRACKING (ON REDIRECT <id> | OFF) */
+        long long redir;
+
+        if (c->argc == 5 && !strcasecmp(c->argv[2]->ptr,"on") &&
+            !strcasecmp(c->argv[3]->ptr,"redirect"))
+        {
+            if (getLongLongFromObjectOrReply(c,c->argv[4],&redir,NULL) !=
+                C_OK) return;
+            if (lookupClientByID(redir) == NULL) {
+                addReplyError(c,"The client ID you want redirect to "
+                                "does not exist");
+                return;
+            }
+            enableTracking(c,redir);
+        } else if (c->argc == 3 && !strcasecmp(c->argv[2]->ptr,"off")) {
+            disableTracking(c);
+        } else {
+            addReplyError(c,"Syntax error, try CLIENT TRACKING "
+                            "(ON REDIRECT <client-id> | OFF)");
+            return;
+        }
+        addReply(c,shared.ok);
     } else {
-        addReplyError(c, "Syntax error, try CLIENT (LIST | KILL | GETNAME | SETNAME | PAUSE | REPLY)");
+        addReplyError(c, "Syntax error, try CLIENT (LIST | KILL | GETNAME | SETNAME | PAUSE | REPLY | ID | TRACKING)");
     }
 }
 
@@ -1838,6 +2375,9 @@ int checkClientOutputBufferLimits(client *c) {
 void asyncCloseClientOnOutputBufferLimitReached(client *c) {
     serverAssert(c->reply_bytes < SIZE_MAX-(1024*64));
     if (c->reply_bytes == 0 || c->flags & CLIENT_CLOSE_ASAP) return;
+    /* Don't touch the global list of clients to close from an I/O thread,
+     * the limits are checked again on the next reply anyway. */
+    if (c->flags & CLIENT_PENDING_READ) return;
     if (checkClientOutputBufferLimits(c)) {
         sds client = catClientInfoString(sdsempty(),c);
 
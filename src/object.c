@@ -223,7 +223,7 @@ robj *createZsetObject(void) {
     robj *o;
 
     zs->dict = dictCreate(&zsetDictType,NULL);
-    zs->zsl = zslCreate();
+    zs->zbt = zbtCreate();
     o = createObject(OBJ_ZSET,zs);
     o->encoding = OBJ_ENCODING_SKIPLIST;
     return o;
@@ -269,7 +269,7 @@ void freeZsetObject(robj *o) {
     case OBJ_ENCODING_SKIPLIST:
         zs = o->ptr;
         dictRelease(zs->dict);
-        zslFree(zs->zsl);
+        zbtFree(zs->zbt);
         zfree(zs);
         break;
     case OBJ_ENCODING_ZIPLIST:
@@ -294,12 +294,23 @@ void freeHashObject(robj *o) {
     }
 }
 
+/* Set a special refcount in the object to make it "shared":
+ * incrRefCount and decrRefCount() will test for this special refcount
+ * and will not touch the object. This way it is free to access shared
+ * objects such as small integers from different threads without any
+ * mutex. */
+robj *makeObjectShared(robj *o) {
+    serverAssert(o->refcount == 1);
+    o->refcount = OBJ_SHARED_REFCOUNT;
+    return o;
+}
+
 void incrRefCount(robj *o) {
     if (!o) {
         return;
     }
     
-    o->refcount++;
+    if (o->refcount != OBJ_SHARED_REFCOUNT) o->refcount++;
 }
 
 void decrRefCount(robj *o) {
@@ -318,8 +329,13 @@ void decrRefCount(robj *o) {
         default: serverPanic("Unknown object type"); break;
         }
         zfree(o);
-    } else {
-        o->refcount--;
+    } else if (o->refcount != OBJ_SHARED_REFCOUNT) {
+        /* The lazy free thread only frees what it owns alone, other
+         * references are dropped by the main thread, see lazyfree.c. */
+        if (lazyfree_bio_thread)
+            lazyfreeDeferDecrRefCount(o);
+        else
+            o->refcount--;
     }
 }
 
@@ -47,12 +47,167 @@ int listMatchPubsubPattern(void *a, void *b) {
            (equalStringObjects(pa->pattern,pb->pattern));
 }
 
+/*-----------------------------------------------------------------------------
+ * Pattern index
+ *
+ * PUBLISH must not try every pattern against the channel: patterns are
+ * indexed in a byte trie keyed on their literal prefix, that is the part
+ * before the first glob special character. Every node keeps the patterns
+ * whose literal prefix ends there, so publishing walks the trie along the
+ * channel name and only runs stringmatchlen() against the glob tail of the
+ * patterns found on the path.
+ *----------------------------------------------------------------------------*/
+
+struct pubsubPatternNode {
+    list *patterns;         /* pubsubPattern ending here, or NULL. */
+    unsigned char *bytes;   /* Sorted labels of the children edges. */
+    struct pubsubPatternNode **children;
+    int numchildren;
+};
+
+pubsubPatternNode *pubsubPatternNodeCreate(void) {
+    pubsubPatternNode *n = zmalloc(sizeof(*n));
+
+    n->patterns = NULL;
+    n->bytes = NULL;
+    n->children = NULL;
+    n->numchildren = 0;
+    return n;
+}
+
+static void pubsubPatternNodeFree(pubsubPatternNode *n) {
+    if (n->patterns) listRelease(n->patterns);
+    zfree(n->bytes);
+    zfree(n->children);
+    zfree(n);
+}
+
+/* Length of the part of the pattern that can only match itself. */
+static size_t pubsubPatternPrefixLen(sds pattern) {
+    size_t j, len = sdslen(pattern);
+
+    for (j = 0; j < len; j++) {
+        char ch = pattern[j];
+        if (ch == '*' || ch == '?' || ch == '[' || ch == '\\') break;
+    }
+    return j;
+}
+
+/* Return the index of the child with label 'b', or the index where it
+ * should be inserted, setting *found accordingly. */
+static int pubsubPatternNodeSeek(pubsubPatternNode *n, unsigned char b,
+                                 int *found)
+{
+    int lo = 0, hi = n->numchildren-1;
+
+    while (lo <= hi) {
+        int mid = (lo+hi)/2;
+
+        if (n->bytes[mid] == b) {
+            *found = 1;
+            return mid;
+        } else if (n->bytes[mid] < b) {
+            lo = mid+1;
+        } else {
+            hi = mid-1;
+        }
+    }
+    *found = 0;
+    return lo;
+}
+
+static pubsubPatternNode *pubsubPatternNodeChild(pubsubPatternNode *n,
+                                                 unsigned char b)
+{
+    int found, idx = pubsubPatternNodeSeek(n,b,&found);
+    return found ? n->children[idx] : NULL;
+}
+
+/* Add 'pat' to the index. */
+static void pubsubPatternIndexAdd(pubsubPattern *pat) {
+    pubsubPatternNode *n = server.pubsub_pattern_index;
+    unsigned char *p = pat->pattern->ptr;
+    size_t j, plen = pubsubPatternPrefixLen(pat->pattern->ptr);
+
+    for (j = 0; j < plen; j++) {
+        int found, idx = pubsubPatternNodeSeek(n,p[j],&found);
+
+        if (!found) {
+            int tail = n->numchildren-idx;
+
+            n->bytes = zrealloc(n->bytes,n->numchildren+1);
+            n->children = zrealloc(n->children,
+                sizeof(pubsubPatternNode*)*(n->numchildren+1));
+            memmove(n->bytes+idx+1,n->bytes+idx,tail);
+            memmove(n->children+idx+1,n->children+idx,
+                sizeof(pubsubPatternNode*)*tail);
+            n->bytes[idx] = p[j];
+            n->children[idx] = pubsubPatternNodeCreate();
+            n->numchildren++;
+        }
+        n = n->children[idx];
+    }
+    if (n->patterns == NULL) n->patterns = listCreate();
+    listAddNodeTail(n->patterns,pat);
+}
+
+/* Remove 'pat' from the subtree rooted at 'n', where 'p' is what is left
+ * of its literal prefix. Returns 1 if 'n' is now empty and can be freed. */
+static int pubsubPatternNodeDelete(pubsubPatternNode *n, pubsubPattern *pat,
+                                   unsigned char *p, size_t plen)
+{
+    if (plen == 0) {
+        listNode *ln = listSearchKey(n->patterns,pat);
+
+        serverAssert(ln != NULL);
+        listDelNode(n->patterns,ln);
+        if (listLength(n->patterns) == 0) {
+            listRelease(n->patterns);
+            n->patterns = NULL;
+        }
+    } else {
+        int found, idx = pubsubPatternNodeSeek(n,p[0],&found);
+
+        serverAssert(found);
+        if (pubsubPatternNodeDelete(n->children[idx],pat,p+1,plen-1)) {
+            int tail = n->numchildren-idx-1;
+
+            pubsubPatternNodeFree(n->children[idx]);
+            memmove(n->bytes+idx,n->bytes+idx+1,tail);
+            memmove(n->children+idx,n->children+idx+1,
+                sizeof(pubsubPatternNode*)*tail);
+            n->numchildren--;
+        }
+    }
+    return n->patterns == NULL && n->numchildren == 0;
+}
+
+/* Remove 'pat' from the index. */
+static void pubsubPatternIndexDelete(pubsubPattern *pat) {
+    sds p = pat->pattern->ptr;
+
+    pubsubPatternNodeDelete(server.pubsub_pattern_index,pat,
+        (unsigned char*)p,pubsubPatternPrefixLen(p));
+}
+
 /* Return the number of channels + patterns a client is subscribed to. */
 int clientSubscriptionsCount(client *c) {
     return dictSize(c->pubsub_channels)+
            listLength(c->pubsub_patterns);
 }
 
+/* Send a Pub/Sub message to a single client, used by the server itself to
+ * notify events. A NULL message is sent as a null bulk. */
+void addReplyPubsubMessage(client *c, robj *channel, robj *msg) {
+    addReply(c,shared.mbulkhdr[3]);
+    addReply(c,shared.messagebulk);
+    addReplyBulk(c,channel);
+    if (msg)
+        addReplyBulk(c,msg);
+    else
+        addReply(c,shared.nullbulk);
+}
+
 /* Subscribe a client to a channel. Returns 1 if the operation succeeded, or
  * 0 if the client was already subscribed to that channel. */
 int pubsubSubscribeChannel(client *c, robj *channel) {
@@ -136,6 +291,7 @@ int pubsubSubscribePattern(client *c, robj *pattern) {
         pat->pattern = getDecodedObject(pattern);
         pat->client = c;
         listAddNodeTail(server.pubsub_patterns,pat);
+        pubsubPatternIndexAdd(pat);
     }
     /* Notify the client */
     addReply(c,shared.mbulkhdr[3]);
@@ -159,6 +315,7 @@ int pubsubUnsubscribePattern(client *c, robj *pattern, int notify) {
         pat.client = c;
         pat.pattern = pattern;
         ln = listSearchKey(server.pubsub_patterns,&pat);
+        pubsubPatternIndexDelete(ln->value);
         listDelNode(server.pubsub_patterns,ln);
     }
     /* Notify the client */
@@ -221,52 +378,81 @@ int pubsubUnsubscribeAllPatterns(client *c, int notify) {
     return count;
 }
 
+/* Build the channel and message part of a message reply. It is the same
+ * for every receiver, so it is created once and referenced by all the
+ * clients output lists instead of being copied for each of them. */
+static robj *pubsubMessagePayload(robj *channel, robj *message) {
+    sds s = sdsempty();
+
+    s = sdsMakeRoomFor(s,sdslen(channel->ptr)+sdslen(message->ptr)+48);
+    s = sdscatprintf(s,"$%zu\r\n",sdslen(channel->ptr));
+    s = sdscatlen(s,channel->ptr,sdslen(channel->ptr));
+    s = sdscatprintf(s,"\r\n$%zu\r\n",sdslen(message->ptr));
+    s = sdscatlen(s,message->ptr,sdslen(message->ptr));
+    s = sdscatlen(s,"\r\n",2);
+    return createObject(OBJ_STRING,s);
+}
+
 /* Publish a message */
 int pubsubPublishMessage(robj *channel, robj *message) {
     int receivers = 0;
+    robj *payload = NULL;
     dictEntry *de;
     listNode *ln;
     listIter li;
 
+    channel = getDecodedObject(channel);
+    message = getDecodedObject(message);
+
     /* Send to clients listening for that channel */
     de = dictFind(server.pubsub_channels,channel);
     if (de) {
         list *list = dictGetVal(de);
-        listNode *ln;
-        listIter li;
 
+        payload = pubsubMessagePayload(channel,message);
         listRewind(list,&li);
         while ((ln = listNext(&li)) != NULL) {
             client *c = ln->value;
 
             addReply(c,shared.mbulkhdr[3]);
             addReply(c,shared.messagebulk);
-            addReplyBulk(c,channel);
-            addReplyBulk(c,message);
+            addReply(c,payload);
             receivers++;
         }
     }
-    /* Send to clients listening to matching channels */
+    /* Send to clients listening to matching channels: only the patterns
+     * whose literal prefix is a prefix of the channel can match it. */
     if (listLength(server.pubsub_patterns)) {
-        listRewind(server.pubsub_patterns,&li);
-        channel = getDecodedObject(channel);
-        while ((ln = listNext(&li)) != NULL) {
-            pubsubPattern *pat = ln->value;
-
-            if (stringmatchlen((char*)pat->pattern->ptr,
-                                sdslen(pat->pattern->ptr),
-                                (char*)channel->ptr,
-                                sdslen(channel->ptr),0)) {
-                addReply(pat->client,shared.mbulkhdr[4]);
-                addReply(pat->client,shared.pmessagebulk);
-                addReplyBulk(pat->client,pat->pattern);
-                addReplyBulk(pat->client,channel);
-                addReplyBulk(pat->client,message);
-                receivers++;
+        pubsubPatternNode *n = server.pubsub_pattern_index;
+        unsigned char *ch = channel->ptr;
+        size_t depth = 0, chlen = sdslen(channel->ptr);
+
+        while (n) {
+            if (n->patterns) {
+                listRewind(n->patterns,&li);
+                while ((ln = listNext(&li)) != NULL) {
+                    pubsubPattern *pat = ln->value;
+                    sds p = pat->pattern->ptr;
+
+                    if (!stringmatchlen(p+depth,sdslen(p)-depth,
+                                        (char*)ch+depth,chlen-depth,0))
+                        continue;
+                    if (payload == NULL)
+                        payload = pubsubMessagePayload(channel,message);
+                    addReply(pat->client,shared.mbulkhdr[4]);
+                    addReply(pat->client,shared.pmessagebulk);
+                    addReplyBulk(pat->client,pat->pattern);
+                    addReply(pat->client,payload);
+                    receivers++;
+                }
             }
+            if (depth == chlen) break;
+            n = pubsubPatternNodeChild(n,ch[depth++]);
         }
-        decrRefCount(channel);
     }
+    if (payload) decrRefCount(payload);
+    decrRefCount(channel);
+    decrRefCount(message);
     return receivers;
 }
 
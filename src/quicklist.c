@@ -33,7 +33,7 @@
 #include "zmalloc.h"
 #include "ziplist.h"
 #include "util.h" /* for ll2string */
-#include "lzf.h"
+#include "codec.h"
 
 #include <signal.h>
 #include <fcntl.h>
@@ -213,20 +213,22 @@ REDIS_STATIC int __quicklistCompressNode(quicklistNode *node) {
         return 0;
     }
 
+    int codec = server.list_compress_codec == CODEC_LZ4 ? CODEC_LZ4 : CODEC_LZF;
     quicklistLZF *lzf = zmalloc(sizeof(*lzf) + node->sz);
 
     /* Cancel if compression fails or doesn't compress small enough */
-    if (((lzf->sz = lzf_compress(node->zl, node->sz, lzf->compressed,
-                                 node->sz)) == 0) ||
+    if (((lzf->sz = codecCompress(codec, node->zl, node->sz, lzf->compressed,
+                                  node->sz)) == 0) ||
         lzf->sz + MIN_COMPRESS_IMPROVE >= node->sz) {
-        /* lzf_compress aborts/rejects compression if value not compressable. */
+        /* The codec aborts/rejects compression if value not compressable. */
         zfree(lzf);
         return 0;
     }
     lzf = zrealloc(lzf, sizeof(*lzf) + lzf->sz);
     zfree(node->zl);
     node->zl = (unsigned char *)lzf;
-    node->encoding = QUICKLIST_NODE_ENCODING_LZF;
+    node->encoding = codec == CODEC_LZ4 ? QUICKLIST_NODE_ENCODING_LZ4 :
+                                          QUICKLIST_NODE_ENCODING_LZF;
     node->recompress = 0;
     return 1;
 }
@@ -255,7 +257,8 @@ REDIS_STATIC int __quicklistDecompressNode(quicklistNode *node) {
 
     void *decompressed = zmalloc(node->sz);
     quicklistLZF *lzf = (quicklistLZF *)node->zl;
-    if (lzf_decompress(lzf->compressed, lzf->sz, decompressed, node->sz) == 0) {
+    if (codecDecompress(quicklistNodeCodec(node), lzf->compressed, lzf->sz,
+                        decompressed, node->sz) == 0) {
         /* Someone requested decompress, but we can't decompress.  Not good. */
         zfree(decompressed);
         return 0;
@@ -269,7 +272,7 @@ REDIS_STATIC int __quicklistDecompressNode(quicklistNode *node) {
 /* Decompress only compressed nodes. */
 #define quicklistDecompressNode(_node)                                         \
     do {                                                                       \
-        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_LZF) {     \
+        if ((_node) && quicklistNodeIsCompressed(_node)) {                     \
             __quicklistDecompressNode((_node));                                \
         }                                                                      \
     } while (0)
@@ -277,17 +280,17 @@ REDIS_STATIC int __quicklistDecompressNode(quicklistNode *node) {
 /* Force node to not be immediately re-compresable */
 #define quicklistDecompressNodeForUse(_node)                                   \
     do {                                                                       \
-        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_LZF) {     \
+        if ((_node) && quicklistNodeIsCompressed(_node)) {                     \
             __quicklistDecompressNode((_node));                                \
             (_node)->recompress = 1;                                           \
         }                                                                      \
     } while (0)
 
-/* Extract the raw LZF data from this quicklistNode.
- * Pointer to LZF data is assigned to '*data'.
- * Return value is the length of compressed LZF data.
+/* Extract the raw compressed data from this quicklistNode.
+ * Pointer to compressed data is assigned to '*data', its codec to '*codec'.
+ * Return value is the length of compressed data.
  * Return -1 if load quicklist from disk failed */
-long quicklistGetLzf(quicklistNode *node, void **data) {
+long quicklistGetCompressed(quicklistNode *node, void **data, int *codec) {
     int rc = C_OK;
     quicklistLZF *lzf = NULL;
 
@@ -298,6 +301,7 @@ long quicklistGetLzf(quicklistNode *node, void **data) {
 
     lzf = (quicklistLZF *)node->zl;
     *data = lzf->compressed;
+    *codec = quicklistNodeCodec(node);
     return lzf->sz;
 }
 
@@ -1438,12 +1442,12 @@ quicklist *quicklistDup(quicklist *orig) {
          current = current->next) {
         quicklistNode *node = quicklistCreateNode(copy);
 
-        if (node->encoding == QUICKLIST_NODE_ENCODING_LZF) {
-            quicklistLZF *lzf = (quicklistLZF *)node->zl;
+        if (quicklistNodeIsCompressed(current)) {
+            quicklistLZF *lzf = (quicklistLZF *)current->zl;
             size_t lzf_sz = sizeof(*lzf) + lzf->sz;
             node->zl = zmalloc(lzf_sz);
             memcpy(node->zl, current->zl, lzf_sz);
-        } else if (node->encoding == QUICKLIST_NODE_ENCODING_RAW) {
+        } else if (current->encoding == QUICKLIST_NODE_ENCODING_RAW) {
             node->zl = zmalloc(current->sz);
             memcpy(node->zl, current->zl, current->sz);
         }
@@ -1895,7 +1899,7 @@ static int _ql_verify(quicklist *ql, uint32_t len, uint32_t count,
                     errors++;
                 }
             } else {
-                if (node->encoding != QUICKLIST_NODE_ENCODING_LZF &&
+                if (!quicklistNodeIsCompressed(node) &&
                     !node->attempted_compress) {
                     yell("Incorrect non-compression: node %d is NOT "
                          "compressed at depth %d ((%u, %u); total "
@@ -2933,7 +2937,7 @@ int quicklistTest(int argc, char *argv[]) {
                                     node->sz);
                             }
                         } else {
-                            if (node->encoding != QUICKLIST_NODE_ENCODING_LZF) {
+                            if (!quicklistNodeIsCompressed(node)) {
                                 ERR("Incorrect non-compression: node %d is NOT "
                                     "compressed at depth %d ((%u, %u); total "
                                     "nodes: %u; size: %u; attempted: %d)",
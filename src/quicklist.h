@@ -40,7 +40,7 @@ struct quicklist;
 /* quicklistNode is a 32 byte struct describing a ziplist for a quicklist.
  * We use bit fields keep the quicklistNode at 32 bytes.
  * count: 16 bits, max 65536 (max zl bytes is 65k, so max count actually < 32k).
- * encoding: 2 bits, RAW=1, LZF=2.
+ * encoding: 2 bits, RAW=1, LZF=2, LZ4=3.
  * container: 2 bits, NONE=1, ZIPLIST=2.
  * recompress: 1 bit, bool, true if node is temporarry decompressed for usage.
  * attempted_compress: 1 bit, boolean, used for verifying during testing.
@@ -54,7 +54,7 @@ typedef struct quicklistNode {
     unsigned long long sno;      /* serial number of quicklistNode */
     sds zl_dstore_key;
     unsigned int count : 16;     /* count of items in ziplist */
-    unsigned int encoding : 2;   /* RAW==1 or LZF==2 */
+    unsigned int encoding : 2;   /* RAW==1, LZF==2 or LZ4==3 */
     unsigned int container : 2;  /* NONE==1 or ZIPLIST==2 */
     unsigned int recompress : 1; /* was this node previous compressed? */
     unsigned int attempted_compress : 1; /* node can't compress; too small */
@@ -64,11 +64,12 @@ typedef struct quicklistNode {
 
 /* quicklistLZF is a 4+N byte struct holding 'sz' followed by 'compressed'.
  * 'sz' is byte length of 'compressed' field.
- * 'compressed' is LZF data with total (compressed) length 'sz'
+ * 'compressed' is LZF or LZ4 data (see the node encoding) with total
+ * (compressed) length 'sz'
  * NOTE: uncompressed length is stored in quicklistNode->sz.
  * When quicklistNode->zl is compressed, node->zl points to a quicklistLZF */
 typedef struct quicklistLZF {
-    unsigned int sz; /* LZF size in bytes*/
+    unsigned int sz; /* Compressed size in bytes*/
     char compressed[];
 } quicklistLZF;
 
@@ -115,6 +116,7 @@ typedef struct quicklistEntry {
 /* quicklist node encodings */
 #define QUICKLIST_NODE_ENCODING_RAW 1
 #define QUICKLIST_NODE_ENCODING_LZF 2
+#define QUICKLIST_NODE_ENCODING_LZ4 3
 
 /* quicklist compression disable */
 #define QUICKLIST_NOCOMPRESS 0
@@ -124,7 +126,11 @@ typedef struct quicklistEntry {
 #define QUICKLIST_NODE_CONTAINER_ZIPLIST 2
 
 #define quicklistNodeIsCompressed(node)                                        \
-    ((node)->encoding == QUICKLIST_NODE_ENCODING_LZF)
+    ((node)->encoding != QUICKLIST_NODE_ENCODING_RAW)
+
+/* Codec of a compressed node, see codec.h. */
+#define quicklistNodeCodec(node)                                               \
+    ((node)->encoding == QUICKLIST_NODE_ENCODING_LZ4 ? CODEC_LZ4 : CODEC_LZF)
 
 /* Prototypes */
 quicklist *quicklistCreate(void);
@@ -180,7 +186,7 @@ int quicklistPop(quicklist *quicklist,
                  long long *slong);
 unsigned int quicklistCount(quicklist *ql);
 int quicklistCompare(unsigned char *p1, unsigned char *p2, int p2_len);
-long quicklistGetLzf(quicklistNode *node, void **data);
+long quicklistGetCompressed(quicklistNode *node, void **data, int *codec);
 
 #ifdef REDIS_TEST
 int quicklistTest(int argc, char *argv[]);
@@ -27,7 +27,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 #include "server.h"
-#include "lzf.h"    /* LZF compression library */
+#include "codec.h"  /* Compression codecs */
 #include "zipmap.h"
 #include "endianconv.h"
 #include "rdb.h"
@@ -172,6 +172,25 @@ int rdbSaveLenToSds(sds *savebuf, uint32_t len) {
     return nwritten;
 }
 
+/* Build the header of a RDB_OPCODE_SEGMENT record: the opcode, the payload
+ * length as a 64 bit little endian integer and the crc64 of the payload
+ * (zero when checksums are disabled). The payload itself is a run of
+ * complete key/value records. Only the opcode is part of the checksum of
+ * the whole file, see dumpSaveThdWriteData(). */
+void rdbSaveSegmentHeaderToSds(sds *savebuf, const char *payload, size_t len) {
+    uint64_t seglen = len;
+    uint64_t cksum = 0;
+
+    rdbSaveTypeToSds(savebuf, RDB_OPCODE_SEGMENT);
+    memrev64ifbe(&seglen);
+    rdbWriteRawToSds(savebuf, &seglen, 8);
+    if (server.rdb_checksum) {
+        cksum = crc64(0, (const unsigned char *)payload, len);
+    }
+    memrev64ifbe(&cksum);
+    rdbWriteRawToSds(savebuf, &cksum, 8);
+}
+
 
 /* Saves an encoded length. The first two bits in the first byte are used to
  * hold the encoding type. See the RDB_* definitions for more information
@@ -319,16 +338,17 @@ int rdbTryIntegerEncoding(char *s, size_t len, unsigned char *enc) {
     return rdbEncodeInteger(value,enc);
 }
 
-ssize_t rdbSaveLzfBlobToSds(sds *savebuf, 
-                            void *data, 
-                            size_t compress_len,
-                            size_t original_len) {
+ssize_t rdbSaveCompressedBlobToSds(sds *savebuf, 
+                                   int codec,
+                                   void *data, 
+                                   size_t compress_len,
+                                   size_t original_len) {
     unsigned char byte = 0;
     ssize_t n = 0;
     ssize_t nwritten = 0;
 
     /* Data compressed! Let's save it on disk */
-    byte = (RDB_ENCVAL << 6) | RDB_ENC_LZF;
+    byte = (RDB_ENCVAL << 6) | RDB_ENC_CODEC(codec);
     n = rdbWriteRawToSds(savebuf, &byte, 1);    
     //if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) goto writeerr;
     nwritten += n;
@@ -351,13 +371,13 @@ ssize_t rdbSaveLzfBlobToSds(sds *savebuf,
     return -1;
 }
 
-ssize_t rdbSaveLzfBlob(rio *rdb, void *data, size_t compress_len,
-                       size_t original_len) {
+ssize_t rdbSaveCompressedBlob(rio *rdb, int codec, void *data,
+                              size_t compress_len, size_t original_len) {
     unsigned char byte;
     ssize_t n, nwritten = 0;
 
     /* Data compressed! Let's save it on disk */
-    byte = (RDB_ENCVAL<<6)|RDB_ENC_LZF;
+    byte = (RDB_ENCVAL<<6)|RDB_ENC_CODEC(codec);
     if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) goto writeerr;
     nwritten += n;
 
@@ -376,9 +396,10 @@ writeerr:
     return -1;
 }
 
-ssize_t rdbSaveLzfStringObjectToSds(sds *savebuf, 
-                                    unsigned char *s, 
-                                    size_t len) {
+ssize_t rdbSaveCompressedStringObjectToSds(sds *savebuf, 
+                                           unsigned char *s, 
+                                           size_t len) {
+    int codec = server.rdb_compression_codec;
     size_t comprlen = 0;
     size_t outlen = 0;
     void *out = NULL;
@@ -395,20 +416,21 @@ ssize_t rdbSaveLzfStringObjectToSds(sds *savebuf,
         return 0;
     }
     
-    comprlen = lzf_compress(s, len, out, outlen);
+    comprlen = codecCompress(codec, s, len, out, outlen);
     if (comprlen == 0) {
         zfree(out);
         return 0;
     }
 
-    nwritten = rdbSaveLzfBlobToSds(savebuf, out, comprlen, len);
+    nwritten = rdbSaveCompressedBlobToSds(savebuf, codec, out, comprlen, len);
     zfree(out);
     
     return nwritten;
 }
 
 
-ssize_t rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
+ssize_t rdbSaveCompressedStringObject(rio *rdb, unsigned char *s, size_t len) {
+    int codec = server.rdb_compression_codec;
     size_t comprlen = 0;
     size_t outlen = 0;
     void *out = NULL;
@@ -425,27 +447,36 @@ ssize_t rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
         return 0;
     }
     
-    comprlen = lzf_compress(s, len, out, outlen);
+    comprlen = codecCompress(codec, s, len, out, outlen);
     if (comprlen == 0) {
         zfree(out);
         return 0;
     }
 
-    nwritten = rdbSaveLzfBlob(rdb, out, comprlen, len);
+    nwritten = rdbSaveCompressedBlob(rdb, codec, out, comprlen, len);
     zfree(out);
     
     return nwritten;
 }
 
-/* Load an LZF compressed string in RDB format. The returned value
+/* Load a string compressed with 'codec' in RDB format. The returned value
  * changes according to 'flags'. For more info check the
  * rdbGenericLoadStringObject() function. */
-void *rdbLoadLzfStringObject(rio *rdb, int flags) {
+void *rdbLoadCompressedStringObject(rio *rdb, int codec, int flags) {
     int plain = flags & RDB_LOAD_PLAIN;
     unsigned int len, clen;
     unsigned char *c = NULL;
     sds val = NULL;
 
+    /* Strings written with a codec this server was built without can't be
+     * loaded at all: stop here with a clear error instead of failing later
+     * on what would look like a corrupted payload. */
+    if (!codecAvailable(codec)) {
+        serverLog(LL_WARNING,"Can't load a string compressed with %s: this "
+                             "server was built without it",codecName(codec));
+        if (rdbCheckMode) rdbCheckSetError("Unsupported compression codec");
+        return NULL;
+    }
     if ((clen = rdbLoadLen(rdb,NULL)) == RDB_LENERR) return NULL;
     if ((len = rdbLoadLen(rdb,NULL)) == RDB_LENERR) return NULL;
     if ((c = zmalloc(clen)) == NULL) goto err;
@@ -459,8 +490,8 @@ void *rdbLoadLzfStringObject(rio *rdb, int flags) {
 
     /* Load the compressed representation and uncompress it to target. */
     if (rioRead(rdb,c,clen) == 0) goto err;
-    if (lzf_decompress(c,clen,val,len) == 0) {
-        if (rdbCheckMode) rdbCheckSetError("Invalid LZF compressed string");
+    if (codecDecompress(codec,c,clen,val,len) == 0) {
+        if (rdbCheckMode) rdbCheckSetError("Invalid compressed string");
         goto err;
     }
     zfree(c);
@@ -495,10 +526,10 @@ ssize_t rdbSaveRawStringToSds(sds *savebuf, unsigned char *s, size_t len) {
         }
     }
 
-    /* Try LZF compression - under 20 bytes it's unable to compress even
+    /* Try compression - under 20 bytes it's unable to compress even
      * aaaaaaaaaaaaaaaaaa so skip it */
     if (server.rdb_compression && len > 20) {
-        n = rdbSaveLzfStringObjectToSds(savebuf, s, len);
+        n = rdbSaveCompressedStringObjectToSds(savebuf, s, len);
         if (n == -1) {
             return -1;
         }
@@ -537,10 +568,10 @@ ssize_t rdbSaveRawString(rio *rdb, unsigned char *s, size_t len) {
         }
     }
 
-    /* Try LZF compression - under 20 bytes it's unable to compress even
+    /* Try compression - under 20 bytes it's unable to compress even
      * aaaaaaaaaaaaaaaaaa so skip it */
     if (server.rdb_compression && len > 20) {
-        n = rdbSaveLzfStringObject(rdb,s,len);
+        n = rdbSaveCompressedStringObject(rdb,s,len);
         if (n == -1) return -1;
         if (n > 0) return n;
         /* Return value of 0 means data can't be compressed, save the old way */
@@ -649,7 +680,11 @@ void *rdbGenericLoadStringObject(rio *rdb, int flags) {
         case RDB_ENC_INT32:
             return rdbLoadIntegerObject(rdb,len,flags);
         case RDB_ENC_LZF:
-            return rdbLoadLzfStringObject(rdb,flags);
+            return rdbLoadCompressedStringObject(rdb,CODEC_LZF,flags);
+        case RDB_ENC_LZ4:
+            return rdbLoadCompressedStringObject(rdb,CODEC_LZ4,flags);
+        case RDB_ENC_ZSTD:
+            return rdbLoadCompressedStringObject(rdb,CODEC_ZSTD,flags);
         default:
             rdbExitReportCorruptRDB("Unknown RDB string encoding type %d",len);
         }
@@ -901,6 +936,7 @@ ssize_t rdbSaveListObjectToSds(dump_task_priv_t *tpriv,
     quicklist *ql = NULL;
     quicklistNode *node = NULL;
     void *data = NULL;
+    int codec = CODEC_LZF;
     
     /* Save a list value */
     if (o->encoding == OBJ_ENCODING_QUICKLIST) {
@@ -924,13 +960,13 @@ ssize_t rdbSaveListObjectToSds(dump_task_priv_t *tpriv,
             } 
             
             if (quicklistNodeIsCompressed(node)) {
-                compress_len = quicklistGetLzf(node, &data);
+                compress_len = quicklistGetCompressed(node, &data, &codec);
                 if (compress_len == -1) {
                     return -1;
                 }
 
-                n = rdbSaveLzfBlobToSds(&tpriv->thd_wrbuf, data, 
-                                        compress_len, node->sz);
+                n = rdbSaveCompressedBlobToSds(&tpriv->thd_wrbuf, codec, data, 
+                                               compress_len, node->sz);
                 if (n == -1) {
                     return -1;
                 }
@@ -1014,10 +1050,9 @@ ssize_t rdbSaveZsetObjectToSds(dump_task_priv_t *tpriv,
     ssize_t nwritten = 0;
     size_t l = 0;
     zset *zs = NULL;
-    dictIterator *di = NULL;
-    dictEntry *de = NULL;
+    zbtCursor cur;
     robj *eleobj = NULL;
-    double *score = NULL;
+    double score = 0;
 
     /* Save a sorted set value */
     if (o->encoding == OBJ_ENCODING_ZIPLIST) {
@@ -1030,7 +1065,6 @@ ssize_t rdbSaveZsetObjectToSds(dump_task_priv_t *tpriv,
         nwritten += n;
     } else if (o->encoding == OBJ_ENCODING_SKIPLIST) {
         zs = o->ptr;
-        di = dictGetIterator(zs->dict);
 
         n = rdbSaveLenToSds(&tpriv->thd_wrbuf, dictSize(zs->dict));
         if (n == -1) {
@@ -1038,9 +1072,10 @@ ssize_t rdbSaveZsetObjectToSds(dump_task_priv_t *tpriv,
         }
         nwritten += n;
 
-        while((de = dictNext(di)) != NULL) {
-            eleobj = dictGetKey(de);
-            score = dictGetVal(de);
+        /* Walk the tree so that elements are saved already ordered. */
+        for (zbtFirst(zs->zbt,&cur); cur.leaf; zbtNext(&cur)) {
+            eleobj = zbtCursorObj(&cur);
+            score = zbtCursorScore(&cur);
 
             n = rdbSaveStringObjectToSds(&tpriv->thd_wrbuf, eleobj);
             if (n == -1) {
@@ -1048,13 +1083,12 @@ ssize_t rdbSaveZsetObjectToSds(dump_task_priv_t *tpriv,
             }
             nwritten += n;
 
-            n = rdbSaveDoubleValueToSds(&tpriv->thd_wrbuf, *score);
+            n = rdbSaveDoubleValueToSds(&tpriv->thd_wrbuf, score);
             if (n == -1) {
                 return -1;
             }
             nwritten += n;
         }
-        dictReleaseIterator(di);
     } else {
         serverPanic("Unknown sorted set encoding");
     }
@@ -1205,12 +1239,15 @@ ssize_t rdbSaveObject(redisDb *db,
                 
                 if (quicklistNodeIsCompressed(node)) {
                     void *data;
-                    long compress_len = quicklistGetLzf(node, &data);
+                    int codec;
+                    long compress_len = quicklistGetCompressed(node, &data,
+                                                               &codec);
                     if (compress_len == -1) {
                         return -1;
                     }
 
-                    n = rdbSaveLzfBlob(rdb, data, compress_len, node->sz);
+                    n = rdbSaveCompressedBlob(rdb, codec, data, compress_len,
+                                              node->sz);
                     if (n == -1) {
                         return -1;
                     }
@@ -1264,22 +1301,21 @@ ssize_t rdbSaveObject(redisDb *db,
             nwritten += n;
         } else if (o->encoding == OBJ_ENCODING_SKIPLIST) {
             zset *zs = o->ptr;
-            dictIterator *di = dictGetIterator(zs->dict);
-            dictEntry *de;
+            zbtCursor cur;
 
             if ((n = rdbSaveLen(rdb,dictSize(zs->dict))) == -1) return -1;
             nwritten += n;
 
-            while((de = dictNext(di)) != NULL) {
-                robj *eleobj = dictGetKey(de);
-                double *score = dictGetVal(de);
+            /* Walk the tree so that elements are saved already ordered. */
+            for (zbtFirst(zs->zbt,&cur); cur.leaf; zbtNext(&cur)) {
+                robj *eleobj = zbtCursorObj(&cur);
 
                 if ((n = rdbSaveStringObject(rdb,eleobj)) == -1) return -1;
                 nwritten += n;
-                if ((n = rdbSaveDoubleValue(rdb,*score)) == -1) return -1;
+                if ((n = rdbSaveDoubleValue(rdb,zbtCursorScore(&cur))) == -1)
+                    return -1;
                 nwritten += n;
             }
-            dictReleaseIterator(di);
         } else {
             serverPanic("Unknown sorted set encoding");
         }
@@ -1353,6 +1389,25 @@ size_t rdbSavedObjectLen(redisDb *db,
     return len;
 }
 
+/* Save the rocksdb encoded value of an on disk key, see RDB_OPCODE_DISKVAL.
+ * Returns -1 on error, number of bytes written on success. */
+static int rdbSaveDiskValPair(rio *rdb, unsigned type, robj *key, 
+                              char *rawval, size_t rawlen) {
+    int n, nwritten = 0;
+
+    if ((n = rdbSaveType(rdb, RDB_OPCODE_DISKVAL)) == -1) return -1;
+    nwritten += n;
+    if ((n = rdbSaveType(rdb, type)) == -1) return -1;
+    nwritten += n;
+    if ((n = rdbSaveStringObject(rdb, key)) == -1) return -1;
+    nwritten += n;
+    if ((n = rdbSaveRawString(rdb, (unsigned char *)rawval, rawlen)) == -1) 
+        return -1;
+    nwritten += n;
+
+    return nwritten;
+}
+
 /* Save a key-value pair, with expire time, type, key, value.
  * On error -1 is returned.
  * On success if the key was actually saved 1 is returned, otherwise 0
@@ -1386,6 +1441,22 @@ int rdbSaveKeyValuePair(redisDb *db, rio *rdb, robj *key, dictEntry *de,
         }
     }
 
+    if (dictIsEntryValOnDisk(de) && server.dump_dstore_raw) {
+        /* Ship the rocksdb encoded value as is */
+        sds *diskkey = getClearedSharedKeySds();
+        char *rawval = NULL;
+        size_t rawlen = 0;
+
+        if (loadRawValFromDiskWithSds(db, de->v_sno, key->ptr, de->v_type, 
+                                      diskkey, &rawval, &rawlen) != C_OK) {
+            return -1;
+        }
+        rc = rdbSaveDiskValPair(rdb, de->v_type, key, rawval, rawlen);
+        rocksFree(rawval);
+
+        return rc == -1 ? -1 : 1;
+    }
+
     if (dictIsEntryValOnDisk(de)) {
         //size_t t_start = mstime();
                
@@ -1501,6 +1572,32 @@ int rdbThdSaveKeyValPair(dump_taskpool_priv_t *ptaskpoolpriv,
         rdbSaveMillisecondTimeToSds(&tpriv->thd_wrbuf, expiredesc->expire_time);
     }
     
+    if (dictIsEntryValOnDisk(pdenode->de) && server.dump_dstore_raw) {
+        /* Ship the rocksdb encoded value as is */
+        char *rawval = NULL;
+        size_t rawlen = 0;
+
+        rc = loadRawValFromDiskWithSds(ptaskext->db, pdenode->de->v_sno, 
+                                       keystr, pdenode->de->v_type, 
+                                       &tpriv->thd_rbuf, &rawval, &rawlen);
+        if (rc != C_OK) {
+            serverLog(LL_WARNING, "load raw value for key(%s) failed",
+                      keystr);
+            return C_ERR;
+        }
+
+        rdbSaveTypeToSds(&tpriv->thd_wrbuf, RDB_OPCODE_DISKVAL);
+        rdbSaveTypeToSds(&tpriv->thd_wrbuf, pdenode->de->v_type);
+        rc = rdbSaveStringObjectToSds(&tpriv->thd_wrbuf, &key);
+        if (rc != -1) {
+            rc = rdbSaveRawStringToSds(&tpriv->thd_wrbuf, 
+                                       (unsigned char *)rawval, rawlen);
+        }
+        rocksFree(rawval);
+
+        return rc == -1 ? C_ERR : C_OK;
+    }
+
     if (dictIsEntryValOnDisk(pdenode->de)) {
         //size_t t_start = mstime();             
         val = loadValObjectFromDiskWithSds(ptaskext->db, 
@@ -1555,6 +1652,7 @@ int rdbSaveThdProc(void *priv)
     dump_denode_t *pdenode = NULL;
     dump_taskpool_priv_t *tpoolpriv = NULL;
     dump_task_priv_t *tpriv = NULL;
+    int canstop = 0;
 
     if (!ptask) {
         return C_OK;
@@ -1576,10 +1674,14 @@ int rdbSaveThdProc(void *priv)
     
     while (1) {
         pdenode = NULL;
-        
-        statistic_getobj((void **)&pdenode, &tpriv->thd_stat);
+        canstop = tpoolpriv->task_can_stop;
+        __sync_synchronize();
+
+        dumpSaveThdGetDentry(tpoolpriv, ptask->task_id, &pdenode);
         if (!pdenode) {
-            if (tpoolpriv->task_can_stop && tpriv->thd_stat.stat_count == 0) {
+            /* task_can_stop was read before every queue was found empty,
+             * so no entry can be queued after this point */
+            if (canstop) {
                 break;
             }
             
@@ -1613,9 +1715,9 @@ int rdbSaveThdProc(void *priv)
         return C_ERR;
     }
 
-    serverLog(LL_WARNING, "Thread %d save %d keys to rdb, "
-              "which started at %ld and duration %ld ms",
-              ptask->task_id, tpriv->thd_opnr, 
+    serverLog(LL_WARNING, "Thread %d save %lld keys (%lld stolen) to rdb, "
+              "which started at %lld and duration %lld ms",
+              ptask->task_id, tpriv->thd_opnr, tpriv->thd_stealnr,
               tpriv->thd_opstart, mstime() - tpriv->thd_opstart);
 
     return C_OK;
@@ -1641,7 +1743,8 @@ int rdbSaveSingleDbCont(redisDb *db, rio *rdb, long long now)
 
     if (server.dump_concurrency == DUMP_CONCURRENCY) {
         rc = dumpSaveTaskpoolInitAndStart(&taskpool, db, rdb, 
-                                now, "DUMPRDB", rdbSaveThdProc);
+                                now, server.dump_segment, 
+                                "DUMPRDB", rdbSaveThdProc);
         if (rc != C_OK) {
             serverLog(LL_WARNING, 
                       "dumpSaveTaskpoolInitAndStart to dump rdb failed");
@@ -2043,7 +2146,6 @@ robj *rdbLoadObject(redisDb *db, sds key, int rdbtype, rio *rdb) {
         while(zsetlen--) {
             robj *ele;
             double score;
-            zskiplistNode *znode;
 
             if ((ele = rdbLoadEncodedStringObject(rdb)) == NULL) return NULL;
             ele = tryObjectEncoding(ele);
@@ -2053,9 +2155,7 @@ robj *rdbLoadObject(redisDb *db, sds key, int rdbtype, rio *rdb) {
             if (sdsEncodedObject(ele) && sdslen(ele->ptr) > maxelelen)
                 maxelelen = sdslen(ele->ptr);
 
-            znode = zslInsert(zs->zsl,score,ele);
-            dictAdd(zs->dict,ele,&znode->score);
-            incrRefCount(ele); /* added to skiplist */
+            zsetAddElement(zs,ele,score);
         }
 
         /* Convert *after* loading, since sorted sets are not stored ordered. */
@@ -2238,6 +2338,158 @@ robj *rdbLoadObject(redisDb *db, sds key, int rdbtype, rio *rdb) {
     return o;
 }
 
+/* Append 'len' bytes read from 'rdb' to '*raw'. Returns -1 on error. */
+static int rdbLoadRawBytes(rio *rdb, sds *raw, size_t len) {
+    size_t oldlen = sdslen(*raw);
+
+    *raw = sdsMakeRoomFor(*raw,len);
+    if (len && rioRead(rdb,*raw+oldlen,len) == 0) return -1;
+    sdsIncrLen(*raw,len);
+    return 0;
+}
+
+/* Like rdbLoadLen() but the bytes read are also appended to '*raw'. */
+static uint32_t rdbLoadRawLen(rio *rdb, sds *raw, int *isencoded) {
+    size_t start = sdslen(*raw);
+    unsigned char *buf;
+    uint32_t len;
+    int type;
+
+    if (isencoded) *isencoded = 0;
+    if (rdbLoadRawBytes(rdb,raw,1) == -1) return RDB_LENERR;
+    buf = (unsigned char*)*raw+start;
+    type = (buf[0]&0xC0)>>6;
+    if (type == RDB_ENCVAL) {
+        if (isencoded) *isencoded = 1;
+        return buf[0]&0x3F;
+    } else if (type == RDB_6BITLEN) {
+        return buf[0]&0x3F;
+    } else if (type == RDB_14BITLEN) {
+        if (rdbLoadRawBytes(rdb,raw,1) == -1) return RDB_LENERR;
+        buf = (unsigned char*)*raw+start;
+        return ((buf[0]&0x3F)<<8)|buf[1];
+    } else if (type == RDB_32BITLEN) {
+        if (rdbLoadRawBytes(rdb,raw,4) == -1) return RDB_LENERR;
+        memcpy(&len,*raw+start+1,4);
+        return ntohl(len);
+    } else {
+        rdbExitReportCorruptRDB(
+            "Unknown length encoding %d in rdbLoadRawLen()",type);
+        return -1; /* Never reached. */
+    }
+}
+
+/* Append to '*raw' a string as saved by rdbSaveRawString(), without
+ * decoding nor decompressing it. Returns -1 on error. */
+static int rdbLoadRawString(rio *rdb, sds *raw) {
+    int isencoded;
+    uint32_t len, clen;
+
+    if ((len = rdbLoadRawLen(rdb,raw,&isencoded)) == RDB_LENERR) return -1;
+    if (isencoded) {
+        switch(len) {
+        case RDB_ENC_INT8: return rdbLoadRawBytes(rdb,raw,1);
+        case RDB_ENC_INT16: return rdbLoadRawBytes(rdb,raw,2);
+        case RDB_ENC_INT32: return rdbLoadRawBytes(rdb,raw,4);
+        case RDB_ENC_LZF:
+        case RDB_ENC_LZ4:
+        case RDB_ENC_ZSTD:
+            if ((clen = rdbLoadRawLen(rdb,raw,NULL)) == RDB_LENERR) return -1;
+            if (rdbLoadRawLen(rdb,raw,NULL) == RDB_LENERR) return -1;
+            return rdbLoadRawBytes(rdb,raw,clen);
+        default:
+            rdbExitReportCorruptRDB("Unknown RDB string encoding type %d",len);
+        }
+    }
+    return rdbLoadRawBytes(rdb,raw,len);
+}
+
+/* Append to '*raw' a double as saved by rdbSaveDoubleValue(). */
+static int rdbLoadRawDoubleValue(rio *rdb, sds *raw) {
+    unsigned char len;
+
+    if (rdbLoadRawBytes(rdb,raw,1) == -1) return -1;
+    len = (*raw)[sdslen(*raw)-1];
+    if (len >= 253) return 0; /* NaN or infinite, no digits follow. */
+    return rdbLoadRawBytes(rdb,raw,len);
+}
+
+/* Load the value of an object of type 'rdbtype' as it is serialized in the
+ * RDB, prefixed by its type. This is exactly the rocksdb encoding of a value
+ * stored as a whole (see rocksLoadObject()), so cold values can be written
+ * into the disk store without building the object. Returns NULL on error. */
+static sds rdbLoadRawObject(rio *rdb, int rdbtype) {
+    unsigned char type = rdbtype;
+    sds raw = sdsnewlen(&type,1);
+    uint32_t len, j;
+
+    if (rdbtype == RDB_TYPE_STRING ||
+        rdbtype == RDB_TYPE_HASH_ZIPMAP ||
+        rdbtype == RDB_TYPE_LIST_ZIPLIST ||
+        rdbtype == RDB_TYPE_SET_INTSET ||
+        rdbtype == RDB_TYPE_ZSET_ZIPLIST ||
+        rdbtype == RDB_TYPE_HASH_ZIPLIST)
+    {
+        if (rdbLoadRawString(rdb,&raw) == -1) goto err;
+    } else if (rdbtype == RDB_TYPE_LIST ||
+               rdbtype == RDB_TYPE_SET ||
+               rdbtype == RDB_TYPE_LIST_QUICKLIST ||
+               rdbtype == RDB_TYPE_ZSET ||
+               rdbtype == RDB_TYPE_HASH)
+    {
+        if ((len = rdbLoadRawLen(rdb,&raw,NULL)) == RDB_LENERR) goto err;
+        for (j = 0; j < len; j++) {
+            if (rdbLoadRawString(rdb,&raw) == -1) goto err;
+            if (rdbtype == RDB_TYPE_ZSET &&
+                rdbLoadRawDoubleValue(rdb,&raw) == -1) goto err;
+            if (rdbtype == RDB_TYPE_HASH &&
+                rdbLoadRawString(rdb,&raw) == -1) goto err;
+        }
+    } else {
+        rdbExitReportCorruptRDB("Unknown RDB encoding type %d",rdbtype);
+    }
+    return raw;
+
+err:
+    sdsfree(raw);
+    return NULL;
+}
+
+/* Return the OBJ_* type of the objects serialized as 'rdbtype'. */
+static int rdbObjectTypeToObjType(int rdbtype) {
+    switch(rdbtype) {
+    case RDB_TYPE_STRING:
+        return OBJ_STRING;
+    case RDB_TYPE_LIST:
+    case RDB_TYPE_LIST_ZIPLIST:
+    case RDB_TYPE_LIST_QUICKLIST:
+        return OBJ_LIST;
+    case RDB_TYPE_SET:
+    case RDB_TYPE_SET_INTSET:
+        return OBJ_SET;
+    case RDB_TYPE_ZSET:
+    case RDB_TYPE_ZSET_ZIPLIST:
+        return OBJ_ZSET;
+    default:
+        return OBJ_HASH;
+    }
+}
+
+/* Return 1 if the value of type 'rdbtype' being loaded has to go cold
+ * as a whole. Lists and hashtable encoded hashes are never stored on disk
+ * as a whole: they are decoded and swapped by saveObjectOnDiskLimit(). */
+static int rdbLoadValueOnDisk(int rdbtype) {
+    int type = rdbObjectTypeToObjType(rdbtype);
+
+    if (!useDiskStore()) return 0;
+    if (type == OBJ_LIST || rdbtype == RDB_TYPE_HASH) return 0;
+    if (type == OBJ_SET &&
+        server.set_use_disk_store == SET_DISK_STORAGE_NOT_USE) return 0;
+    if (type == OBJ_ZSET &&
+        server.zset_use_disk_store == ZSET_DISK_STORAGE_NOT_USE) return 0;
+    return needSaveObjectOnDisk(DISK_STORE_FAST);
+}
+
 /* Mark that we are loading in the global state and setup the fields
  * needed to provide loading stats. */
 void startLoading(FILE *fp) {
@@ -2268,9 +2520,7 @@ void stopLoading(void) {
 
 /* Track loading progress in order to serve client's from time to time
    and if needed calculate rdb checksum  */
-void rdbLoadProgressCallback(rio *r, const void *buf, size_t len) {
-    if (server.rdb_checksum)
-        rioGenericUpdateChecksum(r, buf, len);
+static void rdbLoadProgress(rio *r, size_t len) {
     if (server.loading_process_events_interval_bytes &&
         (r->processed_bytes + len)/server.loading_process_events_interval_bytes > r->processed_bytes/server.loading_process_events_interval_bytes)
     {
@@ -2285,8 +2535,519 @@ void rdbLoadProgressCallback(rio *r, const void *buf, size_t len) {
     }
 }
 
-int rdbLoad(char *filename) {
+void rdbLoadProgressCallback(rio *r, const void *buf, size_t len) {
+    if (server.rdb_checksum)
+        rioGenericUpdateChecksum(r, buf, len);
+    rdbLoadProgress(r, len);
+}
+
+/* Segment payloads carry their own crc64 and are left out of the checksum
+ * of the whole file, see dumpSaveThdWriteData(). */
+static void rdbLoadSegmentProgressCallback(rio *r, const void *buf, size_t len) {
+    UNUSED(buf);
+    rdbLoadProgress(r, len);
+}
+
+/* Read a RDB_OPCODE_SEGMENT record once its opcode was consumed: the
+ * payload length, its crc64 stored into '*cksum' and the payload, which is
+ * returned. Only the opcode is part of the checksum of the whole file.
+ * Returns NULL on short read. */
+sds rdbLoadSegmentPayload(rio *rdb, uint64_t *cksum) {
+    uint64_t len = 0;
+    sds payload = NULL;
+    void (*update_cksum)(struct _rio *, const void *, size_t);
+
+    update_cksum = rdb->update_cksum;
+    rdb->update_cksum = rdbLoadSegmentProgressCallback;
+    if (rioRead(rdb,&len,8) == 0 || rioRead(rdb,cksum,8) == 0) goto done;
+    memrev64ifbe(&len);
+    memrev64ifbe(cksum);
+
+    payload = sdsnewlen(NULL, len);
+    if (rioRead(rdb, payload, len) == 0) {
+        sdsfree(payload);
+        payload = NULL;
+    }
+
+done:
+    rdb->update_cksum = update_cksum;
+    return payload;
+}
+
+/* Consume the optional expire opcode that precedes a key. On return 'type'
+ * holds the type of the object that follows. */
+static int rdbLoadExpireOpcode(rio *rdb, 
+                               int *type, 
+                               long long *expiretime,
+                               int *needdel_realtime) {
+    *expiretime = -1;
+    *needdel_realtime = 0;
+
+    if (*type == RDB_OPCODE_EXPIRETIME 
+        || *type == RDB_OPCODE_REALTIME_EXPIRETIME) {
+        /* EXPIRETIME: load an expire associated with the next key
+         * to load. Note that after loading an expire we need to
+         * load the actual type, and continue. */
+        if ((*expiretime = rdbLoadTime(rdb)) == -1) return C_ERR;
+        /* the EXPIRETIME opcode specifies time in seconds, so convert
+         * into milliseconds. */
+        *expiretime *= 1000;
+    } else if (*type == RDB_OPCODE_EXPIRETIME_MS
+               || *type == RDB_OPCODE_REALTIME_EXPIRETIME_MS) {
+        /* EXPIRETIME_MS: milliseconds precision expire times introduced
+         * with RDB v3. Like EXPIRETIME but no with more precision. */
+        if ((*expiretime = rdbLoadMillisecondTime(rdb)) == -1) return C_ERR;
+    } else {
+        return C_OK;
+    }
+
+    if (*type == RDB_OPCODE_REALTIME_EXPIRETIME
+        || *type == RDB_OPCODE_REALTIME_EXPIRETIME_MS) {
+        *needdel_realtime = 1;
+    }
+
+    /* We read the time so we need to read the object type again. */
+    if ((*type = rdbLoadType(rdb)) == -1) return C_ERR;
+
+    return C_OK;
+}
+
+/* A key/value record as read from the RDB, see rdbLoadKeyVal(). */
+typedef struct {
+    robj *key;
+    robj *val;          // decoded value, NULL if 'rawval' is set
+    robj *rawval;       // value written as it is into the disk store
+    int disktype;       // object type of 'rawval'
+    long long expiretime;
+    int needdel_realtime;
+} rdb_loadkv_t;
+
+static void rdbFreeKeyVal(rdb_loadkv_t *kv) {
+    if (kv->key) decrRefCount(kv->key);
+    if (kv->val) decrRefCount(kv->val);
+    if (kv->rawval) decrRefCount(kv->rawval);
+    kv->key = kv->val = kv->rawval = NULL;
+}
+
+/* Read the key and the value of a record of the given type. The keyspace is
+ * not touched, so the segment loading threads decode with it too.
+ * A RDB_OPCODE_DISKVAL value is kept encoded when the disk store is used,
+ * otherwise it is decoded like a rocksdb value. Values that have to go
+ * cold are not decoded either: their RDB bytes are kept as they are. */
+static int rdbLoadKeyVal(rio *rdb, redisDb *db, int type, rdb_loadkv_t *kv) {
+    kv->key = kv->val = kv->rawval = NULL;
+    kv->disktype = -1;
+
+    if (type == RDB_OPCODE_DISKVAL) {
+        if ((kv->disktype = rdbLoadType(rdb)) == -1) return C_ERR;
+    }
+
+    /* Read key */
+    if ((kv->key = rdbLoadStringObject(rdb)) == NULL) {
+        return C_ERR;
+    }
+
+    /* Read value */
+    if (type == RDB_OPCODE_DISKVAL) {
+        if ((kv->rawval = rdbLoadStringObject(rdb)) == NULL) {
+            goto err;
+        }
+        if (!useDiskStore()) {
+            kv->val = rocksLoadRawValObject(db, kv->key->ptr, 
+                                            kv->rawval->ptr, 
+                                            sdslen(kv->rawval->ptr));
+            decrRefCount(kv->rawval);
+            kv->rawval = NULL;
+            if (kv->val == NULL) {
+                goto err;
+            }
+        }
+    } else if (rdbLoadValueOnDisk(type)) {
+        sds raw = rdbLoadRawObject(rdb, type);
+
+        if (raw == NULL) {
+            goto err;
+        }
+        kv->disktype = rdbObjectTypeToObjType(type);
+        kv->rawval = createObject(OBJ_STRING, raw);
+    } else if ((kv->val = rdbLoadObject(db, kv->key->ptr, 
+                                        type, rdb)) == NULL) {
+        goto err;
+    }
+
+    return C_OK;
+
+err:
+    rdbFreeKeyVal(kv);
+    return C_ERR;
+}
+
+/* Add a record read by rdbLoadKeyVal() to 'db'. The record is consumed
+ * whatever the result. */
+static int rdbAddKeyVal(redisDb *db, rdb_loadkv_t *kv, long long now) {
+    int rc = C_OK;
+    robj *key = kv->key;
+    dictEntry *de = NULL;
+    sds addkey = NULL;
+
+    /* Check if the key already expired. This function is used when loading
+     * an RDB file from disk, either at startup, or when an RDB was
+     * received from the master. In the latter case, the master is
+     * responsible for key expiry. If we would expire keys here, the
+     * snapshot taken by the master may not be reflected on the slave. */
+    if (server.masterhost == NULL 
+        && kv->expiretime != -1 && kv->expiretime < now) {
+        rdbFreeKeyVal(kv);
+        return C_OK;
+    }
+
+    addkey = sdsdup(key->ptr);
+    de = dictAddRaw(db->dict, addkey);
+    if (!de) {
+        sdsfree(addkey);
+        rdbFreeKeyVal(kv);
+        return C_ERR;
+    }
+
+    if (kv->rawval) {
+        rc = saveRawValOnDisk(db, de->v_sno, key->ptr, kv->disktype, 
+                              kv->rawval->ptr, sdslen(kv->rawval->ptr));
+        if (rc != C_OK) {
+            serverLog(LL_WARNING, "load rdb save raw value of key(%s) failed",
+                      (char *)key->ptr);
+            dictDelete(db->dict, key->ptr);
+            rdbFreeKeyVal(kv);
+            return C_ERR;
+        }
+        dictSetEntryValType(de, kv->disktype);
+        dictSetEntryValOnDisk(de, get_event_proc_loop_start_ms());
+    } else {
+        dictSetVal(db->dict, de, kv->val);
+        dictSetEntryValType(de, kv->val->type);
+        dictSetEntryValNotOnDisk(de); 
+        if (kv->val->type == OBJ_LIST) {
+            signalListAsReady(db, key);
+        }
+        kv->val = NULL;
+    }
+
+    if (server.cluster_enabled) {
+        slotToKeyAdd(dictGetKey(de));
+    }   
+          
+    if (useDiskStore() 
+        && needSaveObjectOnDisk(DISK_STORE_FAST)
+        && (!dictIsEntryValOnDisk(de))) {                  
+        rc = saveObjectOnDiskLimit(db, de, 0);
+        if (rc != C_OK) {
+            serverLog(LL_WARNING, 
+                      "load rdb call saveObjectOnDiskLimit failed");
+            rdbFreeKeyVal(kv);
+            return C_ERR;
+        }
+    }
+
+    /* Set the expire time if needed */
+    if (kv->expiretime != -1) {
+        if (kv->needdel_realtime != 0) {
+            setRealtimeExpireFlag(key);
+        }
+        
+        setExpire(db, key, kv->expiretime);
+    }
+
+    rdbFreeKeyVal(kv);
+
+    return C_OK;
+}
+
+/* Load a key and its value of the given type and add them to 'db'. */
+static int rdbLoadKeyValPair(rio *rdb, 
+                             redisDb *db, 
+                             int type,
+                             long long expiretime,
+                             int needdel_realtime,
+                             long long now) {
+    rdb_loadkv_t kv;
+
+    if (rdbLoadKeyVal(rdb, db, type, &kv) == C_ERR) {
+        return C_ERR;
+    }
+    kv.expiretime = expiretime;
+    kv.needdel_realtime = needdel_realtime;
+
+    return rdbAddKeyVal(db, &kv, now);
+}
+
+/* ------------------------- Segment loading ---------------------------------
+ * RDB_OPCODE_SEGMENT records are read by the main thread and handed to a
+ * pool of threads. Each thread checks the crc64 of a segment and only then
+ * decodes its records, which go back to the main thread to be added to the
+ * keyspace: db->dict, the expires and the disk store are only ever touched
+ * by the main thread. A bad segment aborts the load before any of its keys
+ * is added. */
+typedef struct {
+    struct list_head seglist;
+    redisDb *db;
+    sds payload;
+    uint64_t cksum;
+    rdb_loadkv_t *kvs;  // records decoded from 'payload'
+    size_t kvnr;
+    int failed;         // bad checksum or bad record
+} rdb_segment_t;
+
+typedef struct {
+    statistic_head_t seg_todo;  // segments to check and decode
+    statistic_head_t seg_done;  // segments to add to the keyspace
+    long long seg_inflight;     // queued and not added yet, main thread only
+    int seg_can_stop;
+} rdb_segload_priv_t;
+
+static void rdbSegmentNodeFree(void *pobj) {
+    rdb_segment_t *pseg = (rdb_segment_t *)pobj;
+    size_t i = 0;
+
+    for (i = 0; i < pseg->kvnr; i++) {
+        rdbFreeKeyVal(&pseg->kvs[i]);
+    }
+    zfree(pseg->kvs);
+    sdsfree(pseg->payload);
+    zfree(pseg);
+}
+
+static int rdbSegmentFree(void *pobj, void *pstat) {
+    return statistic_freeobj_custom(pobj, pstat, rdbSegmentNodeFree);
+}
+
+static int rdbSegLoadPrivGen(task_pool_t *ptaskpool) {
+    rdb_segload_priv_t *lpriv = NULL;
+
+    lpriv = zcalloc(sizeof(*lpriv));
+    if (statistic_head_init(&lpriv->seg_todo, 1, NULL) == -1) {
+        serverLog(LL_WARNING, "statistic_head_init for segment load failed");
+        zfree(lpriv);
+        return C_ERR;
+    }
+    if (statistic_head_init(&lpriv->seg_done, 1, NULL) == -1) {
+        serverLog(LL_WARNING, "statistic_head_init for segment load failed");
+        statistic_head_finalize(&lpriv->seg_todo);
+        zfree(lpriv);
+        return C_ERR;
+    }
+    lpriv->seg_todo.stat_ops.stat_freeobj = rdbSegmentFree;
+    lpriv->seg_done.stat_ops.stat_freeobj = rdbSegmentFree;
+    ptaskpool->taskpool_taskprivdata = lpriv;
+
+    return C_OK;
+}
+
+static int rdbSegLoadPrivRelease(task_pool_t *ptaskpool) {
+    rdb_segload_priv_t *lpriv = NULL;
+
+    lpriv = (rdb_segload_priv_t *)ptaskpool->taskpool_taskprivdata;
+    if (lpriv) {
+        statistic_head_finalize(&lpriv->seg_todo);
+        statistic_head_finalize(&lpriv->seg_done);
+        zfree(lpriv);
+        ptaskpool->taskpool_taskprivdata = NULL;
+    }
+
+    return C_OK;
+}
+
+/* Decode the records of a segment whose checksum was verified. */
+static int rdbSegmentDecode(rdb_segment_t *pseg) {
+    int type;
+    size_t kvsize = 0;
+    size_t len = sdslen(pseg->payload);
+    rio segrdb;
+    rdb_loadkv_t *kv = NULL;
+
+    rioInitWithBuffer(&segrdb, pseg->payload);
+    while (segrdb.io.buffer.pos < (off_t)len) {
+        if (pseg->kvnr == kvsize) {
+            kvsize = kvsize ? kvsize * 2 : 64;
+            pseg->kvs = zrealloc(pseg->kvs, kvsize * sizeof(rdb_loadkv_t));
+        }
+        kv = &pseg->kvs[pseg->kvnr];
+
+        if ((type = rdbLoadType(&segrdb)) == -1) return C_ERR;
+        if (rdbLoadExpireOpcode(&segrdb, &type, &kv->expiretime, 
+                                &kv->needdel_realtime) == C_ERR) {
+            return C_ERR;
+        }
+        if (!rdbIsObjectType(type) && type != RDB_OPCODE_DISKVAL) {
+            serverLog(LL_WARNING, "Unexpected opcode %d in RDB segment", type);
+            return C_ERR;
+        }
+        if (rdbLoadKeyVal(&segrdb, pseg->db, type, kv) == C_ERR) {
+            return C_ERR;
+        }
+        pseg->kvnr++;
+    }
+
+    return C_OK;
+}
+
+static int rdbSegLoadThdProc(void *priv) {
+    int canstop = 0;
+    task_desc_t *ptask = (task_desc_t *)priv;
+    rdb_segment_t *pseg = NULL;
+    rdb_segload_priv_t *lpriv = NULL;
+
+    lpriv = (rdb_segload_priv_t *)ptask->task_ppool->taskpool_taskprivdata;
+    /* The objects are built off the main thread: dictAdd() must not retire
+     * entries into the global copy rehashing state. */
+    dictDisableCopyRehashInThread();
+    while (1) {
+        pseg = NULL;
+        canstop = lpriv->seg_can_stop;
+        __sync_synchronize();
+
+        statistic_getobj((void **)&pseg, &lpriv->seg_todo);
+        if (!pseg) {
+            if (canstop) {
+                break;
+            }
+
+            usleep(5);
+            continue;
+        }
+
+        if (server.rdb_checksum && pseg->cksum != 0 
+            && crc64(0, (unsigned char *)pseg->payload, 
+                     sdslen(pseg->payload)) != pseg->cksum) {
+            serverLog(LL_WARNING, "Wrong RDB segment checksum.");
+            pseg->failed = 1;
+        } else if (rdbSegmentDecode(pseg) != C_OK) {
+            serverLog(LL_WARNING, "Bad record in RDB segment.");
+            pseg->failed = 1;
+        }
+        sdsfree(pseg->payload);
+        pseg->payload = NULL;
+
+        if (statistic_addobj(&pseg->seglist, &lpriv->seg_done) < 0) {
+            serverLog(LL_WARNING, "add decoded RDB segment failed");
+            rdbSegmentNodeFree(pseg);
+            ptask->task_ppool->taskpool_hasfailed++;
+        }
+    }
+
+    return C_OK;
+}
+
+/* Add the records of the decoded segments to the keyspace, waiting for
+ * the pool until no more than 'maxinflight' segments are left in it. */
+static int rdbSegLoadDrain(task_pool_t *segpool, 
+                           long long now, 
+                           long long maxinflight) {
+    size_t i = 0;
+    int rc = C_OK;
+    rdb_segment_t *pseg = NULL;
+    rdb_segload_priv_t *lpriv = NULL;
+
+    lpriv = (rdb_segload_priv_t *)segpool->taskpool_taskprivdata;
+    while (1) {
+        pseg = NULL;
+        statistic_getobj((void **)&pseg, &lpriv->seg_done);
+        if (!pseg) {
+            if (lpriv->seg_inflight <= maxinflight 
+                || segpool->taskpool_hasfailed) {
+                break;
+            }
+
+            usleep(5);
+            continue;
+        }
+
+        lpriv->seg_inflight--;
+        if (pseg->failed) {
+            rdbSegmentNodeFree(pseg);
+            rdbExitReportCorruptRDB("RDB segment CRC or format error");
+        }
+
+        for (i = 0; i < pseg->kvnr && rc == C_OK; i++) {
+            rc = rdbAddKeyVal(pseg->db, &pseg->kvs[i], now);
+        }
+        rdbSegmentNodeFree(pseg);
+        if (rc != C_OK) {
+            return C_ERR;
+        }
+    }
+
+    return segpool->taskpool_hasfailed ? C_ERR : C_OK;
+}
+
+/* Add what is left in the pool to the keyspace and stop it. */
+static int rdbSegLoadPoolFinal(task_pool_t *segpool, long long now) {
+    int rc = C_OK;
+    rdb_segload_priv_t *lpriv = NULL;
+
+    lpriv = (rdb_segload_priv_t *)segpool->taskpool_taskprivdata;
+    rc = rdbSegLoadDrain(segpool, now, 0);
+    lpriv->seg_can_stop = 1;
+    multitask_pool_wait(segpool);
+    multitask_pool_destroy(segpool);
+
+    return rc;
+}
+
+/* Load a RDB_OPCODE_SEGMENT record of the selected DB and queue it to the
+ * segment loading pool, which is started the first time a segment shows
+ * up. The records decoded so far are added to the keyspace meanwhile. */
+static int rdbLoadSegment(rio *rdb, 
+                          redisDb *db, 
+                          long long now,
+                          task_pool_t *segpool,
+                          int *segpool_started) {
     int rc = C_OK;
+    uint64_t cksum = 0;
+    sds payload = NULL;
+    rdb_segment_t *pseg = NULL;
+    rdb_segload_priv_t *lpriv = NULL;
+
+    if ((payload = rdbLoadSegmentPayload(rdb, &cksum)) == NULL) {
+        return C_ERR;
+    }
+
+    if (!*segpool_started) {
+        rc = multitask_pool_init(segpool, "RDBSEGLOAD", server.dump_thdnr,
+                                 rdbSegLoadThdProc, rdbSegLoadPrivGen,
+                                 rdbSegLoadPrivRelease);
+        if (rc < 0) {
+            serverLog(LL_WARNING, "multitask_pool_init to load rdb failed");
+            sdsfree(payload);
+            return C_ERR;
+        }
+
+        rc = multitask_pool_start(segpool);
+        if (rc < 0) {
+            serverLog(LL_WARNING, 
+                      "multitask_pool_start to load rdb failed");
+            multitask_pool_destroy(segpool);
+            sdsfree(payload);
+            return C_ERR;
+        }
+        *segpool_started = 1;
+    }
+
+    pseg = zcalloc(sizeof(*pseg));
+    init_list_head(&pseg->seglist);
+    pseg->db = db;
+    pseg->payload = payload;
+    pseg->cksum = cksum;
+    lpriv = (rdb_segload_priv_t *)segpool->taskpool_taskprivdata;
+    if (statistic_addobj(&pseg->seglist, &lpriv->seg_todo) < 0) {
+        rdbSegmentNodeFree(pseg);
+        return C_ERR;
+    }
+    lpriv->seg_inflight++;
+
+    /* Bound the memory held by segments read ahead of the keyspace */
+    return rdbSegLoadDrain(segpool, now, 2 * (long long)server.dump_thdnr);
+}
+
+int rdbLoad(char *filename) {
     uint32_t dbid;
     int type, rdbver;
     redisDb *db = server.db+0;
@@ -2295,8 +3056,8 @@ int rdbLoad(char *filename) {
     long long expiretime, now = mstime();
     FILE *fp;
     rio rdb;
-    dictEntry *de = NULL;
-    sds addkey = NULL;
+    task_pool_t segpool;
+    int segpool_started = 0;
 
     if ((fp = fopen(filename,"r")) == NULL) return C_ERR;
 
@@ -2320,52 +3081,34 @@ int rdbLoad(char *filename) {
     }
 
     startLoading(fp);
-    while(1) {
-        robj *key, *val;
-        expiretime = -1;
-        needdel_realtime = 0;
 
+    /* Values that go cold while loading are sorted into SST files and
+     * ingested in bulk, instead of one memtable put per object. */
+    if (useDiskStore() && server.dstore_bulkload) {
+        rocksBulkLoadBegin();
+    }
+
+    while(1) {
         /* Read type. */
         if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
 
         /* Handle special types. */
-        if (type == RDB_OPCODE_EXPIRETIME) {
-            /* EXPIRETIME: load an expire associated with the next key
-             * to load. Note that after loading an expire we need to
-             * load the actual type, and continue. */
-            if ((expiretime = rdbLoadTime(&rdb)) == -1) goto eoferr;
-            /* We read the time so we need to read the object type again. */
-            if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
-            /* the EXPIRETIME opcode specifies time in seconds, so convert
-             * into milliseconds. */
-            expiretime *= 1000;
-        } else if (type == RDB_OPCODE_EXPIRETIME_MS) {
-            /* EXPIRETIME_MS: milliseconds precision expire times introduced
-             * with RDB v3. Like EXPIRETIME but no with more precision. */
-            if ((expiretime = rdbLoadMillisecondTime(&rdb)) == -1) goto eoferr;
-            /* We read the time so we need to read the object type again. */
-            if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
-        } else if(type == RDB_OPCODE_REALTIME_EXPIRETIME) {
-            /* EXPIRETIME: load an expire associated with the next key
-             * to load. Note that after loading an expire we need to
-             * load the actual type, and continue. */
-            if ((expiretime = rdbLoadTime(&rdb)) == -1) goto eoferr;
-            /* We read the time so we need to read the object type again. */
-            if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
-            /* the EXPIRETIME opcode specifies time in seconds, so convert
-             * into milliseconds. */
-            expiretime *= 1000;
-            needdel_realtime = 1;
-        } else if (type == RDB_OPCODE_REALTIME_EXPIRETIME_MS) {
-            /* EXPIRETIME_MS: milliseconds precision expire times introduced
-             * with RDB v3. Like EXPIRETIME but no with more precision. */
-            if ((expiretime = rdbLoadMillisecondTime(&rdb)) == -1) goto eoferr;
-            /* We read the time so we need to read the object type again. */
-            if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
-            needdel_realtime = 1;
-        } else if (type == RDB_OPCODE_EOF) {
+        if (rdbLoadExpireOpcode(&rdb, &type, &expiretime, 
+                                &needdel_realtime) == C_ERR) {
+            goto eoferr;
+        }
+
+        if (type == RDB_OPCODE_EOF) {
             /* EOF: End of file, exit the main loop. */
             break;
+        } else if (type == RDB_OPCODE_SEGMENT) {
+            /* SEGMENT: a run of key/value records of the selected DB
+             * written by one dump thread, see dumpSaveThdWriteData(). */
+            if (rdbLoadSegment(&rdb, db, now, 
+                               &segpool, &segpool_started) == C_ERR) {
+                goto eoferr;
+            }
+            continue; /* Read type again. */
         } else if (type == RDB_OPCODE_SELECTDB) {
             /* SELECTDB: Select the specified database. */
             if ((dbid = rdbLoadLen(&rdb,NULL)) == RDB_LENERR)
@@ -2419,71 +3162,24 @@ int rdbLoad(char *filename) {
             continue; /* Read type again. */
         }
 
-        /* Read key */
-        if ((key = rdbLoadStringObject(&rdb)) == NULL) {
-            goto eoferr;
-        }
-
-        addkey = sdsdup(key->ptr);
-        de = dictAddRaw(db->dict, addkey);
-        if (!de) {
-            sdsfree(addkey);
-            decrRefCount(key);
+        if (rdbLoadKeyValPair(&rdb, db, type, expiretime, 
+                              needdel_realtime, now) == C_ERR) {
             goto eoferr;
         }
-        
-        /* Read value */
-        if ((val = rdbLoadObject(db, key->ptr, type, &rdb)) == NULL) {             
-            dictDelete(db->dict, key->ptr);
-            decrRefCount(key);
-            goto eoferr;
-        }
-        /* Check if the key already expired. This function is used when loading
-         * an RDB file from disk, either at startup, or when an RDB was
-         * received from the master. In the latter case, the master is
-         * responsible for key expiry. If we would expire keys here, the
-         * snapshot taken by the master may not be reflected on the slave. */
-        if (server.masterhost == NULL && expiretime != -1 && expiretime < now) {
-            dictDelete(db->dict, key->ptr);
-            decrRefCount(key);
-            decrRefCount(val);
-            continue;
-        }
-
-        dictSetVal(db->dict, de, val);
-        dictSetEntryValType(de, val->type);
-        dictSetEntryValNotOnDisk(de); 
-   
-        if (val && val->type == OBJ_LIST) {
-            signalListAsReady(db, key);
-        }
-        
-        if (server.cluster_enabled) {
-            slotToKeyAdd(key);
-        }   
-              
-        if (useDiskStore() 
-            && needSaveObjectOnDisk(DISK_STORE_FAST)
-            && (!dictIsEntryValOnDisk(de))) {                  
-            rc = saveObjectOnDiskLimit(db, de, 0);
-            if (rc != C_OK) {
-                serverLog(LL_WARNING, 
-                          "load rdb call saveObjectOnDiskLimit failed");
-                goto eoferr;
-            }
-        }
+    }
 
-        /* Set the expire time if needed */
-        if (expiretime != -1) {
-            if (needdel_realtime != 0) {
-                setRealtimeExpireFlag(key);
-            }
-            
-            setExpire(db, key, expiretime);
-        }
+    /* Add the segments still being decoded to the keyspace */
+    if (segpool_started && rdbSegLoadPoolFinal(&segpool, now) != C_OK) {
+        goto eoferr;
+    }
 
-        decrRefCount(key);
+    if (rocksBulkLoadEnd() != C_OK) {
+        serverLog(LL_WARNING,"Ingest values into rocksdb failed loading DB.");
+        fclose(fp);
+        stopLoading();
+        return C_ERR;
     }
+
     /* Verify the checksum if RDB version is >= 5 */
     if (rdbver >= 5 && server.rdb_checksum) {
         uint64_t cksum, expected = rdb.cksum;
@@ -66,6 +66,9 @@
 #define RDB_ENC_INT16 1       /* 16 bit signed integer */
 #define RDB_ENC_INT32 2       /* 32 bit signed integer */
 #define RDB_ENC_LZF 3         /* string compressed with FASTLZ */
+#define RDB_ENC_LZ4 4         /* string compressed with LZ4 */
+#define RDB_ENC_ZSTD 5        /* string compressed with ZSTD */
+#define RDB_ENC_CODEC(codec) (RDB_ENC_LZF+(codec)) /* See codec.h */
 
 /* Dup object types to RDB object types. Only reason is readability (are we
  * dealing with RDB types or with in-memory object types?). */
@@ -89,6 +92,8 @@
 #define rdbIsObjectType(t) ((t >= 0 && t <= 4) || (t >= 9 && t <= 14))
 
 /* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType). */
+#define RDB_OPCODE_DISKVAL    246  /* obj type, key, rocksdb encoded value */
+#define RDB_OPCODE_SEGMENT    247  /* 64 bit len, crc64, key/value records */
 #define RDB_OPCODE_REALTIME_EXPIRETIME_MS 248
 #define RDB_OPCODE_REALTIME_EXPIRETIME 249
 #define RDB_OPCODE_AUX        250
@@ -131,7 +136,10 @@ void backgroundSaveDoneHandler(int exitcode, int bysignal);
 int rdbSaveKeyValuePair(redisDb *db, rio *rdb, robj *key, dictEntry *de, 
                         expireExtDesc *expiretime, long long now);
 robj *rdbLoadStringObject(rio *rdb);
+ssize_t rdbSaveRawString(rio *rdb, unsigned char *s, size_t len);
 int rdbTryIntegerEncoding(char *s, size_t len, unsigned char *enc);
 int rdbEncodeInteger(long long value, unsigned char *enc);
+void rdbSaveSegmentHeaderToSds(sds *savebuf, const char *payload, size_t len);
+sds rdbLoadSegmentPayload(rio *rdb, uint64_t *cksum);
 
 #endif
@@ -29,6 +29,7 @@
 
 #include "server.h"
 #include "rdb.h"
+#include "rocks.h"
 
 #include <stdarg.h>
 
@@ -44,6 +45,7 @@ struct {
     unsigned long keys;             /* Number of keys processed. */
     unsigned long expires;          /* Number of keys with an expire. */
     unsigned long already_expired;  /* Number of keys already expired. */
+    unsigned long segments;         /* Number of segments processed. */
     int doing;                      /* The state while reading the RDB. */
     int error_set;                  /* True if error is populated. */
     char error[1024];
@@ -59,6 +61,7 @@ struct {
 #define RDB_CHECK_DOING_CHECK_SUM 5
 #define RDB_CHECK_DOING_READ_LEN 6
 #define RDB_CHECK_DOING_READ_AUX 7
+#define RDB_CHECK_DOING_READ_SEGMENT 8
 
 char *rdb_check_doing_string[] = {
     "start",
@@ -68,7 +71,8 @@ char *rdb_check_doing_string[] = {
     "read-object-value",
     "check-sum",
     "read-len",
-    "read-aux"
+    "read-aux",
+    "read-segment"
 };
 
 char *rdb_type_string[] = {
@@ -93,6 +97,8 @@ void rdbShowGenericInfo(void) {
     printf("[info] %lu keys read\n", rdbstate.keys);
     printf("[info] %lu expires\n", rdbstate.expires);
     printf("[info] %lu already expired\n", rdbstate.already_expired);
+    if (rdbstate.segments)
+        printf("[info] %lu segments\n", rdbstate.segments);
 }
 
 /* Called on RDB errors. Provides details about the RDB and the offset
@@ -172,12 +178,125 @@ void rdbCheckSetupSignals(void) {
     sigaction(SIGILL, &act, NULL);
 }
 
+/* Check a key/value record, 'type' being the type read before it: an
+ * expire opcode, RDB_OPCODE_DISKVAL or an object type. Returns 0 on
+ * success, 1 if the type is invalid, which is already reported, and -1 on
+ * short read or bad value. */
+int rdbCheckKeyValPair(rio *rdb, int type, uint64_t dbid, long long now) {
+    robj *key, *val;
+    long long expiretime = -1;
+    int disktype = -1;
+
+    /* Handle special types. */
+    if (type == RDB_OPCODE_EXPIRETIME ||
+        type == RDB_OPCODE_REALTIME_EXPIRETIME) {
+        rdbstate.doing = RDB_CHECK_DOING_READ_EXPIRE;
+        /* EXPIRETIME: load an expire associated with the next key
+         * to load. Note that after loading an expire we need to
+         * load the actual type, and continue. */
+        if ((expiretime = rdbLoadTime(rdb)) == -1) return -1;
+        /* We read the time so we need to read the object type again. */
+        rdbstate.doing = RDB_CHECK_DOING_READ_TYPE;
+        if ((type = rdbLoadType(rdb)) == -1) return -1;
+        /* the EXPIRETIME opcode specifies time in seconds, so convert
+         * into milliseconds. */
+        expiretime *= 1000;
+    } else if (type == RDB_OPCODE_EXPIRETIME_MS ||
+               type == RDB_OPCODE_REALTIME_EXPIRETIME_MS) {
+        /* EXPIRETIME_MS: milliseconds precision expire times introduced
+         * with RDB v3. Like EXPIRETIME but no with more precision. */
+        rdbstate.doing = RDB_CHECK_DOING_READ_EXPIRE;
+        if ((expiretime = rdbLoadMillisecondTime(rdb)) == -1) return -1;
+        /* We read the time so we need to read the object type again. */
+        rdbstate.doing = RDB_CHECK_DOING_READ_TYPE;
+        if ((type = rdbLoadType(rdb)) == -1) return -1;
+    }
+
+    if (type == RDB_OPCODE_DISKVAL) {
+        /* DISKVAL: the object type, then a value encoded like it is
+         * stored in rocksdb. */
+        if ((disktype = rdbLoadType(rdb)) == -1) return -1;
+        rdbstate.key_type = disktype;
+    } else if (!rdbIsObjectType(type)) {
+        rdbCheckError("Invalid object type: %d", type);
+        return 1;
+    } else {
+        rdbstate.key_type = type;
+    }
+
+    /* Read key */
+    rdbstate.doing = RDB_CHECK_DOING_READ_KEY;
+    if ((key = rdbLoadStringObject(rdb)) == NULL) return -1;
+    rdbstate.key = key;
+    rdbstate.keys++;
+    /* Read value */
+    rdbstate.doing = RDB_CHECK_DOING_READ_OBJECT_VALUE;
+    if (type == RDB_OPCODE_DISKVAL) {
+        robj *rawval = rdbLoadStringObject(rdb);
+
+        val = NULL;
+        if (rawval) {
+            val = rocksLoadRawValObject(server.db + dbid, key->ptr,
+                                        rawval->ptr, sdslen(rawval->ptr));
+            decrRefCount(rawval);
+        }
+    } else {
+        val = rdbLoadObject(server.db + dbid, key->ptr, type, rdb);
+    }
+    if (val == NULL) return -1;
+    /* Check if the key already expired. This function is used when loading
+     * an RDB file from disk, either at startup, or when an RDB was
+     * received from the master. In the latter case, the master is
+     * responsible for key expiry. If we would expire keys here, the
+     * snapshot taken by the master may not be reflected on the slave. */
+    if (server.masterhost == NULL && expiretime != -1 && expiretime < now)
+        rdbstate.already_expired++;
+    if (expiretime != -1) rdbstate.expires++;
+    rdbstate.key = NULL;
+    decrRefCount(key);
+    decrRefCount(val);
+    rdbstate.key_type = -1;
+    return 0;
+}
+
+/* Check a RDB_OPCODE_SEGMENT record: its crc64 first, then every record
+ * of its payload. Returns like rdbCheckKeyValPair(). */
+int rdbCheckSegment(rio *rdb, uint64_t dbid, long long now) {
+    int type, retval = 0;
+    uint64_t cksum;
+    sds payload;
+    rio segrdb;
+
+    rdbstate.doing = RDB_CHECK_DOING_READ_SEGMENT;
+    if ((payload = rdbLoadSegmentPayload(rdb,&cksum)) == NULL) return -1;
+    rdbstate.segments++;
+    if (server.rdb_checksum && cksum != 0 &&
+        crc64(0,(unsigned char*)payload,sdslen(payload)) != cksum)
+    {
+        rdbCheckError("RDB segment CRC error");
+        sdsfree(payload);
+        return 1;
+    }
+
+    rioInitWithBuffer(&segrdb,payload);
+    while (retval == 0 && segrdb.io.buffer.pos < (off_t)sdslen(payload)) {
+        rdbstate.doing = RDB_CHECK_DOING_READ_TYPE;
+        if ((type = rdbLoadType(&segrdb)) == -1) {
+            retval = -1;
+            break;
+        }
+        retval = rdbCheckKeyValPair(&segrdb,type,dbid,now);
+    }
+    sdsfree(payload);
+    return retval;
+}
+
 /* Check the specified RDB file. */
 int redis_check_rdb(char *rdbfilename) {
     uint64_t dbid = 0;
-    int type, rdbver;
+    int type, rdbver, retval;
     char buf[1024];
-    long long expiretime, now = mstime();
+    long long now = mstime();
     FILE *fp;
     rio rdb;
 
@@ -200,37 +319,20 @@ int redis_check_rdb(char *rdbfilename) {
 
     startLoading(fp);
     while(1) {
-        robj *key, *val;
-        expiretime = -1;
-
         /* Read type. */
         rdbstate.doing = RDB_CHECK_DOING_READ_TYPE;
         if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
 
         /* Handle special types. */
-        if (type == RDB_OPCODE_EXPIRETIME) {
-            rdbstate.doing = RDB_CHECK_DOING_READ_EXPIRE;
-            /* EXPIRETIME: load an expire associated with the next key
-             * to load. Note that after loading an expire we need to
-             * load the actual type, and continue. */
-            if ((expiretime = rdbLoadTime(&rdb)) == -1) goto eoferr;
-            /* We read the time so we need to read the object type again. */
-            rdbstate.doing = RDB_CHECK_DOING_READ_TYPE;
-            if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
-            /* the EXPIRETIME opcode specifies time in seconds, so convert
-             * into milliseconds. */
-            expiretime *= 1000;
-        } else if (type == RDB_OPCODE_EXPIRETIME_MS) {
-            /* EXPIRETIME_MS: milliseconds precision expire times introduced
-             * with RDB v3. Like EXPIRETIME but no with more precision. */
-            rdbstate.doing = RDB_CHECK_DOING_READ_EXPIRE;
-            if ((expiretime = rdbLoadMillisecondTime(&rdb)) == -1) goto eoferr;
-            /* We read the time so we need to read the object type again. */
-            rdbstate.doing = RDB_CHECK_DOING_READ_TYPE;
-            if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
-        } else if (type == RDB_OPCODE_EOF) {
+        if (type == RDB_OPCODE_EOF) {
             /* EOF: End of file, exit the main loop. */
             break;
+        } else if (type == RDB_OPCODE_SEGMENT) {
+            /* SEGMENT: a run of key/value records of the selected DB. */
+            retval = rdbCheckSegment(&rdb,dbid,now);
+            if (retval == -1) goto eoferr;
+            if (retval == 1) return 1;
+            continue; /* Read type again. */
         } else if (type == RDB_OPCODE_SELECTDB) {
             /* SELECTDB: Select the specified database. */
             rdbstate.doing = RDB_CHECK_DOING_READ_LEN;
@@ -265,37 +367,12 @@ int redis_check_rdb(char *rdbfilename) {
             decrRefCount(auxkey);
             decrRefCount(auxval);
             continue; /* Read type again. */
-        } else {
-            if (!rdbIsObjectType(type)) {
-                rdbCheckError("Invalid object type: %d", type);
-                return 1;
-            }
-            rdbstate.key_type = type;
         }
 
-        /* Read key */
-        rdbstate.doing = RDB_CHECK_DOING_READ_KEY;
-        if ((key = rdbLoadStringObject(&rdb)) == NULL) goto eoferr;
-        rdbstate.key = key;
-        rdbstate.keys++;
-        /* Read value */
-        rdbstate.doing = RDB_CHECK_DOING_READ_OBJECT_VALUE;
-        val = rdbLoadObject(server.db + dbid, key->ptr, type, &rdb);
-        if (val == NULL) {
-            goto eoferr;
-        }
-        /* Check if the key already expired. This function is used when loading
-         * an RDB file from disk, either at startup, or when an RDB was
-         * received from the master. In the latter case, the master is
-         * responsible for key expiry. If we would expire keys here, the
-         * snapshot taken by the master may not be reflected on the slave. */
-        if (server.masterhost == NULL && expiretime != -1 && expiretime < now)
-            rdbstate.already_expired++;
-        if (expiretime != -1) rdbstate.expires++;
-        rdbstate.key = NULL;
-        decrRefCount(key);
-        decrRefCount(val);
-        rdbstate.key_type = -1;
+        /* Read an optional expire, the key and its value. */
+        retval = rdbCheckKeyValPair(&rdb,type,dbid,now);
+        if (retval == -1) goto eoferr;
+        if (retval == 1) return 1;
     }
     /* Verify the checksum if RDB version is >= 5 */
     if (rdbver >= 5 && server.rdb_checksum) {
@@ -304,6 +304,26 @@ void rioSetAutoSync(rio *r, off_t bytes) {
     r->io.file.autosync = bytes;
 }
 
+/* Flush a file-based rio object and return its file descriptor, so that
+ * several threads can write past the current position with pwrite() instead
+ * of serializing on the stdio stream. Once they are done rioFileSkip() must
+ * be called with the number of bytes they wrote. Returns -1 if the object
+ * is not file-based or the flush failed. */
+int rioFileFd(rio *r) {
+    if (r->read != rioFileIO.read) return -1;
+    if (fflush(r->io.file.fp) == EOF) return -1;
+    return fileno(r->io.file.fp);
+}
+
+/* Move the position of a file-based rio object past 'len' bytes written
+ * with pwrite(), see rioFileFd(). Returns 1 or 0 for success/failure. */
+int rioFileSkip(rio *r, off_t len) {
+    serverAssert(r->read == rioFileIO.read);
+    if (fseeko(r->io.file.fp, len, SEEK_CUR) == -1) return 0;
+    r->processed_bytes += len;
+    return 1;
+}
+
 /* --------------------------- Higher level interface --------------------------
  *
  * The following higher level functions use lower level rio.c functions to help
@@ -141,5 +141,7 @@ size_t rioWriteBulkDoubleToSds(sds *savebuf, double d);
 
 void rioGenericUpdateChecksum(rio *r, const void *buf, size_t len);
 void rioSetAutoSync(rio *r, off_t bytes);
+int rioFileFd(rio *r);
+int rioFileSkip(rio *r, off_t len);
 
 #endif
@@ -59,6 +59,24 @@
 #include <unistd.h>  // sysconf() - get CPU count
 
 rocksdb_context_t g_rocksdb_context;
+rocks_bulkload_t g_rocks_bulkload;
+
+unsigned int dictSdsHash(const void *key);
+int dictSdsKeyCompare(void *privdata, const void *key1, const void *key2);
+
+/* keys buffered by the bulk load, owned by the entries themselves */
+static dictType rocksBulkLoadDictType = {
+    dictSdsHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictSdsKeyCompare,          /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
+static rocks_bulkload_entry_t *rocksBulkLoadLookup(const char *key, 
+                                                   size_t keylen);
+static void rocksBulkLoadDelete(void *state, const char *key, size_t keylen);
 
 rocksdb_context_t *get_rocksdb_context(void) {
     return &g_rocksdb_context;
@@ -343,6 +361,10 @@ int32_t write_to_rocksdb(char *key,  size_t keylen, char *value,  size_t vallen)
     char *err = NULL;
     rocksdb_context_t *procksdbctx = get_rocksdb_context();
 
+    if (g_rocks_bulkload.active) {
+        return rocksBulkLoadAdd(key, keylen, value, vallen);
+    }
+
     //serverLog(LL_WARNING, "write Key(%s) to rocksdb", key);
     rocksdb_put(procksdbctx->db, procksdbctx->writeoptions, 
                        key, keylen, value, vallen, &err);
@@ -360,8 +382,20 @@ int get_from_rocksdb(char *key, size_t keylen, char **value, size_t *pvallen)
 {
     char *err = NULL;
     char *returned_value = NULL;
+    rocks_bulkload_entry_t *ent = NULL;
     rocksdb_context_t *procksdbctx = get_rocksdb_context();
 
+    /* values still buffered for the next SST file are served from there */
+    if ((ent = rocksBulkLoadLookup(key, keylen)) != NULL) {
+        if (!ent->val) {
+            return C_ERR;
+        }
+        *value = zlibc_malloc(sdslen(ent->val));
+        memcpy(*value, ent->val, sdslen(ent->val));
+        *pvallen = sdslen(ent->val);
+        return C_OK;
+    }
+
     //serverLog(LL_WARNING, "get Key(%s) from rocksdb", key);
     
     returned_value = rocksdb_get(procksdbctx->db, procksdbctx->readoptions, 
@@ -379,11 +413,57 @@ int get_from_rocksdb(char *key, size_t keylen, char **value, size_t *pvallen)
     return C_OK;
 }
 
+/* Read 'num' keys with a single rocksdb MultiGet. values[j] is set to NULL
+ * for the keys that could not be read, the other ones must be released
+ * with rocksFree() after used. Returns the number of values read. */
+int multi_get_from_rocksdb(size_t num, char **keys, size_t *keylens,
+                           char **values, size_t *vallens)
+{
+    size_t j;
+    int found = 0;
+    char **errs = zcalloc(sizeof(char*)*num);
+    rocks_bulkload_entry_t *ent = NULL;
+    rocksdb_context_t *procksdbctx = get_rocksdb_context();
+
+    rocksdb_multi_get(procksdbctx->db, procksdbctx->readoptions, num,
+                      (const char * const *)keys, keylens, values, vallens,
+                      errs);
+    for (j = 0; j < num; j++) {
+        /* values still buffered for the next SST file are newer */
+        if ((ent = rocksBulkLoadLookup(keys[j], keylens[j])) != NULL) {
+            rocksFree(errs[j]);
+            rocksFree(values[j]);
+            errs[j] = values[j] = NULL;
+            if (ent->val) {
+                values[j] = zlibc_malloc(sdslen(ent->val));
+                memcpy(values[j], ent->val, sdslen(ent->val));
+                vallens[j] = sdslen(ent->val);
+            }
+        }
+
+        if (errs[j]) {
+            serverLog(LL_WARNING, "rocksdb multi read Key(%s) failed:%s",
+                      keys[j], errs[j]);
+            rocksFree(errs[j]);
+            rocksFree(values[j]);
+            values[j] = NULL;
+        } else if (values[j]) {
+            found++;
+        }
+    }
+    zfree(errs);
+
+    return found;
+}
+
 int del_from_rocksdb(char *key, size_t keylen)
 {
     char *err = NULL;
     rocksdb_context_t *procksdbctx = get_rocksdb_context();
 
+    /* drop the buffered value, the older ones are deleted below */
+    rocksBulkLoadDelete(NULL, key, keylen);
+
     //serverLog(LL_WARNING, "del Key(%s) from rocksdb", key);
     
     rocksdb_delete(procksdbctx->db, procksdbctx->writeoptions, key, keylen,  &err);
@@ -395,6 +475,288 @@ int del_from_rocksdb(char *key, size_t keylen)
     return C_OK;
 }
 
+rocksdb_writebatch_t *del_batch_create(void)
+{
+    return rocksdb_writebatch_create();
+}
+
+void del_batch_add(rocksdb_writebatch_t *batch, char *key, size_t keylen)
+{
+    rocksdb_writebatch_delete(batch, key, keylen);
+}
+
+/* write all the deletes of 'batch' at once and destroy it, so freeing big
+ * values costs one rocksdb write instead of one per node or field */
+int del_batch_commit(rocksdb_writebatch_t *batch)
+{
+    char *err = NULL;
+    rocksdb_context_t *procksdbctx = get_rocksdb_context();
+
+    if (rocksdb_writebatch_count(batch) == 0) {
+        rocksdb_writebatch_destroy(batch);
+        return C_OK;
+    }
+
+    /* drop the buffered values, the older ones are deleted below */
+    if (g_rocks_bulkload.active && g_rocks_bulkload.entnr) {
+        rocksdb_writebatch_iterate(batch, NULL, NULL, rocksBulkLoadDelete);
+    }
+
+    rocksdb_write(procksdbctx->db, procksdbctx->writeoptions, batch, &err);
+    if (err) {
+        serverLog(LL_WARNING, "rocksdb delete %d keys failed:%s\n",
+                  rocksdb_writebatch_count(batch), err);
+        rocksdb_writebatch_destroy(batch);
+        return C_ERR;
+    }
+
+    rocksdb_writebatch_destroy(batch);
+    return C_OK;
+}
+
+static int rocksBulkLoadEntryCmp(const void *a, const void *b)
+{
+    const rocks_bulkload_entry_t *ea = a;
+    const rocks_bulkload_entry_t *eb = b;
+    size_t la = sdslen(ea->key);
+    size_t lb = sdslen(eb->key);
+    int cmp = memcmp(ea->key, eb->key, la < lb ? la : lb);
+
+    if (cmp) {
+        return cmp;
+    }
+
+    return la < lb ? -1 : (la > lb);
+}
+
+/* the buffered entry of 'key', valid until the next buffered value */
+static rocks_bulkload_entry_t *rocksBulkLoadLookup(const char *key, 
+                                                   size_t keylen)
+{
+    rocks_bulkload_t *pbulk = &g_rocks_bulkload;
+    dictEntry *de = NULL;
+    sds k = NULL;
+
+    if (!pbulk->active || !pbulk->entnr) {
+        return NULL;
+    }
+
+    k = sdsnewlen(key, keylen);
+    de = dictFind(pbulk->index, k);
+    sdsfree(k);
+
+    return de ? pbulk->ents + dictGetUnsignedIntegerVal(de) : NULL;
+}
+
+/* forget the buffered value of a deleted key, the entry is skipped when
+** the SST file is written. 'state' is unused, this is also the delete
+** callback of rocksdb_writebatch_iterate() */
+static void rocksBulkLoadDelete(void *state, const char *key, size_t keylen)
+{
+    rocks_bulkload_entry_t *ent = rocksBulkLoadLookup(key, keylen);
+    UNUSED(state);
+
+    if (ent && ent->val) {
+        g_rocks_bulkload.bufsize -= sdslen(ent->val);
+        sdsfree(ent->val);
+        ent->val = NULL;
+    }
+}
+
+/*
+** Start buffering the rocksdb writes of a RDB load. Values are sorted 
+** in memory and ingested as SST files instead of going through the
+** memtable one put at a time. Reads of buffered keys are served from the
+** buffer, and deletes drop them from it, so that point operations never
+** cut an SST file.
+** return C_OK if success
+** return C_ERR if failed
+*/
+int rocksBulkLoadBegin(void)
+{
+    rocks_bulkload_t *pbulk = &g_rocks_bulkload;
+
+    if (pbulk->active) {
+        return C_OK;
+    }
+
+    memset(pbulk, 0, sizeof(*pbulk));
+    pbulk->index = dictCreate(&rocksBulkLoadDictType, NULL);
+    pbulk->envoptions = rocksdb_envoptions_create();
+    pbulk->ingestoptions = rocksdb_ingestexternalfileoptions_create();
+    rocksdb_ingestexternalfileoptions_set_move_files(pbulk->ingestoptions, 1);
+    rocksdb_ingestexternalfileoptions_set_allow_global_seqno(
+                                            pbulk->ingestoptions, 1);
+    rocksdb_ingestexternalfileoptions_set_allow_blocking_flush(
+                                            pbulk->ingestoptions, 1);
+    pbulk->active = 1;
+
+    return C_OK;
+}
+
+/*
+** Sort the buffered values, write them into one SST file and ingest it.
+** return C_OK if success
+** return C_ERR if failed
+*/
+int rocksBulkLoadFlush(void)
+{
+    int rc = C_OK;
+    size_t i = 0;
+    char *err = NULL;
+    char sstpath[ROCKSDB_PATH_LEN_MAX + 64];
+    const char *sstfiles[1];
+    rocksdb_sstfilewriter_t *writer = NULL;
+    rocks_bulkload_t *pbulk = &g_rocks_bulkload;
+    rocksdb_context_t *procksdbctx = get_rocksdb_context();
+
+    if (!pbulk->entnr) {
+        return C_OK;
+    }
+
+    qsort(pbulk->ents, pbulk->entnr, sizeof(rocks_bulkload_entry_t),
+          rocksBulkLoadEntryCmp);
+
+    snprintf(sstpath, sizeof(sstpath), "%s.bulkload.%d.%llu.sst",
+             server.rocksdb_data_path, (int)getpid(), pbulk->filenr);
+    writer = rocksdb_sstfilewriter_create(pbulk->envoptions, 
+                                          procksdbctx->options);
+    rocksdb_sstfilewriter_open(writer, sstpath, &err);
+    if (err) {
+        serverLog(LL_WARNING, "rocksdb open sst file(%s) failed:%s", 
+                  sstpath, err);
+        rc = C_ERR;
+        goto out;
+    }
+
+    for (i = 0; i < pbulk->entnr; i++) {
+        rocks_bulkload_entry_t *ent = pbulk->ents + i;
+
+        if (!ent->val) {
+            continue;
+        }
+
+        rocksdb_sstfilewriter_put(writer, ent->key, sdslen(ent->key),
+                                  ent->val, sdslen(ent->val), &err);
+        if (err) {
+            serverLog(LL_WARNING, "rocksdb add Key(%s) to sst file failed:%s",
+                      ent->key, err);
+            rc = C_ERR;
+            goto out;
+        }
+    }
+
+    rocksdb_sstfilewriter_finish(writer, &err);
+    if (err) {
+        serverLog(LL_WARNING, "rocksdb finish sst file(%s) failed:%s", 
+                  sstpath, err);
+        rc = C_ERR;
+        goto out;
+    }
+
+    sstfiles[0] = sstpath;
+    rocksdb_ingest_external_file(procksdbctx->db, sstfiles, 1, 
+                                 pbulk->ingestoptions, &err);
+    if (err) {
+        serverLog(LL_WARNING, "rocksdb ingest sst file(%s) failed:%s", 
+                  sstpath, err);
+        rc = C_ERR;
+        goto out;
+    }
+
+    serverLog(LL_VERBOSE, "rocksdb ingested %zu keys (%llu bytes) from %s",
+              pbulk->entnr, pbulk->bufsize, sstpath);
+    pbulk->filenr++;
+
+out:
+    if (err) {
+        rocksFree(err);
+        unlink(sstpath);
+    }
+    rocksdb_sstfilewriter_destroy(writer);
+    dictEmpty(pbulk->index, NULL);
+    for (i = 0; i < pbulk->entnr; i++) {
+        sdsfree(pbulk->ents[i].key);
+        sdsfree(pbulk->ents[i].val);
+    }
+    pbulk->entnr = 0;
+    pbulk->bufsize = 0;
+
+    return rc;
+}
+
+/*
+** Buffer one value of the bulk load, the SST file is cut when the
+** buffer grows over 'dstore-bulkload-buf-size'. A key written twice
+** keeps only the last value.
+** return C_OK if success
+** return C_ERR if failed
+*/
+int rocksBulkLoadAdd(char *key, size_t keylen, char *value, size_t vallen)
+{
+    rocks_bulkload_t *pbulk = &g_rocks_bulkload;
+    rocks_bulkload_entry_t *ent = rocksBulkLoadLookup(key, keylen);
+
+    if (ent) {
+        if (ent->val) {
+            pbulk->bufsize -= sdslen(ent->val);
+            sdsfree(ent->val);
+        }
+        ent->val = sdsnewlen(value, vallen);
+        pbulk->bufsize += vallen;
+        return C_OK;
+    }
+
+    if (pbulk->entnr == pbulk->entcap) {
+        pbulk->entcap = pbulk->entcap ? pbulk->entcap * 2 : 1024;
+        pbulk->ents = zrealloc(pbulk->ents, 
+                               pbulk->entcap * sizeof(*pbulk->ents));
+    }
+
+    ent = pbulk->ents + pbulk->entnr;
+    ent->key = sdsnewlen(key, keylen);
+    ent->val = sdsnewlen(value, vallen);
+    dictSetUnsignedIntegerVal(dictAddRaw(pbulk->index, ent->key), 
+                              pbulk->entnr);
+    pbulk->entnr++;
+    pbulk->bufsize += keylen + vallen;
+
+    if (pbulk->bufsize >= server.dstore_bulkload_bufsize) {
+        return rocksBulkLoadFlush();
+    }
+
+    return C_OK;
+}
+
+/*
+** Ingest the rest of the buffered values and go back to plain puts.
+** return C_OK if success
+** return C_ERR if failed
+*/
+int rocksBulkLoadEnd(void)
+{
+    int rc = C_OK;
+    rocks_bulkload_t *pbulk = &g_rocks_bulkload;
+
+    if (!pbulk->active) {
+        return C_OK;
+    }
+
+    rc = rocksBulkLoadFlush();
+    if (pbulk->filenr) {
+        serverLog(LL_NOTICE, "rocksdb bulk load ingested %llu sst files",
+                  pbulk->filenr);
+    }
+
+    zfree(pbulk->ents);
+    dictRelease(pbulk->index);
+    rocksdb_envoptions_destroy(pbulk->envoptions);
+    rocksdb_ingestexternalfileoptions_destroy(pbulk->ingestoptions);
+    memset(pbulk, 0, sizeof(*pbulk));
+
+    return rc;
+}
+
 void real_release_rocksdb_snapshot(void)
 {
     rocksdb_context_t *procksdbctx = get_rocksdb_context();
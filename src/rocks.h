@@ -54,6 +54,24 @@ typedef struct rocksdb_context {
     rocksdb_block_based_table_options_t *block_options; /* recksdb block options */
 } rocksdb_context_t;
 
+// value buffered by the bulk load, see rocksBulkLoadAdd()
+typedef struct rocks_bulkload_entry {
+    sds key;
+    sds val;                  // NULL if deleted after it was buffered
+} rocks_bulkload_entry_t;
+
+typedef struct rocks_bulkload {
+    int active;
+    rocks_bulkload_entry_t *ents;
+    size_t entnr;
+    size_t entcap;
+    dict *index;              // buffered key -> position in 'ents'
+    unsigned long long bufsize;   // key and value bytes buffered
+    unsigned long long filenr;    // SST files ingested so far
+    rocksdb_envoptions_t *envoptions;
+    rocksdb_ingestexternalfileoptions_t *ingestoptions;
+} rocks_bulkload_t;
+
 // structure for buffer accessing
 typedef struct accbuf {
     char *val_buf;         // buffer to storage value content
@@ -68,7 +86,16 @@ int init_rocksdb_context(char *dbpath,
                          rocksdbStoreOptions *dboptions);
 int32_t write_to_rocksdb(char *key, size_t keylen, char *value, size_t vallen);
 int get_from_rocksdb(char *key, size_t keylen, char **value, size_t *pvallen);
+int multi_get_from_rocksdb(size_t num, char **keys, size_t *keylens,
+                           char **values, size_t *vallens);
 int del_from_rocksdb(char *key, size_t keylen);
+rocksdb_writebatch_t *del_batch_create(void);
+void del_batch_add(rocksdb_writebatch_t *batch, char *key, size_t keylen);
+int del_batch_commit(rocksdb_writebatch_t *batch);
+int rocksBulkLoadBegin(void);
+int rocksBulkLoadAdd(char *key, size_t keylen, char *value, size_t vallen);
+int rocksBulkLoadFlush(void);
+int rocksBulkLoadEnd(void);
 int backup_rocksdb(void);
 int restore_rocksdb(char *dbpath);
 void release_rocksdb_context(void);
@@ -84,6 +111,23 @@ robj *loadValObjectFromDiskWithSds(redisDb *db,
                                    uint32_t type, 
                                    sds *diskkey);
 int loadObjectFromDisk(redisDb *db, dictEntry *de);
+int loadObjectsFromDisk(redisDb *db, dictEntry **des, int num);
+int loadRawValsFromDisk(redisDb *db, dictEntry **des, int num,
+                        char **rawvals, size_t *rawlens);
+int loadRawValFromDiskWithSds(redisDb *db, 
+                              unsigned long long desno,
+                              sds key, 
+                              uint32_t type, 
+                              sds *diskkey,
+                              char **rawval,
+                              size_t *rawlen);
+int saveRawValOnDisk(redisDb *db, 
+                     unsigned long long desno, 
+                     sds key, 
+                     unsigned type,
+                     char *rawval, 
+                     size_t rawlen);
+robj *rocksLoadRawValObject(redisDb *db, sds key, char *rawval, size_t rawlen);
 int loadHashFieldValueFromDisk(redisDb *db, 
                                unsigned long long desno,
                                sds hkey, 
@@ -155,6 +199,10 @@ void freeHashFieldVal(redisDb *db,
                     unsigned char type,
                     dict *d,                    
                     dictEntry *de);                 
+void delValPartsOnDisk(redisDb *db, 
+                       unsigned long long desno,
+                       sds key, 
+                       robj *val);
 
 void rocksFree(void *ptr);
 int saveObjectOnDiskLimit(redisDb *db, dictEntry *de, int limit);
@@ -34,7 +34,7 @@
 #include "latency.h"
 #include "git_version.h"
 #include "rocks.h"
-#include "lzf.h"
+#include "codec.h"
 #include "rdb.h"
 #include "dict.h"
 #include "const.h"
@@ -345,8 +345,8 @@ int rocksSaveLen(sds *psaveval, uint32_t len)
 ** return -1 if failed
 ** return bytes if success
 */
-ssize_t rocksSaveLzfBlob(sds *psaveval, void *data, 
-                         size_t compress_len, size_t original_len) 
+ssize_t rocksSaveCompressedBlob(sds *psaveval, int codec, void *data, 
+                                size_t compress_len, size_t original_len) 
 {
     unsigned char byte = 0;
     ssize_t len = 0;
@@ -354,7 +354,7 @@ ssize_t rocksSaveLzfBlob(sds *psaveval, void *data,
     int rc = C_OK;
 
     /* Data compressed! Let's save it on disk */
-    byte = (RDB_ENCVAL << 6) | RDB_ENC_LZF;
+    byte = (RDB_ENCVAL << 6) | RDB_ENC_CODEC(codec);
 
     rc = rockssdscatlen(psaveval, &byte, 1);
     if (rc != C_OK) {
@@ -388,7 +388,9 @@ ssize_t rocksSaveLzfBlob(sds *psaveval, void *data,
 ** return -1 if do compression failed
 ** return bytes if do compression success
 */
-ssize_t rocksSaveLzfStringObject(sds *psaveval, unsigned char *s, size_t len) {
+ssize_t rocksSaveCompressedStringObject(sds *psaveval, unsigned char *s, 
+                                        size_t len) {
+    int codec = server.dstore_compression_codec;
     size_t comprlen = 0;
     size_t outlen = 0;
     ssize_t nwritten = 0;
@@ -405,13 +407,13 @@ ssize_t rocksSaveLzfStringObject(sds *psaveval, unsigned char *s, size_t len) {
         return 0;
     }
     
-    comprlen = lzf_compress(s, len, out, outlen);
+    comprlen = codecCompress(codec, s, len, out, outlen);
     if (comprlen == 0) {
         zfree(out);
         return 0;
     }
     
-    nwritten = rocksSaveLzfBlob(psaveval, out, comprlen, len);    
+    nwritten = rocksSaveCompressedBlob(psaveval, codec, out, comprlen, len);    
     zfree(out);
     
     return nwritten;
@@ -442,10 +444,10 @@ ssize_t rocksSaveRawString(sds *psaveval, unsigned char *s, size_t len)
         }
     }
 
-    /* Try LZF compression - under 20 bytes it's unable to compress even
+    /* Try compression - under 20 bytes it's unable to compress even
      * aaaaaaaaaaaaaaaaaa so skip it */
     if (server.rdb_compression && len > 20) {
-        n = rocksSaveLzfStringObject(psaveval, s, len);
+        n = rocksSaveCompressedStringObject(psaveval, s, len);
         if (n == -1) {
             return -1;
         }
@@ -610,6 +612,7 @@ int rocksGenListObjectVal(robj *val, sds *psaveval)
     quicklistNode *node = NULL;
     void *data = NULL;
     ssize_t compress_len = 0;
+    int codec = CODEC_LZF;
     ssize_t n = 0;
     size_t nwritten = 0;
     
@@ -636,12 +639,13 @@ int rocksGenListObjectVal(robj *val, sds *psaveval)
 
     do {
         if (quicklistNodeIsCompressed(node)) {
-            compress_len = quicklistGetLzf(node, &data);
+            compress_len = quicklistGetCompressed(node, &data, &codec);
             if (compress_len == -1) {
                 return -1;
             } 
             
-            n = rocksSaveLzfBlob(psaveval, data, compress_len, node->sz);
+            n = rocksSaveCompressedBlob(psaveval, codec, data, compress_len, 
+                                        node->sz);
             if (n == -1) {
                 return -1;
             }            
@@ -668,10 +672,9 @@ int rocksGenZsetObjectVal(robj *val, sds *psaveval)
     ssize_t nwritten = 0;
     size_t l = 0;
     zset *zs = NULL;
-    dictIterator *di = NULL;
-    dictEntry *de = NULL;
+    zbtCursor cur;
     robj *eleobj = NULL;
-    double *score = NULL;
+    double score = 0;
     int rc = C_OK;
 
     rc = rocksSaveObjectType(psaveval, val);
@@ -691,7 +694,6 @@ int rocksGenZsetObjectVal(robj *val, sds *psaveval)
         nwritten += n;
     } else if (val->encoding == OBJ_ENCODING_SKIPLIST) {
         zs = val->ptr;
-        di = dictGetIterator(zs->dict);
 
         n = rocksSaveLen(psaveval, dictSize(zs->dict));
         if (n == -1) {
@@ -700,9 +702,10 @@ int rocksGenZsetObjectVal(robj *val, sds *psaveval)
         
         nwritten += n;
 
-        while((de = dictNext(di)) != NULL) {
-            eleobj = dictGetKey(de);
-            score = dictGetVal(de);
+        /* Walk the tree so that elements are saved already ordered. */
+        for (zbtFirst(zs->zbt, &cur); cur.leaf; zbtNext(&cur)) {
+            eleobj = zbtCursorObj(&cur);
+            score = zbtCursorScore(&cur);
 
             n = rocksGenStringObjectVal(eleobj, psaveval, 
                                         ROCKS_NOT_SAVE_STRING_TYPE);
@@ -711,13 +714,12 @@ int rocksGenZsetObjectVal(robj *val, sds *psaveval)
             }            
             nwritten += n;
 
-            n = rocksSaveDoubleValue(psaveval, *score);
+            n = rocksSaveDoubleValue(psaveval, score);
             if (n == -1) {
                 return -1;
             }            
             nwritten += n;
         }
-        dictReleaseIterator(di);
     } else {
         serverLog(LL_WARNING, "Unknown sorted set encoding");
         return -1;
@@ -1202,6 +1204,7 @@ int saveListObjectOnDisk(redisDb *db,
     quicklist *ql = NULL;
     void *data = NULL;
     ssize_t compress_len = 0;
+    int codec = CODEC_LZF;
     ssize_t n = 0;
     sds *diskkey = NULL;
     sds *diskval = NULL;
@@ -1259,12 +1262,12 @@ int saveListObjectOnDisk(redisDb *db,
         }                     
         
         if (quicklistNodeIsCompressed(ql->iterator)) {
-            compress_len = quicklistGetLzf(ql->iterator, &data);
+            compress_len = quicklistGetCompressed(ql->iterator, &data, &codec);
             if (compress_len == -1) {
                 n = -1;
             } else {
-                n = rocksSaveLzfBlob(diskval, data, 
-                                     compress_len, ql->iterator->sz);  
+                n = rocksSaveCompressedBlob(diskval, codec, data, 
+                                            compress_len, ql->iterator->sz);  
             }
         } else {
             n = rocksSaveRawString(diskval, 
@@ -1776,10 +1779,10 @@ void freeListNodes(redisDb *db,
                    sds key, 
                    robj *val)
 {
-    int rc = C_OK;
     quicklist *ql = NULL;
     quicklistNode *node = NULL;
     sds *diskkey = NULL;
+    rocksdb_writebatch_t *batch = NULL;
     
     if (val->encoding != OBJ_ENCODING_QUICKLIST) {
         serverLog(LL_WARNING, "Unknown list encoding:%d", val->encoding);
@@ -1788,6 +1791,7 @@ void freeListNodes(redisDb *db,
        
     ql = val->ptr;    
     node = ql->head;
+    batch = del_batch_create();
     
     while (node) {
         if (node->zl_ondisk != VAL_ON_DISK) {
@@ -1804,14 +1808,15 @@ void freeListNodes(redisDb *db,
                              db->id, val->type, key, node->sno);
         }                     
                              
-        rc = del_from_rocksdb(*diskkey, sdslen(*diskkey));
-        if (rc != C_OK) {
-            serverLog(LL_WARNING, 
-                    "delete key(%s) from rocksdb failed", *diskkey);             
-        }
+        del_batch_add(batch, *diskkey, sdslen(*diskkey));
 
         node = node->next;
     } 
+
+    if (del_batch_commit(batch) != C_OK) {
+        serverLog(LL_WARNING, 
+                "delete nodes of list(%s) from rocksdb failed", key);             
+    }
 }
 
 
@@ -1852,6 +1857,37 @@ void freeZsetEnrty(redisDb *db,
     freeEnrtyPub(db, key, dt, de, type);
 }
 
+/* build in 'diskkey' the rocksdb key of the hash field 'de' of KEY 'key' */
+static void catHashFieldDiskKey(sds *diskkey,
+                                redisDb *db, 
+                                unsigned long long desno,
+                                sds key,
+                                unsigned char type,
+                                dictEntry *de)
+{
+    robj *curkey = getDecodedObject(dictGetKey(de));
+
+    if (rocksNeedExchangeKey(key)) {
+        if (rocksNeedExchangeKey((sds)curkey->ptr)) {
+            *diskkey = sdscatfmt(*diskkey, "%i_%u_%U_%U", 
+                         db->id, type, desno, de->v_sno);
+        } else {
+            *diskkey = sdscatfmt(*diskkey, "%i_%u_%U_%S", 
+                         db->id, type, desno, (sds)curkey->ptr);
+        }                 
+    } else {
+        if (rocksNeedExchangeKey((sds)curkey->ptr)) {
+            *diskkey = sdscatfmt(*diskkey, "%i_%u_%S_%U", 
+                         db->id, type, key, de->v_sno); 
+        } else {
+            *diskkey = sdscatfmt(*diskkey, "%i_%u_%S_%S", 
+                         db->id, type, key, (sds)curkey->ptr); 
+        }                 
+    }
+
+    decrRefCount(curkey);  
+}
+
 /* free whole dentry content in certain dict.
  *  @db      server.db[xx]
  *  @key     KEY refers to dict 'd' in 'db'
@@ -1867,40 +1903,17 @@ void freeHashFieldVal(redisDb *db,
                     dictEntry *de)
 {
     int rc = C_OK;
-    robj *curkey = NULL;
     sds *diskkey = NULL;
     
     if (dictIsEntryValOnDisk(de)) {      
         diskkey = getClearedSharedKeySds();
-        
-        curkey = dictGetKey(de);
-        curkey = getDecodedObject(curkey);         
-
-        if (rocksNeedExchangeKey(key)) {
-            if (rocksNeedExchangeKey((sds)curkey->ptr)) {
-                *diskkey = sdscatfmt(*diskkey, "%i_%u_%U_%U", 
-                             db->id, type, desno, de->v_sno);
-            } else {
-                *diskkey = sdscatfmt(*diskkey, "%i_%u_%U_%S", 
-                             db->id, type, desno, (sds)curkey->ptr);
-            }                 
-        } else {
-            if (rocksNeedExchangeKey((sds)curkey->ptr)) {
-                *diskkey = sdscatfmt(*diskkey, "%i_%u_%S_%U", 
-                             db->id, type, key, de->v_sno); 
-            } else {
-                *diskkey = sdscatfmt(*diskkey, "%i_%u_%S_%S", 
-                             db->id, type, key, (sds)curkey->ptr); 
-            }                 
-        }
+        catHashFieldDiskKey(diskkey, db, desno, key, type, de);
         
         rc = del_from_rocksdb(*diskkey, sdslen(*diskkey));
         if (rc != C_OK) {
             serverLog(LL_WARNING, 
                     "delete key(%s) from rocksdb failed", *diskkey);             
         }
-        
-        decrRefCount(curkey);  
     } else {
         dictFreeVal(d, de);
     }
@@ -1910,6 +1923,55 @@ void freeHashFieldVal(redisDb *db,
     zfree(de);         
 }
 
+/* delete from rocksdb, in one batch, the fields of hash 'val' that are
+ * on disk, leaving the memory of 'val' untouched */
+void delHashFieldsOnDisk(redisDb *db, 
+                         unsigned long long desno,
+                         sds key, 
+                         robj *val)
+{
+    dictIterator *di = NULL;
+    dictEntry *de = NULL;
+    sds *diskkey = NULL;
+    rocksdb_writebatch_t *batch = NULL;
+
+    if (val->encoding != OBJ_ENCODING_HT) {
+        return;
+    }
+
+    batch = del_batch_create();
+    di = dictGetIterator((dict *)val->ptr);
+    while((de = dictNext(di)) != NULL) { 
+        if (!dictIsEntryValOnDisk(de)) {
+            continue;
+        }
+        
+        diskkey = getClearedSharedKeySds();
+        catHashFieldDiskKey(diskkey, db, desno, key, val->type, de);
+        del_batch_add(batch, *diskkey, sdslen(*diskkey));
+    }
+    dictReleaseIterator(di);
+
+    if (del_batch_commit(batch) != C_OK) {
+        serverLog(LL_WARNING, 
+                "delete fields of hash(%s) from rocksdb failed", key);             
+    }
+}
+
+/* delete from rocksdb the parts of in memory value 'val' that are stored
+ * on their own: list nodes and hash fields */
+void delValPartsOnDisk(redisDb *db, 
+                       unsigned long long desno,
+                       sds key, 
+                       robj *val)
+{
+    if (val->type == OBJ_LIST) {
+        freeListNodes(db, desno, key, val);
+    } else if (val->type == OBJ_HASH) {
+        delHashFieldsOnDisk(db, desno, key, val);
+    }
+}
+
 void freeHashFields(redisDb *db, 
                     unsigned long long desno,
                     sds key, 
@@ -1925,10 +1987,16 @@ void freeHashFields(redisDb *db,
         return;
     } 
 
+    delHashFieldsOnDisk(db, desno, key, val);
+
     d = (dict *)val->ptr;
     di = dictGetIterator((dict *)val->ptr);
     while((de = dictNext(di)) != NULL) { 
-        freeHashFieldVal(db, desno, key, val->type, (dict *)val->ptr, de);
+        if (!dictIsEntryValOnDisk(de)) {
+            dictFreeVal(d, de);
+        }
+        dictFreeKey(d, de);
+        zfree(de);
     }
     dictReleaseIterator(di);
 
@@ -2172,20 +2240,26 @@ void *rocksLoadIntegerObject(accbuf_t *pbufacc,
     }
 }
 
-/* Load an LZF compressed string in RDB format. The returned value
+/* Load a string compressed with 'codec' in RDB format. The returned value
  * changes according to 'flags'. For more info check the
  * rdbGenericLoadStringObject() function. 
  *
  * return NULL if failed
  * return object if success
 */
-void *rocksLoadLzfStringObject(accbuf_t *pbufacc, int flags) {
+void *rocksLoadCompressedStringObject(accbuf_t *pbufacc, int codec, int flags) {
     int plain = flags & RDB_LOAD_PLAIN;
     unsigned int len = 0;
     unsigned int clen = 0;
     unsigned char *c = NULL;
     sds val = NULL;
 
+    if (!codecAvailable(codec)) {
+        serverLog(LL_WARNING, "Can't load a cold value compressed with %s: "
+                  "this server was built without it", codecName(codec));
+        return NULL;
+    }
+
     clen = rocksLoadLen(pbufacc, NULL);
     if (clen  == RDB_LENERR) {
         return NULL;
@@ -2224,7 +2298,7 @@ void *rocksLoadLzfStringObject(accbuf_t *pbufacc, int flags) {
         return NULL;
     }
     
-    if (lzf_decompress(c, clen, val, len) == 0) {
+    if (codecDecompress(codec, c, clen, val, len) == 0) {
         zfree(c);
         if (plain) {
             zfree(val);
@@ -2271,7 +2345,11 @@ void *rocksGenericLoadStringObject(accbuf_t *paccbuf, int flags) {
         case RDB_ENC_INT32:
             return rocksLoadIntegerObject(paccbuf, len, flags);
         case RDB_ENC_LZF:
-            return rocksLoadLzfStringObject(paccbuf, flags);
+            return rocksLoadCompressedStringObject(paccbuf, CODEC_LZF, flags);
+        case RDB_ENC_LZ4:
+            return rocksLoadCompressedStringObject(paccbuf, CODEC_LZ4, flags);
+        case RDB_ENC_ZSTD:
+            return rocksLoadCompressedStringObject(paccbuf, CODEC_ZSTD, flags);
         default:
             serverLog(LL_WARNING, "Unknown RDB string encoding type %d",len);
             return NULL;
@@ -2479,7 +2557,6 @@ robj *rocksLoadZsetObject(accbuf_t *paccbuf)
     size_t maxelelen = 0;
     zset *zs = NULL;
     double score = 0.0;
-    zskiplistNode *znode = NULL;
 
     zsetlen = rocksLoadLen(paccbuf, NULL);
     if (zsetlen == RDB_LENERR) {
@@ -2506,9 +2583,7 @@ robj *rocksLoadZsetObject(accbuf_t *paccbuf)
             maxelelen = sdslen(ele->ptr);
         }
 
-        znode = zslInsert(zs->zsl,score,ele);
-        dictAdd(zs->dict,ele,&znode->score);
-        incrRefCount(ele); /* added to skiplist */
+        zsetAddElement(zs,ele,score);
     }
 
     /* Convert *after* loading, since sorted sets are not stored ordered. */
@@ -2860,6 +2935,89 @@ robj *loadValObjectFromDisk(redisDb *db,
     return val;
 }
 
+/* 
+** Get the rocksdb encoded value of an on disk entry without decoding it,
+** remember to rocksFree() returned 'rawval' after used.
+** return C_ERR if failed
+** return C_OK if success
+*/
+int loadRawValFromDiskWithSds(redisDb *db, 
+                              unsigned long long desno,
+                              sds key, 
+                              uint32_t type, 
+                              sds *diskkey,
+                              char **rawval,
+                              size_t *rawlen)
+{
+    int rc = C_OK;
+
+    sdssetlen(*diskkey, 0);  
+
+    if (rocksNeedExchangeKey(key)) {
+        *diskkey = sdscatfmt(*diskkey, "%i_%u_%U", db->id, type, desno);
+    } else {
+        *diskkey = sdscatfmt(*diskkey, "%i_%u_%S", db->id, type, key);
+    }
+    
+    rc = get_from_rocksdb(*diskkey, sdslen(*diskkey), rawval, rawlen);
+    if (rc != C_OK) {
+        serverLog(LL_WARNING, 
+                  "get value of key(%s) from disk failed", *diskkey);
+        return C_ERR;
+    }
+
+    return C_OK;
+}
+
+/* 
+** Write a rocksdb encoded value, as returned by loadRawValFromDiskWithSds(),
+** for the entry 'desno' of this instance.
+** return C_ERR if failed
+** return C_OK if success
+*/
+int saveRawValOnDisk(redisDb *db, 
+                     unsigned long long desno, 
+                     sds key, 
+                     unsigned type,
+                     char *rawval, 
+                     size_t rawlen)
+{
+    int rc = C_OK;
+    sds *diskkey = getClearedSharedKeySds();
+
+    if (rocksNeedExchangeKey(key)) {
+        *diskkey = sdscatfmt(*diskkey, "%i_%u_%U", db->id, type, desno);
+    } else {
+        *diskkey = sdscatfmt(*diskkey, "%i_%u_%S", db->id, type, key);
+    }
+
+    rc = write_to_rocksdb(*diskkey, sdslen(*diskkey), rawval, rawlen);
+    if (rc != C_OK) {
+        serverLog(LL_WARNING, 
+                "write value of key(%s) to rocksdb failed", key);       
+        return C_ERR;        
+    }         
+
+    return C_OK;
+}
+
+/* Returns NULL on error, object decoded from a rocksdb encoded value */
+robj *rocksLoadRawValObject(redisDb *db, sds key, char *rawval, size_t rawlen)
+{
+    int valtype = 0;
+    accbuf_t valdesc;
+
+    init_value_desc(rawval, rawlen, &valdesc);  
+
+    valtype = rocksLoadType(&valdesc);
+    if (valtype == -1) {
+        serverLog(LL_WARNING, "load vtype for key(%s) failed", key);
+        return NULL;
+    }
+
+    return rocksLoadObject(db, key, valtype, &valdesc);
+}
+
 int loadObjectFromDisk(redisDb *db, dictEntry *de)
 {
     int rc = C_OK;
@@ -2878,6 +3036,77 @@ int loadObjectFromDisk(redisDb *db, dictEntry *de)
     return C_OK;
 }
 
+/* Read the rocksdb encoded values of 'num' entries stored on disk with a
+ * single rocksdb MultiGet, without decoding them nor touching the entries.
+ * rawvals[j] is set to NULL for the values that could not be read, the
+ * other ones must be released with rocksFree() after used.
+ * Returns the number of values read. */
+int loadRawValsFromDisk(redisDb *db, dictEntry **des, int num,
+                        char **rawvals, size_t *rawlens)
+{
+    int j = 0;
+    int found = 0;
+    sds *diskkeys = zmalloc(sizeof(sds)*num);
+    size_t *diskkeylens = zmalloc(sizeof(size_t)*num);
+
+    for (j = 0; j < num; j++) {
+        sds key = dictGetKey(des[j]);
+
+        serverAssert(dictIsEntryValOnDisk(des[j]));
+        if (rocksNeedExchangeKey(key)) {
+            diskkeys[j] = sdscatfmt(sdsempty(), "%i_%u_%U", 
+                    db->id, des[j]->v_type, des[j]->v_sno);
+        } else {
+            diskkeys[j] = sdscatfmt(sdsempty(), "%i_%u_%S", 
+                    db->id, des[j]->v_type, key);
+        }
+        diskkeylens[j] = sdslen(diskkeys[j]);
+    }
+
+    found = multi_get_from_rocksdb(num, diskkeys, diskkeylens, 
+                                   rawvals, rawlens);
+
+    for (j = 0; j < num; j++) {
+        sdsfree(diskkeys[j]);
+    }
+    zfree(diskkeys);
+    zfree(diskkeylens);
+
+    return found;
+}
+
+/* Load the values of 'num' entries stored on disk with a single rocksdb
+ * MultiGet. The entries which fail to load are left on disk, so that the
+ * command accessing them reports the error. Returns the number of values
+ * loaded into memory. */
+int loadObjectsFromDisk(redisDb *db, dictEntry **des, int num)
+{
+    int j = 0;
+    int loaded = 0;
+    robj *val = NULL;
+    char **diskvals = zmalloc(sizeof(char*)*num);
+    size_t *diskvallens = zmalloc(sizeof(size_t)*num);
+
+    loadRawValsFromDisk(db, des, num, diskvals, diskvallens);
+
+    for (j = 0; j < num; j++) {
+        if (diskvals[j]) {
+            val = rocksLoadRawValObject(db, dictGetKey(des[j]), 
+                                        diskvals[j], diskvallens[j]);
+            if (val) {
+                dictSetVal(db->dict, des[j], val);
+                dictSetEntryValNotOnDisk(des[j]);
+                loaded++;
+            }
+            rocksFree(diskvals[j]);
+        }
+    }
+    zfree(diskvals);
+    zfree(diskvallens);
+
+    return loaded;
+}
+
 int loadHashFieldValueFromDiskWithSds(redisDb *db,
                                       unsigned long long desno,
                                       sds hkey, 
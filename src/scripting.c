@@ -193,9 +193,8 @@ char *redisProtocolToLuaType_MultiBulk(lua_State *lua, char *reply) {
     }
     lua_newtable(lua);
     for (j = 0; j < mbulklen; j++) {
-        lua_pushnumber(lua,j+1);
         p = redisProtocolToLuaType(lua,p);
-        lua_settable(lua,-3);
+        lua_rawseti(lua,-2,j+1);
     }
     return p;
 }
@@ -345,6 +344,37 @@ void luaReplyToRedisReply(client *c, lua_State *lua) {
 
 #define LUA_CMD_OBJCACHE_SIZE 32
 #define LUA_CMD_OBJCACHE_MAX_LEN 64
+#define LUA_CMD_LOOKUP_CACHE_SIZE 64 /* Must be a power of two. */
+
+/* Cache of the commands called by scripts, indexed by the command name
+ * exactly as written in the script. Scripts call the same few commands over
+ * and over, so most lookups are resolved with a memcmp() here instead of
+ * hashing the name case insensitively to look it up in the commands table,
+ * that never changes after startup. */
+static struct luaCmdLookupEntry {
+    sds name;
+    struct redisCommand *cmd;
+} luaCmdLookupCache[LUA_CMD_LOOKUP_CACHE_SIZE];
+
+static struct redisCommand *luaLookupCommand(sds name) {
+    size_t len = sdslen(name);
+    struct luaCmdLookupEntry *e;
+    struct redisCommand *cmd;
+
+    if (len == 0) return lookupCommand(name);
+    e = luaCmdLookupCache + (((unsigned char)name[0]*31 +
+        (unsigned char)name[len-1]*7 + len) & (LUA_CMD_LOOKUP_CACHE_SIZE-1));
+    if (e->name && sdslen(e->name) == len && !memcmp(e->name,name,len))
+        return e->cmd;
+
+    cmd = lookupCommand(name);
+    if (cmd) {
+        e->name = e->name ? sdscpylen(e->name,name,len) : sdsnewlen(name,len);
+        e->cmd = cmd;
+    }
+    return cmd;
+}
+
 int luaRedisGenericCommand(lua_State *lua, int raise_error) {
     int j, argc = lua_gettop(lua);
     struct redisCommand *cmd;
@@ -396,7 +426,16 @@ int luaRedisGenericCommand(lua_State *lua, int raise_error) {
              * since Lua uses a format specifier that loses precision. */
             lua_Number num = lua_tonumber(lua,j+1);
 
-            obj_len = snprintf(dbuf,sizeof(dbuf),"%.17g",(double)num);
+            /* Integers, the common case, are formatted by ll2string() that
+             * is much faster than snprintf(), and produces the same output
+             * as long as %.17g does not switch to the exponent notation. */
+            if (num > -1e17 && num < 1e17 && num == (long long)num &&
+                !(num == 0 && signbit(num)))
+            {
+                obj_len = ll2string(dbuf,sizeof(dbuf),(long long)num);
+            } else {
+                obj_len = snprintf(dbuf,sizeof(dbuf),"%.17g",(double)num);
+            }
             obj_s = dbuf;
         } else {
             obj_s = (char*)lua_tolstring(lua,j+1,&obj_len);
@@ -452,7 +491,7 @@ int luaRedisGenericCommand(lua_State *lua, int raise_error) {
     }
 
     /* Command lookup */
-    cmd = lookupCommand(argv[0]->ptr);
+    cmd = luaLookupCommand(argv[0]->ptr);
     if (!cmd || ((cmd->arity > 0 && cmd->arity != argc) ||
                    (argc < -cmd->arity)))
     {
@@ -137,6 +137,7 @@ struct redisCommand redisCommandTable[] = {
     {"append",appendCommand,3,"wm",0,NULL,1,1,1,0,0},
     {"strlen",strlenCommand,2,"rF",0,NULL,1,1,1,0,0},
     {"del",delCommand,-2,"w",0,NULL,1,-1,1,0,0},
+    {"unlink",unlinkCommand,-2,"wF",0,NULL,1,-1,1,0,0},
     {"exists",existsCommand,-2,"rF",0,NULL,1,-1,1,0,0},
     {"setbit",setbitCommand,4,"wm",0,NULL,1,1,1,0,0},
     {"getbit",getbitCommand,3,"rF",0,NULL,1,1,1,0,0},
@@ -248,8 +249,8 @@ struct redisCommand redisCommandTable[] = {
     {"sync",syncCommand,1,"ars",0,NULL,0,0,0,0,0},
     {"psync",syncCommand,3,"ars",0,NULL,0,0,0,0,0},
     {"replconf",replconfCommand,-1,"aslt",0,NULL,0,0,0,0,0},
-    {"flushdb",flushdbCommand,1,"w",0,NULL,0,0,0,0,0},
-    {"flushall",flushallCommand,1,"w",0,NULL,0,0,0,0,0},
+    {"flushdb",flushdbCommand,-1,"w",0,NULL,0,0,0,0,0},
+    {"flushall",flushallCommand,-1,"w",0,NULL,0,0,0,0,0},
     {"sort",sortCommand,-2,"wm",0,sortGetKeys,1,1,1,0,0},
     {"info",infoCommand,-1,"lt",0,NULL,0,0,0,0,0},
     {"monitor",monitorCommand,1,"as",0,NULL,0,0,0,0,0},
@@ -564,9 +565,7 @@ void expiredescObjectDestructor(void *privdata, void *val)
         redisdb = getDbByIdx((int)pexpiredesc->dbid);        
         serverAssert(redisdb != NULL);
         
-        zslDelete(redisdb->expireskiplist, (double)pexpiredesc->expire_time, 
-                  pexpiredesc->obj);
-        decrRefCount(pexpiredesc->obj);
+        twDel(redisdb->expirewheel, pexpiredesc->twnode);
     } 
 
     //decrRefCount(val);
@@ -681,6 +680,16 @@ dictType shaScriptObjectDictType = {
     dictObjectDestructor        /* val destructor */
 };
 
+/* Cluster slots_to_keys, keys are the sds strings of db->dict, no value. */
+dictType slotToKeyDictType = {
+    dictSdsHash,               /* hash function */
+    NULL,                      /* key dup */
+    NULL,                      /* val dup */
+    dictSdsKeyCompare,         /* key compare */
+    NULL,                      /* key destructor */
+    NULL                       /* val destructor */
+};
+
 /* Db->expires */
 dictType keyptrDictType = {
     dictSdsHash,               /* hash function */
@@ -734,6 +743,16 @@ dictType clusterNodesDictType = {
     NULL                        /* val destructor */
 };
 
+/* Keys in flight of a CLUSTER MIGRATESLOT job, owned sds strings. */
+dictType slotMigrationDictType = {
+    dictSdsHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictSdsKeyCompare,          /* key compare */
+    dictSdsDestructor,          /* key destructor */
+    NULL                        /* val destructor */
+};
+
 /* Cluster re-addition blacklist. This maps node IDs to the time
  * we can re-add this node. The goal is to avoid readding a removed
  * node for some time. */
@@ -756,6 +775,28 @@ dictType migrateCacheDictType = {
     NULL                        /* val destructor */
 };
 
+unsigned int dictClientIdHash(const void *key) {
+    return dictGenHashFunction(key,sizeof(uint64_t));
+}
+
+int dictClientIdKeyCompare(void *privdata, const void *key1,
+        const void *key2)
+{
+    DICT_NOTUSED(privdata);
+    return *(const uint64_t*)key1 == *(const uint64_t*)key2;
+}
+
+/* Clients by ID (server.clients_index). Keys point to the id field of the
+ * client itself, so nothing is duplicated or freed. */
+dictType clientIdDictType = {
+    dictClientIdHash,           /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictClientIdKeyCompare,     /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
 /* Replication cached script dict (server.repl_scriptcache_dict).
  * Keys are sds SHA1 strings, while values are not used at all in the current
  * implementation. */
@@ -814,27 +855,22 @@ int incrementallyRehash(int dbid) {
  * for dict.c to resize the hash tables accordingly to the fact we have o not
  * running childs. */
 void updateDictResizePolicy(void) {
-    if (server.rdb_child_pid == -1 && server.aof_child_pid == -1)
+    if (server.rdb_child_pid == -1 && server.aof_child_pid == -1) {
         dictEnableResize();
-    else
+        dictDisableCopyRehash();
+    } else {
         dictDisableResize();
+        if (server.rehash_while_saving)
+            dictEnableCopyRehash();
+        else
+            dictDisableCopyRehash();
+    }
 }
 
 /* ======================= Cron: called every 100 ms ======================== */
 void realtimeExpireDescEmpty(redisDb *db) 
 {
-    zskiplistNode  *zslnode = NULL;
-    zskiplist *zsl = db->expireskiplist;
-
-    while (zsl->length && zsl->header) {
-        zslnode = zsl->header->level[0].forward;
-        if (!zslnode) { 
-            break;
-        }
-     
-        zslDelete(zsl, zslnode->score, zslnode->obj);
-        //decrRefCount(zslnode->obj);
-    }
+    twEmpty(db->expirewheel);
 }
 
 void realtimeExpireDb(redisDb *db, 
@@ -843,32 +879,53 @@ void realtimeExpireDb(redisDb *db,
                       long long total, 
                       long long *count) 
 {
-    zskiplistNode  *zslnode = NULL;
+    twNode *node = NULL;
     long long expirednr = 0;
-    zskiplist *zsl = db->expireskiplist;
+    timeWheel *tw = db->expirewheel;
     long long timenow = mstime();
     robj *keyobj = NULL;
+    sds key = NULL;
+    expireExtDesc *pexpiredesc = NULL;
     int stepmax = server.realtime_expire_step_cnt;
     int stepnr = 0;
 
-    while (zsl->length && zsl->header) {
-        zslnode = zsl->header->level[0].forward;
-        serverAssert(zslnode != NULL);
-
-        /* key expired */
-        if (zslnode->score <= timenow) {        
-            incrRefCount(zslnode->obj);
-            keyobj = zslnode->obj;            
-                      
-            if (realtimeExpireCheckAndPredo(db, keyobj) != C_OK) {
-                serverLog(LL_WARNING, "realtimeExpireCheckAndPredo(%s) failed",
-                          keyobj->ptr);
+    stepmax = stepmax > 0 ? stepmax : 1;
+    while (1) {
+        node = twFirstDue(tw);
+        if (!node) {
+            /* collect the timers due by now, a few at a time, so crowded
+             * slots are spread over the following cycles */
+            if (twProcess(tw, timenow, stepmax) == 0) {
+                break;
+            }
+            stepnr = stepmax;
+        } else {
+            /* key expired */
+            key = node->data;
+            pexpiredesc = dictFetchRawValue(db->expires, key);
+            if (!pexpiredesc || pexpiredesc->twnode != node) {
+                serverLog(LL_WARNING, "realtime expire timer of key(%s) "
+                          "is not referenced by db->expires", key);
+                twDel(tw, node);
                 continue;
             }
+
+            keyobj = createStringObject(key, sdslen(key));
+            if (realtimeExpirePredo(db, keyobj, pexpiredesc) != C_OK) {
+                serverLog(LL_WARNING, "realtimeExpirePredo(%s) failed",
+                          keyobj->ptr);
+                decrRefCount(keyobj);
+                break;
+            }
             
-            dbDelete(db, keyobj);
+            /* the timer is released with the expire of the key */
+            if (server.lazyfree_lazy_expire)
+                dbAsyncDelete(db, keyobj);
+            else
+                dbSyncDelete(db, keyobj);
             propagateExpire(db, keyobj);
             notifyKeyspaceEvent(NOTIFY_EXPIRED, "expired", keyobj, db->id);
+            trackingInvalidateKey(keyobj);
 
             decrRefCount(keyobj);           
             
@@ -879,9 +936,7 @@ void realtimeExpireDb(redisDb *db,
             if (expirednr >= total) {
                 break;
             }
-        } else {
-            break;
-        }  
+        }
 
         if (stepnr >= stepmax) {
             stepnr = 0;
@@ -988,9 +1043,13 @@ int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
         }
                        
         propagateExpire(db,keyobj);
-        dbDelete(db,keyobj);
+        if (server.lazyfree_lazy_expire)
+            dbAsyncDelete(db,keyobj);
+        else
+            dbSyncDelete(db,keyobj);
         notifyKeyspaceEvent(NOTIFY_EXPIRED,
             "expired",keyobj,db->id);
+        trackingInvalidateKey(keyobj);
         decrRefCount(keyobj);
         server.stat_expiredkeys++;
         return 1;
@@ -1287,10 +1346,13 @@ void databasesCron(void) {
         saveDataOnDiskCycle(DISK_STORE_FAST);
     }
 
-    /* Perform hash tables rehashing if needed, but only if there are no
-     * other processes saving the DB on disk. Otherwise rehashing is bad
-     * as will cause a lot of copy-on-write of memory pages. */
-    if (server.rdb_child_pid == -1 && server.aof_child_pid == -1) {
+    /* Perform hash tables rehashing if needed. While other processes are
+     * saving the DB on disk the plain rehashing is bad as will cause a lot
+     * of copy-on-write of memory pages, so we only rehash if the dicts are
+     * in the copy rehashing mode (see updateDictResizePolicy()), and never
+     * shrink the tables. */
+    int saving = server.rdb_child_pid != -1 || server.aof_child_pid != -1;
+    if (!saving || server.rehash_while_saving) {
         /* We use global counters so if we stop the computation at a given
          * DB we'll be able to start from the successive in the next
          * cron loop iteration. */
@@ -1302,8 +1364,12 @@ void databasesCron(void) {
         /* Don't test more DBs than we have. */
         if (dbs_per_call > server.dbnum) dbs_per_call = server.dbnum;
 
+        /* Release the entries left behind by the copy rehashing
+         * performed while the last child was alive. */
+        if (!saving) dictFreeRetiredMilliseconds(1);
+
         /* Resize */
-        for (j = 0; j < dbs_per_call; j++) {
+        for (j = 0; j < dbs_per_call && !saving; j++) {
             tryResizeHashTables(resize_db % server.dbnum);
             resize_db++;
         }
@@ -1588,6 +1654,13 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
 
     server.event_proc_loop_start_ms = mstime();
 
+    /* Handle the reads postponed to the I/O threads, executing the commands
+     * they parsed. */
+    handleClientsWithPendingReadsUsingThreads();
+
+    /* Drop the references the lazy free thread handed back. */
+    lazyfreeReleaseDeferred();
+
     /* Call the Redis Cluster before sleep function. Note that this function
      * may change the state of Redis Cluster (from ok to fail or vice versa),
      * so it's a good idea to call it before serving the unblocked clients
@@ -1634,7 +1707,7 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     flushAppendOnlyFile(0);
 
     /* Handle writes with pending output buffers. */
-    handleClientsWithPendingWrites();
+    handleClientsWithPendingWritesUsingThreads();
 }
 
 /* =========================== Server initialization ======================== */
@@ -1852,10 +1925,31 @@ int dumpWriteRaw(rio *rdb, void *p, size_t len) {
     return len;
 }
 
+int dumpPwriteRaw(int fd, void *p, size_t len, off_t offset) {
+    ssize_t nwritten = 0;
+    size_t left = len;
+    char *buf = p;
+
+    while (left) {
+        nwritten = pwrite(fd, buf, left, offset);
+        if (nwritten == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += nwritten;
+        offset += nwritten;
+        left -= nwritten;
+    }
+    return len;
+}
+
 int dumpSaveTaskpoolInitAndStart(task_pool_t *ptaskpool,
                                  redisDb *db, 
                                  rio *prio, 
                                  long long now,
+                                 int segmented,
                                  char *poolname,
                                  void *thdproc)
 {
@@ -1876,6 +1970,18 @@ int dumpSaveTaskpoolInitAndStart(task_pool_t *ptaskpool,
     ptaskpoolpriv->task_ext.db = db;
     ptaskpoolpriv->task_ext.prio = prio;
     ptaskpoolpriv->task_ext.now = now;
+    ptaskpoolpriv->task_ext.segmented = segmented;
+    ptaskpoolpriv->task_ext.segfd = -1;
+    if (segmented && prio) {
+        ptaskpoolpriv->task_ext.segfd = rioFileFd(prio);
+    }
+    if (ptaskpoolpriv->task_ext.segfd != -1) {
+        ptaskpoolpriv->task_ext.segstart = rioTell(prio);
+        ptaskpoolpriv->task_ext.segend = ptaskpoolpriv->task_ext.segstart;
+        if (ptaskpoolpriv->task_ext.segstart == -1) {
+            ptaskpoolpriv->task_ext.segfd = -1;
+        }
+    }
 
     rc = multitask_pool_start(ptaskpool);
     if (rc < 0) {
@@ -1888,6 +1994,35 @@ int dumpSaveTaskpoolInitAndStart(task_pool_t *ptaskpool,
     return C_OK;
 }
 
+/* Account for the segments the dump threads wrote with pwrite(): the rio
+ * moves past them and the opcode of every segment is added to its checksum.
+ * All the opcodes are the same byte, so the checksum does not depend on the
+ * order the threads reserved their segments in. */
+static int dumpSaveSegmentsDone(task_ext_t *ptaskext)
+{
+    unsigned char type = RDB_OPCODE_SEGMENT;
+    long long i = 0;
+    rio *prio = ptaskext->prio;
+
+    if (ptaskext->segfd == -1) {
+        return C_OK;
+    }
+
+    if (!rioFileSkip(prio, ptaskext->segend - ptaskext->segstart)) {
+        serverLog(LL_WARNING, "seek past %lld segments failed", 
+                  ptaskext->segnr);
+        return C_ERR;
+    }
+
+    if (prio->update_cksum) {
+        for (i = 0; i < ptaskext->segnr; i++) {
+            prio->update_cksum(prio, &type, 1);
+        }
+    }
+
+    return C_OK;
+}
+
 int dumpSaveTaskpoolWaitFinal(task_pool_t *ptaskpool)
 {
     int rc = C_OK;
@@ -1909,16 +2044,69 @@ int dumpSaveTaskpoolWaitFinal(task_pool_t *ptaskpool)
         return C_ERR;
     }
 
+    rc = dumpSaveSegmentsDone(&ptaskpoolpriv->task_ext);
     multitask_pool_destroy(ptaskpool); 
 
-    return C_OK;
+    return rc;
 }
 
+/* Estimate how many bytes the entry will take once serialized, so that the
+ * dump threads can be balanced by work rather than by key count. This runs
+ * on the main thread for every key, so it must stay O(1) and never touch
+ * the disk store: values living in rocksdb get a flat cost. */
+size_t dumpEstimateDentryCost(dictEntry *de)
+{
+    robj *o = NULL;
+    size_t cost = sdslen(dictGetKey(de));
+
+    if (dictIsEntryValOnDisk(de)) {
+        return cost + DUMP_COST_ONDISK;
+    }
+
+    o = dictGetVal(de);
+    switch (o->encoding) {
+    case OBJ_ENCODING_INT:
+        cost += sizeof(long long);
+        break;
+    case OBJ_ENCODING_RAW:
+    case OBJ_ENCODING_EMBSTR:
+        cost += sdslen(o->ptr);
+        break;
+    case OBJ_ENCODING_ZIPLIST:
+        cost += ziplistBlobLen(o->ptr);
+        break;
+    case OBJ_ENCODING_INTSET:
+        cost += intsetBlobLen(o->ptr);
+        break;
+    case OBJ_ENCODING_QUICKLIST:
+        cost += listTypeLength(o) * DUMP_COST_ELE_BYTES;
+        break;
+    case OBJ_ENCODING_HT:
+        cost += dictSize((dict *)o->ptr) * DUMP_COST_ELE_BYTES;
+        break;
+    case OBJ_ENCODING_SKIPLIST:
+        cost += zsetLength(o) * DUMP_COST_ELE_BYTES;
+        break;
+    default:
+        cost += DUMP_COST_ELE_BYTES;
+        break;
+    }
+
+    return cost;
+}
+
+/* Queue the entry on the thread with the least pending work. Pending costs
+ * are updated concurrently by the dump threads, a stale read only makes the
+ * choice slightly worse, stealing corrects it afterwards. */
 int dumpSaveSingleDentry(task_pool_t *ptaskpool, dictEntry *de)
 {
     int rc = C_OK;
+    int i = 0;
     int thdidx = 0;
+    long long pending = 0;
+    long long minpending = LLONG_MAX;
     dump_denode_t *pdenode = NULL;
+    dump_task_priv_t *tpriv = NULL;
     dump_taskpool_priv_t *ptaskpoolpriv = NULL;        
     
     rc = dumpGenDumpDeNode(de, &pdenode);
@@ -1926,23 +2114,86 @@ int dumpSaveSingleDentry(task_pool_t *ptaskpool, dictEntry *de)
         serverLog(LL_WARNING, "rdbGenDumpDeNode failed");
         return C_ERR;
     }
+    pdenode->cost = dumpEstimateDentryCost(de);
 
     ptaskpoolpriv = (dump_taskpool_priv_t *)ptaskpool->taskpool_taskprivdata;
-    thdidx = ptaskpoolpriv->serialno % ptaskpool->taskpool_size;
-    ptaskpoolpriv->serialno++;
-    rc = statistic_addobj(&pdenode->delist, 
-                          &ptaskpoolpriv->task_privs[thdidx].thd_stat);
+    for (i = 0; i < ptaskpool->taskpool_size; i++) {
+        pending = ptaskpoolpriv->task_privs[i].thd_pending;
+        if (pending < minpending) {
+            minpending = pending;
+            thdidx = i;
+        }
+    }
+
+    tpriv = &ptaskpoolpriv->task_privs[thdidx];
+    __sync_add_and_fetch(&tpriv->thd_pending, (long long)pdenode->cost);
+    rc = statistic_addobj(&pdenode->delist, &tpriv->thd_stat);
     if (rc < 0) {
         serverLog(LL_WARNING, "add dump dentry node failed");
+        __sync_sub_and_fetch(&tpriv->thd_pending, (long long)pdenode->cost);
         zfree(pdenode);
         return C_ERR;
-    } else {
-        ptaskpoolpriv->task_privs[thdidx].thd_opnr++;
     }
 
     return C_OK;
 }
 
+/* Fetch the next entry for dump thread 'taskid'. The thread consumes its
+ * own queue from the head; once it is empty it steals from the tail of the
+ * queue with most pending work, so a thread that drew a few huge values
+ * does not keep the whole dump waiting while the others sit idle.
+ * Returns C_ERR when there is nothing left to do anywhere. */
+int dumpSaveThdGetDentry(dump_taskpool_priv_t *tpoolpriv,
+                         int taskid,
+                         dump_denode_t **ppdenode)
+{
+    int i = 0;
+    int victim = -1;
+    int taskpool_size = server.dump_thdnr;
+    long long pending = 0;
+    long long maxpending = 0;
+    dump_denode_t *pdenode = NULL;
+    dump_task_priv_t *tpriv = &tpoolpriv->task_privs[taskid];
+
+    statistic_getobj((void **)&pdenode, &tpriv->thd_stat);
+    if (pdenode) {
+        __sync_sub_and_fetch(&tpriv->thd_pending, (long long)pdenode->cost);
+        tpriv->thd_opnr++;
+        *ppdenode = pdenode;
+        return C_OK;
+    }
+
+    for (i = 0; i < taskpool_size; i++) {
+        if (i == taskid || !tpoolpriv->task_privs[i].thd_stat.stat_count) {
+            continue;
+        }
+
+        pending = tpoolpriv->task_privs[i].thd_pending;
+        if (victim == -1 || pending > maxpending) {
+            maxpending = pending;
+            victim = i;
+        }
+    }
+
+    if (victim == -1) {
+        return C_ERR;
+    }
+
+    statistic_getobj_tail((void **)&pdenode, 
+                          &tpoolpriv->task_privs[victim].thd_stat);
+    if (!pdenode) {
+        return C_ERR;
+    }
+
+    __sync_sub_and_fetch(&tpoolpriv->task_privs[victim].thd_pending, 
+                         (long long)pdenode->cost);
+    tpriv->thd_opnr++;
+    tpriv->thd_stealnr++;
+    *ppdenode = pdenode;
+
+    return C_OK;
+}
+
 void dumpSaveSetTaskCanStop(task_pool_t *ptaskpool)
 {
     dump_taskpool_priv_t *ptaskpoolpriv = NULL;
@@ -1965,36 +2216,100 @@ void dumpSaveSetTaskHasFailed(task_pool_t *ptaskpool)
     }
 }
 
+/* Reserve room for a segment after the ones written so far and pwrite() it
+ * there. The reservation is a single atomic add, so the dump threads write
+ * their segments concurrently instead of serializing on task_mutex. */
+static int dumpSaveThdWriteSegment(task_ext_t *ptaskext, sds seghdr, sds payload)
+{
+    size_t hdrlen = sdslen(seghdr);
+    size_t dlen = sdslen(payload);
+    off_t offset = 0;
+
+    offset = __sync_fetch_and_add(&ptaskext->segend, (off_t)(hdrlen + dlen));
+    if (dumpPwriteRaw(ptaskext->segfd, seghdr, hdrlen, offset) == -1 
+        || dumpPwriteRaw(ptaskext->segfd, payload, dlen, 
+                         offset + hdrlen) == -1) {
+        return C_ERR;
+    }
+    __sync_add_and_fetch(&ptaskext->segnr, 1);
+
+    return C_OK;
+}
+
+/* Write the buffered records of a dump thread into the shared rio. When the
+ * pool is segmented the buffer is framed as an RDB_OPCODE_SEGMENT record
+ * whose crc64 is computed by the thread itself. On a file the segment is
+ * written at an offset of its own without any lock, otherwise it is copied
+ * into the rio under task_mutex. Either way only the opcode is part of the
+ * rio checksum, see dumpSaveSegmentsDone(). */
 int dumpSaveThdWriteData(dump_taskpool_priv_t *tpoolpriv,
                      dump_task_priv_t *tpriv,
                      int checklen)
 {
     int rc = C_OK;
     size_t dlen = 0;
+    sds seghdr = NULL;
+    rio *prio = NULL;
+    void (*update_cksum)(struct _rio *, const void *, size_t) = NULL;
 
     if (!tpriv) {
         return C_OK;
     }
 
     dlen = sdslen(tpriv->thd_wrbuf);
-    if (checklen && dlen < server.dump_thdbuf_size) {
+    if (!dlen || (checklen && dlen < server.dump_thdbuf_size)) {
         return C_OK;
     }
 
     if (!tpoolpriv || !tpoolpriv->task_ext.prio) {
-        serverLog(LL_WARNING, "taskpool privdata for write data invalid",
-                  dlen);
+        serverLog(LL_WARNING, "taskpool privdata for write data invalid");
         return C_ERR;
     }
+    prio = tpoolpriv->task_ext.prio;
+
+    if (tpoolpriv->task_ext.segmented) {
+        seghdr = sdsempty();
+        rdbSaveSegmentHeaderToSds(&seghdr, tpriv->thd_wrbuf, dlen);
+    }
+
+    if (seghdr && tpoolpriv->task_ext.segfd != -1) {
+        rc = dumpSaveThdWriteSegment(&tpoolpriv->task_ext, seghdr, 
+                                     tpriv->thd_wrbuf);
+        sdsfree(seghdr);
+        if (rc != C_OK) {
+            serverLog(LL_WARNING, "write segment(len:%ld) failed: %s",
+                      dlen, strerror(errno));
+            return C_ERR;
+        }
+
+        tpriv->thd_wrbuf = sdsCheckAndReset(&tpriv->thd_wrbuf, 
+                                            server.dump_thdbuf_size);
+        return C_OK;
+    }
 
     rc = pthread_mutex_lock(&tpoolpriv->task_mutex);
     if (rc) {
-        serverLog(LL_WARNING, "pthread_mutex_lock for writing rdb failed",
-                  dlen);
+        serverLog(LL_WARNING, "pthread_mutex_lock for writing rdb failed");
+        sdsfree(seghdr);
         return C_ERR;
     }
     
-    rc = dumpWriteRaw(tpoolpriv->task_ext.prio, tpriv->thd_wrbuf, dlen);
+    if (seghdr) {
+        rc = dumpWriteRaw(prio, seghdr, 1);
+        if (rc != -1) {
+            update_cksum = prio->update_cksum;
+            prio->update_cksum = NULL;
+            rc = dumpWriteRaw(prio, seghdr + 1, sdslen(seghdr) - 1);
+            if (rc != -1) {
+                rc = dumpWriteRaw(prio, tpriv->thd_wrbuf, dlen);
+            }
+            prio->update_cksum = update_cksum;
+        }
+    } else {
+        rc = dumpWriteRaw(prio, tpriv->thd_wrbuf, dlen);
+    }
+    sdsfree(seghdr);
+    
     if (rc == -1) {
         serverLog(LL_WARNING, "write thread buf content(len:%ld) failed",
                   dlen);
@@ -2095,7 +2410,8 @@ void createSharedObjects(void) {
     shared.lpush = createStringObject("LPUSH",5);
     shared.rpush = createStringObject("RPUSH", 5);
     for (j = 0; j < OBJ_SHARED_INTEGERS; j++) {
-        shared.integers[j] = createObject(OBJ_STRING,(void*)(long)j);
+        shared.integers[j] =
+            makeObjectShared(createObject(OBJ_STRING,(void*)(long)j));
         shared.integers[j]->encoding = OBJ_ENCODING_INT;
     }
     for (j = 0; j < OBJ_SHARED_BULKHDR_LEN; j++) {
@@ -2195,6 +2511,9 @@ void initServerConfig(void) {
     server.maxidletime = CONFIG_DEFAULT_CLIENT_TIMEOUT;
     server.tcpkeepalive = CONFIG_DEFAULT_TCP_KEEPALIVE;
     server.active_expire_enabled = 1;
+    server.lazyfree_lazy_eviction = CONFIG_DEFAULT_LAZYFREE_LAZY_EVICTION;
+    server.lazyfree_lazy_expire = CONFIG_DEFAULT_LAZYFREE_LAZY_EXPIRE;
+    server.lazyfree_lazy_server_del = CONFIG_DEFAULT_LAZYFREE_LAZY_SERVER_DEL;
     server.client_max_querybuf_len = PROTO_MAX_QUERYBUF_LEN;
     server.saveparams = NULL;
     server.loading = 0;
@@ -2227,11 +2546,16 @@ void initServerConfig(void) {
     server.aof_filename = zstrdup(CONFIG_DEFAULT_AOF_FILENAME);
     server.requirepass = NULL;
     server.rdb_compression = CONFIG_DEFAULT_RDB_COMPRESSION;
+    server.rdb_compression_codec = CONFIG_DEFAULT_RDB_COMPRESSION_CODEC;
     server.rdb_checksum = CONFIG_DEFAULT_RDB_CHECKSUM;
     server.stop_writes_on_bgsave_err = CONFIG_DEFAULT_STOP_WRITES_ON_BGSAVE_ERROR;
     server.activerehashing = CONFIG_DEFAULT_ACTIVE_REHASHING;
+    server.rehash_while_saving = CONFIG_DEFAULT_REHASH_WHILE_SAVING;
     server.notify_keyspace_events = 0;
     server.maxclients = CONFIG_DEFAULT_MAX_CLIENTS;
+    server.io_threads_num = CONFIG_DEFAULT_IO_THREADS_NUM;
+    server.io_threads_do_reads = CONFIG_DEFAULT_IO_THREADS_DO_READS;
+    server.io_threads_active = 0;
     server.bpop_blocked_clients = 0;
     server.maxmemory = CONFIG_DEFAULT_MAXMEMORY;
     server.maxmemory_policy = CONFIG_DEFAULT_MAXMEMORY_POLICY;
@@ -2240,6 +2564,7 @@ void initServerConfig(void) {
     server.hash_max_ziplist_value = OBJ_HASH_MAX_ZIPLIST_VALUE;
     server.list_max_ziplist_size = OBJ_LIST_MAX_ZIPLIST_SIZE;
     server.list_compress_depth = OBJ_LIST_COMPRESS_DEPTH;
+    server.list_compress_codec = CONFIG_DEFAULT_LIST_COMPRESS_CODEC;
     server.set_max_intset_entries = OBJ_SET_MAX_INTSET_ENTRIES;
     server.zset_max_ziplist_entries = OBJ_ZSET_MAX_ZIPLIST_ENTRIES;
     server.zset_max_ziplist_value = OBJ_ZSET_MAX_ZIPLIST_VALUE;
@@ -2257,12 +2582,16 @@ void initServerConfig(void) {
     server.cluster_configfile = zstrdup(CONFIG_DEFAULT_CLUSTER_CONFIG_FILE);
     server.migrate_cached_sockets = dictCreate(&migrateCacheDictType,NULL);
     server.next_client_id = 1; /* Client IDs, start from 1 .*/
+    server.clients_index = dictCreate(&clientIdDictType,NULL);
+    server.tracking_clients = 0;
     server.loading_process_events_interval_bytes = (1024*1024*2);
 
     server.dump_concurrency = DUMP_CONCURRENCY;
     server.dump_thdnr = DUMP_THD_NR_DEF;
     server.dump_thdbuf_size = DUMP_THDBUF_SIZE;
     server.dump_thd_tmpbuf_size = DUMP_THD_TMPBUF_SIZE;
+    server.dump_segment = 0;
+    server.dump_dstore_raw = 0;
 
     server.lruclock = getLRUClock();
     resetServerSaveParams();
@@ -2355,6 +2684,9 @@ void initServerConfig(void) {
     server.dstore_hash_loop_field_nr = DISK_STORE_HASH_LOOP_FIELD_NR;  
     server.dstore_need_loadmem_hz = DISK_STORE_NEED_LOADMEM_HZ;
     server.dstore_policy = DISK_STORE_ALLKEYS_LRU;
+    server.dstore_bulkload = 0;
+    server.dstore_compression_codec = CONFIG_DEFAULT_DSTORE_COMPRESSION_CODEC;
+    server.dstore_bulkload_bufsize = DSTORE_BULKLOAD_BUF_SIZE;
     server.datadir = zstrdup(CONFIG_DEFAULT_DATADIR);
     snprintf(server.rocksdb_data_path, sizeof(server.rocksdb_data_path),
                 "/tmp/%s_%d", ROCKSDB_DATA_DIR_NAME, server.port);
@@ -2611,6 +2943,8 @@ void resetServerStats(void) {
     }
     server.stat_net_input_bytes = 0;
     server.stat_net_output_bytes = 0;
+    server.stat_io_reads_processed = 0;
+    server.stat_io_writes_processed = 0;
     server.aof_delayed_fsync = 0;
 }
 
@@ -2672,6 +3006,7 @@ void initServer(void) {
     server.slaves = listCreate();
     server.monitors = listCreate();
     server.clients_pending_write = listCreate();
+    server.clients_pending_read = listCreate();
     server.slaveseldb = -1; /* Force to emit the first SELECT command. */
     server.unblocked_clients = listCreate();
     server.ready_keys = listCreate();
@@ -2718,7 +3053,7 @@ void initServer(void) {
     for (j = 0; j < server.dbnum; j++) {
         server.db[j].dict = dictCreate(&dbDictType,NULL);
         server.db[j].expires = dictCreate(&keyptrDictType,NULL);
-        server.db[j].expireskiplist = zslCreate();
+        server.db[j].expirewheel = twCreate(mstime());
         server.db[j].blocking_keys = dictCreate(&keylistDictType,NULL);
         server.db[j].ready_keys = dictCreate(&setDictType,NULL);
         server.db[j].watched_keys = dictCreate(&keylistDictType,NULL);
@@ -2731,6 +3066,7 @@ void initServer(void) {
     server.pubsub_patterns = listCreate();
     listSetFreeMethod(server.pubsub_patterns,freePubsubPattern);
     listSetMatchMethod(server.pubsub_patterns,listMatchPubsubPattern);
+    server.pubsub_pattern_index = pubsubPatternNodeCreate();
     server.cronloops = 0;
     server.rdb_child_pid = -1;
     server.aof_child_pid = -1;
@@ -2807,6 +3143,7 @@ void initServer(void) {
     slowlogInit();
     latencyMonitorInit();
     bioInit();
+    initThreadedIO();
 }
 
 /* Populates the Redis Command Table starting from the hard coded list
@@ -3065,6 +3402,14 @@ void call(client *c, int flags) {
     dirty = server.dirty-dirty;
     if (dirty < 0) dirty = 0;
 
+    /* Remember the keys read by clients doing client side caching. Commands
+     * called by scripts are accounted to the client calling EVAL. */
+    if (c->cmd->flags & CMD_READONLY) {
+        client *caller = (c->flags & CLIENT_LUA && server.lua_caller) ?
+                         server.lua_caller : c;
+        if (caller->flags & CLIENT_TRACKING) trackingRememberKeys(caller,c);
+    }
+
     /* When EVAL is called loading the AOF we don't want commands called
      * from Lua to go into the slowlog or to populate statistics. */
     if (server.loading && c->flags & CLIENT_LUA)
@@ -3339,6 +3684,8 @@ int processCommand(client *c) {
         queueMultiCommand(c);
         addReply(c,shared.queued);
     } else {
+        /* Warm up the keys of the pipelined commands that follow. */
+        if (c->pipeline_ahead == 0) prefetchPipelinedKeys(c);
         call(c,CMD_CALL_FULL);
         c->woff = server.master_repl_offset;
         if (listLength(server.ready_keys))
@@ -3823,10 +4170,14 @@ sds genRedisInfoString(char *section) {
             "connected_clients:%lu\r\n"
             "client_longest_output_list:%lu\r\n"
             "client_biggest_input_buf:%lu\r\n"
-            "blocked_clients:%d\r\n",
+            "blocked_clients:%d\r\n"
+            "tracking_clients:%lu\r\n"
+            "tracking_table_used_slots:%llu\r\n",
             listLength(server.clients)-listLength(server.slaves),
             lol, bib,
-            server.bpop_blocked_clients);
+            server.bpop_blocked_clients,
+            server.tracking_clients,
+            (unsigned long long) trackingGetUsedSlots());
     }
 
     /* Memory */
@@ -3873,7 +4224,8 @@ sds genRedisInfoString(char *section) {
             "maxmemory_human:%s\r\n"
             "maxmemory_policy:%s\r\n"
             "mem_fragmentation_ratio:%.2f\r\n"
-            "mem_allocator:%s\r\n",
+            "mem_allocator:%s\r\n"
+            "lazyfree_pending_objects:%zu\r\n",
             zmalloc_used,
             hmem,
             server.resident_set_size,
@@ -3888,7 +4240,8 @@ sds genRedisInfoString(char *section) {
             maxmemory_hmem,
             evict_policy,
             zmalloc_get_fragmentation_ratio(server.resident_set_size),
-            ZMALLOC_LIB
+            ZMALLOC_LIB,
+            lazyfreeGetPendingObjectsCount()
             );
     }
 
@@ -4001,7 +4354,10 @@ sds genRedisInfoString(char *section) {
             "pubsub_channels:%ld\r\n"
             "pubsub_patterns:%lu\r\n"
             "latest_fork_usec:%lld\r\n"
-            "migrate_cached_sockets:%ld\r\n",
+            "migrate_cached_sockets:%ld\r\n"
+            "io_threads_active:%d\r\n"
+            "io_threaded_reads_processed:%lld\r\n"
+            "io_threaded_writes_processed:%lld\r\n",
             server.stat_numconnections,
             server.stat_numcommands,
             getInstantaneousMetric(STATS_METRIC_COMMAND),
@@ -4020,7 +4376,10 @@ sds genRedisInfoString(char *section) {
             dictSize(server.pubsub_channels),
             listLength(server.pubsub_patterns),
             server.stat_fork_time,
-            dictSize(server.migrate_cached_sockets));
+            dictSize(server.migrate_cached_sockets),
+            server.io_threads_active,
+            server.stat_io_reads_processed,
+            server.stat_io_writes_processed);
     }
 
     /* Replication */
@@ -4326,7 +4685,15 @@ void evictionPoolPopulateHashWithDstoreCheck(dict *sampledict,
     } else {
         count = dictGetSomeKeys(sampledict, samples, server.maxmemory_samples);
     }
-    
+
+    /* The idle time of every sample is read from its value object: issue
+     * the loads all together before walking the samples. */
+    if (sampledict == keydict) {
+        for (j = 0; j < count; j++) {
+            if (!dictIsEntryValOnDisk(samples[j]))
+                dictPrefetch(dictGetVal(samples[j]));
+        }
+    }
     for (j = 0; j < count; j++) {        
         de = samples[j];
         if (dstore_check) {
@@ -4426,6 +4793,14 @@ void evictionPoolPopulateWithDstoreCheck(dict *sampledict,
     }
 
     //serverLog(LL_WARNING, "SELECT SAMPLE %d KEYS", count);
+
+    /* Same as in evictionPoolPopulateHashWithDstoreCheck(). */
+    if (sampledict == keydict) {
+        for (j = 0; j < count; j++) {
+            if (!dictIsEntryValOnDisk(samples[j]))
+                dictPrefetch(dictGetVal(samples[j]));
+        }
+    }
     for (j = 0; j < count; j++) {        
         de = samples[j];
         if (dstore_check) {
@@ -4498,15 +4873,13 @@ void evictionPoolPopulate(dict *sampledict,
     evictionPoolPopulateWithDstoreCheck(sampledict, keydict, pool, 0);
 }
 
-int freeMemoryIfNeeded(void) {
-    size_t mem_used, mem_tofree, mem_freed;
-    int slaves = listLength(server.slaves);
-    mstime_t latency, eviction_latency;
+/* Return the memory used by the data set, that is the allocated memory
+ * minus the slaves output buffers and the AOF buffers, which are not
+ * counted against maxmemory. */
+static size_t freeMemoryGetDatasetMemory(void) {
+    size_t mem_used = zmalloc_used_memory();
 
-    /* Remove the size of slaves output buffers and AOF buffer from the
-     * count of used memory. */
-    mem_used = zmalloc_used_memory();
-    if (slaves) {
+    if (listLength(server.slaves)) {
         listIter li;
         listNode *ln;
 
@@ -4524,6 +4897,15 @@ int freeMemoryIfNeeded(void) {
         mem_used -= sdslen(server.aof_buf);
         mem_used -= aofRewriteBufferSize();
     }
+    return mem_used;
+}
+
+int freeMemoryIfNeeded(void) {
+    size_t mem_used, mem_tofree, mem_freed;
+    int slaves = listLength(server.slaves);
+    mstime_t latency, eviction_latency;
+
+    mem_used = freeMemoryGetDatasetMemory();
 
     /* Check if we are over the memory limit. */
     if (mem_used <= server.maxmemory) return C_OK;
@@ -4641,7 +5023,10 @@ int freeMemoryIfNeeded(void) {
                  * we only care about memory used by the key space. */
                 delta = (long long) zmalloc_used_memory();
                 latencyStartMonitor(eviction_latency);
-                dbDelete(db,keyobj);
+                if (server.lazyfree_lazy_eviction)
+                    dbAsyncDelete(db,keyobj);
+                else
+                    dbSyncDelete(db,keyobj);
                 latencyEndMonitor(eviction_latency);
                 latencyAddSampleIfNeeded("eviction-del",eviction_latency);
                 latencyRemoveNestedEvent(latency,eviction_latency);
@@ -4650,6 +5035,7 @@ int freeMemoryIfNeeded(void) {
                 server.stat_evictedkeys++;
                 notifyKeyspaceEvent(NOTIFY_EVICTED, "evicted",
                     keyobj, db->id);
+                trackingInvalidateKey(keyobj);
                 decrRefCount(keyobj);
                 keys_freed++;
 
@@ -4658,6 +5044,14 @@ int freeMemoryIfNeeded(void) {
                  * deliver data to the slaves fast enough, so we force the
                  * transmission here inside the loop. */
                 if (slaves) flushSlavesOutputBuffers();
+
+                /* With lazy eviction the memory of big values is released
+                 * by the bio thread and is not seen in 'delta', so check
+                 * from time to time if we are already under the limit. */
+                if (server.lazyfree_lazy_eviction && !(keys_freed % 16)) {
+                    if (freeMemoryGetDatasetMemory() <= server.maxmemory)
+                        mem_freed = mem_tofree;
+                }
             }
         }
         if (!keys_freed) {
@@ -67,7 +67,9 @@ typedef long long mstime_t; /* millisecond time type. */
 #include "latency.h" /* Latency monitor API */
 #include "sparkline.h" /* ASCII graphs API */
 #include "quicklist.h"
+#include "codec.h"   /* Compression codecs */
 #include "list.h"
+#include "twheel.h"  /* Timing wheel of the real-time expires */
 #include "rio.h"
 #include "pubutil.h"
 #include "multitask.h"
@@ -94,6 +96,13 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_MAX_LINE    1024
 #define CRON_DBS_PER_CALL 16
 #define NET_MAX_WRITES_PER_EVENT (1024*64)
+#define NET_MAX_WRITEV_IOVCNT 64  /* Max iovecs per writev() to a client */
+#define CONFIG_DEFAULT_IO_THREADS_NUM 1       /* Single threaded by default */
+#define CONFIG_DEFAULT_IO_THREADS_DO_READS 0  /* Threaded reads are optional */
+#define IO_THREADS_MAX_NUM 128
+#define CONFIG_DEFAULT_LAZYFREE_LAZY_EVICTION 0
+#define CONFIG_DEFAULT_LAZYFREE_LAZY_EXPIRE 0
+#define CONFIG_DEFAULT_LAZYFREE_LAZY_SERVER_DEL 0
 #define PROTO_SHARED_SELECT_CMDS 10
 #define OBJ_SHARED_INTEGERS 10000
 #define OBJ_SHARED_BULKHDR_LEN 32
@@ -126,6 +135,9 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_DEFAULT_SYSLOG_ENABLED 0
 #define CONFIG_DEFAULT_STOP_WRITES_ON_BGSAVE_ERROR 1
 #define CONFIG_DEFAULT_RDB_COMPRESSION 1
+#define CONFIG_DEFAULT_RDB_COMPRESSION_CODEC CODEC_LZF
+#define CONFIG_DEFAULT_LIST_COMPRESS_CODEC CODEC_LZF
+#define CONFIG_DEFAULT_DSTORE_COMPRESSION_CODEC CODEC_LZF
 #define CONFIG_DEFAULT_RDB_CHECKSUM 1
 #define CONFIG_DEFAULT_RDB_FILENAME "dump.rdb"
 #define CONFIG_DEFAULT_REPL_DISKLESS_SYNC 0
@@ -141,6 +153,7 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_DEFAULT_AOF_NO_FSYNC_ON_REWRITE 0
 #define CONFIG_DEFAULT_AOF_LOAD_TRUNCATED 1
 #define CONFIG_DEFAULT_ACTIVE_REHASHING 1
+#define CONFIG_DEFAULT_REHASH_WHILE_SAVING 1
 #define CONFIG_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC 1
 #define CONFIG_DEFAULT_MIN_SLAVES_TO_WRITE 0
 #define CONFIG_DEFAULT_MIN_SLAVES_MAX_LAG 10
@@ -169,6 +182,7 @@ enum {
     MEMBUF_SIZE = 3221225472, // 3G   
     MEMBUF_SIZE_FRAG_RATIO = 30, // 30%
     SDS_BUF_SIZE = 8388608, // 8M
+    DSTORE_BULKLOAD_BUF_SIZE = 67108864, // 64M
 
     FAKE_RELEASE_SNAP = 1,
     REAL_RELEASE_SNAP = 0,
@@ -198,8 +212,11 @@ enum {
 #define PROTO_MAX_QUERYBUF_LEN  (1024*1024*1024) /* 1GB max query buffer. */
 #define PROTO_IOBUF_LEN         (1024*16)  /* Generic I/O buffer size */
 #define PROTO_REPLY_CHUNK_BYTES (16*1024) /* 16k output buffer */
+#define PROTO_REPLY_MIN_SHARED  (4*1024)  /* Bigger values are referenced */
 #define PROTO_INLINE_MAX_SIZE   (1024*64) /* Max size of inline reads */
 #define PROTO_MBULK_BIG_ARG     (1024*32)
+#define PROTO_PIPELINE_PREFETCH_MAX 16 /* Keys of pipelined commands warmed
+                                         up at once. */
 #define LONG_STR_SIZE      21          /* Bytes needed for long -> str + '\0' */
 #define AOF_AUTOSYNC_BYTES (1024*1024*32) /* fdatasync every 32MB */
 
@@ -325,6 +342,15 @@ enum {
 #define CLIENT_REPLY_SKIP (1<<24)  /* Don't send just this reply. */
 #define CLIENT_LUA_DEBUG (1<<25)  /* Run EVAL in debug mode. */
 #define CLIENT_LUA_DEBUG_SYNC (1<<26)  /* EVAL debugging without fork() */
+#define CLIENT_PENDING_READ (1<<27) /* The client has pending reads and was put
+                                       in the list of clients we can read
+                                       from using the I/O threads. */
+#define CLIENT_PENDING_COMMAND (1<<28) /* argv was parsed by an I/O thread and
+                                          is waiting to be executed. */
+#define CLIENT_IO_ERROR (1<<29) /* An I/O thread hit a read/write error, the
+                                   main thread will free the client. */
+#define CLIENT_TRACKING (1<<30) /* Client enabled keys tracking in order to
+                                   perform client side caching. */
 
 /* Client block type (btype field in client structure)
  * if CLIENT_BLOCKED flag is set. */
@@ -522,6 +548,9 @@ typedef struct redisObject {
     void *ptr;
 } robj;
 
+/* Refcount of the objects that are never freed, see makeObjectShared(). */
+#define OBJ_SHARED_REFCOUNT ((1<<27)-1)
+
 /* ZSETs use a specialized version of Skiplists */
 typedef struct zskiplistNode {
     robj *obj;
@@ -539,9 +568,55 @@ typedef struct zskiplist {
     int level;
 } zskiplist;
 
+/* Big ZSETs keep their elements ordered in a B+tree with order statistics
+ * (see zbtree.c). Leaves store the scores and the members of a run of
+ * elements in two arrays, inner nodes store for every child the size of its
+ * subtree and the first element of the next child as separator. One slot
+ * more than the maximum is allocated so that a node can overflow by one
+ * before being split, and the sizes are chosen to fill 1k allocations. */
+#define ZBT_LEAF_SLOTS 62
+#define ZBT_INNER_SLOTS 31
+
+typedef struct zbtNode {
+    int leaf;                   /* 1 for leaves, 0 for inner nodes. */
+    int count;                  /* Elements (leaves) or children. */
+} zbtNode;
+
+typedef struct zbtLeaf {
+    zbtNode hdr;
+    struct zbtLeaf *prev, *next;
+    double score[ZBT_LEAF_SLOTS];
+    robj *obj[ZBT_LEAF_SLOTS];
+} zbtLeaf;
+
+typedef struct zbtInner {
+    zbtNode hdr;
+    zbtNode *child[ZBT_INNER_SLOTS];
+    unsigned long size[ZBT_INNER_SLOTS];    /* Elements under every child. */
+    double sepscore[ZBT_INNER_SLOTS-1];     /* First element of child i+1. */
+    robj *sepobj[ZBT_INNER_SLOTS-1];
+} zbtInner;
+
+typedef struct zbtree {
+    zbtNode *root;
+    zbtLeaf *head, *tail;
+    unsigned long length;
+    int height;
+} zbtree;
+
+/* Position of an element in a zbtree. 'leaf' is NULL past the ends. */
+typedef struct zbtCursor {
+    zbtLeaf *leaf;
+    int pos;
+} zbtCursor;
+
+#define zbtCursorScore(c) ((c)->leaf->score[(c)->pos])
+#define zbtCursorObj(c) ((c)->leaf->obj[(c)->pos])
+
+/* The dict maps members to their score, stored in the entry value. */
 typedef struct zset {
     dict *dict;
-    zskiplist *zsl;
+    zbtree *zbt;
 } zset;
 
 /* Macro used to obtain the current LRU clock.
@@ -580,7 +655,7 @@ struct evictionPoolEntry {
 typedef struct redisDb {
     dict *dict;                 /* The keyspace for this DB */
     dict *expires;              /* Timeout of keys with a timeout set */
-    zskiplist *expireskiplist;  /* keys need to delete real-time */
+    timeWheel *expirewheel;     /* keys need to delete real-time */
     dict *blocking_keys;        /* Keys with clients waiting for data (BLPOP) */
     dict *ready_keys;           /* Blocked keys that received a PUSH */
     dict *watched_keys;         /* WATCHED keys for MULTI/EXEC CAS */
@@ -659,6 +734,8 @@ typedef struct client {
     unsigned long long reply_bytes; /* Tot bytes of objects in reply list. */
     size_t sentlen;         /* Amount of bytes already sent in the current
                                buffer or object being sent. */
+    int pipeline_ahead;     /* Pipelined commands whose keys were already
+                               warmed up, see prefetchPipelinedKeys(). */
     time_t ctime;           /* Client creation time. */
     time_t lastinteraction; /* Time of the last interaction, used for timeout */
     time_t obuf_soft_limit_reached_time;
@@ -688,6 +765,8 @@ typedef struct client {
     dict *pubsub_channels;  /* channels a client is interested in (SUBSCRIBE) */
     list *pubsub_patterns;  /* patterns a client is interested in (SUBSCRIBE) */
     sds peerid;             /* Cached peer ID. */
+    uint64_t client_tracking_redirection; /* Client ID receiving the
+                                             invalidation messages. */
 
     /* Response buffer */
     int bufpos;
@@ -754,6 +833,10 @@ enum {
     DUMP_THDBUF_SIZE = 4096,  // 1M
     DUMP_THD_TMPBUF_SIZE = 1024,  // 1k
     DUMP_THD_NR_DEF = 8,
+
+    // estimated serialized bytes used to balance dump tasks among threads
+    DUMP_COST_ELE_BYTES = 16,     // per element of aggregate values
+    DUMP_COST_ONDISK = 4096,      // value must be loaded from rocksdb first
 };
 
 /*-----------------------------------------------------------------------------
@@ -864,6 +947,7 @@ struct redisServer {
     unsigned lruclock:LRU_BITS; /* Clock for LRU eviction */
     int shutdown_asap;          /* SHUTDOWN needed ASAP */
     int activerehashing;        /* Incremental rehash in serverCron() */
+    int rehash_while_saving;    /* Copy-rehash dicts while a child exists */
     char *requirepass;          /* Pass for AUTH command, or NULL */
     char *pidfile;              /* PID file path */
     int arch_bits;              /* 32 or 64 depending on sizeof(long) */
@@ -885,6 +969,7 @@ struct redisServer {
     list *clients;              /* List of active clients */
     list *clients_to_close;     /* Clients to close asynchronously */
     list *clients_pending_write; /* There is to write or install handler. */
+    list *clients_pending_read; /* Reads deferred to the I/O threads. */
     list *slaves, *monitors;    /* List of slaves and MONITORs */
     client *current_client; /* Current client, only used on crash report */
     int clients_paused;         /* True if clients are currently paused */
@@ -892,6 +977,8 @@ struct redisServer {
     char neterr[ANET_ERR_LEN];   /* Error buffer for anet.c */
     dict *migrate_cached_sockets;/* MIGRATE cached sockets */
     uint64_t next_client_id;    /* Next client unique ID. Incremental. */
+    dict *clients_index;        /* Connected clients by client ID. */
+    unsigned long tracking_clients; /* Clients with CLIENT_TRACKING set. */
     int protected_mode;         /* Don't accept external connections. */
     /* RDB / AOF loading information */
     int loading;                /* We are loading data from disk if true */
@@ -924,6 +1011,8 @@ struct redisServer {
     size_t resident_set_size;       /* RSS sampled in serverCron(). */
     long long stat_net_input_bytes; /* Bytes read from network. */
     long long stat_net_output_bytes; /* Bytes written to network. */
+    long long stat_io_reads_processed; /* Clients read by the I/O threads. */
+    long long stat_io_writes_processed; /* Clients written by the I/O threads. */
     /* The following two are used to track instantaneous metrics, like
      * number of operations per second, network traffic. */
     struct {
@@ -937,6 +1026,10 @@ struct redisServer {
     int maxidletime;                /* Client timeout in seconds */
     int tcpkeepalive;               /* Set SO_KEEPALIVE if non-zero. */
     int active_expire_enabled;      /* Can be disabled for testing purposes. */
+    int lazyfree_lazy_eviction;     /* Free evicted values in background. */
+    int lazyfree_lazy_expire;       /* Free expired values in background. */
+    int lazyfree_lazy_server_del;   /* Free implicitly deleted values in
+                                       background. */
     long long realtime_expire_once_maxnr; /* maxmum number of keys to be expired once time */
     long long realtime_expire_once_maxms; /* max microseconds for each expire cycle */
     long long realtime_expire_step_cnt; /* number of keys expired between two intervals */
@@ -954,6 +1047,8 @@ struct redisServer {
     int dump_thdnr;
     size_t dump_thdbuf_size;
     size_t dump_thd_tmpbuf_size;
+    int dump_segment;   // frame rdb thread buffers as checksummed segments
+    int dump_dstore_raw; // dump on disk values rocksdb encoded
     
     /* AOF persistence */
     int aof_state;                  /* AOF_(ON|OFF|WAIT_REWRITE) */
@@ -998,6 +1093,7 @@ struct redisServer {
     int saveparamslen;              /* Number of saving points */
     char *rdb_filename;             /* Name of RDB file */
     int rdb_compression;            /* Use compression in RDB? */
+    int rdb_compression_codec;      /* Codec of compressed RDB strings. */
     int rdb_checksum;               /* Use RDB checksum? */
     time_t lastsave;                /* Unix time of last successful save */
     time_t lastbgsave_try;          /* Unix time of last attempted bgsave */
@@ -1069,6 +1165,9 @@ struct redisServer {
     int get_ack_from_slaves;            /* If true we send REPLCONF GETACK. */
     /* Limits */
     unsigned int maxclients;            /* Max number of simultaneous clients */
+    int io_threads_num;         /* Number of I/O threads, main one included. */
+    int io_threads_do_reads;    /* Read and parse queries using I/O threads. */
+    int io_threads_active;      /* Whether the I/O threads are in use. */
     unsigned long long maxmemory;   /* Max number of memory bytes to use */
     int maxmemory_policy;           /* Policy for key eviction */
     int maxmemory_samples;          /* Pricision of random sampling */
@@ -1092,12 +1191,15 @@ struct redisServer {
     /* List parameters */
     int list_max_ziplist_size;
     int list_compress_depth;
+    int list_compress_codec;        /* Codec of compressed list nodes. */
     /* time cache */
     time_t unixtime;        /* Unix time sampled every cron cycle. */
     long long mstime;       /* Like 'unixtime' but with milliseconds resolution. */
     /* Pubsub */
     dict *pubsub_channels;  /* Map channels to list of subscribed clients */
     list *pubsub_patterns;  /* A list of pubsub_patterns */
+    struct pubsubPatternNode *pubsub_pattern_index; /* Patterns trie indexed
+                                                       by literal prefix. */
     int notify_keyspace_events; /* Events to propagate via Pub/Sub. This is an
                                    xor of NOTIFY_... flags. */
     /* Cluster */
@@ -1166,6 +1268,9 @@ struct redisServer {
     int dstore_need_loadmem_hz;  // key accessory frequency, if big enough then
                                  // value should load into memory(reserved)
     int dstore_hash_loop_field_nr; // maxmum fields to store hash in one loop                             
+    int dstore_bulkload;         // ingest cold values as SST files on load
+    int dstore_compression_codec; // codec of compressed cold values
+    unsigned long long dstore_bulkload_bufsize; // bytes sorted per SST file
         
     char rocksdb_data_path[ROCKSDB_PATH_LEN_MAX];
     char rocksdb_backup_path[ROCKSDB_PATH_LEN_MAX];
@@ -1182,6 +1287,8 @@ typedef struct pubsubPattern {
     robj *pattern;
 } pubsubPattern;
 
+typedef struct pubsubPatternNode pubsubPatternNode;
+
 typedef void redisCommandProc(client *c);
 typedef int *redisGetKeysProc(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
 struct redisCommand {
@@ -1270,7 +1377,7 @@ typedef struct {
                                    // OBJ_NOT_NEED_EXPIRE_REAL_TIME
     unsigned int dbid:31;                               
     long long expire_time;
-    robj *obj;
+    twNode *twnode;     // timer in db->expirewheel if needdel_realtime
  } expireExtDesc;
 
  /*-----------------------------------------------------------------------------
@@ -1279,12 +1386,18 @@ typedef struct {
 typedef struct {
     struct list_head delist;    
     dictEntry *de;    
+    size_t cost;    // estimated serialized size, see dumpEstimateDentryCost
 } dump_denode_t;
 
 typedef struct {
     redisDb *db;
     rio *prio;
     long long now;
+    int segmented;  // write buffers as RDB_OPCODE_SEGMENT records
+    int segfd;      // segments written with pwrite() on this fd, or -1
+    off_t segstart; // offset of the first segment in segfd
+    off_t segend;   // end of the segments reserved so far
+    long long segnr;    // segments written with pwrite()
 } task_ext_t;
 
 typedef struct {
@@ -1293,18 +1406,19 @@ typedef struct {
     sds thd_rbuf;    // buffer for tmperary search from disk
     long long thd_opnr;
     long long thd_opstart;
+    long long thd_pending;  // estimated cost queued in thd_stat
+    long long thd_stealnr;  // entries stolen from other threads' queues
 } dump_task_priv_t;
 
 typedef struct {
     dump_task_priv_t *task_privs;
     pthread_mutex_t task_mutex;
-    size_t serialno;
     int task_can_stop; 
     task_ext_t task_ext;
 } dump_taskpool_priv_t;
 
 sds createExpireDescObj(long long expire_time);
-sds createRealtimeExpireDescObj(int dbid, robj *key, long long expire_time);
+sds createRealtimeExpireDescObj(int dbid, sds key, long long expire_time);
 int is_realtime_expire_list_overflow(void);
 
 /*-----------------------------------------------------------------------------
@@ -1318,6 +1432,9 @@ extern dictType zsetDictType;
 extern dictType clusterNodesDictType;
 extern dictType clusterNodesBlackListDictType;
 extern dictType dbDictType;
+extern dictType keyptrDictType;
+extern dictType slotToKeyDictType;
+extern dictType slotMigrationDictType;
 extern dictType shaScriptObjectDictType;
 extern double R_Zero, R_PosInf, R_NegInf, R_Nan;
 extern dictType hashDictType;
@@ -1343,6 +1460,7 @@ client *createClient(int fd);
 void closeTimedoutClients(void);
 void freeClient(client *c);
 void freeClientAsync(client *c);
+client *lookupClientByID(uint64_t id);
 void resetClient(client *c);
 void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask);
 void *addDeferredMultiBulkLength(client *c);
@@ -1388,6 +1506,10 @@ void pauseClients(mstime_t duration);
 int clientsArePaused(void);
 int processEventsWhileBlocked(void);
 int handleClientsWithPendingWrites(void);
+int handleClientsWithPendingWritesUsingThreads(void);
+int handleClientsWithPendingReadsUsingThreads(void);
+void initThreadedIO(void);
+void prefetchPipelinedKeys(client *c);
 int clientHasPendingReplies(client *c);
 void unlinkClient(client *c);
 int writeToClient(int fd, client *c, int handler_installed);
@@ -1438,6 +1560,7 @@ void execCommandPropagateMulti(client *c);
 void decrRefCount(robj *o);
 void decrRefCountVoid(void *o);
 void incrRefCount(robj *o);
+robj *makeObjectShared(robj *o);
 robj *resetRefCount(robj *obj);
 void freeStringObject(robj *o);
 void freeListObject(robj *o);
@@ -1552,8 +1675,34 @@ void zzlPrev(unsigned char *zl, unsigned char **eptr, unsigned char **sptr);
 unsigned int zsetLength(robj *zobj);
 void zsetConvert(robj *zobj, int encoding);
 void zsetConvertToZiplistIfNeeded(robj *zobj, size_t maxelelen);
+void zsetAddElement(zset *zs, robj *ele, double score);
 int zsetScore(robj *zobj, robj *member, double *score);
 unsigned long zslGetRank(zskiplist *zsl, double score, robj *o);
+int zslValueGteMin(double value, zrangespec *spec);
+int zslValueLteMax(double value, zrangespec *spec);
+int zslLexValueGteMin(robj *value, zlexrangespec *spec);
+int zslLexValueLteMax(robj *value, zlexrangespec *spec);
+int compareStringObjectsForLexRange(robj *a, robj *b);
+
+/* Sorted sets B+tree */
+zbtree *zbtCreate(void);
+void zbtFree(zbtree *zbt);
+void zbtInsert(zbtree *zbt, double score, robj *obj);
+int zbtDelete(zbtree *zbt, double score, robj *obj);
+int zbtFirst(zbtree *zbt, zbtCursor *c);
+int zbtLast(zbtree *zbt, zbtCursor *c);
+void zbtNext(zbtCursor *c);
+void zbtPrev(zbtCursor *c);
+int zbtFirstInRange(zbtree *zbt, zrangespec *range, zbtCursor *c);
+int zbtLastInRange(zbtree *zbt, zrangespec *range, zbtCursor *c);
+int zbtFirstInLexRange(zbtree *zbt, zlexrangespec *range, zbtCursor *c);
+int zbtLastInLexRange(zbtree *zbt, zlexrangespec *range, zbtCursor *c);
+unsigned long zbtGetRank(zbtree *zbt, double score, robj *obj);
+int zbtGetElementByRank(zbtree *zbt, unsigned long rank, zbtCursor *c);
+void zbtSkip(zbtree *zbt, zbtCursor *c, unsigned long count, int reverse);
+unsigned long zbtDeleteRangeByScore(zbtree *zbt, zrangespec *range, dict *dict);
+unsigned long zbtDeleteRangeByLex(zbtree *zbt, zlexrangespec *range, dict *dict);
+unsigned long zbtDeleteRangeByRank(zbtree *zbt, unsigned long start, unsigned long end, dict *dict);
 
 /* Core functions */
 int freeMemoryIfNeeded(void);
@@ -1651,7 +1800,17 @@ int pubsubUnsubscribeAllChannels(client *c, int notify);
 int pubsubUnsubscribeAllPatterns(client *c, int notify);
 void freePubsubPattern(void *p);
 int listMatchPubsubPattern(void *a, void *b);
+pubsubPatternNode *pubsubPatternNodeCreate(void);
 int pubsubPublishMessage(robj *channel, robj *message);
+void addReplyPubsubMessage(client *c, robj *channel, robj *msg);
+
+/* Keys tracking for client side caching */
+void enableTracking(client *c, uint64_t redirect_to);
+void disableTracking(client *c);
+void trackingRememberKeys(client *tracking, client *executing);
+void trackingInvalidateKey(robj *key);
+void trackingInvalidateKeysOnFlush(int dbid);
+uint64_t trackingGetUsedSlots(void);
 
 /* Keyspace events notification */
 void notifyKeyspaceEvent(int type, char *event, robj *key, int dbid);
@@ -1692,6 +1851,7 @@ robj *lookupKeyReadOrReply(client *c, robj *key, robj *reply);
 robj *lookupKeyWriteOrReply(client *c, robj *key, robj *reply);
 robj *lookupKeyReadWithFlags(redisDb *db, robj *key, int flags);
 unsigned getKeyType(redisDb *db, robj *key);
+void dbPrefetchKeys(redisDb *db, sds *keys, int numkeys, int loadcold);
 
 #define LOOKUP_NONE 0
 #define LOOKUP_NOTOUCH (1<<0)
@@ -1701,15 +1861,32 @@ void setKey(redisDb *db, robj *key, robj *val);
 int dbExists(redisDb *db, robj *key);
 robj *dbRandomKey(redisDb *db);
 int dbDelete(redisDb *db, robj *key);
+int dbSyncDelete(redisDb *db, robj *key);
 robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o);
+
+#define EMPTYDB_NO_FLAGS 0      /* No flags. */
+#define EMPTYDB_ASYNC (1<<0)    /* Reclaim memory in another thread. */
 long long emptyDb(void(callback)(void*));
+long long emptyDbWithFlags(int flags, void(callback)(void*));
 int selectDb(client *c, int id);
 redisDb *getDbByIdx(int id);
 void signalModifiedKey(redisDb *db, robj *key);
 void signalFlushedDb(int dbid);
-unsigned int getKeysInSlot(unsigned int hashslot, robj **keys, unsigned int count);
+unsigned int getKeysInSlot(unsigned int hashslot, sds *keys, unsigned int count);
 unsigned int countKeysInSlot(unsigned int hashslot);
 unsigned int delKeysInSlot(unsigned int hashslot);
+
+/* Lazy free */
+extern __thread int lazyfree_bio_thread;
+int dbAsyncDelete(redisDb *db, robj *key);
+long long emptyDbAsync(redisDb *db);
+void freeObjAsync(robj *o);
+size_t lazyfreeGetPendingObjectsCount(void);
+size_t lazyfreeGetFreeEffort(robj *obj);
+void lazyfreeDeferDecrRefCount(robj *o);
+void lazyfreeReleaseDeferred(void);
+void lazyfreeFreeObjectFromBioThread(robj *o);
+void lazyfreeFreeDatabaseFromBioThread(dict *ht1, dict *ht2);
 int verifyClusterConfigWithData(void);
 void scanGenericCommand(client *c, robj *o, unsigned long cursor);
 int parseScanCursorOrReply(client *c, robj *o, unsigned long *cursor);
@@ -1772,6 +1949,7 @@ void setexCommand(client *c);
 void psetexCommand(client *c);
 void getCommand(client *c);
 void delCommand(client *c);
+void unlinkCommand(client *c);
 void existsCommand(client *c);
 void setbitCommand(client *c);
 void getbitCommand(client *c);
@@ -1989,14 +2167,19 @@ int dumpSaveTaskpoolPrivGen(task_pool_t *ptaskpool);
 void dumpSaveTaskpoolPrivRelease(task_pool_t *ptaskpool);
 int dumpGenDumpDeNode(dictEntry *de, dump_denode_t **pde);
 int dumpWriteRaw(rio *rdb, void *p, size_t len);
+int dumpPwriteRaw(int fd, void *p, size_t len, off_t offset);
 int dumpWriteRawToSds(sds *savebuf, void *p, size_t len);
 int dumpSaveTaskpoolInitAndStart(task_pool_t *ptaskpool,
                                  redisDb *db, 
                                  rio *prio, 
                                  long long now,
+                                 int segmented,
                                  char *poolname,
                                  void *thdproc);
 int dumpSaveSingleDentry(task_pool_t *ptaskpool, dictEntry *de); 
+int dumpSaveThdGetDentry(dump_taskpool_priv_t *tpoolpriv,
+                         int taskid,
+                         dump_denode_t **ppdenode);
 int dumpSaveTaskpoolWaitFinal(task_pool_t *ptaskpool);
 void dumpSaveSetTaskCanStop(task_pool_t *ptaskpool);
 void dumpSaveSetTaskHasFailed(task_pool_t *ptaskpool);
@@ -2005,8 +2188,8 @@ int dumpSaveThdWriteData(dump_taskpool_priv_t *tpoolpriv,
                      int checklen);
 unsigned long long gen_entry_sno(void);   
 
-void slotToKeyAdd(robj *key);
-void slotToKeyDel(robj *key);
+void slotToKeyAdd(sds key);
+void slotToKeyDel(sds key);
 void slotToKeyFlush(void);
                                          
 #define redisDebug(fmt, ...) \
@@ -33,7 +33,9 @@
 #include "pqsort.h" /* Partial qsort for SORT+LIMIT */
 #include <math.h> /* isnan() */
 
-zskiplistNode* zslGetElementByRank(zskiplist *zsl, unsigned long rank);
+/* Numeric sorts of at least this many elements use a radix sort. */
+#define SORT_RADIX_MIN_LEN 256
+
 
 redisSortOperation *createSortOperation(int type, robj *pattern) {
     redisSortOperation *so = zmalloc(sizeof(*so));
@@ -42,6 +44,45 @@ redisSortOperation *createSortOperation(int type, robj *pattern) {
     return so;
 }
 
+/* Return the name of the key obtained substituting the first occurrence of
+ * '*' in the pattern 'spat' with 'subst', without the "->field" part of
+ * hash dereferences. The length of the field name, or zero if the pattern
+ * is not a hash dereference, is stored into '*fieldlen'.
+ *
+ * If there is no '*' in the pattern NULL is returned. */
+static sds sortPatternKeyName(sds spat, robj *subst, int *fieldlen) {
+    char *p, *f;
+    sds ssub, key;
+    int prefixlen, sublen, postfixlen;
+
+    p = strchr(spat,'*');
+    if (!p) return NULL;
+
+    /* Find out if we're dealing with a hash dereference. */
+    if ((f = strstr(p+1, "->")) != NULL && *(f+2) != '\0') {
+        *fieldlen = sdslen(spat)-(f-spat)-2;
+    } else {
+        *fieldlen = 0;
+    }
+
+    /* The substitution object may be specially encoded. If so we create
+     * a decoded object on the fly. Otherwise getDecodedObject will just
+     * increment the ref count, that we'll decrement later. */
+    subst = getDecodedObject(subst);
+    ssub = subst->ptr;
+
+    /* Perform the '*' substitution. */
+    prefixlen = p-spat;
+    sublen = sdslen(ssub);
+    postfixlen = sdslen(spat)-(prefixlen+1)-(*fieldlen ? *fieldlen+2 : 0);
+    key = sdsnewlen(NULL,prefixlen+sublen+postfixlen);
+    memcpy(key,spat,prefixlen);
+    memcpy(key+prefixlen,ssub,sublen);
+    memcpy(key+prefixlen+sublen,p+1,postfixlen);
+    decrRefCount(subst); /* Incremented by decodeObject() */
+    return key;
+}
+
 /* Return the value associated to the key with a name obtained using
  * the following rules:
  *
@@ -59,10 +100,9 @@ redisSortOperation *createSortOperation(int type, robj *pattern) {
  * The returned object will always have its refcount increased by 1
  * when it is non-NULL. */
 robj *lookupKeyByPattern(redisDb *db, robj *pattern, robj *subst) {
-    char *p, *f, *k;
-    sds spat, ssub;
+    sds spat, key;
     robj *keyobj, *fieldobj = NULL, *o;
-    int prefixlen, sublen, postfixlen, fieldlen;
+    int fieldlen;
 
     /* If the pattern is "#" return the substitution object itself in order
      * to implement the "SORT ... GET #" feature. */
@@ -72,38 +112,13 @@ robj *lookupKeyByPattern(redisDb *db, robj *pattern, robj *subst) {
         return subst;
     }
 
-    /* The substitution object may be specially encoded. If so we create
-     * a decoded object on the fly. Otherwise getDecodedObject will just
-     * increment the ref count, that we'll decrement later. */
-    subst = getDecodedObject(subst);
-    ssub = subst->ptr;
-
     /* If we can't find '*' in the pattern we return NULL as to GET a
      * fixed key does not make sense. */
-    p = strchr(spat,'*');
-    if (!p) {
-        decrRefCount(subst);
-        return NULL;
-    }
-
-    /* Find out if we're dealing with a hash dereference. */
-    if ((f = strstr(p+1, "->")) != NULL && *(f+2) != '\0') {
-        fieldlen = sdslen(spat)-(f-spat)-2;
-        fieldobj = createStringObject(f+2,fieldlen);
-    } else {
-        fieldlen = 0;
-    }
-
-    /* Perform the '*' substitution. */
-    prefixlen = p-spat;
-    sublen = sdslen(ssub);
-    postfixlen = sdslen(spat)-(prefixlen+1)-(fieldlen ? fieldlen+2 : 0);
-    keyobj = createStringObject(NULL,prefixlen+sublen+postfixlen);
-    k = keyobj->ptr;
-    memcpy(k,spat,prefixlen);
-    memcpy(k+prefixlen,ssub,sublen);
-    memcpy(k+prefixlen+sublen,p+1,postfixlen);
-    decrRefCount(subst); /* Incremented by decodeObject() */
+    key = sortPatternKeyName(spat,subst,&fieldlen);
+    if (!key) return NULL;
+    keyobj = createObject(OBJ_STRING,key);
+    if (fieldlen)
+        fieldobj = createStringObject(spat+sdslen(spat)-fieldlen,fieldlen);
 
     /* Lookup substituted key */
     o = lookupKeyRead(db, keyobj);
@@ -141,6 +156,52 @@ noobj:
     return NULL;
 }
 
+/* Warm up the keys 'pattern' resolves to for the elements of 'vector' from
+ * 'start' to 'end' (inclusive): keys in memory are prefetched in the CPU
+ * caches and the ones stored on disk are loaded with a rocksdb MultiGet
+ * per batch, instead of a read per element when lookupKeyByPattern() is
+ * called for them. See dbPrefetchKeys(). */
+static void sortPrefetchPatternKeys(redisDb *db, robj *pattern,
+                                    redisSortObject *vector,
+                                    long start, long end)
+{
+    sds keys[PROTO_PIPELINE_PREFETCH_MAX];
+    sds spat = pattern->ptr;
+    int numkeys = 0, fieldlen, k;
+    long j;
+
+    if (spat[0] == '#' && spat[1] == '\0') return;
+    for (j = start; j <= end; j++) {
+        sds key = sortPatternKeyName(spat,vector[j].obj,&fieldlen);
+
+        if (!key) return;
+        keys[numkeys++] = key;
+        if (numkeys == PROTO_PIPELINE_PREFETCH_MAX || j == end) {
+            dbPrefetchKeys(db,keys,numkeys,1);
+            for (k = 0; k < numkeys; k++) sdsfree(keys[k]);
+            numkeys = 0;
+        }
+    }
+}
+
+/* Warm up the keys of the GET operations for the next batch of elements of
+ * 'vector' starting at 'start', up to 'end' (inclusive). */
+static void sortPrefetchGetKeys(redisDb *db, list *operations,
+                                redisSortObject *vector,
+                                long start, long end)
+{
+    listNode *ln;
+    listIter li;
+
+    if (end >= start+PROTO_PIPELINE_PREFETCH_MAX)
+        end = start+PROTO_PIPELINE_PREFETCH_MAX-1;
+    listRewind(operations,&li);
+    while((ln = listNext(&li))) {
+        redisSortOperation *sop = ln->value;
+        sortPrefetchPatternKeys(db,sop->pattern,vector,start,end);
+    }
+}
+
 /* sortCompare() is used by qsort in sortCommand(). Given that qsort_r with
  * the additional parameter is not standard but a BSD-specific we have to
  * pass sorting parameters via the global 'server' structure */
@@ -193,6 +254,75 @@ int sortCompare(const void *s1, const void *s2) {
     return server.sort_desc ? -cmp : cmp;
 }
 
+/* Map a score to an unsigned integer with the same ordering, so that it
+ * can be sorted one byte at a time. Negative zero is mapped like zero, as
+ * sortCompare() considers them equal. */
+static uint64_t sortScoreToRadixKey(double score) {
+    uint64_t u;
+
+    if (score == 0) score = 0;
+    memcpy(&u,&score,sizeof(u));
+    return (u & (1ULL<<63)) ? ~u : u | (1ULL<<63);
+}
+
+/* Sort the vector of 'vectorlen' elements by score with a LSD radix sort,
+ * one byte per pass, skipping the bytes that are the same for every score
+ * (like the high bytes of small integers). Runs of elements with the same
+ * score are then sorted with sortCompare(), so that the result is the same
+ * qsort() with sortCompare() produces, in time linear with the number of
+ * elements. The server.sort_* parameters must be set by the caller. */
+static void sortRadixByScore(redisSortObject *vector, long vectorlen, int desc) {
+    redisSortObject *aux = zmalloc(sizeof(redisSortObject)*vectorlen);
+    redisSortObject *from = vector, *to = aux, *tmp;
+    long count[8][256], j, i;
+    int pass;
+
+    /* Count all the bytes of all the keys in a single scan. */
+    memset(count,0,sizeof(count));
+    for (j = 0; j < vectorlen; j++) {
+        uint64_t key = sortScoreToRadixKey(vector[j].u.score);
+
+        if (desc) key = ~key;
+        for (pass = 0; pass < 8; pass++)
+            count[pass][(key >> (pass*8)) & 0xff]++;
+    }
+
+    for (pass = 0; pass < 8; pass++) {
+        long *c = count[pass], pos = 0;
+        int shift = pass*8;
+
+        /* Every key has the same byte here: nothing to do. */
+        for (i = 0; i < 256; i++) if (c[i]) break;
+        if (c[i] == vectorlen) continue;
+
+        for (i = 0; i < 256; i++) {
+            long n = c[i];
+            c[i] = pos;
+            pos += n;
+        }
+        for (j = 0; j < vectorlen; j++) {
+            uint64_t key = sortScoreToRadixKey(from[j].u.score);
+
+            if (desc) key = ~key;
+            to[c[(key >> shift) & 0xff]++] = from[j];
+        }
+        tmp = from;
+        from = to;
+        to = tmp;
+    }
+    if (from != vector)
+        memcpy(vector,from,sizeof(redisSortObject)*vectorlen);
+    zfree(aux);
+
+    /* Order the elements with the same score. */
+    for (j = 0; j < vectorlen; j = i) {
+        for (i = j+1; i < vectorlen && vector[i].u.score == vector[j].u.score;
+             i++);
+        if (i-j > 1)
+            qsort(vector+j,i-j,sizeof(redisSortObject),sortCompare);
+    }
+}
+
 /* The SORT command is the most complex command in Redis. Warning: this code
  * is optimized for speed and a bit less for readability */
 void sortCommand(client *c) {
@@ -411,8 +541,8 @@ void sortCommand(client *c) {
          * way, just getting the required range, as an optimization. */
 
         zset *zs = sortval->ptr;
-        zskiplist *zsl = zs->zsl;
-        zskiplistNode *ln;
+        zbtree *zbt = zs->zbt;
+        zbtCursor ln;
         robj *ele;
         int rangelen = vectorlen;
 
@@ -420,23 +550,23 @@ void sortCommand(client *c) {
         if (desc) {
             long zsetlen = dictSize(((zset*)sortval->ptr)->dict);
 
-            ln = zsl->tail;
+            zbtLast(zbt,&ln);
             if (start > 0)
-                ln = zslGetElementByRank(zsl,zsetlen-start);
+                zbtGetElementByRank(zbt,zsetlen-start,&ln);
         } else {
-            ln = zsl->header->level[0].forward;
+            zbtFirst(zbt,&ln);
             if (start > 0)
-                ln = zslGetElementByRank(zsl,start+1);
+                zbtGetElementByRank(zbt,start+1,&ln);
         }
 
         while(rangelen--) {
-            serverAssertWithInfo(c,sortval,ln != NULL);
-            ele = ln->obj;
+            serverAssertWithInfo(c,sortval,ln.leaf != NULL);
+            ele = zbtCursorObj(&ln);
             vector[j].obj = ele;
             vector[j].u.score = 0;
             vector[j].u.cmpobj = NULL;
             j++;
-            ln = desc ? ln->backward : ln->level[0].forward;
+            if (desc) zbtPrev(&ln); else zbtNext(&ln);
         }
         /* Fix start/end: output code is not aware of this optimization. */
         end -= start;
@@ -463,6 +593,10 @@ void sortCommand(client *c) {
         for (j = 0; j < vectorlen; j++) {
             robj *byval;
             if (sortby) {
+                if (j % PROTO_PIPELINE_PREFETCH_MAX == 0)
+                    sortPrefetchPatternKeys(c->db,sortby,vector,j,
+                        (j+PROTO_PIPELINE_PREFETCH_MAX < vectorlen) ?
+                        j+PROTO_PIPELINE_PREFETCH_MAX-1 : vectorlen-1);
                 /* lookup value to sort by */
                 byval = lookupKeyByPattern(c->db,sortby,vector[j].obj);
                 if (!byval) continue;
@@ -506,8 +640,10 @@ void sortCommand(client *c) {
         server.sort_alpha = alpha;
         server.sort_bypattern = sortby ? 1 : 0;
         server.sort_store = storekey ? 1 : 0;
-        if (sortby && (start != 0 || end != vectorlen-1))
+        if ((sortby || !alpha) && (start != 0 || end != vectorlen-1))
             pqsort(vector,vectorlen,sizeof(redisSortObject),sortCompare, start,end);
+        else if (!alpha && vectorlen >= SORT_RADIX_MIN_LEN)
+            sortRadixByScore(vector,vectorlen,desc);
         else
             qsort(vector,vectorlen,sizeof(redisSortObject),sortCompare);
     }
@@ -524,6 +660,9 @@ void sortCommand(client *c) {
             listNode *ln;
             listIter li;
 
+            if (getop && (j-start) % PROTO_PIPELINE_PREFETCH_MAX == 0)
+                sortPrefetchGetKeys(c->db,operations,vector,j,end);
+
             if (!getop) addReplyBulk(c,vector[j].obj);
             listRewind(operations,&li);
             while((ln = listNext(&li))) {
@@ -552,6 +691,9 @@ void sortCommand(client *c) {
             listNode *ln;
             listIter li;
 
+            if (getop && (j-start) % PROTO_PIPELINE_PREFETCH_MAX == 0)
+                sortPrefetchGetKeys(c->db,operations,vector,j,end);
+
             if (!getop) {
                 /* here 'sobj' new created, not neccessary to carry about load 
                    content from disk */
@@ -565,29 +565,24 @@ int hashTypeConvertZiplist(redisDb *db,
         hashTypeIterator *hi;
         dict *dict;
         int ret;
-        dictEntry *de = NULL;
-
-        de = dictFind(db->dict, hkey);
-        if (!de) {
-            return -1;
-        }
 
+        /* Ziplist fields always live in memory, so the keyspace is not
+         * looked up: the RDB loading threads convert hashes that are not
+         * in db->dict yet. */
         hi = hashTypeInitIterator(o);
         dict = dictCreate(&hashDictType, NULL);
 
         while (hashTypeNext(hi) != C_ERR) {
             robj *field, *value;
 
-            field = hashTypeCurrentObject(db, de->v_sno, 
-                                          hkey, hi, OBJ_HASH_KEY);
+            field = hashTypeCurrentObject(db, 0, hkey, hi, OBJ_HASH_KEY);
             if (!field) {
                 dictRelease(dict);
                 return -1;
             }             
             field = tryObjectEncoding(field);
             
-            value = hashTypeCurrentObject(db, de->v_sno, 
-                                          hkey, hi, OBJ_HASH_VALUE);
+            value = hashTypeCurrentObject(db, 0, hkey, hi, OBJ_HASH_VALUE);
             if (!value) {
                 decrRefCount(field);
                 dictRelease(dict);
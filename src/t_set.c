@@ -834,6 +834,24 @@ void srandmemberCommand(client *c) {
     }
 }
 
+/* If every existing set in 'sets' is intset encoded return an array with
+ * their intsets, storing its length into *num, otherwise return NULL.
+ * Missing sets (NULL pointers) are skipped. The array must be freed by the
+ * caller with zfree(). */
+intset **setsGetIntsets(robj **sets, unsigned long setnum, uint32_t *num) {
+    intset **isets;
+    unsigned long j;
+
+    for (j = 0; j < setnum; j++)
+        if (sets[j] && sets[j]->encoding != OBJ_ENCODING_INTSET) return NULL;
+
+    isets = zmalloc(sizeof(intset*)*setnum);
+    *num = 0;
+    for (j = 0; j < setnum; j++)
+        if (sets[j]) isets[(*num)++] = sets[j]->ptr;
+    return isets;
+}
+
 int qsortCompareSetsByCardinality(const void *s1, const void *s2) {
     return setTypeSize(*(robj**)s1)-setTypeSize(*(robj**)s2);
 }
@@ -855,6 +873,8 @@ void sinterGenericCommand(client *c, robj **setkeys,
     void *replylen = NULL;
     unsigned long j, cardinality = 0;
     int encoding;
+    intset **isets;
+    uint32_t inum;
 
     for (j = 0; j < setnum; j++) {
         robj *setobj = dstkey ?
@@ -903,6 +923,24 @@ void sinterGenericCommand(client *c, robj **setkeys,
         dstset = createIntsetObject();
     }
 
+    /* When all the sets are intsets we intersect them directly, producing
+     * an intset without going through the set type iterator. */
+    if ((isets = setsGetIntsets(sets,setnum,&inum)) != NULL) {
+        intset *is = intsetIntersection(isets,inum);
+
+        zfree(isets);
+        if (!dstkey) {
+            for (j = 0; intsetGet(is,j,&intobj); j++)
+                addReplyBulkLongLong(c,intobj);
+            cardinality = intsetLen(is);
+            zfree(is);
+        } else {
+            zfree(dstset->ptr);
+            dstset->ptr = is;
+        }
+        goto done;
+    }
+
     /* Iterate all the elements of the first (smallest) set, and test
      * the element against all the other sets, if at least one set does
      * not include the element it is discarded */
@@ -965,6 +1003,7 @@ void sinterGenericCommand(client *c, robj **setkeys,
     }
     setTypeReleaseIterator(si);
 
+done:
     if (dstkey) {
         /* Store the resulting set into the target, if the intersection
          * is not an empty set. */
@@ -1008,6 +1047,8 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
     robj *ele, *dstset = NULL;
     int j, cardinality = 0;
     int diff_algo = 1;
+    intset **isets = NULL;
+    uint32_t inum;
 
     for (j = 0; j < setnum; j++) {
         robj *setobj = dstkey ?
@@ -1040,7 +1081,9 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
      * the sets.
      *
      * We compute what is the best bet with the current input here. */
-    if (op == SET_OP_DIFF && sets[0]) {
+    if (op == SET_OP_UNION || sets[0])
+        isets = setsGetIntsets(sets,setnum,&inum);
+    if (op == SET_OP_DIFF && sets[0] && !isets) {
         long long algo_one_work = 0, algo_two_work = 0;
 
         for (j = 0; j < setnum; j++) {
@@ -1069,7 +1112,17 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
      * this set object will be the resulting object to set into the target key*/
     dstset = createIntsetObject();
 
-    if (op == SET_OP_UNION) {
+    if (isets) {
+        /* All the sets are intsets: merge them directly into the
+         * resulting intset. */
+        zfree(dstset->ptr);
+        dstset->ptr = (op == SET_OP_UNION) ? intsetUnion(isets,inum) :
+                                             intsetDifference(isets,inum);
+        cardinality = intsetLen(dstset->ptr);
+        if (cardinality > (int)server.set_max_intset_entries)
+            setTypeConvert(dstset,OBJ_ENCODING_HT);
+        zfree(isets);
+    } else if (op == SET_OP_UNION) {
         /* Union is trivial, just add every element of every set to the
          * temporary set. */
         for (j = 0; j < setnum; j++) {
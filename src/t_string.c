@@ -359,10 +359,20 @@ void getrangeCommand(client *c) {
 }
 
 void mgetCommand(client *c) {
-    int j;
+    sds keys[PROTO_PIPELINE_PREFETCH_MAX];
+    int j, k, numkeys;
 
     addReplyMultiBulkLen(c,c->argc-1);
     for (j = 1; j < c->argc; j++) {
+        /* Warm up the next keys in batches, see dbPrefetchKeys(). */
+        if ((j-1) % PROTO_PIPELINE_PREFETCH_MAX == 0) {
+            numkeys = 0;
+            for (k = j; k < c->argc && k-j < PROTO_PIPELINE_PREFETCH_MAX; k++)
+                if (sdsEncodedObject(c->argv[k]))
+                    keys[numkeys++] = c->argv[k]->ptr;
+            dbPrefetchKeys(c->db,keys,numkeys,1);
+        }
+
         robj *o = lookupKeyRead(c->db,c->argv[j]);
         if (o == NULL) {
             addReply(c,shared.nullbulk);
@@ -52,8 +52,6 @@
 #include "server.h"
 #include <math.h>
 
-static int zslLexValueGteMin(robj *value, zlexrangespec *spec);
-static int zslLexValueLteMax(robj *value, zlexrangespec *spec);
 
 zskiplistNode *zslCreateNode(int level, double score, robj *obj) {
     zskiplistNode *zn = zmalloc(sizeof(*zn)+level*sizeof(struct zskiplistLevel));
@@ -209,7 +207,7 @@ int zslDelete(zskiplist *zsl, double score, robj *obj) {
     return 0; /* not found */
 }
 
-static int zslValueGteMin(double value, zrangespec *spec) {
+int zslValueGteMin(double value, zrangespec *spec) {
     return spec->minex ? (value > spec->min) : (value >= spec->min);
 }
 
@@ -547,13 +545,13 @@ int compareStringObjectsForLexRange(robj *a, robj *b) {
     return compareStringObjects(a,b);
 }
 
-static int zslLexValueGteMin(robj *value, zlexrangespec *spec) {
+int zslLexValueGteMin(robj *value, zlexrangespec *spec) {
     return spec->minex ?
         (compareStringObjectsForLexRange(value,spec->min) > 0) :
         (compareStringObjectsForLexRange(value,spec->min) >= 0);
 }
 
-static int zslLexValueLteMax(robj *value, zlexrangespec *spec) {
+int zslLexValueLteMax(robj *value, zlexrangespec *spec) {
     return spec->maxex ?
         (compareStringObjectsForLexRange(value,spec->max) < 0) :
         (compareStringObjectsForLexRange(value,spec->max) <= 0);
@@ -916,23 +914,19 @@ unsigned char *zzlFind(unsigned char *zl, robj *ele, double *score) {
     unsigned char *eptr = ziplistIndex(zl,0), *sptr;
 
     ele = getDecodedObject(ele);
-    while (eptr != NULL) {
+    /* Elements and scores alternate, so only every other entry needs to
+     * be compared. */
+    if (eptr != NULL)
+        eptr = ziplistFind(eptr,ele->ptr,sdslen(ele->ptr),1);
+    if (eptr != NULL) {
+        /* Matching element, pull out score. */
         sptr = ziplistNext(zl,eptr);
         serverAssertWithInfo(NULL,ele,sptr != NULL);
-
-        if (ziplistCompare(eptr,ele->ptr,sdslen(ele->ptr))) {
-            /* Matching element, pull out score. */
-            if (score != NULL) *score = zzlGetScore(sptr);
-            decrRefCount(ele);
-            return eptr;
-        }
-
-        /* Move to next element. */
-        eptr = ziplistNext(zl,sptr);
+        if (score != NULL) *score = zzlGetScore(sptr);
     }
 
     decrRefCount(ele);
-    return NULL;
+    return eptr;
 }
 
 /* Delete (element,score) pair from ziplist. Use local copy of eptr because we
@@ -1083,16 +1077,27 @@ unsigned int zsetLength(robj *zobj) {
     if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
         length = zzlLength(zobj->ptr);
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
-        length = ((zset*)zobj->ptr)->zsl->length;
+        length = ((zset*)zobj->ptr)->zbt->length;
     } else {
         serverPanic("Unknown sorted set encoding");
     }
     return length;
 }
 
+/* Add a new element to a skiplist encoded sorted set. The tree takes the
+ * reference of the caller, while a new one is created for the dict. */
+void zsetAddElement(zset *zs, robj *ele, double score) {
+    dictEntry *de = dictAddRaw(zs->dict,ele);
+
+    serverAssertWithInfo(NULL,ele,de != NULL);
+    dictSetDoubleVal(de,score);
+    incrRefCount(ele); /* Added to dictionary. */
+    zbtInsert(zs->zbt,score,ele);
+}
+
 void zsetConvert(robj *zobj, int encoding) {
     zset *zs;
-    zskiplistNode *node, *next;
+    zbtCursor cur;
     robj *ele;
     double score;
 
@@ -1109,7 +1114,7 @@ void zsetConvert(robj *zobj, int encoding) {
 
         zs = zmalloc(sizeof(*zs));
         zs->dict = dictCreate(&zsetDictType,NULL);
-        zs->zsl = zslCreate();
+        zs->zbt = zbtCreate();
 
         eptr = ziplistIndex(zl,0);
         serverAssertWithInfo(NULL,zobj,eptr != NULL);
@@ -1125,9 +1130,7 @@ void zsetConvert(robj *zobj, int encoding) {
                 ele = createStringObject((char*)vstr,vlen);
 
             /* Has incremented refcount since it was just created. */
-            node = zslInsert(zs->zsl,score,ele);
-            serverAssertWithInfo(NULL,zobj,dictAdd(zs->dict,ele,&node->score) == DICT_OK);
-            incrRefCount(ele); /* Added to dictionary. */
+            zsetAddElement(zs,ele,score);
             zzlNext(zl,&eptr,&sptr);
         }
 
@@ -1140,24 +1143,17 @@ void zsetConvert(robj *zobj, int encoding) {
         if (encoding != OBJ_ENCODING_ZIPLIST)
             serverPanic("Unknown target encoding");
 
-        /* Approach similar to zslFree(), since we want to free the skiplist at
-         * the same time as creating the ziplist. */
         zs = zobj->ptr;
-        dictRelease(zs->dict);
-        node = zs->zsl->header->level[0].forward;
-        zfree(zs->zsl->header);
-        zfree(zs->zsl);
-
-        while (node) {
-            ele = getDecodedObject(node->obj);
-            zl = zzlInsertAt(zl,NULL,ele,node->score);
+        zbtFirst(zs->zbt,&cur);
+        while (cur.leaf) {
+            ele = getDecodedObject(zbtCursorObj(&cur));
+            zl = zzlInsertAt(zl,NULL,ele,zbtCursorScore(&cur));
             decrRefCount(ele);
-
-            next = node->level[0].forward;
-            zslFreeNode(node);
-            node = next;
+            zbtNext(&cur);
         }
 
+        dictRelease(zs->dict);
+        zbtFree(zs->zbt);
         zfree(zs);
         zobj->ptr = zl;
         zobj->encoding = OBJ_ENCODING_ZIPLIST;
@@ -1173,7 +1169,7 @@ void zsetConvertToZiplistIfNeeded(robj *zobj, size_t maxelelen) {
     if (zobj->encoding == OBJ_ENCODING_ZIPLIST) return;
     zset *zset = zobj->ptr;
 
-    if (zset->zsl->length <= server.zset_max_ziplist_entries &&
+    if (zset->zbt->length <= server.zset_max_ziplist_entries &&
         maxelelen <= server.zset_max_ziplist_value)
             zsetConvert(zobj,OBJ_ENCODING_ZIPLIST);
 }
@@ -1191,7 +1187,7 @@ int zsetScore(robj *zobj, robj *member, double *score) {
         zset *zs = zobj->ptr;
         dictEntry *de = dictFind(zs->dict, member);
         if (de == NULL) return C_ERR;
-        *score = *(double*)dictGetVal(de);
+        *score = dictGetDoubleVal(de);
     } else {
         serverPanic("Unknown sorted set encoding");
     }
@@ -1337,7 +1333,6 @@ void zaddGenericCommand(client *c, int flags) {
             }
         } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
             zset *zs = zobj->ptr;
-            zskiplistNode *znode;
             dictEntry *de;
 
             ele = c->argv[scoreidx+1+j*2] =
@@ -1346,7 +1341,7 @@ void zaddGenericCommand(client *c, int flags) {
             if (de != NULL) {
                 if (nx) continue;
                 curobj = dictGetKey(de);
-                curscore = *(double*)dictGetVal(de);
+                curscore = dictGetDoubleVal(de);
 
                 if (incr) {
                     score += curscore;
@@ -1359,22 +1354,20 @@ void zaddGenericCommand(client *c, int flags) {
                 }
 
                 /* Remove and re-insert when score changed. We can safely
-                 * delete the key object from the skiplist, since the
+                 * delete the key object from the tree, since the
                  * dictionary still has a reference to it. */
                 if (score != curscore) {
-                    serverAssertWithInfo(c,curobj,zslDelete(zs->zsl,curscore,curobj));
-                    znode = zslInsert(zs->zsl,score,curobj);
-                    incrRefCount(curobj); /* Re-inserted in skiplist. */
-                    dictGetVal(de) = &znode->score; /* Update score ptr. */
+                    serverAssertWithInfo(c,curobj,zbtDelete(zs->zbt,curscore,curobj));
+                    incrRefCount(curobj); /* Re-inserted in the tree. */
+                    zbtInsert(zs->zbt,score,curobj);
+                    dictSetDoubleVal(de,score);
                     server.dirty++;
                     updated++;
                 }
                 processed++;
             } else if (!xx) {
-                znode = zslInsert(zs->zsl,score,ele);
-                incrRefCount(ele); /* Inserted in skiplist. */
-                serverAssertWithInfo(c,NULL,dictAdd(zs->dict,ele,&znode->score) == DICT_OK);
-                incrRefCount(ele); /* Added to dictionary. */
+                incrRefCount(ele); /* Inserted in the tree. */
+                zsetAddElement(zs,ele,score);
                 server.dirty++;
                 added++;
                 processed++;
@@ -1450,9 +1443,9 @@ void zremCommand(client *c) {
             if (de != NULL) {
                 deleted++;
 
-                /* Delete from the skiplist */
-                score = *(double*)dictGetVal(de);
-                serverAssertWithInfo(c,c->argv[j],zslDelete(zs->zsl,score,c->argv[j]));
+                /* Delete from the tree */
+                score = dictGetDoubleVal(de);
+                serverAssertWithInfo(c,c->argv[j],zbtDelete(zs->zbt,score,c->argv[j]));
 
                 /* Delete from the hash table */
                 dictDelete(zs->dict,c->argv[j]);
@@ -1556,13 +1549,13 @@ void zremrangeGenericCommand(client *c, int rangetype) {
         zset *zs = zobj->ptr;
         switch(rangetype) {
         case ZRANGE_RANK:
-            deleted = zslDeleteRangeByRank(zs->zsl,start+1,end+1,zs->dict);
+            deleted = zbtDeleteRangeByRank(zs->zbt,start+1,end+1,zs->dict);
             break;
         case ZRANGE_SCORE:
-            deleted = zslDeleteRangeByScore(zs->zsl,&range,zs->dict);
+            deleted = zbtDeleteRangeByScore(zs->zbt,&range,zs->dict);
             break;
         case ZRANGE_LEX:
-            deleted = zslDeleteRangeByLex(zs->zsl,&lexrange,zs->dict);
+            deleted = zbtDeleteRangeByLex(zs->zbt,&lexrange,zs->dict);
             break;
         }
         if (htNeedsResize(zs->dict)) dictResize(zs->dict);
@@ -1629,7 +1622,7 @@ typedef struct {
             } zl;
             struct {
                 zset *zs;
-                zskiplistNode *node;
+                zbtCursor cur;
             } sl;
         } zset;
     } iter;
@@ -1687,7 +1680,7 @@ void zuiInitIterator(zsetopsrc *op) {
             }
         } else if (op->encoding == OBJ_ENCODING_SKIPLIST) {
             it->sl.zs = op->subject->ptr;
-            it->sl.node = it->sl.zs->zsl->header->level[0].forward;
+            zbtFirst(it->sl.zs->zbt,&it->sl.cur);
         } else {
             serverPanic("Unknown sorted set encoding");
         }
@@ -1741,7 +1734,7 @@ int zuiLength(zsetopsrc *op) {
             return zzlLength(op->subject->ptr);
         } else if (op->encoding == OBJ_ENCODING_SKIPLIST) {
             zset *zs = op->subject->ptr;
-            return zs->zsl->length;
+            return zs->zbt->length;
         } else {
             serverPanic("Unknown sorted set encoding");
         }
@@ -1797,13 +1790,13 @@ int zuiNext(zsetopsrc *op, zsetopval *val) {
             /* Move to next element. */
             zzlNext(it->zl.zl,&it->zl.eptr,&it->zl.sptr);
         } else if (op->encoding == OBJ_ENCODING_SKIPLIST) {
-            if (it->sl.node == NULL)
+            if (it->sl.cur.leaf == NULL)
                 return 0;
-            val->ele = it->sl.node->obj;
-            val->score = it->sl.node->score;
+            val->ele = zbtCursorObj(&it->sl.cur);
+            val->score = zbtCursorScore(&it->sl.cur);
 
             /* Move to next element. */
-            it->sl.node = it->sl.node->level[0].forward;
+            zbtNext(&it->sl.cur);
         } else {
             serverPanic("Unknown sorted set encoding");
         }
@@ -1912,7 +1905,7 @@ int zuiFind(zsetopsrc *op, zsetopval *val, double *score) {
             zset *zs = op->subject->ptr;
             dictEntry *de;
             if ((de = dictFind(zs->dict,val->ele)) != NULL) {
-                *score = *(double*)dictGetVal(de);
+                *score = dictGetDoubleVal(de);
                 return 1;
             } else {
                 return 0;
@@ -1932,7 +1925,6 @@ int zuiCompareByCardinality(const void *s1, const void *s2) {
 #define REDIS_AGGR_SUM 1
 #define REDIS_AGGR_MIN 2
 #define REDIS_AGGR_MAX 3
-#define zunionInterDictValue(_e) (dictGetVal(_e) == NULL ? 1.0 : *(double*)dictGetVal(_e))
 
 inline static void zunionInterAggregate(double *target, double val, int aggregate) {
     if (aggregate == REDIS_AGGR_SUM) {
@@ -1961,7 +1953,6 @@ void zunionInterGenericCommand(client *c, robj *dstkey, int op) {
     unsigned int maxelelen = 0;
     robj *dstobj;
     zset *dstzset;
-    zskiplistNode *znode;
     int touched = 0;
 
     /* expect setnum input keys to be given */
@@ -2082,10 +2073,8 @@ void zunionInterGenericCommand(client *c, robj *dstkey, int op) {
                 /* Only continue when present in every input. */
                 if (j == setnum) {
                     tmp = zuiObjectFromValue(&zval);
-                    znode = zslInsert(dstzset->zsl,score,tmp);
-                    incrRefCount(tmp); /* added to skiplist */
-                    dictAdd(dstzset->dict,tmp,&znode->score);
-                    incrRefCount(tmp); /* added to dictionary */
+                    incrRefCount(tmp); /* added to the tree */
+                    zsetAddElement(dstzset,tmp,score);
 
                     if (sdsEncodedObject(tmp)) {
                         if (sdslen(tmp->ptr) > maxelelen)
@@ -2158,10 +2147,8 @@ void zunionInterGenericCommand(client *c, robj *dstkey, int op) {
         while((de = dictNext(di)) != NULL) {
             robj *ele = dictGetKey(de);
             score = dictGetDoubleVal(de);
-            znode = zslInsert(dstzset->zsl,score,ele);
-            incrRefCount(ele); /* added to skiplist */
-            dictAdd(dstzset->dict,ele,&znode->score);
-            incrRefCount(ele); /* added to dictionary */
+            incrRefCount(ele); /* added to the tree */
+            zsetAddElement(dstzset,ele,score);
         }
         dictReleaseIterator(di);
 
@@ -2173,7 +2160,7 @@ void zunionInterGenericCommand(client *c, robj *dstkey, int op) {
 
     if (dbDelete(c->db,dstkey))
         touched = 1;
-    if (dstzset->zsl->length) {
+    if (dstzset->zbt->length) {
         zsetConvertToZiplistIfNeeded(dstobj,maxelelen);
         dbAdd(c->db,dstkey,dstobj);
         addReplyLongLong(c,zsetLength(dstobj));
@@ -2276,28 +2263,28 @@ void zrangeGenericCommand(client *c, int reverse) {
 
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
-        zskiplist *zsl = zs->zsl;
-        zskiplistNode *ln;
+        zbtree *zbt = zs->zbt;
+        zbtCursor ln;
         robj *ele;
 
         /* Check if starting point is trivial, before doing log(N) lookup. */
         if (reverse) {
-            ln = zsl->tail;
+            zbtLast(zbt,&ln);
             if (start > 0)
-                ln = zslGetElementByRank(zsl,llen-start);
+                zbtGetElementByRank(zbt,llen-start,&ln);
         } else {
-            ln = zsl->header->level[0].forward;
+            zbtFirst(zbt,&ln);
             if (start > 0)
-                ln = zslGetElementByRank(zsl,start+1);
+                zbtGetElementByRank(zbt,start+1,&ln);
         }
 
         while(rangelen--) {
-            serverAssertWithInfo(c,zobj,ln != NULL);
-            ele = ln->obj;
+            serverAssertWithInfo(c,zobj,ln.leaf != NULL);
+            ele = zbtCursorObj(&ln);
             addReplyBulk(c,ele);
             if (withscores)
-                addReplyDouble(c,ln->score);
-            ln = reverse ? ln->backward : ln->level[0].forward;
+                addReplyDouble(c,zbtCursorScore(&ln));
+            if (reverse) zbtPrev(&ln); else zbtNext(&ln);
         }
     } else {
         serverPanic("Unknown sorted set encoding");
@@ -2442,18 +2429,18 @@ void genericZrangebyscoreCommand(client *c, int reverse) {
         }
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
-        zskiplist *zsl = zs->zsl;
-        zskiplistNode *ln;
+        zbtree *zbt = zs->zbt;
+        zbtCursor ln;
 
         /* If reversed, get the last node in range as starting point. */
         if (reverse) {
-            ln = zslLastInRange(zsl,&range);
+            zbtLastInRange(zbt,&range,&ln);
         } else {
-            ln = zslFirstInRange(zsl,&range);
+            zbtFirstInRange(zbt,&range,&ln);
         }
 
         /* No "first" element in the specified interval. */
-        if (ln == NULL) {
+        if (ln.leaf == NULL) {
             addReply(c, shared.emptymultibulk);
             return;
         }
@@ -2463,36 +2450,33 @@ void genericZrangebyscoreCommand(client *c, int reverse) {
          * length in the output buffer, and will "fix" it later */
         replylen = addDeferredMultiBulkLength(c);
 
-        /* If there is an offset, just traverse the number of elements without
+        /* If there is an offset, just jump over the elements by rank without
          * checking the score because that is done in the next loop. */
-        while (ln && offset--) {
-            if (reverse) {
-                ln = ln->backward;
-            } else {
-                ln = ln->level[0].forward;
-            }
-        }
+        if (offset > 0)
+            zbtSkip(zbt,&ln,offset,reverse);
+        else if (offset < 0)
+            ln.leaf = NULL;
 
-        while (ln && limit--) {
+        while (ln.leaf && limit--) {
             /* Abort when the node is no longer in range. */
             if (reverse) {
-                if (!zslValueGteMin(ln->score,&range)) break;
+                if (!zslValueGteMin(zbtCursorScore(&ln),&range)) break;
             } else {
-                if (!zslValueLteMax(ln->score,&range)) break;
+                if (!zslValueLteMax(zbtCursorScore(&ln),&range)) break;
             }
 
             rangelen++;
-            addReplyBulk(c,ln->obj);
+            addReplyBulk(c,zbtCursorObj(&ln));
 
             if (withscores) {
-                addReplyDouble(c,ln->score);
+                addReplyDouble(c,zbtCursorScore(&ln));
             }
 
             /* Move to next node */
             if (reverse) {
-                ln = ln->backward;
+                zbtPrev(&ln);
             } else {
-                ln = ln->level[0].forward;
+                zbtNext(&ln);
             }
         }
     } else {
@@ -2570,25 +2554,25 @@ void zcountCommand(client *c) {
         }
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
-        zskiplist *zsl = zs->zsl;
-        zskiplistNode *zn;
+        zbtree *zbt = zs->zbt;
+        zbtCursor zn;
         unsigned long rank;
 
         /* Find first element in range */
-        zn = zslFirstInRange(zsl, &range);
+        zbtFirstInRange(zbt, &range, &zn);
 
         /* Use rank of first element, if any, to determine preliminary count */
-        if (zn != NULL) {
-            rank = zslGetRank(zsl, zn->score, zn->obj);
-            count = (zsl->length - (rank - 1));
+        if (zn.leaf != NULL) {
+            rank = zbtGetRank(zbt, zbtCursorScore(&zn), zbtCursorObj(&zn));
+            count = (zbt->length - (rank - 1));
 
             /* Find last element in range */
-            zn = zslLastInRange(zsl, &range);
+            zbtLastInRange(zbt, &range, &zn);
 
             /* Use rank of last element, if any, to determine the actual count */
-            if (zn != NULL) {
-                rank = zslGetRank(zsl, zn->score, zn->obj);
-                count -= (zsl->length - rank);
+            if (zn.leaf != NULL) {
+                rank = zbtGetRank(zbt, zbtCursorScore(&zn), zbtCursorObj(&zn));
+                count -= (zbt->length - rank);
             }
         }
     } else {
@@ -2653,25 +2637,25 @@ void zlexcountCommand(client *c) {
         }
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
-        zskiplist *zsl = zs->zsl;
-        zskiplistNode *zn;
+        zbtree *zbt = zs->zbt;
+        zbtCursor zn;
         unsigned long rank;
 
         /* Find first element in range */
-        zn = zslFirstInLexRange(zsl, &range);
+        zbtFirstInLexRange(zbt, &range, &zn);
 
         /* Use rank of first element, if any, to determine preliminary count */
-        if (zn != NULL) {
-            rank = zslGetRank(zsl, zn->score, zn->obj);
-            count = (zsl->length - (rank - 1));
+        if (zn.leaf != NULL) {
+            rank = zbtGetRank(zbt, zbtCursorScore(&zn), zbtCursorObj(&zn));
+            count = (zbt->length - (rank - 1));
 
             /* Find last element in range */
-            zn = zslLastInLexRange(zsl, &range);
+            zbtLastInLexRange(zbt, &range, &zn);
 
             /* Use rank of last element, if any, to determine the actual count */
-            if (zn != NULL) {
-                rank = zslGetRank(zsl, zn->score, zn->obj);
-                count -= (zsl->length - rank);
+            if (zn.leaf != NULL) {
+                rank = zbtGetRank(zbt, zbtCursorScore(&zn), zbtCursorObj(&zn));
+                count -= (zbt->length - rank);
             }
         }
     } else {
@@ -2806,18 +2790,18 @@ void genericZrangebylexCommand(client *c, int reverse) {
         }
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
-        zskiplist *zsl = zs->zsl;
-        zskiplistNode *ln;
+        zbtree *zbt = zs->zbt;
+        zbtCursor ln;
 
         /* If reversed, get the last node in range as starting point. */
         if (reverse) {
-            ln = zslLastInLexRange(zsl,&range);
+            zbtLastInLexRange(zbt,&range,&ln);
         } else {
-            ln = zslFirstInLexRange(zsl,&range);
+            zbtFirstInLexRange(zbt,&range,&ln);
         }
 
         /* No "first" element in the specified interval. */
-        if (ln == NULL) {
+        if (ln.leaf == NULL) {
             addReply(c, shared.emptymultibulk);
             zslFreeLexRange(&range);
             return;
@@ -2828,32 +2812,29 @@ void genericZrangebylexCommand(client *c, int reverse) {
          * length in the output buffer, and will "fix" it later */
         replylen = addDeferredMultiBulkLength(c);
 
-        /* If there is an offset, just traverse the number of elements without
-         * checking the score because that is done in the next loop. */
-        while (ln && offset--) {
-            if (reverse) {
-                ln = ln->backward;
-            } else {
-                ln = ln->level[0].forward;
-            }
-        }
+        /* If there is an offset, just jump over the elements by rank without
+         * checking the range because that is done in the next loop. */
+        if (offset > 0)
+            zbtSkip(zbt,&ln,offset,reverse);
+        else if (offset < 0)
+            ln.leaf = NULL;
 
-        while (ln && limit--) {
+        while (ln.leaf && limit--) {
             /* Abort when the node is no longer in range. */
             if (reverse) {
-                if (!zslLexValueGteMin(ln->obj,&range)) break;
+                if (!zslLexValueGteMin(zbtCursorObj(&ln),&range)) break;
             } else {
-                if (!zslLexValueLteMax(ln->obj,&range)) break;
+                if (!zslLexValueLteMax(zbtCursorObj(&ln),&range)) break;
             }
 
             rangelen++;
-            addReplyBulk(c,ln->obj);
+            addReplyBulk(c,zbtCursorObj(&ln));
 
             /* Move to next node */
             if (reverse) {
-                ln = ln->backward;
+                zbtPrev(&ln);
             } else {
-                ln = ln->level[0].forward;
+                zbtNext(&ln);
             }
         }
     } else {
@@ -2959,15 +2940,14 @@ void zrankGenericCommand(client *c, int reverse) {
         }
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
-        zskiplist *zsl = zs->zsl;
         dictEntry *de;
         double score;
 
         ele = c->argv[2];
         de = dictFind(zs->dict,ele);
         if (de != NULL) {
-            score = *(double*)dictGetVal(de);
-            rank = zslGetRank(zsl,score,ele);
+            score = dictGetDoubleVal(de);
+            rank = zbtGetRank(zs->zbt,score,ele);
             serverAssertWithInfo(c,ele,rank); /* Existing elements always have a rank. */
             if (reverse)
                 addReplyLongLong(c,llen-rank);
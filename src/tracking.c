@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "server.h"
+#include "intset.h"
+
+/* Client side caching support: key tracking.
+ *
+ * A client enabling tracking with CLIENT TRACKING ON REDIRECT <id> gets the
+ * keys it reads remembered by the server. When one of them is modified,
+ * deleted, expired or evicted, an invalidation message is sent as a Pub/Sub
+ * message on the __redis__:invalidate channel to the redirection client,
+ * that is expected to be SUBSCRIBEd, so that the application can drop the
+ * key from its local cache.
+ *
+ * Keys are not stored: the tracking table is indexed by a hash of the key
+ * name, and every slot is an intset with the IDs of the clients that read a
+ * key hashing there. Collisions only cause spurious invalidations. A slot is
+ * cleared once its invalidation is sent, clients track a key again the next
+ * time they read it. Moving values to the disk store does not change them
+ * and is not an invalidation event. */
+
+#define TRACKING_TABLE_SIZE (1<<18)
+
+static intset **TrackingTable = NULL;
+static uint64_t TrackingTableUsedSlots = 0;
+static robj *TrackingChannelName;
+
+/* Return the tracking table slot of the specified key. */
+static uint64_t trackingKeySlot(robj *key) {
+    unsigned int hash;
+
+    key = getDecodedObject(key);
+    hash = dictGenHashFunction(key->ptr,sdslen(key->ptr));
+    decrRefCount(key);
+    return hash & (TRACKING_TABLE_SIZE-1);
+}
+
+/* Enable tracking for the client, sending invalidation messages to the
+ * client with the specified ID. */
+void enableTracking(client *c, uint64_t redirect_to) {
+    if (!(c->flags & CLIENT_TRACKING)) server.tracking_clients++;
+    c->flags |= CLIENT_TRACKING;
+    c->client_tracking_redirection = redirect_to;
+    if (TrackingTable == NULL) {
+        TrackingTable = zcalloc(sizeof(intset*) * TRACKING_TABLE_SIZE);
+        TrackingChannelName = createStringObject("__redis__:invalidate",20);
+    }
+}
+
+/* Disable tracking for the client. Its ID is left in the tracking table
+ * and is skipped when the slots are invalidated. */
+void disableTracking(client *c) {
+    if (c->flags & CLIENT_TRACKING) {
+        server.tracking_clients--;
+        c->flags &= ~CLIENT_TRACKING;
+    }
+}
+
+/* Remember the keys of the read only command just executed by 'executing'
+ * on behalf of the client 'tracking', that is the same client unless the
+ * command was called by a script. */
+void trackingRememberKeys(client *tracking, client *executing) {
+    int numkeys, j;
+    robj **argv = executing->argv;
+    int *keys = getKeysFromCommand(executing->cmd,argv,executing->argc,
+                                   &numkeys);
+
+    if (keys == NULL) return;
+    for (j = 0; j < numkeys; j++) {
+        uint64_t slot = trackingKeySlot(argv[keys[j]]);
+        intset *is = TrackingTable[slot];
+
+        if (is == NULL) {
+            is = intsetNew();
+            TrackingTableUsedSlots++;
+        }
+        TrackingTable[slot] = intsetAdd(is,tracking->id,NULL);
+    }
+    getKeysFreeResult(keys);
+}
+
+/* Send an invalidation message for 'key', or a NULL one meaning all the
+ * keys were invalidated, on behalf of the tracking client 'c'. The message
+ * can't be interleaved with the replies of a normal connection, so it goes
+ * to the redirection client, and only if it is in Pub/Sub mode. */
+static void sendTrackingMessage(client *c, robj *key) {
+    client *target = lookupClientByID(c->client_tracking_redirection);
+
+    if (target == NULL || !(target->flags & CLIENT_PUBSUB)) return;
+    addReplyPubsubMessage(target,TrackingChannelName,key);
+}
+
+/* Invalidate the slot of the key for all the clients that read it. Called
+ * every time a key is modified, expired or evicted. */
+void trackingInvalidateKey(robj *key) {
+    uint64_t slot;
+    intset *is;
+    uint32_t j;
+
+    if (TrackingTable == NULL) return;
+    slot = trackingKeySlot(key);
+    is = TrackingTable[slot];
+    if (is == NULL) return;
+
+    for (j = 0; j < intsetLen(is); j++) {
+        int64_t id;
+        client *c;
+
+        intsetGet(is,j,&id);
+        c = lookupClientByID(id);
+        if (c == NULL || !(c->flags & CLIENT_TRACKING)) continue;
+        sendTrackingMessage(c,key);
+    }
+    zfree(is);
+    TrackingTable[slot] = NULL;
+    TrackingTableUsedSlots--;
+}
+
+/* Invalidate every key on FLUSHDB / FLUSHALL: all the tracking clients get
+ * a NULL invalidation message and the table is emptied. */
+void trackingInvalidateKeysOnFlush(int dbid) {
+    listNode *ln;
+    listIter li;
+    uint64_t j;
+
+    UNUSED(dbid);
+    if (TrackingTable == NULL) return;
+    if (server.tracking_clients) {
+        listRewind(server.clients,&li);
+        while ((ln = listNext(&li)) != NULL) {
+            client *c = listNodeValue(ln);
+
+            if (c->flags & CLIENT_TRACKING) sendTrackingMessage(c,NULL);
+        }
+    }
+    for (j = 0; j < TRACKING_TABLE_SIZE && TrackingTableUsedSlots; j++) {
+        if (TrackingTable[j] == NULL) continue;
+        zfree(TrackingTable[j]);
+        TrackingTable[j] = NULL;
+        TrackingTableUsedSlots--;
+    }
+}
+
+/* Number of tracking table slots currently used, for INFO. */
+uint64_t trackingGetUsedSlots(void) {
+    return TrackingTableUsedSlots;
+}
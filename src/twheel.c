@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "twheel.h"
+#include "zmalloc.h"
+
+static const struct {
+    long long gran;
+    int slotnr;
+} twLevelDesc[TW_LEVELS] = {
+    {1, 1000},       /* milliseconds */
+    {1000, 60},      /* seconds */
+    {60000, 60},     /* minutes */
+    {3600000, 24},   /* hours */
+};
+
+#define twLevelSpan(tw,l) ((tw)->levels[l].gran * (tw)->levels[l].slotnr)
+
+timeWheel *twCreate(long long now) {
+    int l, j;
+    timeWheel *tw = zmalloc(sizeof(*tw));
+
+    tw->curms = now;
+    tw->count = 0;
+    tw->duenr = 0;
+    init_list_head(&tw->due);
+    init_list_head(&tw->cascade);
+    init_list_head(&tw->overflow);
+    for (l = 0; l < TW_LEVELS; l++) {
+        tw->levels[l].gran = twLevelDesc[l].gran;
+        tw->levels[l].slotnr = twLevelDesc[l].slotnr;
+        tw->levels[l].slots = 
+            zmalloc(sizeof(struct list_head) * twLevelDesc[l].slotnr);
+        for (j = 0; j < twLevelDesc[l].slotnr; j++) {
+            init_list_head(&tw->levels[l].slots[j]);
+        }
+    }
+
+    return tw;
+}
+
+static void twFreeList(struct list_head *head) {
+    struct list_head *pos, *next;
+
+    list_for_each_safe(pos, next, head) {
+        list_del(pos);
+        zfree((twNode *)pos);
+    }
+}
+
+/* Remove every timer, the data they point to is not touched. */
+void twEmpty(timeWheel *tw) {
+    int l, j;
+
+    twFreeList(&tw->due);
+    twFreeList(&tw->cascade);
+    twFreeList(&tw->overflow);
+    for (l = 0; l < TW_LEVELS; l++) {
+        for (j = 0; j < tw->levels[l].slotnr; j++) {
+            twFreeList(&tw->levels[l].slots[j]);
+        }
+    }
+    tw->count = 0;
+    tw->duenr = 0;
+}
+
+void twRelease(timeWheel *tw) {
+    int l;
+
+    twEmpty(tw);
+    for (l = 0; l < TW_LEVELS; l++) {
+        zfree(tw->levels[l].slots);
+    }
+    zfree(tw);
+}
+
+/* Put the timer in the slot of the first level whose span covers it.
+ * A timer of level l is at least one slot of level l away, so its slot
+ * is reached again before the timer expires and the timer moves down. */
+static void twPlace(timeWheel *tw, twNode *node) {
+    int l;
+    long long delta = node->when - tw->curms;
+    twLevel *level;
+
+    if (delta <= 0) {
+        list_add_tail(&node->twlist, &tw->due);
+        node->level = TW_DUE;
+        tw->duenr++;
+        return;
+    }
+
+    for (l = 0; l < TW_LEVELS; l++) {
+        level = tw->levels + l;
+        if (delta < twLevelSpan(tw,l)) {
+            list_add_tail(&node->twlist, 
+                          &level->slots[(node->when / level->gran) % 
+                                        level->slotnr]);
+            node->level = l;
+            return;
+        }
+    }
+
+    list_add_tail(&node->twlist, &tw->overflow);
+    node->level = TW_OVERFLOW;
+}
+
+twNode *twAdd(timeWheel *tw, long long when, void *data) {
+    twNode *node = zmalloc(sizeof(*node));
+
+    node->when = when;
+    node->data = data;
+    twPlace(tw, node);
+    tw->count++;
+
+    return node;
+}
+
+void twDel(timeWheel *tw, twNode *node) {
+    list_del(&node->twlist);
+    if (node->level == TW_DUE) {
+        tw->duenr--;
+    }
+    tw->count--;
+    zfree(node);
+}
+
+/* Return the oldest expired timer still in the wheel, or NULL. */
+twNode *twFirstDue(timeWheel *tw) {
+    if (list_empty(&tw->due)) {
+        return NULL;
+    }
+
+    return (twNode *)tw->due.next;
+}
+
+/* Advance the wheel up to 'now', moving at most 'maxops' timers: first
+ * the ones of the millisecond slot just reached into tw->due, then the 
+ * ones of coarser slots going down a level. The work left is resumed by 
+ * the next call, so a crowded slot is spread over several calls. Returns 
+ * the number of timers moved, 0 when the wheel is up to date. */
+unsigned long twProcess(timeWheel *tw, long long now, unsigned long maxops) {
+    int l;
+    long long t;
+    unsigned long ops = 0;
+    struct list_head *slot;
+    twNode *node;
+    twLevel *level;
+
+    while (ops < maxops) {
+        /* New timers never go to the current millisecond slot, whatever
+         * is left there was reached and is due */
+        level = tw->levels;
+        slot = &level->slots[tw->curms % level->slotnr];
+        if (!list_empty(slot)) {
+            node = (twNode *)slot->next;
+            list_move_tail(&node->twlist, &tw->due);
+            node->level = TW_DUE;
+            tw->duenr++;
+            ops++;
+            continue;
+        }
+
+        if (!list_empty(&tw->cascade)) {
+            node = (twNode *)tw->cascade.next;
+            list_del(&node->twlist);
+            twPlace(tw, node);
+            ops++;
+            continue;
+        }
+
+        if (tw->curms >= now) {
+            break;
+        }
+
+        /* Nothing left in the slots, skip the empty ticks at once */
+        if (tw->count == tw->duenr) {
+            tw->curms = now;
+            break;
+        }
+
+        t = ++tw->curms;
+
+        /* Coarser slots reached at this tick go down a level */
+        if (t % twLevelSpan(tw,TW_LEVELS-1) == 0) {
+            list_splice_tail_init(&tw->overflow, &tw->cascade);
+        }
+        for (l = TW_LEVELS-1; l > 0; l--) {
+            level = tw->levels + l;
+            if (t % level->gran == 0) {
+                list_splice_tail_init(
+                    &level->slots[(t / level->gran) % level->slotnr],
+                    &tw->cascade);
+            }
+        }
+    }
+
+    return ops;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __TWHEEL_H__
+#define __TWHEEL_H__
+
+#include <stddef.h>
+#include "list.h"
+
+/* Hierarchical timing wheel with millisecond, second, minute and hour
+ * levels. A timer is kept in the slot of the coarsest level that still 
+ * covers it, and moved down a level every time the wheel reaches that 
+ * slot, so adding and deleting a timer are O(1). Timers farther than the 
+ * hour level are parked in an overflow list scanned once a day. */
+
+#define TW_LEVELS 4
+#define TW_DUE -1        /* timer expired, waiting in tw->due */
+#define TW_OVERFLOW -2   /* timer in tw->overflow */
+
+typedef struct twNode {
+    struct list_head twlist; /* first member, a list pointer is the node */
+    long long when;          /* unix time in milliseconds */
+    void *data;
+    int level;               /* where it was placed, see twPlace() */
+} twNode;
+
+typedef struct twLevel {
+    long long gran;          /* milliseconds covered by one slot */
+    int slotnr;
+    struct list_head *slots;
+} twLevel;
+
+typedef struct timeWheel {
+    long long curms;         /* every slot up to this time was collected */
+    unsigned long count;     /* timers in the wheel */
+    unsigned long duenr;     /* timers in 'due' */
+    struct list_head due;
+    struct list_head cascade;
+    struct list_head overflow;
+    twLevel levels[TW_LEVELS];
+} timeWheel;
+
+timeWheel *twCreate(long long now);
+void twRelease(timeWheel *tw);
+void twEmpty(timeWheel *tw);
+twNode *twAdd(timeWheel *tw, long long when, void *data);
+void twDel(timeWheel *tw, twNode *node);
+twNode *twFirstDue(timeWheel *tw);
+unsigned long twProcess(timeWheel *tw, long long now, unsigned long maxops);
+
+#endif /* __TWHEEL_H__ */
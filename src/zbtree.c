@@ -0,0 +1,750 @@
+/*
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* B+tree with order statistics used by the sorted sets that are too big for
+ * the ziplist encoding.
+ *
+ * Elements are ordered by score and then by member, exactly like in the
+ * skiplist (see t_zset.c), but they are stored packed in leaves of up to
+ * ZBT_LEAF_SLOTS-1 elements linked in both directions, so that range
+ * iterations walk contiguous arrays instead of chasing a pointer per
+ * element. Every inner node keeps the number of elements under each of its
+ * children, so ranks are computed and elements are found by rank while
+ * descending the tree.
+ *
+ * The members are shared with the dict of the sorted set: every member
+ * stored in a leaf owns a reference, and so does every separator of the
+ * inner nodes (the first element of the child on its right), since the
+ * element it was copied from may be deleted while the separator is still a
+ * valid bound. */
+
+#include "server.h"
+
+#define ZBT_LEAF_MAX (ZBT_LEAF_SLOTS-1)
+#define ZBT_LEAF_MIN (ZBT_LEAF_MAX/2)
+#define ZBT_INNER_MAX (ZBT_INNER_SLOTS-1)
+#define ZBT_INNER_MIN (ZBT_INNER_MAX/2)
+
+/* Compare two elements in the order of the sorted set. */
+static int zbtCompare(double s1, robj *o1, double s2, robj *o2) {
+    if (s1 < s2) return -1;
+    if (s1 > s2) return 1;
+    if (o1 == o2) return 0;
+    return compareStringObjects(o1,o2);
+}
+
+static zbtLeaf *zbtCreateLeaf(void) {
+    zbtLeaf *l = zmalloc(sizeof(*l));
+
+    l->hdr.leaf = 1;
+    l->hdr.count = 0;
+    l->prev = l->next = NULL;
+    return l;
+}
+
+static zbtInner *zbtCreateInner(void) {
+    zbtInner *in = zmalloc(sizeof(*in));
+
+    in->hdr.leaf = 0;
+    in->hdr.count = 0;
+    return in;
+}
+
+zbtree *zbtCreate(void) {
+    zbtree *zbt = zmalloc(sizeof(*zbt));
+    zbtLeaf *l = zbtCreateLeaf();
+
+    zbt->root = (zbtNode*)l;
+    zbt->head = zbt->tail = l;
+    zbt->length = 0;
+    zbt->height = 1;
+    return zbt;
+}
+
+static void zbtFreeNode(zbtNode *n) {
+    int j;
+
+    if (n->leaf) {
+        zbtLeaf *l = (zbtLeaf*)n;
+
+        for (j = 0; j < n->count; j++) decrRefCount(l->obj[j]);
+    } else {
+        zbtInner *in = (zbtInner*)n;
+
+        for (j = 0; j < n->count; j++) zbtFreeNode(in->child[j]);
+        for (j = 0; j < n->count-1; j++) decrRefCount(in->sepobj[j]);
+    }
+    zfree(n);
+}
+
+void zbtFree(zbtree *zbt) {
+    zbtFreeNode(zbt->root);
+    zfree(zbt);
+}
+
+/* Return the number of elements under the node. */
+static unsigned long zbtNodeSize(zbtNode *n) {
+    zbtInner *in = (zbtInner*)n;
+    unsigned long size = 0;
+    int j;
+
+    if (n->leaf) return n->count;
+    for (j = 0; j < n->count; j++) size += in->size[j];
+    return size;
+}
+
+/* Return the index of the child of 'in' that may hold the element, that is
+ * the number of separators <= the element. */
+static int zbtChildIndex(zbtInner *in, double score, robj *obj) {
+    int lo = 0, hi = in->hdr.count-1;
+
+    while(lo < hi) {
+        int mid = (lo+hi)/2;
+
+        if (zbtCompare(score,obj,in->sepscore[mid],in->sepobj[mid]) >= 0)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Return the position of the first element of the leaf that is >= the
+ * specified element, or the count of the leaf if there is none. */
+static int zbtLeafLowerBound(zbtLeaf *l, double score, robj *obj) {
+    int lo = 0, hi = l->hdr.count;
+
+    while(lo < hi) {
+        int mid = (lo+hi)/2;
+
+        if (zbtCompare(l->score[mid],l->obj[mid],score,obj) < 0)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Insert the element in the subtree rooted at 'n'. When the node has to be
+ * split the new right sibling is returned and its separator is stored into
+ * *sepscore and *sepobj, with a reference owned by the caller. Otherwise
+ * NULL is returned. */
+static zbtNode *zbtInsertNode(zbtree *zbt, zbtNode *n, double score, robj *obj,
+                              double *sepscore, robj **sepobj)
+{
+    int half;
+
+    if (n->leaf) {
+        zbtLeaf *l = (zbtLeaf*)n, *r;
+        int pos = zbtLeafLowerBound(l,score,obj);
+
+        memmove(l->score+pos+1,l->score+pos,sizeof(double)*(n->count-pos));
+        memmove(l->obj+pos+1,l->obj+pos,sizeof(robj*)*(n->count-pos));
+        l->score[pos] = score;
+        l->obj[pos] = obj;
+        if (++n->count <= ZBT_LEAF_MAX) return NULL;
+
+        /* Move the upper half into a new leaf on the right. */
+        r = zbtCreateLeaf();
+        half = n->count/2;
+        r->hdr.count = n->count-half;
+        memcpy(r->score,l->score+half,sizeof(double)*r->hdr.count);
+        memcpy(r->obj,l->obj+half,sizeof(robj*)*r->hdr.count);
+        n->count = half;
+        r->prev = l;
+        r->next = l->next;
+        if (l->next)
+            l->next->prev = r;
+        else
+            zbt->tail = r;
+        l->next = r;
+
+        *sepscore = r->score[0];
+        *sepobj = r->obj[0];
+        incrRefCount(r->obj[0]);
+        return (zbtNode*)r;
+    } else {
+        zbtInner *in = (zbtInner*)n, *r;
+        int i = zbtChildIndex(in,score,obj);
+        double s;
+        robj *o;
+        zbtNode *nc = zbtInsertNode(zbt,in->child[i],score,obj,&s,&o);
+
+        if (nc == NULL) {
+            in->size[i]++;
+            return NULL;
+        }
+
+        /* The child was split: link the new one at i+1. */
+        memmove(in->child+i+2,in->child+i+1,sizeof(zbtNode*)*(n->count-i-1));
+        memmove(in->size+i+2,in->size+i+1,sizeof(unsigned long)*(n->count-i-1));
+        memmove(in->sepscore+i+1,in->sepscore+i,sizeof(double)*(n->count-i-1));
+        memmove(in->sepobj+i+1,in->sepobj+i,sizeof(robj*)*(n->count-i-1));
+        in->child[i+1] = nc;
+        in->size[i] = zbtNodeSize(in->child[i]);
+        in->size[i+1] = zbtNodeSize(nc);
+        in->sepscore[i] = s;
+        in->sepobj[i] = o;
+        if (++n->count <= ZBT_INNER_MAX) return NULL;
+
+        /* Move the upper half of the children into a new node on the
+         * right. The separator between the two halves moves up. */
+        r = zbtCreateInner();
+        half = n->count/2;
+        r->hdr.count = n->count-half;
+        memcpy(r->child,in->child+half,sizeof(zbtNode*)*r->hdr.count);
+        memcpy(r->size,in->size+half,sizeof(unsigned long)*r->hdr.count);
+        memcpy(r->sepscore,in->sepscore+half,sizeof(double)*(r->hdr.count-1));
+        memcpy(r->sepobj,in->sepobj+half,sizeof(robj*)*(r->hdr.count-1));
+        *sepscore = in->sepscore[half-1];
+        *sepobj = in->sepobj[half-1];
+        n->count = half;
+        return (zbtNode*)r;
+    }
+}
+
+/* Insert a new element. The element must not be already in the tree, and
+ * the tree takes ownership of one reference of 'obj'. */
+void zbtInsert(zbtree *zbt, double score, robj *obj) {
+    double s;
+    robj *o;
+    zbtNode *r = zbtInsertNode(zbt,zbt->root,score,obj,&s,&o);
+
+    if (r) {
+        zbtInner *root = zbtCreateInner();
+
+        root->hdr.count = 2;
+        root->child[0] = zbt->root;
+        root->child[1] = r;
+        root->size[0] = zbtNodeSize(zbt->root);
+        root->size[1] = zbtNodeSize(r);
+        root->sepscore[0] = s;
+        root->sepobj[0] = o;
+        zbt->root = (zbtNode*)root;
+        zbt->height++;
+    }
+    zbt->length++;
+}
+
+/* Remove the separator 'j' and the child on its right from 'in'. */
+static void zbtRemoveChild(zbtInner *in, int j) {
+    int count = in->hdr.count;
+
+    decrRefCount(in->sepobj[j]);
+    memmove(in->sepscore+j,in->sepscore+j+1,sizeof(double)*(count-j-2));
+    memmove(in->sepobj+j,in->sepobj+j+1,sizeof(robj*)*(count-j-2));
+    memmove(in->child+j+1,in->child+j+2,sizeof(zbtNode*)*(count-j-2));
+    memmove(in->size+j+1,in->size+j+2,sizeof(unsigned long)*(count-j-2));
+    in->hdr.count--;
+}
+
+/* Fix the child 'i' of 'in' after it went below the minimum fill, merging
+ * it with a sibling when both fit in a single node, or moving elements from
+ * the sibling otherwise. */
+static void zbtRebalance(zbtree *zbt, zbtInner *in, int i) {
+    int a = (i+1 < in->hdr.count) ? i : i-1, b = a+1;
+    zbtNode *ln = in->child[a], *rn = in->child[b];
+
+    if (ln->leaf) {
+        zbtLeaf *l = (zbtLeaf*)ln, *r = (zbtLeaf*)rn;
+        int total = ln->count+rn->count, move;
+
+        if (total <= ZBT_LEAF_MAX) {
+            memcpy(l->score+ln->count,r->score,sizeof(double)*rn->count);
+            memcpy(l->obj+ln->count,r->obj,sizeof(robj*)*rn->count);
+            ln->count = total;
+            l->next = r->next;
+            if (r->next)
+                r->next->prev = l;
+            else
+                zbt->tail = l;
+            zfree(r);
+            zbtRemoveChild(in,a);
+            in->size[a] = total;
+            return;
+        }
+
+        if (ln->count < total/2) {
+            move = total/2-ln->count;
+            memcpy(l->score+ln->count,r->score,sizeof(double)*move);
+            memcpy(l->obj+ln->count,r->obj,sizeof(robj*)*move);
+            memmove(r->score,r->score+move,sizeof(double)*(rn->count-move));
+            memmove(r->obj,r->obj+move,sizeof(robj*)*(rn->count-move));
+            ln->count += move;
+            rn->count -= move;
+        } else {
+            move = ln->count-total/2;
+            memmove(r->score+move,r->score,sizeof(double)*rn->count);
+            memmove(r->obj+move,r->obj,sizeof(robj*)*rn->count);
+            memcpy(r->score,l->score+ln->count-move,sizeof(double)*move);
+            memcpy(r->obj,l->obj+ln->count-move,sizeof(robj*)*move);
+            ln->count -= move;
+            rn->count += move;
+        }
+        decrRefCount(in->sepobj[a]);
+        in->sepscore[a] = r->score[0];
+        in->sepobj[a] = r->obj[0];
+        incrRefCount(r->obj[0]);
+        in->size[a] = ln->count;
+        in->size[b] = rn->count;
+    } else {
+        zbtInner *l = (zbtInner*)ln, *r = (zbtInner*)rn;
+
+        if (ln->count+rn->count <= ZBT_INNER_MAX) {
+            /* The separator of the parent moves down between the two. */
+            l->sepscore[ln->count-1] = in->sepscore[a];
+            l->sepobj[ln->count-1] = in->sepobj[a];
+            incrRefCount(in->sepobj[a]);
+            memcpy(l->child+ln->count,r->child,sizeof(zbtNode*)*rn->count);
+            memcpy(l->size+ln->count,r->size,sizeof(unsigned long)*rn->count);
+            memcpy(l->sepscore+ln->count,r->sepscore,sizeof(double)*(rn->count-1));
+            memcpy(l->sepobj+ln->count,r->sepobj,sizeof(robj*)*(rn->count-1));
+            ln->count += rn->count;
+            zfree(r);
+            zbtRemoveChild(in,a);
+            in->size[a] = zbtNodeSize(ln);
+            return;
+        }
+
+        /* Rotate children through the parent one at a time. */
+        while(ln->count < rn->count-1) {
+            l->child[ln->count] = r->child[0];
+            l->size[ln->count] = r->size[0];
+            l->sepscore[ln->count-1] = in->sepscore[a];
+            l->sepobj[ln->count-1] = in->sepobj[a];
+            in->sepscore[a] = r->sepscore[0];
+            in->sepobj[a] = r->sepobj[0];
+            memmove(r->child,r->child+1,sizeof(zbtNode*)*(rn->count-1));
+            memmove(r->size,r->size+1,sizeof(unsigned long)*(rn->count-1));
+            memmove(r->sepscore,r->sepscore+1,sizeof(double)*(rn->count-2));
+            memmove(r->sepobj,r->sepobj+1,sizeof(robj*)*(rn->count-2));
+            ln->count++;
+            rn->count--;
+        }
+        while(rn->count < ln->count-1) {
+            memmove(r->child+1,r->child,sizeof(zbtNode*)*rn->count);
+            memmove(r->size+1,r->size,sizeof(unsigned long)*rn->count);
+            memmove(r->sepscore+1,r->sepscore,sizeof(double)*(rn->count-1));
+            memmove(r->sepobj+1,r->sepobj,sizeof(robj*)*(rn->count-1));
+            r->child[0] = l->child[ln->count-1];
+            r->size[0] = l->size[ln->count-1];
+            r->sepscore[0] = in->sepscore[a];
+            r->sepobj[0] = in->sepobj[a];
+            in->sepscore[a] = l->sepscore[ln->count-2];
+            in->sepobj[a] = l->sepobj[ln->count-2];
+            ln->count--;
+            rn->count++;
+        }
+        in->size[a] = zbtNodeSize(ln);
+        in->size[b] = zbtNodeSize(rn);
+    }
+}
+
+/* Delete the element from the subtree rooted at 'n'. Returns 1 if the
+ * element was found and deleted, 0 otherwise. */
+static int zbtDeleteNode(zbtree *zbt, zbtNode *n, double score, robj *obj) {
+    if (n->leaf) {
+        zbtLeaf *l = (zbtLeaf*)n;
+        int pos = zbtLeafLowerBound(l,score,obj);
+
+        if (pos == n->count ||
+            zbtCompare(l->score[pos],l->obj[pos],score,obj) != 0) return 0;
+        decrRefCount(l->obj[pos]);
+        memmove(l->score+pos,l->score+pos+1,sizeof(double)*(n->count-pos-1));
+        memmove(l->obj+pos,l->obj+pos+1,sizeof(robj*)*(n->count-pos-1));
+        n->count--;
+        return 1;
+    } else {
+        zbtInner *in = (zbtInner*)n;
+        int i = zbtChildIndex(in,score,obj);
+        zbtNode *child = in->child[i];
+
+        if (!zbtDeleteNode(zbt,child,score,obj)) return 0;
+        in->size[i]--;
+        if (child->count < (child->leaf ? ZBT_LEAF_MIN : ZBT_INNER_MIN))
+            zbtRebalance(zbt,in,i);
+        return 1;
+    }
+}
+
+/* Delete an element with matching score/object from the tree, releasing
+ * the reference owned by the tree. Returns 1 if found, 0 otherwise. */
+int zbtDelete(zbtree *zbt, double score, robj *obj) {
+    if (!zbtDeleteNode(zbt,zbt->root,score,obj)) return 0;
+    zbt->length--;
+
+    /* A root left with a single child is replaced by the child. */
+    if (!zbt->root->leaf && zbt->root->count == 1) {
+        zbtInner *root = (zbtInner*)zbt->root;
+
+        zbt->root = root->child[0];
+        zfree(root);
+        zbt->height--;
+    }
+    return 1;
+}
+
+/* Point the cursor at the first / last element. Return 0 if the tree is
+ * empty. */
+int zbtFirst(zbtree *zbt, zbtCursor *c) {
+    c->leaf = zbt->length ? zbt->head : NULL;
+    c->pos = 0;
+    return c->leaf != NULL;
+}
+
+int zbtLast(zbtree *zbt, zbtCursor *c) {
+    c->leaf = zbt->length ? zbt->tail : NULL;
+    c->pos = c->leaf ? c->leaf->hdr.count-1 : 0;
+    return c->leaf != NULL;
+}
+
+/* Move the cursor to the next / previous element. The leaf of the cursor
+ * is set to NULL when moving past the ends. */
+void zbtNext(zbtCursor *c) {
+    if (++c->pos == c->leaf->hdr.count) {
+        c->leaf = c->leaf->next;
+        c->pos = 0;
+    }
+}
+
+void zbtPrev(zbtCursor *c) {
+    if (c->pos-- == 0) {
+        c->leaf = c->leaf->prev;
+        c->pos = c->leaf ? c->leaf->hdr.count-1 : 0;
+    }
+}
+
+/* Returns if there is a part of the tree in range. */
+static int zbtIsInRange(zbtree *zbt, zrangespec *range) {
+    /* Test for ranges that will always be empty. */
+    if (range->min > range->max ||
+            (range->min == range->max && (range->minex || range->maxex)))
+        return 0;
+    if (zbt->length == 0) return 0;
+    if (!zslValueGteMin(zbt->tail->score[zbt->tail->hdr.count-1],range))
+        return 0;
+    if (!zslValueLteMax(zbt->head->score[0],range))
+        return 0;
+    return 1;
+}
+
+static int zbtIsInLexRange(zbtree *zbt, zlexrangespec *range) {
+    int cmp = compareStringObjectsForLexRange(range->min,range->max);
+
+    /* Test for ranges that will always be empty. */
+    if (cmp > 0 || (cmp == 0 && (range->minex || range->maxex)))
+        return 0;
+    if (zbt->length == 0) return 0;
+    if (!zslLexValueGteMin(zbt->tail->obj[zbt->tail->hdr.count-1],range))
+        return 0;
+    if (!zslLexValueLteMax(zbt->head->obj[0],range))
+        return 0;
+    return 1;
+}
+
+/* The range lookups below descend the tree counting, in the separators of
+ * the inner nodes and then in the leaf, how many elements are below the
+ * minimum or within the maximum of the range. Scores and members are
+ * sorted, so these are binary searches. */
+static int zbtCountBelowMin(double *score, int count, zrangespec *range) {
+    int lo = 0, hi = count;
+
+    while(lo < hi) {
+        int mid = (lo+hi)/2;
+
+        if (zslValueGteMin(score[mid],range)) hi = mid; else lo = mid+1;
+    }
+    return lo;
+}
+
+static int zbtCountLteMax(double *score, int count, zrangespec *range) {
+    int lo = 0, hi = count;
+
+    while(lo < hi) {
+        int mid = (lo+hi)/2;
+
+        if (zslValueLteMax(score[mid],range)) lo = mid+1; else hi = mid;
+    }
+    return lo;
+}
+
+static int zbtCountBelowLexMin(robj **obj, int count, zlexrangespec *range) {
+    int lo = 0, hi = count;
+
+    while(lo < hi) {
+        int mid = (lo+hi)/2;
+
+        if (zslLexValueGteMin(obj[mid],range)) hi = mid; else lo = mid+1;
+    }
+    return lo;
+}
+
+static int zbtCountLteLexMax(robj **obj, int count, zlexrangespec *range) {
+    int lo = 0, hi = count;
+
+    while(lo < hi) {
+        int mid = (lo+hi)/2;
+
+        if (zslLexValueLteMax(obj[mid],range)) lo = mid+1; else hi = mid;
+    }
+    return lo;
+}
+
+/* Point the cursor at the first element in the specified range. Returns 0
+ * when no element is contained in the range. */
+int zbtFirstInRange(zbtree *zbt, zrangespec *range, zbtCursor *c) {
+    zbtNode *n = zbt->root;
+    zbtLeaf *l;
+    int i;
+
+    c->leaf = NULL;
+    if (!zbtIsInRange(zbt,range)) return 0;
+
+    while(!n->leaf) {
+        zbtInner *in = (zbtInner*)n;
+        i = zbtCountBelowMin(in->sepscore,n->count-1,range);
+        n = in->child[i];
+    }
+    l = (zbtLeaf*)n;
+    i = zbtCountBelowMin(l->score,n->count,range);
+    c->leaf = l;
+    c->pos = i;
+    if (i == n->count) {
+        /* This is an inner range, so the next element is in range. */
+        c->leaf = l->next;
+        c->pos = 0;
+    }
+
+    /* Check if score <= max. */
+    if (c->leaf == NULL || !zslValueLteMax(zbtCursorScore(c),range)) {
+        c->leaf = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/* Point the cursor at the last element in the specified range. Returns 0
+ * when no element is contained in the range. */
+int zbtLastInRange(zbtree *zbt, zrangespec *range, zbtCursor *c) {
+    zbtNode *n = zbt->root;
+    zbtLeaf *l;
+    int i;
+
+    c->leaf = NULL;
+    if (!zbtIsInRange(zbt,range)) return 0;
+
+    while(!n->leaf) {
+        zbtInner *in = (zbtInner*)n;
+        i = zbtCountLteMax(in->sepscore,n->count-1,range);
+        n = in->child[i];
+    }
+    l = (zbtLeaf*)n;
+    i = zbtCountLteMax(l->score,n->count,range);
+    c->leaf = l;
+    c->pos = i-1;
+    if (i == 0) {
+        /* This is an inner range, so the previous element is in range. */
+        c->leaf = l->prev;
+        c->pos = c->leaf ? c->leaf->hdr.count-1 : 0;
+    }
+
+    /* Check if score >= min. */
+    if (c->leaf == NULL || !zslValueGteMin(zbtCursorScore(c),range)) {
+        c->leaf = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/* Point the cursor at the first element in the specified lex range.
+ * Returns 0 when no element is contained in the range. */
+int zbtFirstInLexRange(zbtree *zbt, zlexrangespec *range, zbtCursor *c) {
+    zbtNode *n = zbt->root;
+    zbtLeaf *l;
+    int i;
+
+    c->leaf = NULL;
+    if (!zbtIsInLexRange(zbt,range)) return 0;
+
+    while(!n->leaf) {
+        zbtInner *in = (zbtInner*)n;
+        i = zbtCountBelowLexMin(in->sepobj,n->count-1,range);
+        n = in->child[i];
+    }
+    l = (zbtLeaf*)n;
+    i = zbtCountBelowLexMin(l->obj,n->count,range);
+    c->leaf = l;
+    c->pos = i;
+    if (i == n->count) {
+        c->leaf = l->next;
+        c->pos = 0;
+    }
+
+    if (c->leaf == NULL || !zslLexValueLteMax(zbtCursorObj(c),range)) {
+        c->leaf = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/* Point the cursor at the last element in the specified lex range.
+ * Returns 0 when no element is contained in the range. */
+int zbtLastInLexRange(zbtree *zbt, zlexrangespec *range, zbtCursor *c) {
+    zbtNode *n = zbt->root;
+    zbtLeaf *l;
+    int i;
+
+    c->leaf = NULL;
+    if (!zbtIsInLexRange(zbt,range)) return 0;
+
+    while(!n->leaf) {
+        zbtInner *in = (zbtInner*)n;
+        i = zbtCountLteLexMax(in->sepobj,n->count-1,range);
+        n = in->child[i];
+    }
+    l = (zbtLeaf*)n;
+    i = zbtCountLteLexMax(l->obj,n->count,range);
+    c->leaf = l;
+    c->pos = i-1;
+    if (i == 0) {
+        c->leaf = l->prev;
+        c->pos = c->leaf ? c->leaf->hdr.count-1 : 0;
+    }
+
+    if (c->leaf == NULL || !zslLexValueGteMin(zbtCursorObj(c),range)) {
+        c->leaf = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/* Find the rank for an element by both score and key.
+ * Returns 0 when the element cannot be found, rank otherwise.
+ * Note that the rank is 1-based. */
+unsigned long zbtGetRank(zbtree *zbt, double score, robj *obj) {
+    zbtNode *n = zbt->root;
+    zbtLeaf *l;
+    unsigned long rank = 0;
+    int i, j;
+
+    while(!n->leaf) {
+        zbtInner *in = (zbtInner*)n;
+
+        i = zbtChildIndex(in,score,obj);
+        for (j = 0; j < i; j++) rank += in->size[j];
+        n = in->child[i];
+    }
+    l = (zbtLeaf*)n;
+    i = zbtLeafLowerBound(l,score,obj);
+    if (i < n->count && zbtCompare(l->score[i],l->obj[i],score,obj) == 0)
+        return rank+i+1;
+    return 0;
+}
+
+/* Point the cursor at the element with the specified 1-based rank.
+ * Returns 0 when the rank is out of range. */
+int zbtGetElementByRank(zbtree *zbt, unsigned long rank, zbtCursor *c) {
+    zbtNode *n = zbt->root;
+
+    c->leaf = NULL;
+    if (rank == 0 || rank > zbt->length) return 0;
+    rank--;
+    while(!n->leaf) {
+        zbtInner *in = (zbtInner*)n;
+        int i = 0;
+
+        while(rank >= in->size[i]) rank -= in->size[i++];
+        n = in->child[i];
+    }
+    c->leaf = (zbtLeaf*)n;
+    c->pos = rank;
+    return 1;
+}
+
+/* Move the cursor 'count' elements forward, or backward if 'reverse' is
+ * true, jumping to the target rank instead of walking the elements. The
+ * leaf of the cursor is set to NULL when moving past the ends. */
+void zbtSkip(zbtree *zbt, zbtCursor *c, unsigned long count, int reverse) {
+    unsigned long rank;
+
+    if (c->leaf == NULL || count == 0) return;
+    rank = zbtGetRank(zbt,zbtCursorScore(c),zbtCursorObj(c));
+    if (reverse)
+        rank = (rank > count) ? rank-count : 0;
+    else
+        rank += count;
+    zbtGetElementByRank(zbt,rank,c);
+}
+
+/* Delete the element at the cursor from both the tree and the dict. */
+static void zbtDeleteAtCursor(zbtree *zbt, zbtCursor *c, dict *dict) {
+    double score = zbtCursorScore(c);
+    robj *obj = zbtCursorObj(c);
+
+    /* The reference of the tree keeps the object alive until the end. */
+    dictDelete(dict,obj);
+    zbtDelete(zbt,score,obj);
+}
+
+/* Delete all the elements with score between min and max from the tree
+ * and the dict. Min and max are inclusive unless excluded by the spec. */
+unsigned long zbtDeleteRangeByScore(zbtree *zbt, zrangespec *range, dict *dict) {
+    unsigned long removed = 0;
+    zbtCursor c;
+
+    while(zbtFirstInRange(zbt,range,&c)) {
+        zbtDeleteAtCursor(zbt,&c,dict);
+        removed++;
+    }
+    return removed;
+}
+
+unsigned long zbtDeleteRangeByLex(zbtree *zbt, zlexrangespec *range, dict *dict) {
+    unsigned long removed = 0;
+    zbtCursor c;
+
+    while(zbtFirstInLexRange(zbt,range,&c)) {
+        zbtDeleteAtCursor(zbt,&c,dict);
+        removed++;
+    }
+    return removed;
+}
+
+/* Delete all the elements with rank between start and end from the tree
+ * and the dict. Start and end are inclusive and 1-based. */
+unsigned long zbtDeleteRangeByRank(zbtree *zbt, unsigned long start, unsigned long end, dict *dict) {
+    unsigned long removed = 0;
+    zbtCursor c;
+
+    while(removed < end-start+1 && zbtGetElementByRank(zbt,start,&c)) {
+        zbtDeleteAtCursor(zbt,&c,dict);
+        removed++;
+    }
+    return removed;
+}
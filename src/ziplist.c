@@ -947,49 +947,54 @@ unsigned int ziplistCompare(unsigned char *p, unsigned char *sstr, unsigned int
 }
 
 /* Find pointer to the entry equal to the specified entry. Skip 'skip' entries
- * between every comparison. Returns NULL when the field could not be found. */
+ * between every comparison. Returns NULL when the field could not be found.
+ *
+ * Since this is the hot path of HGET / HEXISTS / ZSCORE on small encoded
+ * objects, entries with the most common layout (a 1 byte previous entry
+ * length and a string shorter than 64 bytes) are decoded inline, and strings
+ * are only compared with memcmp() once their length and first byte match.
+ * The searched value is also tried as an integer only once, and integer
+ * entries are not even decoded when it can't be one. */
 unsigned char *ziplistFind(unsigned char *p, unsigned char *vstr, unsigned int vlen, unsigned int skip) {
     int skipcnt = 0;
     unsigned char vencoding = 0;
+    unsigned char vfirst = vlen ? vstr[0] : 0;
     long long vll = 0;
 
+    /* Find out if the searched field can be encoded. If it can't we set
+     * vencoding to UCHAR_MAX so that integer entries are never compared. */
+    if (!zipTryEncoding(vstr, vlen, &vll, &vencoding))
+        vencoding = UCHAR_MAX;
+
     while (p[0] != ZIP_END) {
         unsigned int prevlensize, encoding, lensize, len;
         unsigned char *q;
 
-        ZIP_DECODE_PREVLENSIZE(p, prevlensize);
-        ZIP_DECODE_LENGTH(p + prevlensize, encoding, lensize, len);
-        q = p + prevlensize + lensize;
+        if (p[0] < ZIP_BIGLEN && (p[1] & ZIP_STR_MASK) == ZIP_STR_06B) {
+            /* Fast path: small string entry after a small entry. */
+            encoding = ZIP_STR_06B;
+            len = p[1] & 0x3f;
+            q = p + 2;
+        } else {
+            ZIP_DECODE_PREVLENSIZE(p, prevlensize);
+            ZIP_DECODE_LENGTH(p + prevlensize, encoding, lensize, len);
+            q = p + prevlensize + lensize;
+        }
 
         if (skipcnt == 0) {
             /* Compare current entry with specified entry */
             if (ZIP_IS_STR(encoding)) {
-                if (len == vlen && memcmp(q, vstr, vlen) == 0) {
+                if (len == vlen && (len == 0 || q[0] == vfirst) &&
+                    memcmp(q, vstr, vlen) == 0)
+                {
                     return p;
                 }
-            } else {
-                /* Find out if the searched field can be encoded. Note that
-                 * we do it only the first time, once done vencoding is set
-                 * to non-zero and vll is set to the integer value. */
-                if (vencoding == 0) {
-                    if (!zipTryEncoding(vstr, vlen, &vll, &vencoding)) {
-                        /* If the entry can't be encoded we set it to
-                         * UCHAR_MAX so that we don't retry again the next
-                         * time. */
-                        vencoding = UCHAR_MAX;
-                    }
-                    /* Must be non-zero by now */
-                    assert(vencoding);
-                }
-
-                /* Compare current entry with specified entry, do it only
-                 * if vencoding != UCHAR_MAX because if there is no encoding
-                 * possible for the field it can't be a valid integer. */
-                if (vencoding != UCHAR_MAX) {
-                    long long ll = zipLoadInteger(q, encoding);
-                    if (ll == vll) {
-                        return p;
-                    }
+            } else if (vencoding != UCHAR_MAX) {
+                /* Compare current entry with specified entry, only if
+                 * the field can be a valid integer at all. */
+                long long ll = zipLoadInteger(q, encoding);
+                if (ll == vll) {
+                    return p;
                 }
             }
 
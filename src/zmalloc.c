@@ -39,6 +39,12 @@ void zlibc_free(void *ptr) {
     free(ptr);
 }
 
+/* Like zlibc_free(), the original libc malloc(), for the memory handed to
+ * code releasing it with free(), like the values returned by rocksdb. */
+void *zlibc_malloc(size_t size) {
+    return malloc(size);
+}
+
 #include <string.h>
 #include <pthread.h>
 #include "config.h"
@@ -0,0 +1,167 @@
+# Check CLUSTER MIGRATESLOT moves the keys and the ownership of a slot.
+
+source "../tests/includes/init-tests.tcl"
+
+test "Create a 3 nodes cluster" {
+    create_cluster 3 0
+}
+
+test "Cluster should start ok" {
+    assert_cluster_state ok
+}
+
+set slot [R 0 cluster keyslot "{mig}"]
+
+test "Find the owner of the slot" {
+    set src -1
+    foreach_redis_id id {
+        if {![catch {R $id set "{mig}probe" 1}]} {set src $id}
+    }
+    assert {$src != -1}
+    set dst [expr {($src+1)%3}]
+    set dst_id [dict get [get_myself $dst] id]
+}
+
+test "Populate the slot" {
+    for {set j 0} {$j < 1000} {incr j} {
+        R $src set "{mig}:$j" $j
+    }
+    R $src rpush "{mig}list" a b c
+    R $src hset "{mig}hash" f v
+    assert_equal 1003 [R $src cluster countkeysinslot $slot]
+}
+
+test "Migrate the slot with CLUSTER MIGRATESLOT" {
+    R $src cluster migrateslot $slot $dst_id
+    wait_for_condition 1000 50 {
+        [string match "*state:done*" [R $src cluster migrateslot status]]
+    } else {
+        fail "Slot migration did not complete: [R $src cluster migrateslot status]"
+    }
+}
+
+test "Keys and ownership moved to the target" {
+    assert_equal 0 [R $src cluster countkeysinslot $slot]
+    assert_equal 1003 [R $dst cluster countkeysinslot $slot]
+    assert_equal 500 [R $dst get "{mig}:500"]
+    assert_equal {a b c} [R $dst lrange "{mig}list" 0 -1]
+    assert_equal v [R $dst hget "{mig}hash" f]
+    catch {R $src get "{mig}:500"} err
+    assert_match "MOVED $slot *" $err
+}
+
+test "Cluster should be still up" {
+    assert_cluster_state ok
+}
+
+# Find the owner of the slot of 'tag' and a target master for it.
+proc migrateslot_nodes {tag} {
+    set src -1
+    foreach_redis_id id {
+        if {![catch {R $id set "{$tag}probe" 1}]} {set src $id}
+    }
+    assert {$src != -1}
+    R $src del "{$tag}probe"
+    set dst [expr {($src+1)%3}]
+    list $src $dst [dict get [get_myself $dst] id]
+}
+
+# Return the CLUSTER MIGRATESLOT STATUS line of the job of 'slot'.
+proc migrateslot_status {id slot} {
+    foreach line [split [R $id cluster migrateslot status] "\n"] {
+        if {[string match "slot:$slot *" $line]} {return $line}
+    }
+}
+
+# Run 'cmd' on the node 'id' following the ASK and MOVED redirections
+# that a migrating slot causes.
+proc migrateslot_call {id args} {
+    if {[catch {R $id {*}$args} reply]} {
+        if {[string match "ASK *" $reply]} {
+            set id [get_instance_id_by_port redis [lindex [split [lindex $reply 2] :] 1]]
+            R $id asking
+            return [R $id {*}$args]
+        } elseif {[string match "MOVED *" $reply]} {
+            set id [get_instance_id_by_port redis [lindex [split [lindex $reply 2] :] 1]]
+            return [R $id {*}$args]
+        }
+        error $reply
+    }
+    return $reply
+}
+
+set slot [R 0 cluster keyslot "{busy}"]
+
+test "Keys written during CLUSTER MIGRATESLOT are not lost" {
+    lassign [migrateslot_nodes busy] src dst dst_id
+    set payload [string repeat x 1024]
+    for {set j 0} {$j < 10000} {incr j} {
+        R $src set "{busy}:$j" $payload
+    }
+
+    # Keep appending to random keys while the migration runs: the keys
+    # modified while their RESTORE is in flight must be sent again. The
+    # target doesn't reply for a while, so that many keys are in flight.
+    R $dst client pause 500
+    R $src cluster migrateslot $slot $dst_id
+    set writes 0
+    while {![string match "*state:done*" [migrateslot_status $src $slot]]} {
+        for {set i 0} {$i < 100} {incr i} {
+            set j [randomInt 10000]
+            migrateslot_call $src append "{busy}:$j" y
+            incr appended($j)
+        }
+        incr writes 100
+        if {$writes > 1000000} {
+            fail "Slot migration did not complete: [migrateslot_status $src $slot]"
+        }
+    }
+
+    assert_equal 0 [R $src cluster countkeysinslot $slot]
+    assert_equal 10000 [R $dst cluster countkeysinslot $slot]
+    foreach j [array names appended] {
+        assert_equal $payload[string repeat y $appended($j)] \
+            [R $dst get "{busy}:$j"]
+    }
+}
+
+set slot [R 0 cluster keyslot "{cancel}"]
+
+test "CLUSTER MIGRATESLOT CANCEL stops a running migration" {
+    lassign [migrateslot_nodes cancel] src dst dst_id
+    set payload [string repeat x 1024]
+    for {set j 0} {$j < 20000} {incr j} {
+        R $src set "{cancel}:$j" $payload
+    }
+    catch {R $src cluster migrateslot cancel $slot} err
+    assert_equal "ERR No migration of slot $slot in progress" $err
+
+    R $src cluster migrateslot $slot $dst_id
+    assert_equal OK [R $src cluster migrateslot cancel $slot]
+    assert_match "*state:failed*error:cancelled*" \
+        [migrateslot_status $src $slot]
+
+    # The slot is still ours, the keys already moved are on the target
+    # (the ones acknowledged after the cancel are on both nodes).
+    assert {[R $src cluster countkeysinslot $slot] > 0}
+    for {set j 0} {$j < 20000} {incr j 1000} {
+        assert_equal $payload [migrateslot_call $src get "{cancel}:$j"]
+    }
+}
+
+test "A cancelled migration can be started again" {
+    R $src cluster migrateslot $slot $dst_id
+    wait_for_condition 1000 50 {
+        [string match "*state:done*" [migrateslot_status $src $slot]]
+    } else {
+        fail "Slot migration did not complete: [migrateslot_status $src $slot]"
+    }
+    # Only the last job of the slot is reported.
+    assert_equal 1 [regexp -all "slot:$slot " [R $src cluster migrateslot status]]
+    assert_equal 0 [R $src cluster countkeysinslot $slot]
+    assert_equal 20000 [R $dst cluster countkeysinslot $slot]
+}
+
+test "Cluster should be still up after the migrations" {
+    assert_cluster_state ok
+}
@@ -96,3 +96,140 @@ start_server_and_kill_it [list "dir" $server_path] {
         }
     }
 }
+
+set server_path [tmpdir "server.rdb-segment-test"]
+
+start_server [list overrides [list "dir" $server_path "dump-segment" "yes" "dump-thdbuf-size" 4096]] {
+    test {Segmented RDB reloads the same dataset} {
+        r flushall
+        createComplexDataset r 1000
+        set sha1 [r debug digest]
+        r debug reload
+        assert_equal $sha1 [r debug digest]
+    }
+
+    test {Segmented RDB with expires in several DBs reloads the same dataset} {
+        r flushall
+        for {set j 0} {$j < 3} {incr j} {
+            r select $j
+            createComplexDataset r 2000
+            for {set i 0} {$i < 100} {incr i} {
+                r setex expiring:$i 1000 $i
+            }
+        }
+        r select 9
+        set sha1 [r debug digest]
+        r debug reload
+        assert_equal $sha1 [r debug digest]
+    }
+
+    test {redis-check-rdb verifies the segments of a segmented RDB} {
+        r save
+        set result [exec src/redis-check-rdb [file join $server_path dump.rdb]]
+        assert_match {*Checksum OK*} $result
+        assert_match {*RDB looks OK*} $result
+        assert_match {*segments*} $result
+    }
+}
+
+# Strings compressed with LZ4 and ZSTD. The payloads are built by hand, so
+# they are the same whatever codec the server saves with: a LZ4 block made
+# of literals only, and a ZSTD frame with a single raw block, both holding
+# "hello". The trailing zero checksum disables the CRC64 check.
+set codec_payloads [dict create \
+    lz4 [list 4 [binary format ca* 0x50 hello]] \
+    zstd [list 5 [binary format c4ccc3a* \
+        {0x28 0xB5 0x2F 0xFD} 0x20 5 {0x29 0 0} hello]]]
+
+set server_path [tmpdir "server.rdb-codec-test"]
+start_server [list overrides [list "dir" $server_path]] {
+    set available {}
+    foreach codec [dict keys $codec_payloads] {
+        if {![catch {r config set rdbcompression-codec $codec}]} {
+            lappend available $codec
+        }
+    }
+}
+
+dict for {codec payload} $codec_payloads {
+    lassign $payload enc data
+    set fd [open [file join $server_path $codec.rdb] w]
+    fconfigure $fd -translation binary
+    puts -nonewline $fd "REDIS0007"
+    puts -nonewline $fd [binary format cca* 0 1 k]
+    puts -nonewline $fd [binary format ccc [expr {0xC0|$enc}] \
+        [string length $data] 5]
+    puts -nonewline $fd $data
+    puts -nonewline $fd [binary format c 0xFF][string repeat \x00 8]
+    close $fd
+
+    if {[lsearch $available $codec] != -1} {
+        start_server [list overrides [list "dir" $server_path \
+                                          "dbfilename" $codec.rdb]] {
+            test "RDB string compressed with $codec is loaded" {
+                r select 0
+                r get k
+            } {hello}
+
+            test "DUMP / RESTORE of a string compressed with $codec" {
+                r config set rdbcompression-codec $codec
+                r set big [string repeat "compressible $codec " 200]
+                set dump [r dump big]
+                r del big
+                r restore big 0 $dump
+                r get big
+            } [string repeat "compressible $codec " 200]
+        }
+    } else {
+        start_server_and_kill_it [list "dir" $server_path \
+                                       "dbfilename" $codec.rdb] {
+            test "RDB string compressed with $codec is refused without it" {
+                wait_for_condition 50 100 {
+                    [string match "*compressed with $codec: this server was built without it*" \
+                        [exec tail -n10 < [dict get $srv stdout]]]
+                } else {
+                    fail "Server didn't refuse the $codec compressed RDB"
+                }
+            }
+        }
+    }
+}
+
+set server_path [tmpdir "server.rehash-while-saving"]
+
+start_server [list overrides [list "dir" $server_path]] {
+    test {The keyspace is rehashed while a child saves} {
+        r config set save ""
+        r config set rehash-while-saving yes
+        r select 0
+        # With 2^19 keys the main dict is at the 1:1 ratio, so the first
+        # key added while the child saves makes it start growing.
+        r debug populate 524288
+        set digest [r debug digest]
+        r bgsave
+        for {set j 0} {$j < 100} {incr j} {
+            r set new:$j $j
+        }
+        assert_match {*rehashing target*} [r debug htstats 0]
+        assert_equal 1 [s rdb_bgsave_in_progress]
+        for {set j 100} {$j < 1000} {incr j} {
+            r set new:$j $j
+        }
+        for {set j 0} {$j < 1000} {incr j} {
+            assert_equal $j [r get new:$j]
+            assert_equal value:$j [r get key:$j]
+        }
+        r del key:0
+        assert_equal 0 [r exists key:0]
+        waitForBgsave r
+        list [s rdb_last_bgsave_status] [r dbsize]
+    } {ok 525287}
+
+    set saved_digest $digest
+}
+
+start_server [list overrides [list "dir" $server_path]] {
+    test {The RDB saved while rehashing matches the data set at fork time} {
+        r debug digest
+    } $saved_digest
+}
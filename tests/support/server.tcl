@@ -275,8 +275,9 @@ proc start_server {options {code undefined}} {
         }
 
         while 1 {
-            # check that the server actually started and is ready for connections
-            if {[exec grep "ready to accept" | wc -l < $stdout] > 0} {
+            # check that the server actually started and is ready for
+            # connections. Grep fails while the server is still loading.
+            if {![catch {exec grep "ready to accept" $stdout}]} {
                 break
             }
             after 10
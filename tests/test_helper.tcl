@@ -42,6 +42,8 @@ set ::all_tests {
     integration/convert-zipmap-hash-on-load
     integration/logging
     unit/pubsub
+    unit/tracking
+    unit/io-threads
     unit/slowlog
     unit/scripting
     unit/maxmemory
@@ -54,6 +56,7 @@ set ::all_tests {
     unit/geo
     unit/memefficiency
     unit/hyperloglog
+    unit/lazyfree
 }
 # Index to the next test to run in the ::all_tests list.
 set ::next_test 0
@@ -192,6 +192,38 @@ start_server {tags {"bitops"}} {
         }
     }
 
+    test {BITOP with many keys of different lengths spanning blocks} {
+        r flushall
+        set keys {}
+        set lens {}
+        for {set j 0} {$j < 30} {incr j} {
+            set l [expr {[randomInt 40000]+1}]
+            r set key:$j [string repeat "\xff" $l]
+            lappend keys key:$j
+            lappend lens $l
+        }
+        set lens [lsort -integer $lens]
+        set minlen [lindex $lens 0]
+        set maxlen [lindex $lens end]
+        # Every byte is the AND/OR/XOR of the keys long enough to cover it.
+        set xor {}
+        set prev 0
+        set covering 30
+        foreach l $lens {
+            append xor [string repeat [expr {$covering % 2 ? "\xff" : "\x00"}] \
+                [expr {$l-$prev}]]
+            set prev $l
+            incr covering -1
+        }
+        r bitop and res {*}$keys
+        assert_equal [string repeat "\xff" $minlen][string repeat "\x00" [expr {$maxlen-$minlen}]] [r get res]
+        r bitop or res {*}$keys
+        assert_equal [string repeat "\xff" $maxlen] [r get res]
+        r bitop xor res {*}$keys
+        assert_equal $xor [r get res]
+        assert_equal [count_bits $xor] [r bitcount res]
+    }
+
     test {BITOP with integer encoded source objects} {
         r set a 1
         r set b 2
@@ -284,6 +316,17 @@ start_server {tags {"bitops"}} {
         assert {[r bitpos str 1 8] == 216}
     }
 
+    test {BITPOS skips long runs of words} {
+        r set str [string repeat "\x00" 10000]
+        r setbit str 70001 1
+        assert_equal 70001 [r bitpos str 1]
+        assert_equal 70001 [r bitpos str 1 3]
+        r set str [string repeat "\xff" 10000]
+        r setbit str 70001 0
+        assert_equal 70001 [r bitpos str 0]
+        assert_equal -1 [r bitpos str 0 8751 -1]
+    }
+
     test {BITPOS bit=1 returns -1 if string is all 0 bits} {
         r set str ""
         for {set j 0} {$j < 20} {incr j} {
@@ -308,4 +308,31 @@ start_server {tags {"dump"}} {
         }
     }
 
+    test {MIGRATE with multiple keys: keys sent in several batches} {
+        set first [srv 0 client]
+        r flushdb
+        set keys {}
+        for {set j 0} {$j < 500} {incr j} {
+            r set key:$j $j
+            lappend keys key:$j
+        }
+        r rpush list a b c
+        r hset hash f v
+        lappend keys list hash
+        start_server {tags {"repl"}} {
+            set second [srv 0 client]
+            set second_host [srv 0 host]
+            set second_port [srv 0 port]
+
+            set ret [r -1 migrate $second_host $second_port "" 9 5000 keys {*}$keys]
+
+            assert_equal OK $ret
+            assert {[$first dbsize] == 0}
+            assert {[$second dbsize] == 502}
+            assert_equal 499 [$second get key:499]
+            assert_equal {a b c} [$second lrange list 0 -1]
+            assert_equal v [$second hget hash f]
+        }
+    }
+
 }
@@ -204,4 +204,33 @@ start_server {tags {"expire"}} {
         catch {r expire foo ""} e
         set e
     } {*not an integer*}
+
+    test {Real-time expired values are called back in expire order} {
+        r flushall
+        r set rx3 v3 px 300 rx
+        r set rx1 v1 px 100 rx
+        r set rx4 v4 px 1500 rx
+        r set rx2 v2 px 200 rx
+        after 2000
+        set size [r dbsize]
+        r select 0
+        set cb [r lrange #_EXPIRE_CALLBACK_LIST_# 0 -1]
+        r select 9
+        list $size $cb
+    } {0 {v1 v2 v3 v4}}
+
+    test {Real-time expire is cancelled by overwrite and PERSIST} {
+        r flushall
+        r set rx1 v1 px 100 rx
+        r set rx2 v2 px 100 rx
+        r set rx1 v1-new
+        r persist rx2
+        r set rx3 v3 px 150 rx
+        after 500
+        set vals [r mget rx1 rx2 rx3]
+        r select 0
+        set cb [r lrange #_EXPIRE_CALLBACK_LIST_# 0 -1]
+        r select 9
+        list $vals $cb
+    } {{v1-new v2 {}} v3}
 }
@@ -220,6 +220,31 @@ start_server {tags {"geo"}} {
         assert {[lindex $res 0] eq "Catania"}
     }
 
+    test {GEORADIUS COUNT returns the first items of the sorted result} {
+        r del points
+        for {set j 0} {$j < 500} {incr j} {
+            r geoadd points [expr {13+rand()*2}] [expr {38+rand()*2}] p:$j
+        }
+        foreach order {asc desc} {
+            set all [r georadius points 14 39 500 km withdist $order]
+            assert_equal 500 [llength $all]
+            foreach count {1 7 100 499 500 1000} {
+                set res [r georadius points 14 39 500 km withdist count $count $order]
+                assert_equal [lrange $all 0 [expr {$count-1}]] $res
+            }
+        }
+    }
+
+    test {GEORADIUS with a huge radius returns every member once} {
+        r del points
+        for {set j 0} {$j < 100} {incr j} {
+            r geoadd points [expr {-180+rand()*360}] [expr {-85+rand()*170}] p:$j
+        }
+        set res [r georadius points 0 0 22000 km]
+        assert_equal 100 [llength $res]
+        assert_equal 100 [llength [lsort -unique $res]]
+    }
+
     test {GEOADD + GEORANGE randomized test} {
         set attempt 30
         while {[incr attempt -1]} {
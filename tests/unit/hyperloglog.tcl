@@ -166,6 +166,29 @@ start_server {tags {"hll"}} {
         assert {$err < (double($card)/100)*5}
     }
 
+    test {PFCOUNT and PFMERGE of many dense HLLs agree} {
+        r del hll
+        r config set hll-sparse-max-bytes 30
+        set keys {}
+        for {set j 0} {$j < 30} {incr j} {
+            set elements {}
+            for {set x [expr {$j*500}]} {$x < $j*500+1000} {incr x} {
+                lappend elements $x
+            }
+            r del day:$j
+            r pfadd day:$j {*}$elements
+            assert_equal dense [r pfdebug encoding day:$j]
+            lappend keys day:$j
+        }
+        r config set hll-sparse-max-bytes 3000
+        set realcard [expr {29*500+1000}]
+        set card [r pfcount {*}$keys]
+        set err [expr {abs($card-$realcard)}]
+        assert {$err < (double($card)/100)*5}
+        r pfmerge hll {*}$keys
+        assert_equal $card [r pfcount hll]
+    }
+
     test {PFDEBUG GETREG returns the HyperLogLog raw registers} {
         r del hll
         r pfadd hll 1 2 3
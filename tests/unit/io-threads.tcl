@@ -0,0 +1,80 @@
+start_server {tags {"io-threads"} overrides {io-threads 4 io-threads-do-reads yes}} {
+    test {Pipelined clients get ordered replies from the I/O threads} {
+        set numclients 16
+        set rounds 20
+        set pipeline 50
+        for {set j 0} {$j < $numclients} {incr j} {
+            set rd($j) [redis_deferring_client]
+        }
+
+        # Every round each client pipelines a batch of writes and reads
+        # of its own keys, so that many clients have pending replies in
+        # the same event loop iteration and the threads are turned on.
+        for {set round 0} {$round < $rounds} {incr round} {
+            for {set j 0} {$j < $numclients} {incr j} {
+                set buf {}
+                for {set i 0} {$i < $pipeline} {incr i} {
+                    append buf [formatCommand set key:$j:$i $round:$j:$i]
+                    append buf [formatCommand incr counter:$j]
+                    append buf [formatCommand get key:$j:$i]
+                }
+                $rd($j) write $buf
+            }
+            for {set j 0} {$j < $numclients} {incr j} {
+                $rd($j) flush
+            }
+            for {set j 0} {$j < $numclients} {incr j} {
+                for {set i 0} {$i < $pipeline} {incr i} {
+                    assert_equal OK [$rd($j) read]
+                    assert_equal [expr {$round*$pipeline+$i+1}] \
+                        [$rd($j) read]
+                    assert_equal $round:$j:$i [$rd($j) read]
+                }
+            }
+        }
+
+        for {set j 0} {$j < $numclients} {incr j} {
+            $rd($j) close
+        }
+        for {set j 0} {$j < $numclients} {incr j} {
+            assert_equal [expr {$rounds*$pipeline}] [r get counter:$j]
+        }
+    }
+
+    test {A command read by the I/O threads during CLIENT PAUSE runs after it} {
+        # Publishing to many subscribers right before the pause leaves
+        # enough clients with pending replies to keep the threads on, so
+        # the command sent while paused is parsed by them.
+        set numsubs 16
+        for {set j 0} {$j < $numsubs} {incr j} {
+            set sub($j) [redis_deferring_client]
+            $sub($j) subscribe io-threads-pause
+            $sub($j) read
+        }
+        set pauser [redis_deferring_client]
+        set paused [redis_deferring_client]
+        $pauser write [formatCommand publish io-threads-pause hello]
+        $pauser write [formatCommand client pause 500]
+        $pauser flush
+        assert_equal $numsubs [$pauser read]
+        assert_equal OK [$pauser read]
+
+        set start [clock milliseconds]
+        $paused set paused-key 1
+        assert_equal OK [$paused read]
+        assert {[clock milliseconds] - $start >= 300}
+        assert_equal 1 [r get paused-key]
+
+        for {set j 0} {$j < $numsubs} {incr j} {
+            $sub($j) read
+            $sub($j) close
+        }
+        $pauser close
+        $paused close
+    }
+
+    test {INFO reports the clients served by the I/O threads} {
+        assert {[s io_threaded_writes_processed] > 0}
+        assert {[s io_threaded_reads_processed] > 0}
+    }
+}
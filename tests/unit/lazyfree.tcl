@@ -0,0 +1,90 @@
+start_server {tags {"lazyfree"}} {
+    test "UNLINK can reclaim memory in background" {
+        set orig_mem [s used_memory]
+        set args {}
+        for {set i 0} {$i < 100000} {incr i} {
+            lappend args $i
+        }
+        r sadd myset {*}$args
+        assert {[r scard myset] == 100000}
+        set peak_mem [s used_memory]
+        assert {[r unlink myset] == 1}
+        assert {$peak_mem > $orig_mem+1000000}
+        wait_for_condition 50 100 {
+            [s used_memory] < $peak_mem &&
+            [s used_memory] < $orig_mem*2
+        } else {
+            fail "Memory is not reclaimed by UNLINK"
+        }
+    }
+
+    test "UNLINK of a big sorted set, hash and list" {
+        r zadd myzset 1 shared
+        for {set i 0} {$i < 1000} {incr i} {
+            r zadd myzset $i $i
+            r hset myhash $i $i
+            r rpush mylist $i
+        }
+        r set shared x
+        assert {[r unlink myzset myhash mylist nokey] == 3}
+        assert {[r exists myzset myhash mylist] == 0}
+        wait_for_condition 50 100 {
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Lazy free jobs are not processed"
+        }
+        r get shared
+    } {x}
+
+    test "FLUSHDB ASYNC can reclaim memory in background" {
+        set orig_mem [s used_memory]
+        set args {}
+        for {set i 0} {$i < 100000} {incr i} {
+            lappend args $i
+        }
+        r sadd myset {*}$args
+        assert {[r scard myset] == 100000}
+        set peak_mem [s used_memory]
+        r flushdb async
+        assert {[r dbsize] == 0}
+        wait_for_condition 50 100 {
+            [s used_memory] < $peak_mem &&
+            [s used_memory] < $orig_mem*2
+        } else {
+            fail "Memory is not reclaimed by FLUSHDB ASYNC"
+        }
+    }
+
+    test "FLUSHALL ASYNC empties every database" {
+        r select 9
+        r set foo bar
+        r expire foo 100
+        r select 10
+        r set foo bar
+        r flushall async
+        set res [r dbsize]
+        r select 9
+        lappend res [r dbsize]
+        wait_for_condition 50 100 {
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Lazy free jobs are not processed"
+        }
+        set res
+    } {0 0}
+
+    test "FLUSHDB with a wrong option is a syntax error" {
+        catch {r flushdb foo} e
+        set e
+    } {*syntax*}
+
+    test "Lazy server-side delete on overwrite" {
+        r config set lazyfree-lazy-server-del yes
+        for {set i 0} {$i < 1000} {incr i} {
+            r sadd myset $i
+        }
+        r set myset foo
+        r config set lazyfree-lazy-server-del no
+        r get myset
+    } {foo}
+}
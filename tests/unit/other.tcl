@@ -54,6 +54,39 @@ start_server {tags {"other"}} {
         set _ $err
     } {*invalid*}
 
+    test {DEBUG RELOAD with every compression codec} {
+        set rdbcodec [lindex [r config get rdbcompression-codec] 1]
+        set listcodec [lindex [r config get list-compress-codec] 1]
+        r flushdb
+        r config set list-compress-depth 1
+        set big [string repeat "compressible " 100]
+        set codecs {}
+        foreach codec {lzf lz4 zstd} {
+            # LZ4 and ZSTD are only there when found at build time.
+            if {[catch {r config set rdbcompression-codec $codec}]} continue
+            catch {r config set list-compress-codec $codec}
+            lappend codecs $codec
+            r set str:$codec "$big $codec"
+            for {set j 0} {$j < 500} {incr j} {
+                r rpush list:$codec "$big $j"
+            }
+            r debug reload
+        }
+        # Keys compressed with any codec load whatever the current one.
+        r config set rdbcompression-codec lzf
+        r debug reload
+        foreach codec $codecs {
+            assert_equal "$big $codec" [r get str:$codec]
+            assert_equal 500 [r llen list:$codec]
+            assert_equal "$big 250" [r lindex list:$codec 250]
+            assert_equal "$big 499" [r lindex list:$codec -1]
+        }
+        r config set list-compress-depth 0
+        r config set rdbcompression-codec $rdbcodec
+        r config set list-compress-codec $listcodec
+        r flushdb
+    } {OK}
+
     tags {consistency} {
         if {![catch {package require sha1}]} {
             if {$::accurate} {set numops 10000} else {set numops 1000}
@@ -115,3 +115,64 @@ start_server {tags {"regression"}} {
         $rd read
     }
 }
+
+start_server {tags {"protocol"}} {
+    test "Big values shared by many replies are sent intact" {
+        set big [string repeat "abcdefgh" 4096]
+        r set big $big
+        r set small foo
+        set clients {}
+        for {set j 0} {$j < 10} {incr j} {
+            set rd [redis_deferring_client]
+            for {set i 0} {$i < 20} {incr i} {
+                $rd get big
+                $rd get small
+                $rd mget small big small
+            }
+            lappend clients $rd
+        }
+        foreach rd $clients {
+            for {set i 0} {$i < 20} {incr i} {
+                assert_equal $big [$rd read]
+                assert_equal foo [$rd read]
+                assert_equal [list foo $big foo] [$rd read]
+            }
+            $rd close
+        }
+    }
+
+    test "Big values in deferred length replies" {
+        r del myhash
+        r hset myhash a [string repeat x 5000]
+        r hset myhash b [string repeat y 70000]
+        r hset myhash c z
+        set res [r hgetall myhash]
+        assert_equal [string repeat y 70000] [dict get $res b]
+        assert_equal [string repeat x 5000] [dict get $res a]
+        dict get $res c
+    } {z}
+}
+
+start_server {tags {"protocol"}} {
+    test "Pipelined runs of the same command" {
+        r select 9
+        r mset a 1 b 2 c 3
+        r select 10
+        r mset a x b y c z
+        r select 9
+        set fd [r channel]
+        set proto {}
+        foreach cmd {{GET a} {GET b} {GET nokey} {GET c} {SELECT 10}
+                     {GET a} {GET b} {SET c w} {GET c} {MGET a b c}
+                     {SELECT 9}} {
+            append proto [formatCommand {*}$cmd]
+        }
+        puts -nonewline $fd $proto
+        flush $fd
+        set res {}
+        for {set j 0} {$j < 11} {incr j} {
+            lappend res [r read]
+        }
+        set res
+    } {1 2 {} 3 OK x y OK w {x y w} OK}
+}
@@ -176,6 +176,34 @@ start_server {tags {"pubsub"}} {
         $rd2 close
     }
 
+    test "PUBLISH/PSUBSCRIBE with many overlapping patterns" {
+        set rd1 [redis_deferring_client]
+        set patterns {* a* ab* abc abc* abc? ab?d a*d a\\* \\a* ab\[c\]* a[bx]c* abcd* abcde* b*}
+        psubscribe $rd1 $patterns
+        foreach channel {a ab abc abd abcd abcde axc a* ac b x} {
+            set expected {}
+            foreach p $patterns {
+                if {[string match $p $channel]} {lappend expected $p}
+            }
+            assert_equal [llength $expected] [r publish $channel hello]
+            set got {}
+            foreach p $expected {
+                set msg [$rd1 read]
+                assert_equal [list $channel hello] [lrange $msg 2 3]
+                lappend got [lindex $msg 1]
+            }
+            assert_equal [lsort $expected] [lsort $got]
+        }
+
+        # Removing patterns keeps the remaining ones reachable.
+        punsubscribe $rd1 {ab* abc abcd* a*}
+        assert_equal 6 [r publish abcde hello]
+        punsubscribe $rd1
+        assert_equal 0 [r publish abcde hello]
+        assert_equal 0 [r pubsub numpat]
+        $rd1 close
+    }
+
     test "PUBLISH/PSUBSCRIBE after PUNSUBSCRIBE without arguments" {
         set rd1 [redis_deferring_client]
         assert_equal {1 2 3} [psubscribe $rd1 {chan1.* chan2.* chan3.*}]
@@ -61,6 +61,30 @@ start_server {tags {"scripting"}} {
         set _ $e
     } {NOSCRIPT*}
 
+    test {EVAL - Lua number arguments -> Redis string conversion} {
+        r eval {
+            local res = {redis.call('echo',-0.0)}
+            for _,n in ipairs({7, -123456789012, 0.5, 1/3,
+                               99999999999999984, 1e17, -1e17, 2^53}) do
+                table.insert(res,redis.call('echo',n))
+            end
+            return res
+        } 0
+    } {-0 7 -123456789012 0.5 0.33333333333333331 99999999999999984 1e+17 -1e+17 9007199254740992}
+
+    test {EVAL - Command names are case insensitive in every call} {
+        r set mykey myval
+        r eval {
+            local res = {}
+            for i=1,3 do
+                table.insert(res,redis.call('get',KEYS[1]))
+                table.insert(res,redis.call('GET',KEYS[1]))
+                table.insert(res,redis.call('gEt',KEYS[1]))
+            end
+            return res
+        } 1 mykey
+    } {myval myval myval myval myval myval myval myval myval}
+
     test {EVAL - Redis integer -> Lua type conversion} {
         r set x 0
         r eval {
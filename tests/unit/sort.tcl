@@ -238,6 +238,35 @@ start_server {
         r sort myset by score:*
     } {a aa aaa azz b c d e f g h i l m n o p q r s t u v z}
 
+    test "SORT of a big list with negative and equal scores" {
+        proc cmp_score_then_lex {a b} {
+            if {$a < $b} {return -1}
+            if {$a > $b} {return 1}
+            string compare $a $b
+        }
+        r del mylist
+        set elements {}
+        for {set j 0} {$j < 2000} {incr j} {
+            set n [expr {[randomInt 200]-100}]
+            randpath {
+                set e $n
+            } {
+                set e "$n.0"
+            } {
+                set e [expr {$n+rand()}]
+            } {
+                set e "-0"
+            }
+            lappend elements $e
+        }
+        r rpush mylist {*}$elements
+        set sorted [lsort -command cmp_score_then_lex $elements]
+        assert_equal $sorted [r sort mylist]
+        assert_equal [lreverse $sorted] [r sort mylist desc]
+        assert_equal [lrange $sorted 10 59] [r sort mylist limit 10 50]
+        assert_equal [lrange [lreverse $sorted] 0 9] [r sort mylist desc limit 0 10]
+    }
+
     test "SORT GET with pattern ending with just -> does not get hash field" {
         r del mylist
         r lpush mylist a
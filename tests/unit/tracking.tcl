@@ -0,0 +1,74 @@
+start_server {tags {"tracking"}} {
+    # Create a deferred client we'll use to redirect invalidation
+    # messages to.
+    set rd1 [redis_deferring_client]
+    $rd1 client id
+    set redir [$rd1 read]
+    $rd1 subscribe __redis__:invalidate
+    $rd1 read ; # Consume the SUBSCRIBE reply.
+
+    test {Clients are able to enable tracking and redirect it} {
+        r client tracking on redirect $redir
+    } {OK}
+
+    test {CLIENT LIST and INFO report tracking clients} {
+        assert_match {*flags=t*} [r client list]
+        assert_match {*tracking_clients:1*} [r info clients]
+    }
+
+    test {The other connection is able to get invalidations} {
+        r set a 1
+        r get a
+        r incr a
+        $rd1 read
+    } {message __redis__:invalidate a}
+
+    test {Keys are invalidated once until they are read again} {
+        r set a 3
+        r get b
+        r set b 1
+        r get a
+        r set a 4
+        list [$rd1 read] [$rd1 read]
+    } {{message __redis__:invalidate b} {message __redis__:invalidate a}}
+
+    test {Keys read by scripts are tracked for the caller} {
+        r eval {return redis.call('get',KEYS[1])} 1 s
+        r set s 1
+        $rd1 read
+    } {message __redis__:invalidate s}
+
+    test {Expired keys are invalidated} {
+        r set e 1 px 100
+        r get e
+        $rd1 read
+    } {message __redis__:invalidate e}
+
+    test {FLUSHALL sends a NULL invalidation message} {
+        r get f
+        r flushall
+        $rd1 read
+    } {message __redis__:invalidate {}}
+
+    test {Disabling tracking stops the invalidation messages} {
+        r client tracking off
+        r get g
+        r set g 1
+        r client tracking on redirect $redir
+        r get h
+        r set h 1
+        $rd1 read
+    } {message __redis__:invalidate h}
+
+    test {CLIENT TRACKING errors} {
+        set syntaxerr {ERR Syntax error, try CLIENT TRACKING (ON REDIRECT <client-id> | OFF)}
+        catch {r client tracking on redirect 999999} e
+        assert_equal {ERR The client ID you want redirect to does not exist} $e
+        foreach args {{} on {on redirect} {off now} maybe {on foo 1}} {
+            catch {r client tracking {*}$args} e
+            assert_equal $syntaxerr $e
+        }
+    }
+
+    $rd1 close
+}
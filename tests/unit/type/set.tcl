@@ -246,6 +246,68 @@ start_server {
         }
     }
 
+    test "SINTER, SUNION and SDIFF of intsets fuzzing" {
+        for {set j 0} {$j < 50} {incr j} {
+            set args {}
+            set num_sets [expr {[randomInt 5]+1}]
+            for {set i 0} {$i < $num_sets} {incr i} {
+                set range [lindex {100 40000 5000000000} [randomInt 3]]
+                set elements($i) {}
+                r del set_$i
+                lappend args set_$i
+                for {set k [randomInt 200]} {$k > 0} {incr k -1} {
+                    set ele [expr {[randomInt $range]-$range/2}]
+                    r sadd set_$i $ele
+                    lappend elements($i) $ele
+                }
+                set elements($i) [lsort -integer -unique $elements($i)]
+                if {$elements($i) ne {}} {assert_encoding intset set_$i}
+            }
+
+            set inter $elements(0)
+            set union {}
+            set diff $elements(0)
+            for {set i 0} {$i < $num_sets} {incr i} {
+                set aux {}
+                foreach ele $inter {
+                    if {[lsearch -exact -integer -sorted $elements($i) $ele] != -1} {
+                        lappend aux $ele
+                    }
+                }
+                set inter $aux
+                lappend union {*}$elements($i)
+                if {$i == 0} continue
+                set aux {}
+                foreach ele $diff {
+                    if {[lsearch -exact -integer -sorted $elements($i) $ele] == -1} {
+                        lappend aux $ele
+                    }
+                }
+                set diff $aux
+            }
+            assert_equal $inter [lsort -integer [r sinter {*}$args]]
+            assert_equal [lsort -integer -unique $union] \
+                         [lsort -integer [r sunion {*}$args]]
+            assert_equal $diff [lsort -integer [r sdiff {*}$args]]
+            assert_equal [llength $inter] [r sinterstore setres {*}$args]
+            assert_equal $inter [lsort -integer [r smembers setres]]
+        }
+    }
+
+    test "SUNIONSTORE of intsets bigger than set-max-intset-entries" {
+        r del set1 set2 setres
+        for {set i 0} {$i < 300} {incr i} {
+            r sadd set1 $i
+            r sadd set2 [expr {$i+300}]
+        }
+        assert_encoding intset set1
+        assert_encoding intset set2
+        assert_equal 600 [r sunionstore setres set1 set2]
+        assert_encoding hashtable setres
+        assert_equal 300 [r sdiffstore setres set1 set2]
+        assert_encoding intset setres
+    }
+
     test "SINTER against non-set should throw error" {
         r set key1 x
         assert_error "WRONGTYPE*" {r sinter key1 noset}
@@ -119,6 +119,23 @@ start_server {tags {"string"}} {
         r mget foo baazz bar myset
     } {BAR {} FOO {}}
 
+    test {MGET with many keys, some missing or repeated} {
+        set args {}
+        set expected {}
+        for {set j 0} {$j < 100} {incr j} {
+            if {$j % 3} {
+                r set mgetkey:$j $j
+                lappend expected $j
+            } else {
+                lappend expected {}
+            }
+            lappend args mgetkey:$j
+        }
+        lappend args mgetkey:1 foo
+        lappend expected 1 BAR
+        assert_equal $expected [r mget {*}$args]
+    }
+
     test {GETSET (set new value)} {
         r del foo
         list [r getset foo xyz] [r get foo]
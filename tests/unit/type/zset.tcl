@@ -726,6 +726,24 @@ start_server {tags {"zset"}} {
             }
         }
 
+        test "ZSCORE of similar, empty and integer members - $encoding" {
+            r del zscoretest
+            set long [string repeat x 63]
+            r zadd zscoretest 5 a 1 ab 2 ba 3 "" 4 10 6 $long 7 ${long}y
+            assert_encoding $encoding zscoretest
+            assert_equal 5 [r zscore zscoretest a]
+            assert_equal 1 [r zscore zscoretest ab]
+            assert_equal 2 [r zscore zscoretest ba]
+            assert_equal 3 [r zscore zscoretest ""]
+            assert_equal 4 [r zscore zscoretest 10]
+            assert_equal 6 [r zscore zscoretest $long]
+            assert_equal 7 [r zscore zscoretest ${long}y]
+            # Scores are stored next to the members but are not members.
+            assert_equal {} [r zscore zscoretest 5]
+            assert_equal {} [r zscore zscoretest b]
+            assert_equal {} [r zscore zscoretest 1]
+        }
+
         test "ZSCORE after a DEBUG RELOAD - $encoding" {
             r del zscoretest
             set aux {}
@@ -1023,6 +1041,37 @@ start_server {tags {"zset"}} {
         }
     }
 
+    test "ZSETs big skiplist ranges, ranks and removals" {
+        r config set zset-max-ziplist-entries 128
+        r del myzset
+        set elements 5000
+        for {set j 0} {$j < $elements} {incr j} {
+            r zadd myzset [expr {$j/2}] $j
+        }
+        assert_encoding skiplist myzset
+        assert_equal [expr {$elements/2}] [r zcount myzset 0 [expr {$elements/4-1}]]
+        assert_equal {2000 2001} [r zrangebyscore myzset 1000 1000]
+        assert_equal {2002 2003 2004} \
+            [r zrangebyscore myzset 1000 +inf limit 2 3]
+        assert_equal {1998 1997} [r zrevrangebyscore myzset 1000 -inf limit 3 2]
+        assert_equal {} [r zrangebyscore myzset 1000 1000 limit 2 1]
+        assert_equal 4321 [r zrank myzset 4321]
+        assert_equal 678 [r zrevrank myzset 4321]
+
+        # Removals shrink the tree: ranks must stay consistent.
+        assert_equal 1000 [r zremrangebyrank myzset 1000 1999]
+        assert_equal 1000 [r zremrangebyscore myzset 2000 2499]
+        for {set j 0} {$j < 1000} {incr j 2} {r zrem myzset $j}
+        assert_equal 2500 [r zcard myzset]
+        assert_equal {1 3 5} [r zrange myzset 0 2]
+        assert_equal {999 2000 2001} [r zrange myzset 499 501]
+        assert_equal 500 [r zrank myzset 2000]
+        assert_equal {3999 3998} [r zrevrange myzset 0 1]
+        assert_equal [r zrange myzset 0 -1] [lreverse [r zrevrange myzset 0 -1]]
+        assert_equal 2500 [r zremrangebyrank myzset 0 -1]
+        assert_equal 0 [r exists myzset]
+    }
+
     tags {"slow"} {
         stressers ziplist
         stressers skiplist